@@ -0,0 +1,53 @@
+#!/bin/bash
+
+# Runs pbrt-bench-cloud on a fixed set of scenes and collects the results
+# into one JSON array, so two builds can be compared stage by stage.
+
+set -e
+
+if [ "$#" -ne 3 ]; then
+    echo "Usage: $0 BUILD_DIR WORK_DIR OUTPUT.json"
+    exit 1
+fi
+
+BUILD_DIR="`realpath \"$1\"`"
+WORK_DIR="`realpath -m \"$2\"`"
+OUTPUT="`realpath -m \"$3\"`"
+SCENES_DIR="`dirname \"$0\"`/../scenes"
+
+mkdir -p "$WORK_DIR"
+
+# the generated scenes are the same every time for the same seed
+if [ ! -f "$WORK_DIR/uniform/scene.pbrt" ]; then
+    "$BUILD_DIR/pbrt-gen-scene" --triangles 2000000 --seed 1 \
+        --resolution 256 "$WORK_DIR/uniform"
+fi
+
+if [ ! -f "$WORK_DIR/instanced/scene.pbrt" ]; then
+    "$BUILD_DIR/pbrt-gen-scene" --triangles 1000000 --instances 10000 \
+        --depth 2 --materials 8 --distribution walls --seed 2 \
+        --resolution 256 "$WORK_DIR/instanced"
+fi
+
+SCENES=(
+    "`realpath \"$SCENES_DIR/killeroo-dump.pbrt\"`"
+    "$WORK_DIR/uniform/scene.pbrt"
+    "$WORK_DIR/instanced/scene.pbrt"
+)
+
+echo "[" > "$OUTPUT.partial"
+
+for i in "${!SCENES[@]}"; do
+    scene="${SCENES[$i]}"
+    name="$(basename "$(dirname "$scene")")-$(basename "$scene" .pbrt)"
+
+    echo "> $scene" >&2
+    [ "$i" -gt 0 ] && echo "," >> "$OUTPUT.partial"
+    # the tool's progress goes to stdout, so only the file has the results
+    "$BUILD_DIR/pbrt-bench-cloud" --spp 1 --work-dir "$WORK_DIR/$name.bench" \
+        --output "$WORK_DIR/$name.json" "$scene" >&2
+    cat "$WORK_DIR/$name.json" >> "$OUTPUT.partial"
+done
+
+echo "]" >> "$OUTPUT.partial"
+mv "$OUTPUT.partial" "$OUTPUT"
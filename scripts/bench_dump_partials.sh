@@ -0,0 +1,46 @@
+#!/bin/bash
+
+# Times dumping a scene's instances and chunks two ways: extract-instances
+# followed by dump_partials.sh, one pbrt at a time, and pbrt-dump-partials
+# with JOBS dumps running at once (default: the number of cores). The
+# shards are dumped from their own directories, so the scene should refer
+# to its files by absolute paths.
+
+set -e
+
+if [ "$#" -lt 3 ] || [ "$#" -gt 4 ]; then
+    echo "Usage: $0 BUILD_DIR SCENE WORK_DIR [JOBS]"
+    exit 1
+fi
+
+BUILD_DIR="`realpath \"$1\"`"
+SCENE="`realpath \"$2\"`"
+WORK_DIR="`realpath -m \"$3\"`"
+JOBS="${4:-`nproc`}"
+SCRIPTS_DIR="`realpath \"\`dirname \"$0\"\`\"`"
+
+rm -rf "$WORK_DIR/scripts" "$WORK_DIR/tool"
+mkdir -p "$WORK_DIR/scripts/proxies" "$WORK_DIR/tool"
+
+# the scripts don't order the dumps, so the instances go before the chunks
+# that refer to them
+start=`date +%s%N`
+"$BUILD_DIR/extract-instances" auto "$SCENE" "$WORK_DIR/scripts" \
+    > "$WORK_DIR/scripts.log" 2>&1
+for dir in instances chunks; do
+    "$SCRIPTS_DIR/dump_partials.sh" "$BUILD_DIR/pbrt" \
+        "$WORK_DIR/scripts/$dir" "$WORK_DIR/scripts/proxies" \
+        >> "$WORK_DIR/scripts.log" 2>&1
+done
+end=`date +%s%N`
+scripts=$(( (end - start) / 1000000 ))
+
+start=`date +%s%N`
+"$BUILD_DIR/pbrt-dump-partials" "$BUILD_DIR/pbrt" "$SCENE" \
+    "$WORK_DIR/tool" "$JOBS" > "$WORK_DIR/tool.log" 2>&1
+end=`date +%s%N`
+tool=$(( (end - start) / 1000000 ))
+
+echo "shards: `ls \"$WORK_DIR/tool/proxies\" | grep -vc '[.]\|PROXY_INDEX'`"
+echo "dump_partials.sh: $scripts ms"
+echo "pbrt-dump-partials ($JOBS jobs): $tool ms"
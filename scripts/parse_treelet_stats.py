@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+
+# Summarizes the per-treelet counters written by --treelet-stats (pbrt) or
+# the TREELET-STATS argument of pbrt-do, from any number of workers.
+
+import sys
+import csv
+import json
+
+from collections import defaultdict
+
+def sizeof_fmt(num, suffix='B'):
+    for unit in ['', 'Ki', 'Mi', 'Gi', 'Ti']:
+        if abs(num) < 1024.0:
+            return "%3.1f%s%s" % (num, unit, suffix)
+        num /= 1024.0
+    return "%.1f%s%s" % (num, 'Pi', suffix)
+
+class TreeletStats:
+    def __init__(self, tid):
+        self.id = tid
+        self.rays = 0
+        self.nodes = 0
+        self.primitives = 0
+        self.hits = 0
+        self.loads = 0
+        self.load_ms = 0.0
+        self.resident_bytes = 0
+        self.workers = set()
+        self.forwarded = defaultdict(int)
+
+    def add(self, row):
+        self.rays += row['rays']
+        self.nodes += row['nodes']
+        self.primitives += row['primitives']
+        self.hits += row['hits']
+        self.loads += row['loads']
+        self.load_ms += row['load_ms']
+        self.resident_bytes = max(self.resident_bytes, row['resident_bytes'])
+        self.workers.add(row['worker'])
+
+        for dst, count in row['forwarded'].items():
+            self.forwarded[int(dst)] += count
+
+def read_rows(path):
+    with open(path) as fin:
+        if path.endswith('.csv'):
+            for row in csv.DictReader(fin):
+                forwarded = {}
+                for pair in row['forwarded'].split():
+                    dst, count = pair.split(':')
+                    forwarded[dst] = int(count)
+
+                yield {'worker': int(row['worker']),
+                       'treelet': int(row['treelet']),
+                       'rays': int(row['rays']),
+                       'nodes': int(row['nodes']),
+                       'primitives': int(row['primitives']),
+                       'hits': int(row['hits']),
+                       'loads': int(row['loads']),
+                       'load_ms': float(row['load_ms']),
+                       'resident_bytes': int(row['resident_bytes']),
+                       'forwarded': forwarded}
+        else:
+            for line in fin:
+                if line.strip():
+                    yield json.loads(line)
+
+def parse_treelet_stats(paths):
+    treelets = {}
+
+    for path in paths:
+        for row in read_rows(path):
+            tid = row['treelet']
+            if tid not in treelets:
+                treelets[tid] = TreeletStats(tid)
+            treelets[tid].add(row)
+
+    return treelets
+
+if __name__ == '__main__':
+    if len(sys.argv) < 2:
+        print("{} STATS-FILE...".format(sys.argv[0]))
+        exit(1)
+
+    treelets = parse_treelet_stats(sys.argv[1:])
+    total_nodes = max(sum(t.nodes for t in treelets.values()), 1)
+
+    print("{:>8} {:>12} {:>8} {:>12} {:>7} {:>10} {:>10} {:>8}  {}".format(
+        "treelet", "rays", "nodes/r", "prims/r", "% work", "load ms",
+        "resident", "workers", "top destinations"))
+
+    for t in sorted(treelets.values(), key=lambda t: t.nodes, reverse=True):
+        rays = max(t.rays, 1)
+        top = sorted(t.forwarded.items(), key=lambda x: x[1], reverse=True)[:3]
+
+        print("{:>8} {:>12} {:>8.1f} {:>12.1f} {:>7.2f} {:>10.1f} {:>10} "
+              "{:>8}  {}".format(
+                  t.id, t.rays, t.nodes / rays, t.primitives / rays,
+                  100.0 * t.nodes / total_nodes, t.load_ms,
+                  sizeof_fmt(t.resident_bytes), len(t.workers),
+                  " ".join("T{}:{}".format(d, c) for d, c in top)))
@@ -0,0 +1,359 @@
+#!/usr/bin/env python3
+
+# Renders a fixed set of scenes with one or two pbrt builds and compares
+# them: wall time, the time pbrt's profiler gives each phase, peak memory,
+# and the error of each image against a stored reference, measured with
+# `imgtool diff`.
+#
+#   render_regression.py --update-references BUILD
+#       renders the references with a trusted build
+#   render_regression.py BASELINE-BUILD CANDIDATE-BUILD
+#       compares two builds, and exits with 1 if the candidate regressed
+#   render_regression.py --args-b=--numa BUILD BUILD
+#       compares two runs of one build with different options
+
+import argparse
+import json
+import os
+import re
+import shlex
+import shutil
+import subprocess
+import sys
+import time
+
+SCENES_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                          '..', 'scenes')
+
+# scenes from scenes/ that render with a local accelerator
+SCENES = ['killeroo-simple.pbrt', 'killeroo-camera.pbrt', 'sphere-dump.pbrt']
+
+# (name, pbrt-gen-scene arguments); fixed seeds, so they are the same every
+# time they're generated
+GENERATED_SCENES = [
+    ('gen-uniform', ['--triangles', '500000', '--materials', '4',
+                     '--seed', '1', '--resolution', '256']),
+    ('gen-walls', ['--triangles', '200000', '--instances', '2000',
+                   '--depth', '2', '--materials', '4', '--texture-size',
+                   '256', '--distribution', 'walls', '--seed', '2',
+                   '--resolution', '256']),
+]
+
+PROFILE_LINE = re.compile(
+    r'^\s+(.*\S)\s+(\d+\.\d+)% \(\s*(\d+):(\d+):(\d+)\.(\d+)\)$')
+SPP_PARAM = re.compile(r'("integer pixelsamples"\s*)\[\s*\d+\s*\]')
+INCLUDE = re.compile(r'\b((?:Include|Import)\s+)"([^"/][^"]*)"')
+PATH_PARAM = re.compile(
+    r'("string (?:filename|mapname|lensfile|bsdffile)"\s*\[?\s*)'
+    r'"([^"/][^"]*)"')
+
+def parse_profile(output):
+    '''seconds per phase, from the flattened profile pbrt prints at the end'''
+    phases = {}
+    in_profile = False
+
+    for line in output.splitlines():
+        if line.strip() == 'Profile (flattened)':
+            in_profile = True
+            continue
+
+        if not in_profile:
+            continue
+
+        m = PROFILE_LINE.match(line)
+        if not m:
+            break
+
+        h, mi, s, cs = (int(x) for x in m.group(3, 4, 5, 6))
+        phases[m.group(1)] = h * 3600 + mi * 60 + s + cs / 100
+
+    return phases
+
+def image_error(imgtool, reference, image):
+    '''imgtool diff's metrics of image against reference; it only prints
+    them when the images differ'''
+    result = subprocess.run([imgtool, 'diff', reference, image],
+                            stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                            universal_newlines=True)
+
+    error = {'mse': 0.0, 'rms_pct': 0.0, 'avg_delta_pct': 0.0,
+             'big_diff_pct': 0.0}
+
+    if result.returncode == 0:
+        return error
+
+    m = re.search(r'(\d+) big \(([\d.]+)%\)', result.stdout)
+    if m:
+        error['big_diff_pct'] = float(m.group(2))
+
+    m = re.search(r'\(([-\d.naif]+)% delta\)', result.stdout)
+    if m:
+        error['avg_delta_pct'] = float(m.group(1))
+
+    m = re.search(r'MSE = ([^,]+), RMS = ([\d.naif]+)%', result.stdout)
+    if not m:
+        raise RuntimeError('imgtool diff failed: ' + result.stdout.strip())
+
+    error['mse'] = float(m.group(1))
+    error['rms_pct'] = float(m.group(2))
+    return error
+
+def render(pbrt, scene, image, threads, extra_args):
+    '''renders the scene and returns its wall time, peak RSS and phases'''
+    cmd = ([pbrt, '--nthreads', str(threads), '--outfile', image] +
+           extra_args + [scene])
+    start = time.monotonic()
+    proc = subprocess.Popen(cmd, stdout=subprocess.PIPE,
+                            stderr=subprocess.STDOUT,
+                            universal_newlines=True)
+    output = proc.stdout.read()
+
+    # wait4 gives the rusage of this child alone
+    _, status, rusage = os.wait4(proc.pid, 0)
+    seconds = time.monotonic() - start
+    proc.returncode = os.WEXITSTATUS(status) if os.WIFEXITED(status) else -1
+
+    if proc.returncode != 0:
+        raise RuntimeError('{} failed:\n{}'.format(' '.join(cmd), output))
+
+    return {'seconds': seconds,
+            'peak_rss_mb': rusage.ru_maxrss / 1024,
+            'phases': parse_profile(output)}
+
+def absolute_paths(text, base_dir, include):
+    '''text with the relative paths of its includes and of its file
+    parameters made absolute against base_dir; include(path) gives the path
+    an included file is replaced with'''
+    def resolve(path):
+        return os.path.normpath(os.path.join(base_dir, path))
+
+    text = INCLUDE.sub(
+        lambda m: '{}"{}"'.format(m.group(1), include(resolve(m.group(2)))),
+        text)
+    return PATH_PARAM.sub(
+        lambda m: '{}"{}"'.format(m.group(1), resolve(m.group(2))), text)
+
+def rewrite_scene(path, new_path, spp):
+    '''writes the scene with the sample count replaced to new_path, along
+    with the files it includes, which pbrt resolves against the directory of
+    the scene being rendered too'''
+    base_dir = os.path.dirname(os.path.abspath(path))
+    out_dir = os.path.splitext(new_path)[0] + '-include'
+    written = {}
+
+    def include(source):
+        if source not in written:
+            target = os.path.join(out_dir, '{}-{}'.format(
+                len(written), os.path.basename(source)))
+            written[source] = target
+            write(source, target)
+        return written[source]
+
+    def write(source, target):
+        with open(source) as fin:
+            text = absolute_paths(fin.read(), base_dir, include)
+        if source == path:
+            text = SPP_PARAM.sub(r'\g<1>[{}]'.format(spp), text)
+
+        os.makedirs(os.path.dirname(target), exist_ok=True)
+        with open(target, 'w') as fout:
+            fout.write(text)
+
+    write(path, new_path)
+
+def prepare_scenes(build, work_dir, spp):
+    '''the paths of the scenes to render; with spp, copies of them with the
+    sample count replaced, written into work_dir with their paths made
+    absolute'''
+    scenes = [(os.path.splitext(s)[0], os.path.join(SCENES_DIR, s))
+              for s in SCENES]
+
+    gen_scene = os.path.join(build, 'pbrt-gen-scene')
+    if os.path.exists(gen_scene):
+        for name, args in GENERATED_SCENES:
+            out_dir = os.path.join(work_dir, 'generated', name)
+            if not os.path.exists(os.path.join(out_dir, 'scene.pbrt')):
+                subprocess.run([gen_scene, '--accelerator', 'bvh'] + args +
+                               [out_dir], check=True)
+            scenes.append((name, os.path.join(out_dir, 'scene.pbrt')))
+    else:
+        print('{} not found, skipping the generated scenes'.format(gen_scene),
+              file=sys.stderr)
+
+    if spp is None:
+        return scenes
+
+    for i, (name, path) in enumerate(scenes):
+        new_path = os.path.join(work_dir, 'scenes', name + '.pbrt')
+        rewrite_scene(path, new_path, spp)
+        scenes[i] = (name, new_path)
+
+    return scenes
+
+def run_suite(build, extra_args, scenes, args, label):
+    pbrt = os.path.join(build, 'pbrt')
+    imgtool = os.path.join(build, 'imgtool')
+    out_dir = os.path.join(args.work_dir, label)
+    os.makedirs(out_dir, exist_ok=True)
+
+    results = {}
+    for name, path in scenes:
+        image = os.path.join(out_dir, name + '.exr')
+        print('> [{}] {}'.format(label, name), file=sys.stderr)
+
+        # the fastest of the runs is the least disturbed one
+        runs = [render(pbrt, path, image, args.threads, extra_args)
+                for _ in range(args.runs)]
+        result = min(runs, key=lambda r: r['seconds'])
+        result['peak_rss_mb'] = max(r['peak_rss_mb'] for r in runs)
+
+        reference = os.path.join(args.references, name + '.exr')
+        if args.update_references:
+            os.makedirs(args.references, exist_ok=True)
+            shutil.copyfile(image, reference)
+        elif os.path.exists(reference):
+            result['error'] = image_error(imgtool, reference, image)
+
+        results[name] = result
+
+    with open(os.path.join(args.work_dir, label + '.json'), 'w') as fout:
+        json.dump(results, fout, indent=2, sort_keys=True)
+
+    return results
+
+def pct_change(a, b):
+    return 100 * (b - a) / a if a else 0.0
+
+def print_tables(results, args):
+    labels = list(results.keys())
+    names = list(results[labels[0]].keys())
+    regressions = []
+
+    header = '{:<18}'.format('scene')
+    for label in labels:
+        header += ' {:>9} {:>9} {:>11}'.format('time ' + label, 'MB ' + label,
+                                               'MSE ' + label)
+    if len(labels) == 2:
+        header += ' {:>8} {:>8}'.format('time', 'MSE')
+    print(header)
+
+    for name in names:
+        row = '{:<18}'.format(name)
+        for label in labels:
+            r = results[label][name]
+            mse = r['error']['mse'] if 'error' in r else float('nan')
+            row += ' {:>8.2f}s {:>9.1f} {:>11.4g}'.format(
+                r['seconds'], r['peak_rss_mb'], mse)
+
+        if len(labels) == 2:
+            a, b = (results[label][name] for label in labels)
+            dt = pct_change(a['seconds'], b['seconds'])
+            row += ' {:>+7.1f}%'.format(dt)
+
+            mse_flag = ''
+            if 'error' in a and 'error' in b:
+                ma, mb = a['error']['mse'], b['error']['mse']
+                row += ' {:>+7.1f}%'.format(pct_change(ma, mb) if ma else 0)
+                if mb > ma * (1 + args.max_mse_increase / 100) + 1e-12:
+                    mse_flag = 'MSE'
+            else:
+                row += ' {:>8}'.format('-')
+
+            if dt > args.max_slowdown:
+                regressions.append('{}: {:+.1f}% time'.format(name, dt))
+            if mse_flag:
+                regressions.append('{}: MSE {:.4g} -> {:.4g}'.format(
+                    name, a['error']['mse'], b['error']['mse']))
+
+        print(row)
+
+    # the phases that take at least 1% of a render, per scene
+    print()
+    for name in names:
+        phases = {}
+        for label in labels:
+            for phase, seconds in results[label][name]['phases'].items():
+                phases.setdefault(phase, {})[label] = seconds
+
+        total = max(results[label][name]['seconds'] for label in labels)
+        shown = sorted((p for p, s in phases.items()
+                        if max(s.values()) >= total / 100),
+                       key=lambda p: -max(phases[p].values()))
+        if not shown:
+            continue
+
+        print(name)
+        for phase in shown:
+            row = '    {:<42}'.format(phase)
+            for label in labels:
+                row += ' {:>9.2f}s'.format(phases[phase].get(label, 0.0))
+            if len(labels) == 2:
+                a, b = (phases[phase].get(label, 0.0) for label in labels)
+                row += ' {:>+7.1f}%'.format(pct_change(a, b))
+            print(row)
+
+    return regressions
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Render regression suite for one or two pbrt builds.')
+    parser.add_argument('builds', metavar='BUILD', nargs='+',
+                        help='build directories: the baseline, then the '
+                             'candidate')
+    parser.add_argument('--references', default=os.path.join(
+                            SCENES_DIR, 'references'),
+                        help='directory of the reference EXRs '
+                             '(default: scenes/references)')
+    parser.add_argument('--update-references', action='store_true',
+                        help='store the images of the (single) build as '
+                             'the references')
+    parser.add_argument('--work-dir', default='render-regression',
+                        help='where the images and results go')
+    parser.add_argument('--spp', type=int,
+                        help='samples per pixel, instead of each scene\'s')
+    parser.add_argument('--threads', type=int, default=os.cpu_count(),
+                        help='pbrt threads (default: all cores)')
+    parser.add_argument('--args-a', default='',
+                        help='extra pbrt arguments for the baseline')
+    parser.add_argument('--args-b', default='',
+                        help='extra pbrt arguments for the candidate')
+    parser.add_argument('--runs', type=int, default=1,
+                        help='renders per scene; the fastest one counts')
+    parser.add_argument('--max-slowdown', type=float, default=5.0,
+                        help='percent slowdown that counts as a regression')
+    parser.add_argument('--max-mse-increase', type=float, default=10.0,
+                        help='percent MSE increase that counts as a '
+                             'regression')
+    args = parser.parse_args()
+
+    if len(args.builds) > 2:
+        parser.error('at most two builds can be compared')
+    if args.update_references and len(args.builds) != 1:
+        parser.error('--update-references takes a single build')
+
+    args.work_dir = os.path.abspath(args.work_dir)
+    args.references = os.path.abspath(args.references)
+    builds = [os.path.abspath(b) for b in args.builds]
+    labels = ['A', 'B'][:len(builds)]
+    extra_args = [shlex.split(args.args_a), shlex.split(args.args_b)]
+
+    # both builds render the same generated scenes
+    scenes = prepare_scenes(builds[0], args.work_dir, args.spp)
+    results = {label: run_suite(build, extra, scenes, args, label)
+               for label, build, extra in zip(labels, builds, extra_args)}
+
+    for label, build, extra in zip(labels, builds, extra_args):
+        print('{}: {}'.format(label, ' '.join([build] + extra)))
+    print()
+
+    regressions = print_tables(results, args)
+
+    if regressions:
+        print()
+        print('Regressions:')
+        for regression in regressions:
+            print('    ' + regression)
+        sys.exit(1)
+
+if __name__ == '__main__':
+    main()
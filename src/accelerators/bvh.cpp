@@ -632,7 +632,29 @@ uint64_t BVHAccel::flattenBVHTree(BVHBuildNode *node, uint64_t *offset) {
     return myOffset;
 }
 
-BVHAccel::~BVHAccel() { FreeAligned(nodes); }
+BVHAccel::~BVHAccel() {
+    // Once replicated, nodes is the first replica
+    if (nodeReplicas.empty()) FreeAligned(nodes);
+    for (LinearBVHNode *replica : nodeReplicas)
+        NumaFree(replica, nodeCount * sizeof(LinearBVHNode));
+}
+
+void BVHAccel::ReplicateNodes() {
+    if (!nodes || !nodeReplicas.empty()) return;
+
+    const size_t bytes = nodeCount * sizeof(LinearBVHNode);
+    for (int node = 0; node < NumaNodeCount(); ++node) {
+        LinearBVHNode *replica =
+            (LinearBVHNode *)NumaAllocOnNode(bytes, node);
+        memcpy(replica, nodes, bytes);
+        nodeReplicas.push_back(replica);
+    }
+
+    // The original isn't traversed anymore; node 0's copy takes its place
+    FreeAligned(nodes);
+    nodes = nodeReplicas[0];
+    treeBytes += (NumaNodeCount() - 1) * bytes;
+}
 
 bool BVHAccel::Intersect(const Ray &ray, SurfaceInteraction *isect) const {
     if (!nodes) return false;
@@ -643,8 +665,9 @@ bool BVHAccel::Intersect(const Ray &ray, SurfaceInteraction *isect) const {
     // Follow ray through BVH nodes to find primitive intersections
     uint64_t toVisitOffset = 0, currentNodeIndex = 0;
     uint64_t nodesToVisit[64];
+    const LinearBVHNode *localNodes = threadNodes();
     while (true) {
-        const LinearBVHNode *node = &nodes[currentNodeIndex];
+        const LinearBVHNode *node = &localNodes[currentNodeIndex];
         // Check ray against BVH node
         if (node->bounds.IntersectP(ray, invDir, dirIsNeg)) {
             if (node->nPrimitives > 0) {
@@ -681,8 +704,9 @@ bool BVHAccel::IntersectP(const Ray &ray) const {
     int dirIsNeg[3] = {invDir.x < 0, invDir.y < 0, invDir.z < 0};
     uint64_t nodesToVisit[64];
     uint64_t toVisitOffset = 0, currentNodeIndex = 0;
+    const LinearBVHNode *localNodes = threadNodes();
     while (true) {
-        const LinearBVHNode *node = &nodes[currentNodeIndex];
+        const LinearBVHNode *node = &localNodes[currentNodeIndex];
         if (node->bounds.IntersectP(ray, invDir, dirIsNeg)) {
             // Process BVH node _node_ for traversal
             if (node->nPrimitives > 0) {
@@ -732,6 +756,7 @@ std::shared_ptr<BVHAccel> CreateBVHAccelerator(
 
     int maxPrimsInNode = ps.FindOneInt("maxnodeprims", 4);
     auto res = std::make_shared<BVHAccel>(std::move(prims), maxPrimsInNode, splitMethod);
+    if (PbrtOptions.numa && NumaNodeCount() > 1) res->ReplicateNodes();
 
     return res;
 }
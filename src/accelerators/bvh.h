@@ -41,6 +41,7 @@
 // accelerators/bvh.h*
 #include "pbrt.h"
 #include "primitive.h"
+#include "numa.h"
 #include <atomic>
 
 #include "messages/serialization.h"
@@ -105,7 +106,14 @@ class BVHAccel : public Aggregate {
     bool IntersectP(const Ray &ray) const;
 
     uint32_t Dump(const size_t max_treelet_nodes) const;
-    
+
+    // Gives every NUMA node its own copy of the nodes, which the threads
+    // bound to it traverse.  The original is freed and nodes points to node
+    // 0's copy afterwards.  This is done even on a single node;
+    // CreateBVHAccelerator() only asks for it with --numa on a machine with
+    // several.
+    void ReplicateNodes();
+
   protected:
     uint64_t flattenBVHTree(BVHBuildNode *node, uint64_t *offset);
 
@@ -133,9 +141,14 @@ class BVHAccel : public Aggregate {
                                 std::vector<BVHBuildNode *> &treeletRoots,
                                 uint64_t start, uint64_t end, uint64_t *totalNodes) const;
 
+    const LinearBVHNode *threadNodes() const {
+        return nodeReplicas.empty() ? nodes : nodeReplicas[ThreadNumaNode];
+    }
+
     // BVHAccel Private Data
     const int maxPrimsInNode;
     const SplitMethod splitMethod;
+    std::vector<LinearBVHNode *> nodeReplicas;
 };
 
 std::shared_ptr<BVHAccel> CreateBVHAccelerator(
@@ -1,5 +1,6 @@
 #include "cloud.h"
 
+#include <chrono>
 #include <memory>
 #include <stack>
 #include <thread>
@@ -13,7 +14,9 @@
 #include "messages/serialization.h"
 #include "messages/utils.h"
 #include "pbrt.pb.h"
+#include "pbrt/telemetry.h"
 #include "shapes/triangle.h"
+#include "util/path.h"
 
 using namespace std;
 
@@ -22,9 +25,57 @@ namespace pbrt {
 STAT_COUNTER("BVH/Total nodes", nNodes);
 STAT_COUNTER("BVH/Visited nodes", nNodesVisited);
 STAT_COUNTER("BVH/Visited primitives", nPrimitivesVisited);
+/* what one treelet or material took from the arena before it was reset */
+STAT_INT_DISTRIBUTION("Memory/Arena bytes used to parse a treelet",
+                      arenaBytes);
+
+/* Parsing a treelet creates a lot of small nested messages (bounds,
+   triangles, transformed primitives), so the messages are allocated from an
+   arena that is reset once the treelet has been converted. One per thread,
+   since treelets are preloaded in parallel. */
+static google::protobuf::Arena &LoadArena() {
+    static thread_local google::protobuf::Arena arena{[] {
+        google::protobuf::ArenaOptions options;
+        options.start_block_size = 64 * 1024;
+        options.max_block_size = 4 * 1024 * 1024;
+        return options;
+    }()};
+
+    return arena;
+}
+
+static shared_ptr<Material> LoadMaterial(const SceneManager &manager,
+                                         const uint32_t material_id) {
+    auto &arena = LoadArena();
+    auto reader = manager.GetReader(ObjectType::Material, material_id);
+    auto *material =
+        google::protobuf::Arena::CreateMessage<protobuf::Material>(&arena);
+    reader->read(material);
+
+    auto result = material::from_protobuf(*material);
+    ReportValue(arenaBytes, arena.Reset());
+    return result;
+}
+
+constexpr uint64_t CloudBVH::PROXY_REF_FLAG;
+
+/* Proxy scenes by path, shared by all the CloudBVHs that refer to them. The
+   instances own them, so a scene goes away with the last BVH that uses it.
+   Any CloudBVH may load or clear treelets, hence the lock. */
+struct ProxyScene {
+    SceneManager manager{};
+    unique_ptr<CloudBVH> bvh{};
+};
+
+static map<string, weak_ptr<ProxyScene>> proxyScenes;
+static mutex proxy_scenes_mutex;
 
 CloudBVH::CloudBVH(const uint32_t bvh_root, const bool preload_all)
-    : bvh_root_(bvh_root) {
+    : CloudBVH(global::manager, bvh_root, preload_all) {}
+
+CloudBVH::CloudBVH(SceneManager &manager, const uint32_t bvh_root,
+                   const bool preload_all)
+    : manager_(manager), bvh_root_(bvh_root), preload_all_(preload_all) {
     ProfilePhase _(Prof::AccelConstruction);
 
     if (MaxThreadIndex() > 1 && !preload_all) {
@@ -48,7 +99,7 @@ CloudBVH::CloudBVH(const uint32_t bvh_root, const bool preload_all)
 
     if (preload_all) {
         /* (1) load all the treelets in parallel */
-        const auto treelet_count = global::manager.treeletCount();
+        const auto treelet_count = manager_.treeletCount();
 
         treelets_.resize(treelet_count + 1);
 
@@ -65,10 +116,7 @@ CloudBVH::CloudBVH(const uint32_t bvh_root, const bool preload_all)
 
         for (const auto mid : required_materials) {
             if (materials_.count(mid) == 0) {
-                auto r = global::manager.GetReader(ObjectType::Material, mid);
-                protobuf::Material material;
-                r->read(&material);
-                materials_[mid] = material::from_protobuf(material);
+                materials_[mid] = LoadMaterial(manager_, mid);
             }
         }
 
@@ -82,8 +130,7 @@ CloudBVH::CloudBVH(const uint32_t bvh_root, const bool preload_all)
 
         for (const auto rid : required_instances) {
             if (not bvh_instances_.count(rid)) {
-                bvh_instances_[rid] =
-                    make_shared<ExternalInstance>(*this, (uint16_t)(rid >> 32));
+                bvh_instances_[rid] = makeInstance(rid);
             }
         }
 
@@ -166,18 +213,14 @@ void CloudBVH::LoadTreelet(const uint32_t root_id, istream *stream) const {
     /* load the materials */
     for (const auto mid : treelet.required_materials) {
         if (materials_.count(mid) == 0) {
-            auto reader = global::manager.GetReader(ObjectType::Material, mid);
-            protobuf::Material material;
-            reader->read(&material);
-            materials_[mid] = material::from_protobuf(material);
+            materials_[mid] = LoadMaterial(manager_, mid);
         }
     }
 
     /* create the instances */
     for (const auto rid : treelet.required_instances) {
         if (not bvh_instances_.count(rid)) {
-            bvh_instances_[rid] =
-                make_shared<ExternalInstance>(*this, (uint16_t)(rid >> 32));
+            bvh_instances_[rid] = makeInstance(rid);
         }
     }
 
@@ -210,12 +253,13 @@ void CloudBVH::finializeTreeletLoad(const uint32_t root_id) const {
 
 void CloudBVH::loadTreeletBase(const uint32_t root_id, istream *stream) const {
     ProfilePhase _(Prof::LoadTreelet);
+    const auto loadStart = chrono::steady_clock::now();
 
     deque<TreeletNode> nodes;
     unique_ptr<protobuf::RecordReader> reader;
 
     if (stream == nullptr) {
-        reader = global::manager.GetReader(ObjectType::Treelet, root_id);
+        reader = manager_.GetReader(ObjectType::Treelet, root_id);
     } else {
         reader = make_unique<protobuf::RecordReader>(stream);
     }
@@ -230,17 +274,27 @@ void CloudBVH::loadTreeletBase(const uint32_t root_id, istream *stream) const {
 
     map<uint32_t, uint32_t> mesh_material_ids;
 
+    /* the messages are reused between records; parsing clears them, but
+       what they allocated stays in the arena for the next record */
+    auto &arena = LoadArena();
+    auto *proto_mesh =
+        google::protobuf::Arena::CreateMessage<protobuf::TriangleMesh>(&arena);
+    auto *proto_node_ptr =
+        google::protobuf::Arena::CreateMessage<protobuf::BVHNode>(&arena);
+
     /* read in the triangle meshes for this treelet first */
     uint32_t num_triangle_meshes = 0;
     reader->read(&num_triangle_meshes);
 
     for (int i = 0; i < num_triangle_meshes; ++i) {
         /* load the TriangleMesh if necessary */
-        protobuf::TriangleMesh tm;
+        auto &tm = *proto_mesh;
         reader->read(&tm);
 
         auto p = tree_meshes.emplace(
-            tm.id(), make_shared<TriangleMesh>(move(from_protobuf(tm))));
+            tm.id(), tm.blob() ? loadMeshBlob(tm.blob())
+                               : make_shared<TriangleMesh>(
+                                     move(from_protobuf(tm))));
         CHECK_EQ(p.second, true);
 
         mesh_material_ids[tm.id()] = tm.material_id();
@@ -249,7 +303,7 @@ void CloudBVH::loadTreeletBase(const uint32_t root_id, istream *stream) const {
     stack<pair<uint32_t, Child>> q;
 
     while (not reader->eof()) {
-        protobuf::BVHNode proto_node;
+        auto &proto_node = *proto_node_ptr;
         bool success = reader->read(&proto_node);
         CHECK_EQ(success, true);
 
@@ -319,7 +373,8 @@ void CloudBVH::loadTreeletBase(const uint32_t root_id, istream *stream) const {
             uint16_t instance_group = (uint16_t)(instance_ref >> 32);
             uint32_t instance_node = (uint32_t)instance_ref;
 
-            if (instance_group == root_id) {
+            if (instance_group == root_id &&
+                !(instance_ref & PROXY_REF_FLAG)) {
                 if (not tree_instances.count(instance_ref)) {
                     tree_instances[instance_ref] =
                         make_shared<IncludedInstance>(&treelet, instance_node);
@@ -358,6 +413,31 @@ void CloudBVH::loadTreeletBase(const uint32_t root_id, istream *stream) const {
     }
 
     treelet.nodes = move(nodes);
+    ReportValue(arenaBytes, arena.Reset());
+
+    /* an estimate of what the treelet holds on to, for telemetry */
+    uint64_t residentBytes = treelet.nodes.size() * sizeof(TreeletNode) +
+                             tree_transforms.size() * sizeof(Transform);
+
+    for (const auto &kv : tree_meshes) {
+        const TriangleMesh &mesh = *kv.second;
+        const size_t vertexBytes =
+            sizeof(Point3f) + (mesh.n ? sizeof(Normal3f) : 0) +
+            (mesh.s ? sizeof(Vector3f) : 0) + (mesh.uv ? sizeof(Point2f) : 0);
+
+        residentBytes += mesh.vertexIndices.size() * sizeof(int) +
+                         mesh.faceIndices.size() * sizeof(int) +
+                         mesh.nVertices * vertexBytes;
+    }
+
+    residentBytes +=
+        treelet.unfinished_geometric.size() *
+            (sizeof(Triangle) + sizeof(GeometricPrimitive)) +
+        (tree_primitives.size() - treelet.unfinished_geometric.size()) *
+            sizeof(TransformedPrimitive);
+
+    RecordTreeletLoad(root_id, chrono::steady_clock::now() - loadStart,
+                      residentBytes);
 }
 
 void CloudBVH::Trace(RayState &rayState) const {
@@ -373,6 +453,10 @@ void CloudBVH::Trace(RayState &rayState) const {
     bool hasTransform = false;
     bool transformChanged = false;
 
+    uint64_t nodesVisited = 0;
+    uint64_t primitivesTested = 0;
+    uint64_t hits = 0;
+
     while (true) {
         auto &top = rayState.toVisitTop();
         if (currentTreelet != top.treelet) {
@@ -382,6 +466,7 @@ void CloudBVH::Trace(RayState &rayState) const {
         RayState::TreeletNode current = move(top);
         rayState.toVisitPop();
         nNodesVisited++;
+        nodesVisited++;
 
         auto &treelet = *treelets_[current.treelet];
         auto &node = treelet.nodes[current.node];
@@ -410,6 +495,7 @@ void CloudBVH::Trace(RayState &rayState) const {
                 for (int i = node.primitive_offset + current.primitive;
                      i < node.primitive_offset + node.primitive_count; i++) {
                     nPrimitivesVisited++;
+                    primitivesTested++;
 
                     if (primitives[i]->GetType() ==
                         PrimitiveType::Transformed) {
@@ -445,18 +531,21 @@ void CloudBVH::Trace(RayState &rayState) const {
                             break;
                         }
 
-                        shared_ptr<IncludedInstance> included =
-                            dynamic_pointer_cast<IncludedInstance>(
-                                tp->GetPrimitive());
-                        if (included) {
+                        /* proxy scenes are loaded here in full, so they
+                           are traced like included instances */
+                        const auto &instance = tp->GetPrimitive();
+                        if (dynamic_pointer_cast<IncludedInstance>(instance) ||
+                            dynamic_pointer_cast<ProxyInstance>(instance)) {
                             if (tp->Intersect(ray, &isect)) {
                                 rayState.ray.tMax = ray.tMax;
                                 rayState.SetHit(current);
+                                hits++;
                             }
                         }
                     } else if (primitives[i]->Intersect(ray, &isect)) {
                         rayState.ray.tMax = ray.tMax;
                         rayState.SetHit(current);
+                        hits++;
                     }
 
                     current.primitive++;
@@ -483,6 +572,13 @@ void CloudBVH::Trace(RayState &rayState) const {
             if (rayState.toVisitEmpty()) break;
         }
     }
+
+    RecordTreeletTrace(currentTreelet, nodesVisited, primitivesTested, hits);
+
+    if (!rayState.toVisitEmpty() &&
+        rayState.toVisitTop().treelet != currentTreelet) {
+        RecordTreeletForward(currentTreelet, rayState.toVisitTop().treelet);
+    }
 }
 
 bool CloudBVH::Intersect(RayState &rayState, SurfaceInteraction *isect) const {
@@ -705,6 +801,74 @@ void CloudBVH::clear() const {
     treelets_.clear();
     bvh_instances_.clear();
     materials_.clear();
+
+    /* the proxy scenes nobody else uses were released with the instances */
+    unique_lock<mutex> proxies_lock{proxy_scenes_mutex};
+    for (auto it = proxyScenes.begin(); it != proxyScenes.end();) {
+        it = it->second.expired() ? proxyScenes.erase(it) : next(it);
+    }
+    proxies_lock.unlock();
+
+    lock_guard<mutex> lock{mesh_blobs_mutex_};
+    mesh_blobs_.clear();
+}
+
+shared_ptr<TriangleMesh> CloudBVH::loadMeshBlob(const uint64_t blob_id) const {
+    {
+        lock_guard<mutex> lock{mesh_blobs_mutex_};
+        auto it = mesh_blobs_.find(blob_id);
+        if (it != mesh_blobs_.end()) return it->second;
+    }
+
+    protobuf::TriangleMesh tm;
+    auto reader = manager_.GetReader(ObjectType::Blob, blob_id);
+    if (!reader->read(&tm)) {
+        throw runtime_error("could not read mesh blob " + to_string(blob_id));
+    }
+
+    auto mesh = make_shared<TriangleMesh>(move(from_protobuf(tm)));
+
+    /* another thread may have loaded it meanwhile; keep the first one */
+    lock_guard<mutex> lock{mesh_blobs_mutex_};
+    return mesh_blobs_.emplace(blob_id, move(mesh)).first->second;
+}
+
+shared_ptr<Primitive> CloudBVH::makeInstance(const uint64_t instance_ref) const {
+    if (instance_ref & PROXY_REF_FLAG) {
+        const uint32_t proxy_idx = (instance_ref & ~PROXY_REF_FLAG) >> 32;
+        return make_shared<ProxyInstance>(loadProxy(proxy_idx));
+    }
+
+    return make_shared<ExternalInstance>(*this, (uint16_t)(instance_ref >> 32));
+}
+
+shared_ptr<const CloudBVH> CloudBVH::loadProxy(const uint32_t proxy_idx) const {
+    const string path = manager_.getProxyPath(proxy_idx);
+
+    shared_ptr<ProxyScene> scene;
+    {
+        lock_guard<mutex> lock{proxy_scenes_mutex};
+        scene = proxyScenes[path].lock();
+    }
+
+    if (!scene) {
+        /* built without the lock, since preloading a proxy can load the
+           proxies nested in it; if another thread got there first, its
+           scene is the one everybody shares */
+        auto loaded = make_shared<ProxyScene>();
+        loaded->manager.init(path);
+        loaded->bvh = make_unique<CloudBVH>(loaded->manager, 0, preload_all_);
+
+        lock_guard<mutex> lock{proxy_scenes_mutex};
+        scene = proxyScenes[path].lock();
+        if (!scene) {
+            proxyScenes[path] = loaded;
+            scene = move(loaded);
+        }
+    }
+
+    /* shares ownership of the whole ProxyScene */
+    return shared_ptr<const CloudBVH>(scene, scene->bvh.get());
 }
 
 shared_ptr<CloudBVH> CreateCloudBVH(const ParamSet &ps) {
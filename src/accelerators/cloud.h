@@ -6,6 +6,7 @@
 #include <list>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <stack>
 #include <vector>
@@ -19,6 +20,7 @@ namespace pbrt {
 
 struct TreeletNode;
 class TriangleMesh;
+class SceneManager;
 
 class CloudBVH : public Aggregate {
   public:
@@ -27,7 +29,16 @@ class CloudBVH : public Aggregate {
         std::map<uint32_t, uint64_t> instances{};
     };
 
+    /* Root refs of transformed primitives are (treelet << 32 | node). With
+       this bit set, the treelet half is an index into the scene's proxy
+       table instead, and the primitive instances that proxy's scene. A proxy
+       scene is loaded once for all the scenes that refer to it, and is
+       released when none of them uses it anymore. */
+    static constexpr uint64_t PROXY_REF_FLAG = 1ull << 63;
+
     CloudBVH(const uint32_t bvh_root = 0, const bool preload_all = false);
+    CloudBVH(SceneManager &manager, const uint32_t bvh_root,
+             const bool preload_all);
     ~CloudBVH();
 
     CloudBVH(const CloudBVH &) = delete;
@@ -155,8 +166,27 @@ class CloudBVH : public Aggregate {
         const CloudBVH &bvh_;
     };
 
+    class ProxyInstance : public Aggregate {
+      public:
+        ProxyInstance(std::shared_ptr<const CloudBVH> bvh)
+            : bvh_(std::move(bvh)) {}
+
+        Bounds3f WorldBound() const { return bvh_->WorldBound(); }
+
+        bool Intersect(const Ray &ray, SurfaceInteraction *isect) const {
+            return bvh_->Intersect(ray, isect);
+        }
+
+        bool IntersectP(const Ray &ray) const { return bvh_->IntersectP(ray); }
+
+      private:
+        std::shared_ptr<const CloudBVH> bvh_;
+    };
+
     const std::string bvh_path_;
+    SceneManager &manager_;
     const uint32_t bvh_root_;
+    const bool preload_all_;
     bool preloading_done_{false};
 
     mutable std::vector<std::unique_ptr<Treelet>> treelets_;
@@ -165,6 +195,16 @@ class CloudBVH : public Aggregate {
 
     mutable std::shared_ptr<Material> default_material;
 
+    /* meshes stored as blobs are shared by all the treelets that use them;
+       treelets are preloaded in parallel, hence the lock */
+    mutable std::map<uint64_t, std::shared_ptr<TriangleMesh>> mesh_blobs_;
+    mutable std::mutex mesh_blobs_mutex_;
+
+    std::shared_ptr<TriangleMesh> loadMeshBlob(const uint64_t blob_id) const;
+
+    std::shared_ptr<Primitive> makeInstance(const uint64_t instance_ref) const;
+    std::shared_ptr<const CloudBVH> loadProxy(const uint32_t proxy_idx) const;
+
     void finializeTreeletLoad(const uint32_t root_id) const;
     void loadTreeletBase(const uint32_t root_id,
                          std::istream *stream = nullptr) const;
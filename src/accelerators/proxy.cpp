@@ -1,22 +1,155 @@
 #include "accelerators/proxy.h"
+
+#include <fstream>
+
 #include "cloud/manager.h"
+#include "messages/utils.h"
+#include "util/mmap.h"
+#include "util/path.h"
 
 using namespace std;
 
 namespace pbrt {
 
+bool ReadProxyHeader(const string &path, ProxyInfo *info) {
+    ifstream proxyHdr(path, ios::binary);
+    if (!proxyHdr.is_open()) {
+        return false;
+    }
+
+    proxyHdr.read(reinterpret_cast<char *>(&info->bounds), sizeof(Bounds3f));
+    proxyHdr.read(reinterpret_cast<char *>(&info->size), sizeof(uint64_t));
+    proxyHdr.read(reinterpret_cast<char *>(&info->nodeCount), sizeof(uint64_t));
+
+    uint64_t numDependencies;
+    proxyHdr.read(reinterpret_cast<char *>(&numDependencies), sizeof(uint64_t));
+
+    info->treeletCount = 0;
+    info->dependencies.clear();
+    for (uint64_t i = 0; i < numDependencies; i++) {
+        uint64_t numChars;
+        proxyHdr.read(reinterpret_cast<char *>(&numChars), sizeof(uint64_t));
+        vector<char> depBuf(numChars + 1, '\0');
+        proxyHdr.read(depBuf.data(), numChars);
+
+        info->dependencies.emplace_back(depBuf.data());
+    }
+
+    return true;
+}
+
+string ProxyIndex::Path(const string &proxyDir) {
+    return proxyDir + "/PROXY_INDEX";
+}
+
+void ProxyIndex::Write(const string &proxyDir) {
+    protobuf::ProxyIndex index;
+
+    for (const string &name : roost::list_directory(proxyDir)) {
+        const string dir = proxyDir + "/" + name;
+
+        ProxyInfo info;
+        if (name == "." || name == ".." ||
+            !ReadProxyHeader(dir + "/HEADER", &info)) {
+            continue;
+        }
+
+        SceneManager mgr;
+        mgr.init(dir);
+
+        protobuf::ProxyIndex::Proxy *proxy = index.add_proxies();
+        proxy->set_name(name);
+        *proxy->mutable_bounds() = to_protobuf(info.bounds);
+        proxy->set_size(info.size);
+        proxy->set_node_count(info.nodeCount);
+        proxy->set_treelet_count(mgr.treeletCount());
+
+        for (const string &dep : info.dependencies) {
+            proxy->add_dependencies(dep);
+        }
+    }
+
+    roost::atomic_create(index.SerializeAsString(), Path(proxyDir));
+}
+
+ProxyIndex::ProxyIndex(const string &proxyDir) {
+    const string path = Path(proxyDir);
+    if (!roost::exists(path)) {
+        return;
+    }
+
+    MMap_Region region{path};
+    protobuf::ProxyIndex index;
+    if (!index.ParseFromArray(region.addr(), region.length())) {
+        throw runtime_error("could not parse " + path);
+    }
+
+    proxies_.reserve(index.proxies_size());
+    for (const auto &proxy : index.proxies()) {
+        ProxyInfo &info = proxies_[proxy.name()];
+        info.bounds = from_protobuf(proxy.bounds());
+        info.size = proxy.size();
+        info.nodeCount = proxy.node_count();
+        info.treeletCount = proxy.treelet_count();
+        info.dependencies.assign(proxy.dependencies().begin(),
+                                 proxy.dependencies().end());
+    }
+}
+
+bool ProxyIndex::Lookup(const string &name, ProxyInfo *info) const {
+    auto it = proxies_.find(name);
+    if (it == proxies_.end()) {
+        return false;
+    }
+
+    *info = it->second;
+    return true;
+}
+
+SceneManager &ProxyBVH::Manager() const {
+    if (!manager_) {
+        manager_ = make_shared<SceneManager>();
+        manager_->init(PbrtOptions.proxyDir + "/" + name_);
+    }
+
+    return *manager_;
+}
+
+size_t ProxyBVH::TreeletCount() const {
+    if (treeletCount_ == 0) {
+        treeletCount_ = Manager().treeletCount();
+    }
+
+    return treeletCount_;
+}
+
+unique_ptr<protobuf::RecordReader> ProxyBVH::GetReader(size_t treelet) const {
+    return Manager().GetReader(ObjectType::Treelet, treelet);
+}
+
 vector<unique_ptr<protobuf::RecordReader>> ProxyBVH::GetReaders() const {
     vector<unique_ptr<protobuf::RecordReader>> readers;
 
-    SceneManager mgr;
-    mgr.init(PbrtOptions.proxyDir + "/" + name_);
-
-    size_t numTreelets = mgr.treeletCount();
+    size_t numTreelets = TreeletCount();
     for (size_t i = 0; i < numTreelets; i++) {
-        readers.emplace_back(mgr.GetReader(ObjectType::Treelet, i));
+        readers.emplace_back(GetReader(i));
+    }
+
+    return readers;
+}
+
+void ProxyBVH::ResolveMeshBlob(protobuf::TriangleMesh &mesh) const {
+    if (!mesh.blob()) return;
+
+    protobuf::TriangleMesh data;
+    if (!Manager().GetReader(ObjectType::Blob, mesh.blob())->read(&data)) {
+        throw runtime_error("could not read mesh blob " +
+                            to_string(mesh.blob()) + " of proxy " + name_);
     }
 
-    return move(readers);
+    data.set_id(mesh.id());
+    data.set_material_id(mesh.material_id());
+    mesh = move(data);
 }
 
 }
@@ -2,21 +2,59 @@
 #define PBRT_ACCELERATORS_PROXY_H
 
 #include <exception>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "primitive.h"
 #include "messages/serialization.h"
 
 namespace pbrt {
 
+class SceneManager;
+
+/* What CreateProxy() needs to know about a proxy. treeletCount is 0 when
+   it isn't known, which is the case for proxies read from their HEADER. */
+struct ProxyInfo {
+    Bounds3f bounds;
+    uint64_t size{0};
+    uint64_t nodeCount{0};
+    uint64_t treeletCount{0};
+    std::vector<std::string> dependencies{};
+};
+
+bool ReadProxyHeader(const std::string &path, ProxyInfo *info);
+
+/* The HEADERs of all the proxies of a proxy dir, in one file. Reading it is
+   a single mmap and parse instead of opening a file per proxy. It has to be
+   regenerated (write-proxy-header --index) when the proxies change. */
+class ProxyIndex {
+  public:
+    static std::string Path(const std::string &proxyDir);
+    static void Write(const std::string &proxyDir);
+
+    /* an empty index if the proxy dir doesn't have one */
+    ProxyIndex(const std::string &proxyDir);
+
+    bool Lookup(const std::string &name, ProxyInfo *info) const;
+    size_t size() const { return proxies_.size(); }
+
+  private:
+    std::unordered_map<std::string, ProxyInfo> proxies_{};
+};
+
 class ProxyBVH : public Aggregate {
 public:
     ProxyBVH(const Bounds3f &bounds, uint64_t size,
              const std::string &name, uint64_t nodeCount,
-             std::vector<const ProxyBVH *> &&deps)
+             std::vector<const ProxyBVH *> &&deps,
+             uint64_t treeletCount = 0)
         : bounds_(bounds), size_(size),
           name_(name), nodeCount_(nodeCount),
           dependencies_(move(deps)),
-          numIncludes_(1)
+          numIncludes_(1),
+          treeletCount_(treeletCount)
     {}
 
     Bounds3f WorldBound() const { return bounds_; }
@@ -24,7 +62,15 @@ public:
     std::string Name() const { return name_; }
     uint64_t nodeCount() const { return nodeCount_; }
     const std::vector<const ProxyBVH *> & Dependencies() const { return dependencies_; }
+
+    /* the proxy's scene is only opened once a treelet is asked for */
+    size_t TreeletCount() const;
+    std::unique_ptr<protobuf::RecordReader> GetReader(size_t treelet) const;
     std::vector<std::unique_ptr<protobuf::RecordReader>> GetReaders() const;
+
+    /* if the mesh refers to a blob of the proxy's scene, replaces it with
+       the blob's data so that it can be written into another scene */
+    void ResolveMeshBlob(protobuf::TriangleMesh &mesh) const;
     uint64_t UsageCount() const { return numIncludes_; }
     void IncrUsage() { numIncludes_++; }
 
@@ -36,12 +82,17 @@ public:
     }
 
 private:
+    SceneManager &Manager() const;
+
     Bounds3f bounds_;
     uint64_t size_;
     std::string name_;
     uint64_t nodeCount_;
     std::vector<const ProxyBVH *> dependencies_;
     uint64_t numIncludes_;
+
+    mutable uint64_t treeletCount_;
+    mutable std::shared_ptr<SceneManager> manager_{};
 };
 
 }
@@ -1366,6 +1366,20 @@ vector<uint32_t> ProxyDumpBVH::DumpTreelets(bool root, bool inlineProxies) const
         global::manager.getNextId(ObjectType::Treelet, &treelet);
     }
 
+    // Proxies that aren't inlined are referenced by their index in this
+    // table, and CloudBVH loads their scenes when rendering
+    if (!inlineProxies) {
+        vector<string> proxyNames(proxyOrder.size());
+        for (auto &kv : proxyOrder) {
+            proxyNames[kv.second] = kv.first->Name();
+        }
+
+        auto writer = global::manager.GetWriter(ObjectType::ProxyTable);
+        for (const string &name : proxyNames) {
+            writer->write(name);
+        }
+    }
+
     bool multiDir = false;
     for (const TreeletInfo &info : allTreelets) {
         if (info.dirIdx != 0) {
@@ -1393,8 +1407,10 @@ vector<uint32_t> ProxyDumpBVH::DumpTreelets(bool root, bool inlineProxies) const
 
     DumpSanityCheck(treeletNodeLocations);
 
-    auto copyTreelet = [&](unique_ptr<protobuf::RecordReader> &reader,
+    auto copyTreelet = [&](const ProxyBVH *proxy,
+                           unique_ptr<protobuf::RecordReader> &reader,
                            unique_ptr<protobuf::RecordWriter> &writer,
+                           const uint32_t treeletID,
                            const vector<uint32_t> &mapping) {
         uint32_t numMeshes = 0;
         reader->read(&numMeshes);
@@ -1403,6 +1419,8 @@ vector<uint32_t> ProxyDumpBVH::DumpTreelets(bool root, bool inlineProxies) const
         for (int i = 0; i < numMeshes; i++) {
             protobuf::TriangleMesh tm;
             reader->read(&tm);
+            proxy->ResolveMeshBlob(tm);
+            StoreMeshBlob(tm, treeletID);
             writer->write(tm);
         }
 
@@ -1481,7 +1499,7 @@ vector<uint32_t> ProxyDumpBVH::DumpTreelets(bool root, bool inlineProxies) const
 
                 auto writer = global::manager.GetWriter(ObjectType::Treelet, new_id);
 
-                copyTreelet(reader, writer, id_remap);
+                copyTreelet(large, reader, writer, new_id, id_remap);
             }
         }
     }
@@ -1514,11 +1532,11 @@ vector<uint32_t> ProxyDumpBVH::DumpTreelets(bool root, bool inlineProxies) const
         uint32_t numProxyMeshes = 0;
         if (inlineProxies) {
             for (const ProxyBVH *proxy : treelet.proxies) {
-                auto readers = proxy->GetReaders();
                 // Definitely shouldn't be inlining a proxy that takes up more than 1 full treelet
-                CHECK_EQ(readers.size(), 1);
+                CHECK_EQ(proxy->TreeletCount(), 1);
+                auto reader = proxy->GetReader(0);
                 uint32_t numMeshes;
-                readers[0]->read(&numMeshes);
+                reader->read(&numMeshes);
                 numProxyMeshes += numMeshes;
             }
         }
@@ -1542,64 +1560,11 @@ vector<uint32_t> ProxyDumpBVH::DumpTreelets(bool root, bool inlineProxies) const
             TriangleMesh *mesh = kv.first;
             vector<size_t> &triNums = kv.second;
 
-            size_t numTris = triNums.size();
-            unordered_map<int, size_t> vertexRemap;
-            size_t newIdx = 0;
-            size_t newTriNum = 0;
-
-            for (auto triNum : triNums) {
-                for (int i = 0; i < 3; i++) {
-                    int idx = mesh->vertexIndices[triNum * 3 + i];
-                    if (vertexRemap.count(idx) == 0) {
-                        vertexRemap.emplace(idx, newIdx++);
-                    }
-                }
-                triNumRemap[mesh].emplace(triNum, newTriNum++);
-            }
-            size_t numVerts = newIdx;
-            CHECK_EQ(numVerts, vertexRemap.size());
-
-            vector<int> vertIdxs(numTris * 3);
-            vector<Point3f> P(numVerts);
-            vector<Vector3f> S(numVerts);
-            vector<Normal3f> N(numVerts);
-            vector<Point2f> uv(numVerts);
-            vector<int> faceIdxs(numVerts);
-
-            for (size_t i = 0; i < numTris; i++) {
-                size_t triNum = triNums[i];
-                for (int j = 0; j < 3; j++) {
-                    int origIdx = mesh->vertexIndices[triNum * 3 + j];
-                    int newIdx = vertexRemap.at(origIdx);
-                    vertIdxs[i * 3 + j] = newIdx;
-                }
-                if (mesh->faceIndices.size() > 0) {
-                    faceIdxs[i] = mesh->faceIndices[triNum];
-                }
-            }
-
-            for (auto &kv : vertexRemap) {
-                int origIdx = kv.first;
-                int newIdx = kv.second;
-                P[newIdx] = mesh->p[origIdx];
-                if (mesh->s.get()) {
-                    S[newIdx] = mesh->s[origIdx];
-                }
-                if (mesh->n.get()) {
-                    N[newIdx] = mesh->n[origIdx];
-                }
-                if (mesh->uv.get()) {
-                    uv[newIdx] = mesh->uv[origIdx];
-                }
+            for (size_t i = 0; i < triNums.size(); i++) {
+                triNumRemap[mesh].emplace(triNums[i], i);
             }
 
-            shared_ptr<TriangleMesh> newMesh = make_shared<TriangleMesh>(
-                Transform(), numTris, vertIdxs.data(), numVerts,
-                P.data(), mesh->s.get() ? S.data() : nullptr,
-                mesh->n.get() ? N.data() : nullptr,
-                mesh->uv.get() ? uv.data() : nullptr, mesh->alphaMask,
-                mesh->shadowAlphaMask,
-                mesh->faceIndices.size() > 0 ? faceIdxs.data() : nullptr);
+            shared_ptr<TriangleMesh> newMesh = ExtractSubMesh(*mesh, triNums);
 
 
             // Give triangle mesh an ID
@@ -1610,6 +1575,7 @@ vector<uint32_t> ProxyDumpBVH::DumpTreelets(bool root, bool inlineProxies) const
             protobuf::TriangleMesh tmProto = to_protobuf(*newMesh);
             tmProto.set_id(sMeshID);
             tmProto.set_material_id(0);
+            StoreMeshBlob(tmProto, sTreeletID);
             writer->write(tmProto);
         }
 
@@ -1617,19 +1583,21 @@ vector<uint32_t> ProxyDumpBVH::DumpTreelets(bool root, bool inlineProxies) const
         unordered_map<const ProxyBVH *, unordered_map<uint32_t, uint32_t>> proxyMeshIndices;
         if (inlineProxies) {
             for (const ProxyBVH *proxy : treelet.proxies) {
-                auto readers = proxy->GetReaders();
+                auto reader = proxy->GetReader(0);
                 uint32_t numMeshes;
-                readers[0]->read(&numMeshes);
+                reader->read(&numMeshes);
 
                 for (int i = 0; i < numMeshes; i++) {
                     protobuf::TriangleMesh tm;
-                    readers[0]->read(&tm);
+                    reader->read(&tm);
 
                     uint32_t oldId = tm.id();
 
                     uint32_t sMeshId = global::manager.getNextId(ObjectType::TriangleMesh);
                     tm.set_id(sMeshId);
                     tm.set_material_id(0);
+                    proxy->ResolveMeshBlob(tm);
+                    StoreMeshBlob(tm, sTreeletID);
                     writer->write(tm);
                     proxyMeshIndices[proxy].emplace(oldId, sMeshId);
                 }
@@ -1667,8 +1635,19 @@ vector<uint32_t> ProxyDumpBVH::DumpTreelets(bool root, bool inlineProxies) const
                             instanceRef <<= 32;
                         }
                     } else {
-                        instanceRef = proxyOrder.find(proxy.get())->second;
+                        const uint32_t proxyIdx = proxyOrder.find(proxy.get())->second;
+                        instanceRef = proxyIdx;
                         instanceRef <<= 32;
+                        instanceRef |= CloudBVH::PROXY_REF_FLAG;
+
+                        // The treelet can't be traced without the proxy's
+                        // scene, nor the table that names it
+                        global::manager.recordDependency(
+                            ObjectKey {ObjectType::Treelet, sTreeletID},
+                            ObjectKey {ObjectType::ProxyTable, 0});
+                        global::manager.recordDependency(
+                            ObjectKey {ObjectType::Treelet, sTreeletID},
+                            ObjectKey {ObjectType::ProxyScene, proxyIdx});
                     }
 
                     protobuf::TransformedPrimitive tpProto;
@@ -1722,8 +1701,7 @@ vector<uint32_t> ProxyDumpBVH::DumpTreelets(bool root, bool inlineProxies) const
         // Write out nodes for instances
         if (inlineProxies) {
             for (const ProxyBVH *proxy : treelet.proxies) {
-                auto readers = proxy->GetReaders();
-                auto &reader = readers[0];
+                auto reader = proxy->GetReader(0);
 
                 // Skip over all meshes
                 uint32_t numMeshes;
@@ -1744,7 +1722,7 @@ vector<uint32_t> ProxyDumpBVH::DumpTreelets(bool root, bool inlineProxies) const
                     for (int tIdx = 0; tIdx < nodeProto.transformed_primitives_size(); tIdx++) {
                         auto transformedProto = nodeProto.mutable_transformed_primitives(tIdx);
                         uint64_t rootRef = transformedProto->root_ref();
-                        uint32_t proxyIdx = (uint32_t)(rootRef >> 32);
+                        uint32_t proxyIdx = (uint32_t)((rootRef & ~CloudBVH::PROXY_REF_FLAG) >> 32);
                         const ProxyBVH *dep = proxy->Dependencies()[proxyIdx];
 
                         uint64_t instanceRef = 0;
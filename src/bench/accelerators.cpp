@@ -0,0 +1,49 @@
+#include <memory>
+
+#include "accelerators/bvh.h"
+#include "accelerators/kdtreeaccel.h"
+#include "bench/bench.h"
+#include "bench/fixtures.h"
+#include "interaction.h"
+
+using namespace pbrt;
+using namespace pbrt::bench;
+
+/* built once, since building them takes far longer than a run */
+static const BVHAccel &Bvh() {
+    static const BVHAccel bvh(SphereMesh().primitives, 4);
+    return bvh;
+}
+
+static const KdTreeAccel &KdTree() {
+    static const KdTreeAccel kdTree(SphereMesh().primitives);
+    return kdTree;
+}
+
+/* one op is one ray from a fixed set, about half of which hit */
+static void Intersect(State &state, const Primitive &accel) {
+    const auto &rays = RandomRays();
+    size_t i = 0;
+
+    while (state.KeepRunning()) {
+        Ray ray = rays[i];
+        SurfaceInteraction isect;
+        DoNotOptimize(accel.Intersect(ray, &isect));
+        i = (i + 1 == rays.size()) ? 0 : i + 1;
+    }
+}
+
+static void IntersectP(State &state, const Primitive &accel) {
+    const auto &rays = RandomRays();
+    size_t i = 0;
+
+    while (state.KeepRunning()) {
+        DoNotOptimize(accel.IntersectP(rays[i]));
+        i = (i + 1 == rays.size()) ? 0 : i + 1;
+    }
+}
+
+BENCHMARK(BVHAccel_Intersect) { Intersect(state, Bvh()); }
+BENCHMARK(BVHAccel_IntersectP) { IntersectP(state, Bvh()); }
+BENCHMARK(KdTreeAccel_Intersect) { Intersect(state, KdTree()); }
+BENCHMARK(KdTreeAccel_IntersectP) { IntersectP(state, KdTree()); }
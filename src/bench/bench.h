@@ -0,0 +1,81 @@
+#ifndef PBRT_BENCH_BENCH_H
+#define PBRT_BENCH_BENCH_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace pbrt {
+namespace bench {
+
+/* What a benchmark loops on. Everything before the first KeepRunning() is
+ * setup and isn't timed:
+ *
+ *     BENCHMARK(Triangle_Intersect) {
+ *         ...setup...
+ *         while (state.KeepRunning()) {
+ *             DoNotOptimize(tri->Intersect(...));
+ *         }
+ *     }
+ *
+ * The harness picks the number of iterations, and calls the benchmark
+ * several times with it. */
+class State {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit State(const uint64_t iterations) : iterations_(iterations) {}
+
+    bool KeepRunning() {
+        if (done_ == 0) {
+            start_ = Clock::now();
+        } else if (done_ == iterations_) {
+            end_ = Clock::now();
+            return false;
+        }
+
+        done_++;
+        return true;
+    }
+
+    uint64_t Iterations() const { return iterations_; }
+    Clock::duration Elapsed() const { return end_ - start_; }
+
+  private:
+    const uint64_t iterations_;
+    uint64_t done_{0};
+    Clock::time_point start_{};
+    Clock::time_point end_{};
+};
+
+/* keeps the compiler from dropping a computation whose result is unused */
+template <typename T>
+inline void DoNotOptimize(const T &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct Benchmark {
+    std::string name;
+    std::function<void(State &)> run;
+};
+
+std::vector<Benchmark> &Registry();
+
+struct Registration {
+    Registration(const std::string &name, std::function<void(State &)> run) {
+        Registry().push_back({name, std::move(run)});
+    }
+};
+
+}  // namespace bench
+}  // namespace pbrt
+
+#define BENCHMARK(name)                                                 \
+    static void Benchmark_##name(pbrt::bench::State &state);            \
+    static pbrt::bench::Registration Registration_##name{#name,         \
+                                                         Benchmark_##name}; \
+    static void Benchmark_##name(pbrt::bench::State &state)
+
+#endif  // PBRT_BENCH_BENCH_H
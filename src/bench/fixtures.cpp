@@ -0,0 +1,106 @@
+#include "bench/fixtures.h"
+
+#include "primitive.h"
+#include "rng.h"
+#include "sampling.h"
+#include "shapes/triangle.h"
+
+namespace pbrt {
+namespace bench {
+
+static BenchMesh BuildSphereMesh() {
+    const int nTheta = 225, nPhi = 225;
+    RNG rng(1);
+    BenchMesh mesh;
+
+    for (int t = 0; t < nTheta; ++t) {
+        Float theta = Pi * t / (nTheta - 1);
+        for (int p = 0; p < nPhi; ++p) {
+            Float phi = 2 * Pi * p / nPhi;
+            Float radius = 1 + 0.05f * rng.UniformFloat();
+            mesh.vertices.push_back(
+                Point3f(0, 0, 0) +
+                radius * SphericalDirection(std::sin(theta), std::cos(theta),
+                                            phi));
+        }
+    }
+
+    auto offset = [nPhi](int t, int p) { return t * nPhi + p % nPhi; };
+    for (int t = 0; t < nTheta - 1; ++t) {
+        for (int p = 0; p < nPhi; ++p) {
+            mesh.indices.insert(mesh.indices.end(),
+                                {offset(t, p), offset(t + 1, p),
+                                 offset(t + 1, p + 1)});
+            mesh.indices.insert(mesh.indices.end(),
+                                {offset(t, p), offset(t + 1, p + 1),
+                                 offset(t, p + 1)});
+        }
+    }
+
+    static Transform identity;
+    mesh.triangles = CreateTriangleMesh(
+        &identity, &identity, false, mesh.indices.size() / 3,
+        mesh.indices.data(), mesh.vertices.size(), mesh.vertices.data(),
+        nullptr, nullptr, nullptr, nullptr, nullptr);
+
+    for (const auto &triangle : mesh.triangles) {
+        mesh.primitives.push_back(std::make_shared<GeometricPrimitive>(
+            triangle, nullptr, nullptr, MediumInterface()));
+    }
+
+    return mesh;
+}
+
+const BenchMesh &SphereMesh() {
+    static const BenchMesh mesh = BuildSphereMesh();
+    return mesh;
+}
+
+const std::vector<Ray> &RandomRays() {
+    static const std::vector<Ray> rays = []() {
+        RNG rng(2);
+        std::vector<Ray> rays;
+
+        for (int i = 0; i < 4096; ++i) {
+            Point3f o = Point3f(0, 0, 0) +
+                        3 * UniformSampleSphere({rng.UniformFloat(),
+                                                 rng.UniformFloat()});
+            Point3f target =
+                Point3f(0, 0, 0) +
+                1.4f * rng.UniformFloat() *
+                    UniformSampleSphere(
+                        {rng.UniformFloat(), rng.UniformFloat()});
+            rays.emplace_back(o, Normalize(target - o));
+        }
+
+        return rays;
+    }();
+
+    return rays;
+}
+
+const std::vector<Ray> &AimedRays() {
+    static const std::vector<Ray> rays = []() {
+        const BenchMesh &mesh = SphereMesh();
+        RNG rng(3);
+        std::vector<Ray> rays;
+
+        for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+            Point3f centroid = (mesh.vertices[mesh.indices[i]] +
+                                mesh.vertices[mesh.indices[i + 1]] +
+                                mesh.vertices[mesh.indices[i + 2]]) /
+                               3;
+            Point3f o = centroid +
+                        2 * UniformSampleSphere({rng.UniformFloat(),
+                                                 rng.UniformFloat()});
+            rays.emplace_back(o, Normalize(centroid - o));
+        }
+
+        return rays;
+    }();
+
+    return rays;
+}
+
+}  // namespace bench
+}  // namespace pbrt
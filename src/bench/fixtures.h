@@ -0,0 +1,34 @@
+#ifndef PBRT_BENCH_FIXTURES_H
+#define PBRT_BENCH_FIXTURES_H
+
+#include <memory>
+#include <vector>
+
+#include "geometry.h"
+#include "pbrt.h"
+
+namespace pbrt {
+namespace bench {
+
+/* About 100k triangles on a bumpy unit sphere. It's built the first time
+ * it's asked for and shared by all the benchmarks after that. */
+struct BenchMesh {
+    std::vector<Point3f> vertices;
+    std::vector<int> indices;
+    std::vector<std::shared_ptr<Shape>> triangles;
+    std::vector<std::shared_ptr<Primitive>> primitives;
+};
+
+const BenchMesh &SphereMesh();
+
+/* rays from a sphere of radius 3 towards the inside of the mesh, about half
+ * of which miss it; the same set on every run */
+const std::vector<Ray> &RandomRays();
+
+/* one ray per triangle, aimed at its centroid */
+const std::vector<Ray> &AimedRays();
+
+}  // namespace bench
+}  // namespace pbrt
+
+#endif  // PBRT_BENCH_FIXTURES_H
@@ -0,0 +1,91 @@
+#include <array>
+#include <vector>
+
+#include "bench/bench.h"
+#include "bench/fixtures.h"
+#include "interaction.h"
+#include "shape.h"
+
+using namespace pbrt;
+using namespace pbrt::bench;
+
+/* the rays are aimed at the triangle they're tested against, so these
+ * mostly hit */
+BENCHMARK(Triangle_Intersect) {
+    const auto &triangles = SphereMesh().triangles;
+    const auto &rays = AimedRays();
+    size_t i = 0;
+
+    while (state.KeepRunning()) {
+        Float tHit;
+        SurfaceInteraction isect;
+        DoNotOptimize(triangles[i]->Intersect(rays[i], &tHit, &isect));
+        i = (i + 1 == triangles.size()) ? 0 : i + 1;
+    }
+}
+
+BENCHMARK(Triangle_IntersectP) {
+    const auto &triangles = SphereMesh().triangles;
+    const auto &rays = AimedRays();
+    size_t i = 0;
+
+    while (state.KeepRunning()) {
+        DoNotOptimize(triangles[i]->IntersectP(rays[i]));
+        i = (i + 1 == triangles.size()) ? 0 : i + 1;
+    }
+}
+
+/* random pairs, which almost always miss */
+BENCHMARK(Triangle_IntersectP_Miss) {
+    const auto &triangles = SphereMesh().triangles;
+    const auto &rays = RandomRays();
+    size_t i = 0, j = 0;
+
+    while (state.KeepRunning()) {
+        DoNotOptimize(triangles[i]->IntersectP(rays[j]));
+        i = (i + 1 == triangles.size()) ? 0 : i + 1;
+        j = (j + 1 == rays.size()) ? 0 : j + 1;
+    }
+}
+
+static std::vector<Bounds3f> TriangleBounds() {
+    std::vector<Bounds3f> bounds;
+    for (const auto &triangle : SphereMesh().triangles) {
+        bounds.push_back(triangle->WorldBound());
+    }
+    return bounds;
+}
+
+BENCHMARK(Bounds3_IntersectP) {
+    static const std::vector<Bounds3f> bounds = TriangleBounds();
+    const auto &rays = AimedRays();
+    size_t i = 0;
+
+    while (state.KeepRunning()) {
+        Float t0, t1;
+        DoNotOptimize(bounds[i].IntersectP(rays[i], &t0, &t1));
+        i = (i + 1 == bounds.size()) ? 0 : i + 1;
+    }
+}
+
+/* the variant the BVH uses, with the reciprocal direction precomputed */
+BENCHMARK(Bounds3_IntersectP_InvDir) {
+    static const std::vector<Bounds3f> bounds = TriangleBounds();
+    const auto &rays = AimedRays();
+
+    std::vector<Vector3f> invDirs;
+    std::vector<std::array<int, 3>> dirIsNeg;
+    for (const Ray &ray : rays) {
+        invDirs.emplace_back(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
+        dirIsNeg.push_back({invDirs.back().x < 0, invDirs.back().y < 0,
+                            invDirs.back().z < 0});
+    }
+
+    size_t i = 0;
+
+    while (state.KeepRunning()) {
+        DoNotOptimize(
+            bounds[i].IntersectP(rays[i], invDirs[i], dirIsNeg[i].data()));
+        i = (i + 1 == bounds.size()) ? 0 : i + 1;
+    }
+}
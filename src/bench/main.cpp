@@ -0,0 +1,163 @@
+#include <sched.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "bench/bench.h"
+#include "pbrt.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace pbrt;
+using namespace pbrt::bench;
+
+namespace pbrt {
+namespace bench {
+
+vector<Benchmark> &Registry() {
+    static vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+}  // namespace bench
+}  // namespace pbrt
+
+static void usage(const char *argv0, const char *msg = nullptr) {
+    if (msg) cerr << argv0 << ": " << msg << endl << endl;
+
+    cerr << "Usage: " << argv0 << " [OPTIONS]" << endl << R"(
+  --filter <text>      Only run the benchmarks whose name contains <text>
+  --min-time <ms>      Shortest time a repetition may take (default: 100)
+  --repetitions <n>    Timed repetitions of each benchmark (default: 5)
+  --cpu <n>            Pin the benchmarks to CPU <n> (default: the CPU the
+                       harness starts on)
+  --no-pin             Don't pin the benchmarks to a CPU
+  --list               List the benchmarks and exit
+)";
+
+    exit(msg ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+static double runOnce(const Benchmark &benchmark, const uint64_t iterations) {
+    State state{iterations};
+    benchmark.run(state);
+    return duration<double>(state.Elapsed()).count();
+}
+
+/* grows the iteration count until one run takes at least minTime */
+static uint64_t calibrate(const Benchmark &benchmark, const double minTime) {
+    uint64_t iterations = 1;
+
+    while (true) {
+        const double seconds = runOnce(benchmark, iterations);
+        if (seconds >= minTime) return iterations;
+
+        const double factor =
+            (seconds < minTime / 100) ? 100 : 1.4 * minTime / seconds;
+        iterations = max<uint64_t>(iterations + 1, iterations * factor);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    string filter;
+    double minTime = 0.1;
+    int repetitions = 5;
+    int cpu = sched_getcpu();
+    bool pin = true;
+    bool list = false;
+
+    for (int i = 1; i < argc; i++) {
+        const string arg{argv[i]};
+        auto value = [&]() -> string {
+            if (i + 1 == argc) {
+                usage(argv[0], ("missing value after " + arg).c_str());
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--filter") {
+            filter = value();
+        } else if (arg == "--min-time") {
+            minTime = stod(value()) / 1000;
+        } else if (arg == "--repetitions") {
+            repetitions = stoi(value());
+        } else if (arg == "--cpu") {
+            cpu = stoi(value());
+        } else if (arg == "--no-pin") {
+            pin = false;
+        } else if (arg == "--list") {
+            list = true;
+        } else if (arg == "--help" || arg == "-h") {
+            usage(argv[0]);
+        } else {
+            usage(argv[0], ("unknown option " + arg).c_str());
+        }
+    }
+
+    if (minTime <= 0 || repetitions < 1) {
+        usage(argv[0], "invalid option value");
+    }
+
+    vector<Benchmark> benchmarks = Registry();
+    stable_sort(benchmarks.begin(), benchmarks.end(),
+                [](const Benchmark &a, const Benchmark &b) {
+                    return a.name < b.name;
+                });
+
+    if (list) {
+        for (const auto &benchmark : benchmarks) cout << benchmark.name << endl;
+        return EXIT_SUCCESS;
+    }
+
+    /* setup code must not start worker threads behind our back */
+    PbrtOptions.nThreads = 1;
+
+    if (pin) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+            perror("sched_setaffinity");
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("%-40s %12s %12s %12s %8s\n", "benchmark", "iterations",
+           "ns/op", "min ns/op", "stddev");
+
+    for (const auto &benchmark : benchmarks) {
+        if (benchmark.name.find(filter) == string::npos) continue;
+
+        /* calibrating warms up the caches and the branch predictors, and
+         * one more run at the final count settles the clock frequency */
+        const uint64_t iterations = calibrate(benchmark, minTime);
+        runOnce(benchmark, iterations);
+
+        vector<double> nsPerOp;
+        for (int i = 0; i < repetitions; i++) {
+            nsPerOp.push_back(runOnce(benchmark, iterations) * 1e9 /
+                              iterations);
+        }
+
+        sort(nsPerOp.begin(), nsPerOp.end());
+        double mean = 0;
+        for (const double x : nsPerOp) mean += x / nsPerOp.size();
+        double variance = 0;
+        for (const double x : nsPerOp) {
+            variance += (x - mean) * (x - mean) / nsPerOp.size();
+        }
+
+        printf("%-40s %12llu %12.2f %12.2f %7.2f%%\n", benchmark.name.c_str(),
+               static_cast<unsigned long long>(iterations),
+               nsPerOp[nsPerOp.size() / 2], nsPerOp.front(),
+               100 * sqrt(variance) / mean);
+        fflush(stdout);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,77 @@
+#include <vector>
+
+#include "bench/bench.h"
+#include "mipmap.h"
+#include "rng.h"
+
+using namespace pbrt;
+using namespace pbrt::bench;
+
+/* a 1024x1024 checkerboard, with doTrilinear off so that the lookups with
+ * derivatives go through the EWA filter */
+static const MIPMap<RGBSpectrum> &Checkerboard() {
+    static const MIPMap<RGBSpectrum> mipmap = []() {
+        const int size = 1024;
+        std::vector<RGBSpectrum> texels(size * size);
+
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                texels[y * size + x] =
+                    RGBSpectrum(((x / 32 + y / 32) % 2) ? 0.8f : 0.2f);
+            }
+        }
+
+        return MIPMap<RGBSpectrum>(Point2i(size, size), texels.data());
+    }();
+
+    return mipmap;
+}
+
+/* lookup positions and footprints of a few texels, at random angles */
+struct Footprints {
+    std::vector<Point2f> st;
+    std::vector<Vector2f> dstdx, dstdy;
+};
+
+static const Footprints &RandomFootprints() {
+    static const Footprints footprints = []() {
+        RNG rng(5);
+        Footprints f;
+
+        for (int i = 0; i < 1024; ++i) {
+            const Float angle = 2 * Pi * rng.UniformFloat();
+            const Float scale = (1 + 7 * rng.UniformFloat()) / 1024;
+            f.st.emplace_back(rng.UniformFloat(), rng.UniformFloat());
+            f.dstdx.emplace_back(scale * std::cos(angle),
+                                 scale * std::sin(angle));
+            f.dstdy.emplace_back(-0.5f * scale * std::sin(angle),
+                                 0.5f * scale * std::cos(angle));
+        }
+
+        return f;
+    }();
+
+    return footprints;
+}
+
+BENCHMARK(MIPMap_Lookup_Trilinear) {
+    const MIPMap<RGBSpectrum> &mipmap = Checkerboard();
+    const Footprints &f = RandomFootprints();
+    size_t i = 0;
+
+    while (state.KeepRunning()) {
+        DoNotOptimize(mipmap.Lookup(f.st[i], f.dstdx[i].x));
+        i = (i + 1) % f.st.size();
+    }
+}
+
+BENCHMARK(MIPMap_Lookup_EWA) {
+    const MIPMap<RGBSpectrum> &mipmap = Checkerboard();
+    const Footprints &f = RandomFootprints();
+    size_t i = 0;
+
+    while (state.KeepRunning()) {
+        DoNotOptimize(mipmap.Lookup(f.st[i], f.dstdx[i], f.dstdy[i]));
+        i = (i + 1) % f.st.size();
+    }
+}
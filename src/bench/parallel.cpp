@@ -0,0 +1,90 @@
+#include <sched.h>
+
+#include <string>
+
+#include "bench/bench.h"
+#include "parallel.h"
+
+using namespace std;
+using namespace pbrt;
+using namespace pbrt::bench;
+
+/* The harness pins itself to one CPU before running anything, and threads
+ * inherit that, so the CPUs the process started with are kept for the
+ * worker threads. */
+static const cpu_set_t ProcessCpus = [] {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    sched_getaffinity(0, sizeof(cpus), &cpus);
+    return cpus;
+}();
+
+/* about 20ns of work per unit */
+static void Work(const int64_t seed, const int units) {
+    double x = seed;
+    for (int i = 0; i < 8 * units; i++) x = x * 0.999 + 1;
+    DoNotOptimize(x);
+}
+
+/* One op is one call of loop, with a pool of nThreads threads */
+static void WithThreads(State &state, const int nThreads,
+                        const function<void()> &loop) {
+    cpu_set_t pinned;
+    sched_getaffinity(0, sizeof(pinned), &pinned);
+    sched_setaffinity(0, sizeof(ProcessCpus), &ProcessCpus);
+
+    PbrtOptions.nThreads = nThreads;
+    ParallelInit();
+
+    while (state.KeepRunning()) loop();
+
+    ParallelCleanup();
+    PbrtOptions.nThreads = 1;
+    sched_setaffinity(0, sizeof(pinned), &pinned);
+}
+
+/* 64k iterations of ~20ns each: mostly scheduling overhead */
+static void ForFine(State &state, const int nThreads) {
+    WithThreads(state, nThreads, [] {
+        ParallelFor([](int64_t i) { Work(i, 1); }, 1 << 16);
+    });
+}
+
+/* 32x32 tiles of ~20us each, like SamplerIntegrator::Render() */
+static void For2DTiles(State &state, const int nThreads) {
+    WithThreads(state, nThreads, [] {
+        ParallelFor2D([](Point2i tile) { Work(tile.x, 1000); },
+                      Point2i(32, 32));
+    });
+}
+
+/* 64 loops of 256 iterations of ~1us each, started from inside a loop */
+static void ForNested(State &state, const int nThreads) {
+    WithThreads(state, nThreads, [] {
+        ParallelFor(
+            [](int64_t) {
+                ParallelFor([](int64_t i) { Work(i, 50); }, 256, 4);
+            },
+            64);
+    });
+}
+
+static const bool Registered = [] {
+    for (const int nThreads : {1, 2, 4, 8, 16, 32, 64, 128}) {
+        char suffix[16];
+        snprintf(suffix, sizeof(suffix), "_T%03d", nThreads);
+
+        Registration("Parallel_ForFine" + string(suffix),
+                     [nThreads](State &state) { ForFine(state, nThreads); });
+        Registration("Parallel_For2DTiles" + string(suffix),
+                     [nThreads](State &state) {
+                         For2DTiles(state, nThreads);
+                     });
+        Registration("Parallel_ForNested" + string(suffix),
+                     [nThreads](State &state) {
+                         ForNested(state, nThreads);
+                     });
+    }
+
+    return true;
+}();
@@ -0,0 +1,64 @@
+#include <lz4.h>
+
+#include <vector>
+
+#include "bench/bench.h"
+#include "pbrt/raystate.h"
+#include "transform.h"
+
+using namespace pbrt;
+using namespace pbrt::bench;
+
+/* a ray in the middle of a path, with a hit and a few nodes left to
+ * visit, as they are when they move between workers */
+static RayStatePtr MakeRayState() {
+    RayStatePtr state = RayState::Create();
+    state->sample.id = 1000;
+    state->sample.pFilm = Point2f(10.5f, 20.25f);
+    state->sample.weight = 1.f;
+    state->sample.dim = 5;
+    state->ray = RayDifferential(Point3f(1, 2, 3), Vector3f(0, 1, 0));
+    state->beta = Spectrum(0.5f);
+    state->Ld = Spectrum(0.25f);
+    state->remainingBounces = 3;
+
+    RayState::TreeletNode hit;
+    hit.treelet = 7;
+    hit.node = 42;
+    hit.primitive = 3;
+    hit.transformed = true;
+    state->rayTransform = Translate(Vector3f(1, 0, 0));
+    state->SetHit(hit);
+
+    for (int i = 0; i < 3; i++) {
+        RayState::TreeletNode node;
+        node.treelet = i;
+        node.node = 10 * i;
+        state->toVisitPush(std::move(node));
+    }
+
+    return state;
+}
+
+BENCHMARK(RayState_Serialize) {
+    RayStatePtr ray = MakeRayState();
+    std::vector<char> buffer(LZ4_COMPRESSBOUND(RayState::MaxPackedSize) + 4);
+
+    while (state.KeepRunning()) {
+        DoNotOptimize(ray->Serialize(buffer.data()));
+    }
+}
+
+BENCHMARK(RayState_Deserialize) {
+    RayStatePtr ray = MakeRayState();
+    std::vector<char> buffer(LZ4_COMPRESSBOUND(RayState::MaxPackedSize) + 4);
+
+    /* the length prefix isn't part of what Deserialize() takes */
+    const size_t len = ray->Serialize(buffer.data()) - 4;
+    RayStatePtr copy = RayState::Create();
+
+    while (state.KeepRunning()) {
+        copy->Deserialize(buffer.data() + 4, len);
+        DoNotOptimize(copy->sample.id);
+    }
+}
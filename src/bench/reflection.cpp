@@ -0,0 +1,93 @@
+#include <vector>
+
+#include "bench/bench.h"
+#include "microfacet.h"
+#include "reflection.h"
+#include "rng.h"
+#include "sampling.h"
+
+using namespace pbrt;
+using namespace pbrt::bench;
+
+/* pairs of directions in the upper hemisphere of the shading frame, and
+ * samples for Sample_f() */
+struct Directions {
+    std::vector<Vector3f> wo, wi;
+    std::vector<Point2f> u;
+};
+
+static const Directions &RandomDirections() {
+    static const Directions directions = []() {
+        RNG rng(4);
+        Directions d;
+
+        for (int i = 0; i < 1024; ++i) {
+            d.wo.push_back(CosineSampleHemisphere(
+                {rng.UniformFloat(), rng.UniformFloat()}));
+            d.wi.push_back(CosineSampleHemisphere(
+                {rng.UniformFloat(), rng.UniformFloat()}));
+            d.u.emplace_back(rng.UniformFloat(), rng.UniformFloat());
+        }
+
+        return d;
+    }();
+
+    return directions;
+}
+
+static void F(State &state, const BxDF &bxdf) {
+    const Directions &d = RandomDirections();
+    size_t i = 0;
+
+    while (state.KeepRunning()) {
+        DoNotOptimize(bxdf.f(d.wo[i], d.wi[i]));
+        i = (i + 1) % d.wo.size();
+    }
+}
+
+static void SampleF(State &state, const BxDF &bxdf) {
+    const Directions &d = RandomDirections();
+    size_t i = 0;
+
+    while (state.KeepRunning()) {
+        Vector3f wi;
+        Float pdf;
+        DoNotOptimize(bxdf.Sample_f(d.wo[i], &wi, d.u[i], &pdf));
+        DoNotOptimize(pdf);
+        i = (i + 1) % d.wo.size();
+    }
+}
+
+static const Spectrum R(0.5f);
+
+BENCHMARK(BxDF_f_Lambertian) { F(state, LambertianReflection(R)); }
+BENCHMARK(BxDF_Sample_f_Lambertian) {
+    SampleF(state, LambertianReflection(R));
+}
+
+BENCHMARK(BxDF_f_OrenNayar) { F(state, OrenNayar(R, 20)); }
+BENCHMARK(BxDF_Sample_f_OrenNayar) { SampleF(state, OrenNayar(R, 20)); }
+
+BENCHMARK(BxDF_f_TrowbridgeReitz) {
+    TrowbridgeReitzDistribution distribution(0.3f, 0.3f);
+    FresnelDielectric fresnel(1.f, 1.5f);
+    F(state, MicrofacetReflection(R, &distribution, &fresnel));
+}
+
+BENCHMARK(BxDF_Sample_f_TrowbridgeReitz) {
+    TrowbridgeReitzDistribution distribution(0.3f, 0.3f);
+    FresnelDielectric fresnel(1.f, 1.5f);
+    SampleF(state, MicrofacetReflection(R, &distribution, &fresnel));
+}
+
+BENCHMARK(BxDF_f_Beckmann) {
+    BeckmannDistribution distribution(0.3f, 0.3f);
+    FresnelDielectric fresnel(1.f, 1.5f);
+    F(state, MicrofacetReflection(R, &distribution, &fresnel));
+}
+
+BENCHMARK(BxDF_Sample_f_Beckmann) {
+    BeckmannDistribution distribution(0.3f, 0.3f);
+    FresnelDielectric fresnel(1.f, 1.5f);
+    SampleF(state, MicrofacetReflection(R, &distribution, &fresnel));
+}
@@ -0,0 +1,65 @@
+#include "bench/bench.h"
+#include "samplers/halton.h"
+#include "samplers/maxmin.h"
+#include "samplers/random.h"
+#include "samplers/sobol.h"
+#include "samplers/stratified.h"
+#include "samplers/zerotwosequence.h"
+
+using namespace pbrt;
+using namespace pbrt::bench;
+
+static const int SamplesPerPixel = 16;
+static const int Dimensions = 8;
+static const Bounds2i SampleBounds{Point2i(0, 0), Point2i(64, 64)};
+
+/* One op is one Get2D(). Each sample takes Dimensions of them, as a path
+ * with a few bounces would; moving to the next sample and pixel is part of
+ * the cost, spread over the ops. */
+static void Get2D(State &state, Sampler &sampler) {
+    Point2i pixel(0, 0);
+    sampler.StartPixel(pixel);
+    int dimension = 0;
+
+    while (state.KeepRunning()) {
+        DoNotOptimize(sampler.Get2D());
+
+        if (++dimension < Dimensions) continue;
+        dimension = 0;
+
+        if (!sampler.StartNextSample()) {
+            pixel.x = (pixel.x + 1) % SampleBounds.pMax.x;
+            sampler.StartPixel(pixel);
+        }
+    }
+}
+
+BENCHMARK(Sampler_Get2D_Halton) {
+    HaltonSampler sampler(SamplesPerPixel, SampleBounds);
+    Get2D(state, sampler);
+}
+
+BENCHMARK(Sampler_Get2D_MaxMinDist) {
+    MaxMinDistSampler sampler(SamplesPerPixel, Dimensions);
+    Get2D(state, sampler);
+}
+
+BENCHMARK(Sampler_Get2D_Random) {
+    RandomSampler sampler(SamplesPerPixel);
+    Get2D(state, sampler);
+}
+
+BENCHMARK(Sampler_Get2D_Sobol) {
+    SobolSampler sampler(SamplesPerPixel, SampleBounds);
+    Get2D(state, sampler);
+}
+
+BENCHMARK(Sampler_Get2D_Stratified) {
+    StratifiedSampler sampler(4, 4, true, Dimensions);
+    Get2D(state, sampler);
+}
+
+BENCHMARK(Sampler_Get2D_ZeroTwoSequence) {
+    ZeroTwoSequenceSampler sampler(SamplesPerPixel, Dimensions);
+    Get2D(state, sampler);
+}
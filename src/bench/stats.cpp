@@ -0,0 +1,35 @@
+#include <chrono>
+
+#include "bench/bench.h"
+#include "stats.h"
+
+using namespace pbrt;
+using namespace pbrt::bench;
+
+/* One op is entering and leaving a phase. With tracing off, this is what
+ * every ProfilePhase in the renderer pays for the trace support. */
+BENCHMARK(ProfilePhase_TracingOff) {
+    while (state.KeepRunning()) {
+        ProfilePhase _(Prof::TriIntersect);
+    }
+}
+
+/* A phase inside another one of the same category doesn't record anything */
+BENCHMARK(ProfilePhase_Nested) {
+    ProfilePhase outer(Prof::TriIntersect);
+
+    while (state.KeepRunning()) {
+        ProfilePhase _(Prof::TriIntersect);
+    }
+}
+
+/* Every phase goes into the ring buffer of the thread */
+BENCHMARK(ProfilePhase_TracingOn) {
+    InitTrace(std::chrono::nanoseconds(0), 1 << 16);
+
+    while (state.KeepRunning()) {
+        ProfilePhase _(Prof::TriIntersect);
+    }
+
+    CleanupTrace();
+}
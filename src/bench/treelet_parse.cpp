@@ -0,0 +1,96 @@
+#include <google/protobuf/arena.h>
+
+#include <sstream>
+#include <string>
+
+#include "bench/bench.h"
+#include "messages/serialization.h"
+
+using namespace std;
+using namespace pbrt;
+using namespace pbrt::bench;
+
+/* 20k BVHNode records, shaped like those of a dumped treelet: half of them
+ * leaves with four triangles, and an instance every 17 nodes */
+static const string &TreeletRecords() {
+    static const string records = [] {
+        ostringstream os;
+        protobuf::RecordWriter writer{&os};
+
+        for (int i = 0; i < 20000; i++) {
+            protobuf::BVHNode node;
+            node.mutable_bounds()->mutable_point_min()->set_x(i);
+            node.mutable_bounds()->mutable_point_max()->set_y(i);
+            node.set_axis(i % 3);
+
+            if (i % 2) {
+                for (int t = 0; t < 4; t++) {
+                    auto *triangle = node.add_triangles();
+                    triangle->set_mesh_id(1);
+                    triangle->set_tri_number(4 * i + t);
+                }
+            } else {
+                node.set_left_ref(i);
+            }
+
+            if (i % 17 == 0) {
+                auto *instance = node.add_transformed_primitives();
+                instance->set_root_ref(i);
+                auto *transform = instance->mutable_transform();
+                transform->mutable_start_transform()->add_m(1);
+                transform->mutable_end_transform()->add_m(1);
+            }
+
+            writer.write(node);
+        }
+
+        return os.str();
+    }();
+
+    return records;
+}
+
+/* One op parses all the records; this is how treelets were loaded before
+ * they were parsed into an arena */
+BENCHMARK(Treelet_ParseFreshMessages) {
+    const string &records = TreeletRecords();
+
+    while (state.KeepRunning()) {
+        protobuf::RecordReader reader{records.data(), records.size()};
+        size_t triangles = 0;
+
+        while (!reader.eof()) {
+            protobuf::BVHNode node;
+            reader.read(&node);
+            triangles += node.triangles_size();
+        }
+
+        DoNotOptimize(triangles);
+    }
+}
+
+/* The same, parsing every record into one message allocated from an arena
+ * set up like CloudBVH's, which is reset after each treelet */
+BENCHMARK(Treelet_ParseArenaMessage) {
+    const string &records = TreeletRecords();
+
+    google::protobuf::ArenaOptions options;
+    options.start_block_size = 64 * 1024;
+    options.max_block_size = 4 * 1024 * 1024;
+    google::protobuf::Arena arena{options};
+
+    while (state.KeepRunning()) {
+        protobuf::RecordReader reader{records.data(), records.size()};
+        auto *node =
+            google::protobuf::Arena::CreateMessage<protobuf::BVHNode>(&arena);
+        size_t triangles = 0;
+
+        while (!reader.eof()) {
+            reader.read(node);
+            triangles += node->triangles_size();
+        }
+
+        DoNotOptimize(triangles);
+        arena.Reset();
+    }
+}
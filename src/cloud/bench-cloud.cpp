@@ -0,0 +1,402 @@
+#include <lz4.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "accelerators/cloud.h"
+#include "api.h"
+#include "cloud/manager.h"
+#include "cloud/scheduler.h"
+#include "cloud/tools.h"
+#include "pbrt/main.h"
+#include "pbrt/raystate.h"
+#include "messages/serialization.h"
+#include "util/exception.h"
+#include "util/path.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace pbrt;
+
+/* Runs the stages of the cloud pipeline on one scene, one after the other
+ * and on one thread, and prints what each of them took as JSON. The
+ * samplers are seeded by pixel and sample number, so the same scene and
+ * options always trace the same rays. */
+
+void usage(const char *argv0, const char *msg = nullptr) {
+    if (msg) cerr << argv0 << ": " << msg << endl << endl;
+
+    cerr << "Usage: " << argv0 << " [OPTIONS] SCENE" << endl << R"(
+SCENE is either a .pbrt file, which is dumped first, or a dumped scene.
+
+  --work-dir <dir>   Where to dump the scene and write the camera rays
+                     (default: SCENE.bench)
+  --spp <n>          Samples per pixel, instead of the scene's
+  --max-depth <n>    Maximum path depth (default: 5)
+  --output <file>    Write the results there instead of to stdout
+)";
+
+    exit(msg ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/* peak resident set size of the process so far, in bytes */
+uint64_t peakRSS() {
+    rusage usage;
+    CheckSystemCall("getrusage", getrusage(RUSAGE_SELF, &usage));
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+}
+
+/* resident set size of the process right now, in bytes */
+uint64_t currentRSS() {
+    ifstream statm{"/proc/self/statm"};
+    uint64_t size = 0;
+    uint64_t resident = 0;
+
+    if (!(statm >> size >> resident)) {
+        throw runtime_error("could not read /proc/self/statm");
+    }
+
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+uint64_t directorySize(const string &path) {
+    uint64_t size = 0;
+    for (const string &name : roost::list_directory(path)) {
+        if (name == "." || name == "..") continue;
+        const string child = path + "/" + name;
+        size += roost::is_directory(child) ? directorySize(child)
+                                           : roost::file_size(child);
+    }
+
+    return size;
+}
+
+/* A stage's results, as they appear in the output. Stages that didn't run
+ * aren't printed. The resident set size is taken when the stage starts and
+ * ends; a stage that runs interleaved with another has its memory counted
+ * with that one, and prints none. Memory that an earlier stage freed is
+ * reused first, so a stage can grow by less than it allocates. */
+struct Stage {
+    string name;
+    double seconds{0};
+    uint64_t rssBefore{0};
+    uint64_t rssAfter{0};
+    vector<pair<string, double>> metrics{};
+
+    steady_clock::time_point begin() {
+        rssBefore = currentRSS();
+        return steady_clock::now();
+    }
+
+    void finish(const steady_clock::time_point start) {
+        seconds = duration<double>(steady_clock::now() - start).count();
+        rssAfter = currentRSS();
+    }
+
+    void add(const string &metric, const double value) {
+        metrics.emplace_back(metric, value);
+    }
+
+    /* value / seconds, or 0 when the stage took no measurable time */
+    void addRate(const string &metric, const double value,
+                 const double over) {
+        add(metric, over > 0 ? value / over : 0);
+    }
+};
+
+Stage dumpScene(const string &scenePath, const string &dumpDir) {
+    Stage stage{"dump"};
+
+    if (roost::exists(dumpDir)) {
+        roost::remove_directory(dumpDir);
+    }
+
+    const auto start = stage.begin();
+    DumpScene(scenePath, dumpDir, 1);
+    stage.finish(start);
+
+    stage.add("bytes", directorySize(dumpDir));
+    return stage;
+}
+
+Stage generateRays(const scene::Base &base, const string &raysPath,
+                   const int maxDepth) {
+    Stage stage{"genrays"};
+    auto sampler = base.sampler;
+    uint64_t rayCount = 0;
+    uint64_t rayBytes = 0;
+    vector<char> rayBuffer(LZ4_COMPRESSBOUND(RayState::MaxPackedSize) + 4);
+
+    const auto start = stage.begin();
+
+    {
+        protobuf::AsyncRecordWriter rayWriter{raysPath};
+
+        for (int sample = 0; sample < base.samplesPerPixel; sample++) {
+            for (const Point2i pixel : base.sampleBounds) {
+                RayStatePtr ray = graphics::GenerateCameraRay(
+                    base.camera, pixel, sample, maxDepth, base.sampleExtent,
+                    sampler);
+
+                const auto len = ray->Serialize(rayBuffer.data());
+                rayWriter.write(rayBuffer.data() + 4, len - 4);
+                rayCount++;
+                rayBytes += len - 4;
+            }
+        }
+    }
+
+    stage.finish(start);
+    stage.add("rays", rayCount);
+    stage.addRate("rays_per_sec", rayCount, stage.seconds);
+    stage.addRate("bytes_per_ray", rayBytes, rayCount);
+    return stage;
+}
+
+Stage loadTreelets(vector<unique_ptr<CloudBVH>> &treelets) {
+    Stage stage{"load"};
+    uint64_t bytes = 0;
+
+    const auto start = stage.begin();
+
+    for (size_t i = 0; i < treelets.size(); i++) {
+        treelets[i] = make_unique<CloudBVH>(i);
+        treelets[i]->LoadTreelet(i);
+        bytes += global::manager.getObjectSize(ObjectType::Treelet, i);
+    }
+
+    stage.finish(start);
+    stage.add("treelets", treelets.size());
+    stage.add("bytes", bytes);
+    stage.addRate("mb_per_sec", bytes / 1e6, stage.seconds);
+    return stage;
+}
+
+int main(int argc, char const *argv[]) {
+    try {
+        if (argc <= 0) {
+            abort();
+        }
+
+        string scenePath;
+        string workDir;
+        string outputPath;
+        int samplesPerPixel = 0;
+        int maxDepth = 5;
+
+        auto onArgument = [&](const string &arg) {
+            if (!scenePath.empty()) usage(argv[0], "too many arguments");
+            scenePath = arg;
+        };
+
+        auto onOption = [&](const string &arg, const string &value) {
+            if (arg == "--work-dir") {
+                workDir = value;
+            } else if (arg == "--spp") {
+                samplesPerPixel = stoi(value);
+            } else if (arg == "--max-depth") {
+                maxDepth = stoi(value);
+            } else if (arg == "--output") {
+                outputPath = value;
+            } else {
+                return false;
+            }
+
+            return true;
+        };
+
+        ParseToolArguments(argc, argv, usage, onArgument, onOption);
+
+        if (scenePath.empty()) usage(argv[0], "missing SCENE");
+        if (maxDepth < 1 || samplesPerPixel < 0) {
+            usage(argv[0], "invalid option value");
+        }
+
+        if (workDir.empty()) {
+            workDir = scenePath + ".bench";
+        }
+
+        roost::create_directories(workDir);
+
+        vector<Stage> stages;
+        string dumpDir = scenePath;
+
+        if (!roost::is_directory(scenePath)) {
+            dumpDir = workDir + "/scene";
+            stages.push_back(dumpScene(scenePath, dumpDir));
+        }
+
+        /* CloudBVH requires this */
+        PbrtOptions.nThreads = 1;
+
+        scene::Base base = scene::LoadBase(dumpDir, samplesPerPixel);
+
+        const string raysPath = workDir + "/rays";
+        stages.push_back(generateRays(base, raysPath, maxDepth));
+
+        vector<unique_ptr<CloudBVH>> treelets(global::manager.treeletCount());
+        stages.push_back(loadTreelets(treelets));
+
+        /* tracing and shading the recorded rays, as a worker that holds
+         * every treelet would; the rays that move to another treelet are
+         * the ones a distributed worker would have to send */
+        Stage trace{"trace"};
+        Stage shade{"shade"};
+        Stage accumulate{"accumulate"};
+
+        /* shading happens inside the tracing loop, so the memory of both
+         * is counted under trace */
+        trace.rssBefore = currentRSS();
+
+        {
+            RayScheduler rayList;
+            vector<Sample> samples;
+            MemoryArena arena;
+            vector<char> rayBuffer(LZ4_COMPRESSBOUND(RayState::MaxPackedSize) +
+                                   4);
+
+            steady_clock::duration traceTime{0};
+            steady_clock::duration shadeTime{0};
+            uint64_t traceCount = 0;
+            uint64_t shadeCount = 0;
+            uint64_t forwardedCount = 0;
+            uint64_t forwardedBytes = 0;
+
+            {
+                protobuf::RecordReader reader{MMap_Region{raysPath}};
+                Chunk rayData{nullptr, 0};
+
+                while (!reader.eof()) {
+                    if (reader.read(&rayData)) {
+                        auto ray = RayState::Create();
+                        ray->Deserialize(
+                            reinterpret_cast<const char *>(rayData.buffer()),
+                            rayData.size());
+                        rayList.Push(move(ray));
+                    }
+                }
+            }
+
+            auto enqueue = [&](RayStatePtr &&ray, const TreeletId from) {
+                if (ray->CurrentTreelet() != from) {
+                    forwardedCount++;
+                    forwardedBytes += ray->Serialize(rayBuffer.data()) - 4;
+                }
+
+                rayList.Push(move(ray));
+            };
+
+            while (!rayList.Empty()) {
+                RayStatePtr rayPtr = rayList.Pop();
+                const TreeletId treeletId = rayPtr->CurrentTreelet();
+                const CloudBVH &treelet = *treelets[treeletId];
+
+                if (!rayPtr->toVisitEmpty()) {
+                    const auto start = steady_clock::now();
+                    auto newRayPtr = graphics::TraceRay(move(rayPtr), treelet);
+                    traceTime += steady_clock::now() - start;
+                    traceCount++;
+
+                    auto &newRay = *newRayPtr;
+                    const bool hit = newRay.HasHit();
+                    const bool emptyVisit = newRay.toVisitEmpty();
+
+                    if (newRay.IsShadowRay()) {
+                        if (hit || emptyVisit) {
+                            newRay.Ld = hit ? 0.f : newRay.Ld;
+                            samples.emplace_back(newRay);
+                        } else {
+                            enqueue(move(newRayPtr), treeletId);
+                        }
+                    } else if (!emptyVisit || hit) {
+                        enqueue(move(newRayPtr), treeletId);
+                    } else {
+                        newRay.Ld = 0.f;
+                        samples.emplace_back(newRay);
+                    }
+                } else if (rayPtr->HasHit()) {
+                    RayStatePtr bounceRay, shadowRay;
+
+                    const auto start = steady_clock::now();
+                    tie(bounceRay, shadowRay) = graphics::ShadeRay(
+                        move(rayPtr), treelet, base.lights, base.sampleExtent,
+                        base.sampler, maxDepth, arena);
+                    shadeTime += steady_clock::now() - start;
+                    shadeCount++;
+
+                    if (bounceRay) enqueue(move(bounceRay), treeletId);
+                    if (shadowRay) enqueue(move(shadowRay), treeletId);
+                }
+            }
+
+            trace.seconds = duration<double>(traceTime).count();
+            trace.rssAfter = currentRSS();
+            trace.add("rays", traceCount);
+            trace.addRate("rays_per_sec", traceCount, trace.seconds);
+            trace.add("forwarded_rays", forwardedCount);
+            trace.addRate("bytes_per_ray", forwardedBytes, forwardedCount);
+
+            shade.seconds = duration<double>(shadeTime).count();
+            shade.add("rays", shadeCount);
+            shade.addRate("rays_per_sec", shadeCount, shade.seconds);
+
+            const auto start = accumulate.begin();
+            graphics::AccumulateImage(base.camera, samples);
+            accumulate.finish(start);
+            accumulate.add("samples", samples.size());
+            accumulate.addRate("samples_per_sec", samples.size(),
+                               accumulate.seconds);
+        }
+
+        stages.push_back(move(trace));
+        stages.push_back(move(shade));
+        stages.push_back(move(accumulate));
+
+        ofstream outputFile;
+        if (!outputPath.empty()) {
+            outputFile.open(outputPath, ios::out | ios::trunc);
+            if (!outputFile.good()) {
+                throw runtime_error("could not open " + outputPath);
+            }
+        }
+
+        ostream &out = outputPath.empty() ? cout : outputFile;
+        out << setprecision(10) << "{\"scene\":\"" << scenePath
+            << "\",\"spp\":" << base.samplesPerPixel
+            << ",\"max_depth\":" << maxDepth
+            << ",\"treelets\":" << treelets.size()
+            << ",\"peak_rss_bytes\":" << peakRSS() << ",\"stages\":{";
+
+        for (size_t i = 0; i < stages.size(); i++) {
+            const Stage &stage = stages[i];
+            out << (i ? "," : "") << '"' << stage.name
+                << "\":{\"seconds\":" << stage.seconds;
+
+            if (stage.rssAfter) {
+                out << ",\"rss_before_bytes\":" << stage.rssBefore
+                    << ",\"rss_after_bytes\":" << stage.rssAfter;
+            }
+
+            for (const auto &metric : stage.metrics) {
+                out << ",\"" << metric.first << "\":" << metric.second;
+            }
+
+            out << "}";
+        }
+
+        out << "}}" << endl;
+    } catch (const exception &e) {
+        print_exception(argv[0], e);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,369 @@
+#include "checkpoint.h"
+
+#include <lz4.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <set>
+#include <sstream>
+
+#include "cloud/scheduler.h"
+#include "core/film.h"
+#include "util/exception.h"
+#include "util/path.h"
+
+using namespace std;
+
+namespace pbrt {
+
+STAT_COUNTER("Checkpoint/Checkpoints taken", nCheckpoints);
+STAT_COUNTER("Checkpoint/Checkpoints skipped (writer busy)",
+             nCheckpointsSkipped);
+STAT_MEMORY_COUNTER("Checkpoint/State copied", checkpointBytes);
+
+static string FileName(const string &prefix, const uint64_t epoch) {
+    return prefix + "." + to_string(epoch);
+}
+
+static void WriteFile(const string &directory, const string &name,
+                      const string &contents) {
+    roost::atomic_create(contents, roost::path(directory) / name);
+}
+
+static bool ReadCheckpointInfo(const string &directory,
+                               protobuf::Checkpoint &info) {
+    const roost::path latest = roost::path(directory) / "LATEST";
+    if (!roost::exists(latest)) return false;
+
+    const uint64_t epoch = stoull(roost::read_file(latest));
+    protobuf::RecordReader reader{
+        (roost::path(directory) / FileName("CHECKPOINT", epoch)).string()};
+
+    if (reader.eof() || !reader.read(&info) || info.epoch() != epoch) {
+        throw runtime_error("corrupt checkpoint " + to_string(epoch) +
+                            " in " + directory);
+    }
+
+    return true;
+}
+
+CheckpointWriter::CheckpointWriter(const string &directory,
+                                   const uint64_t fullFilmEvery)
+    : directory(directory), fullFilmEvery(max<uint64_t>(fullFilmEvery, 1)) {
+    roost::create_directories(directory);
+
+    /* continue the numbering of an earlier run; the first checkpoint always
+       carries the whole film, so the old chain can go once it's written */
+    if (ReadCheckpointInfo(directory, previous)) {
+        epoch = previous.epoch();
+    }
+
+    sinceFullFilm = this->fullFilmEvery;
+    writer = thread(&CheckpointWriter::WriterThread, this);
+}
+
+CheckpointWriter::~CheckpointWriter() {
+    {
+        unique_lock<mutex> lock{jobMutex};
+        jobDone.wait(lock, [this] { return pending == nullptr; });
+        exiting = true;
+    }
+
+    jobReady.notify_all();
+    writer.join();
+}
+
+bool CheckpointWriter::Checkpoint(const State &state) {
+    {
+        unique_lock<mutex> lock{jobMutex};
+
+        if (error) {
+            rethrow_exception(error);
+        }
+
+        if (pending) {
+            ++nCheckpointsSkipped;
+            return false;
+        }
+    }
+
+    auto job = make_unique<Job>();
+    const uint64_t e = ++epoch;
+    job->info.set_epoch(e);
+    job->info.set_next_sample(state.nextSample);
+
+    if (state.rays) {
+        /* the spill files stay on disk while the job holds them, even if the
+           scheduler reads them back in the meantime */
+        state.rays->Snapshot(job->rays, job->spillFiles);
+        job->info.add_ray_files(FileName("RAYS", e));
+
+        for (size_t i = 0; i < job->spillFiles.size(); i++) {
+            job->info.add_ray_files(FileName("RAYS", e) + "." + to_string(i));
+        }
+    }
+
+    if (state.samples) {
+        vector<Sample> &samples = *state.samples;
+
+        /* the samples only ever grow, unless the caller started over */
+        if (samples.size() < samplesSaved) {
+            samplesSaved = 0;
+            sampleChain.clear();
+        }
+
+        job->samples.resize(samples.size() - samplesSaved);
+        for (size_t i = 0; i < job->samples.size(); i++) {
+            const Sample &sample = samples[samplesSaved + i];
+            job->samples[i].sampleId = sample.sampleId;
+            job->samples[i].pFilm = sample.pFilm;
+            job->samples[i].weight = sample.weight;
+            job->samples[i].L = sample.L;
+        }
+
+        samplesSaved = samples.size();
+        sampleChain.push_back(FileName("SAMPLES", e));
+
+        for (const string &name : sampleChain) {
+            job->info.add_sample_files(name);
+        }
+    }
+
+    if (state.film) {
+        const bool full = (sinceFullFilm >= fullFilmEvery);
+        state.film->SnapshotRows(!full, &job->filmRows, &job->filmValues);
+
+        if (full) {
+            filmChain.clear();
+            sinceFullFilm = 0;
+        }
+
+        filmChain.push_back(FileName("FILM", e));
+        sinceFullFilm++;
+
+        for (const string &name : filmChain) {
+            job->info.add_film_files(name);
+        }
+    }
+
+    ++nCheckpoints;
+    checkpointBytes += job->rays.size() * sizeof(RayState) +
+                       job->samples.size() * sizeof(Sample) +
+                       job->filmValues.size() * sizeof(Float);
+
+    {
+        unique_lock<mutex> lock{jobMutex};
+        pending = move(job);
+    }
+
+    jobReady.notify_one();
+    return true;
+}
+
+void CheckpointWriter::Wait() {
+    unique_lock<mutex> lock{jobMutex};
+    jobDone.wait(lock, [this] { return pending == nullptr; });
+
+    if (error) {
+        rethrow_exception(error);
+    }
+}
+
+void CheckpointWriter::WriterThread() {
+    unique_lock<mutex> lock{jobMutex};
+
+    while (true) {
+        jobReady.wait(lock, [this] { return pending != nullptr || exiting; });
+        if (exiting) return;
+
+        lock.unlock();
+
+        try {
+            Write(*pending);
+        } catch (const exception &) {
+            lock.lock();
+            error = current_exception();
+            pending.reset();
+            jobDone.notify_all();
+            continue;
+        }
+
+        lock.lock();
+        pending.reset();
+        jobDone.notify_all();
+    }
+}
+
+void CheckpointWriter::Write(Job &job) {
+    const uint64_t e = job.info.epoch();
+
+    if (job.info.ray_files_size() > 0) {
+        vector<char> rayBuffer(LZ4_COMPRESSBOUND(RayState::MaxPackedSize) + 4);
+
+        string rays;
+        for (size_t i = 0; i < job.rays.size(); i++) {
+            rays.append(rayBuffer.data(),
+                        job.rays.Serialize(i, rayBuffer.data()));
+        }
+
+        WriteFile(directory, FileName("RAYS", e), rays);
+
+        /* spilled rays are immutable, so a link is enough */
+        for (size_t i = 0; i < job.spillFiles.size(); i++) {
+            const string src = job.spillFiles[i]->name();
+            const string dst = (roost::path(directory) /
+                                (FileName("RAYS", e) + "." + to_string(i)))
+                                   .string();
+
+            if (link(src.c_str(), dst.c_str()) != 0) {
+                if (errno != EXDEV) {
+                    throw unix_error("link " + src);
+                }
+
+                roost::copy_then_rename(src, dst);
+            }
+        }
+    }
+
+    if (job.info.sample_files_size() > 0) {
+        static thread_local char
+            sampleBuffer[LZ4_COMPRESSBOUND(sizeof(Sample)) + 4];
+
+        string samples;
+        for (Sample &sample : job.samples) {
+            samples.append(sampleBuffer, sample.Serialize(sampleBuffer));
+        }
+
+        WriteFile(directory, FileName("SAMPLES", e), samples);
+    }
+
+    if (job.info.film_files_size() > 0) {
+        ostringstream film;
+
+        {
+            protobuf::RecordWriter writer{&film};
+            const size_t rowSize = job.filmRows.empty()
+                                       ? 0
+                                       : job.filmValues.size() /
+                                             job.filmRows.size();
+
+            for (size_t i = 0; i < job.filmRows.size(); i++) {
+                writer.write(static_cast<uint32_t>(job.filmRows[i]));
+                writer.write(reinterpret_cast<const char *>(
+                                 job.filmValues.data() + i * rowSize),
+                             rowSize * sizeof(Float));
+            }
+        }
+
+        WriteFile(directory, FileName("FILM", e), film.str());
+    }
+
+    ostringstream info;
+
+    {
+        protobuf::RecordWriter writer{&info};
+        writer.write(job.info);
+    }
+
+    WriteFile(directory, FileName("CHECKPOINT", e), info.str());
+
+    /* the checkpoint is complete only once LATEST points to it */
+    WriteFile(directory, "LATEST", to_string(e));
+
+    /* drop whatever the new checkpoint doesn't refer to */
+    set<string> keep;
+    keep.insert(job.info.sample_files().begin(),
+                job.info.sample_files().end());
+    keep.insert(job.info.film_files().begin(), job.info.film_files().end());
+
+    auto cleanup =
+        [&](const google::protobuf::RepeatedPtrField<string> &files) {
+            for (const string &name : files) {
+                if (!keep.count(name)) {
+                    roost::remove(roost::path(directory) / name);
+                }
+            }
+        };
+
+    if (previous.epoch() != 0 && previous.epoch() != e) {
+        cleanup(previous.ray_files());
+        cleanup(previous.sample_files());
+        cleanup(previous.film_files());
+        roost::remove(roost::path(directory) /
+                      FileName("CHECKPOINT", previous.epoch()));
+    }
+
+    previous = job.info;
+}
+
+bool RestoreCheckpoint(const string &directory, protobuf::Checkpoint &info,
+                       RayScheduler *rays, vector<Sample> *samples,
+                       Film *film) {
+    if (!ReadCheckpointInfo(directory, info)) {
+        return false;
+    }
+
+    auto open = [&directory](const string &name) {
+        return make_unique<protobuf::RecordReader>(
+            MMap_Region{(roost::path(directory) / name).string()});
+    };
+
+    string record;
+    Chunk chunk{nullptr, 0};
+
+    auto chunkData = [&chunk] {
+        return reinterpret_cast<const char *>(chunk.buffer());
+    };
+
+    if (rays) {
+        for (const string &name : info.ray_files()) {
+            auto reader = open(name);
+            while (!reader->eof()) {
+                if (reader->read(&chunk)) {
+                    RayStatePtr ray = RayState::Create();
+                    ray->Deserialize(chunkData(), chunk.size());
+                    rays->Push(move(ray));
+                }
+            }
+        }
+    }
+
+    if (samples) {
+        for (const string &name : info.sample_files()) {
+            auto reader = open(name);
+            while (!reader->eof()) {
+                if (reader->read(&chunk)) {
+                    samples->emplace_back();
+                    samples->back().Deserialize(chunkData(), chunk.size());
+                }
+            }
+        }
+    }
+
+    if (film) {
+        /* later files in the chain overwrite the rows of earlier ones */
+        for (const string &name : info.film_files()) {
+            auto reader = open(name);
+            vector<int> rows;
+            vector<Float> values;
+
+            while (!reader->eof()) {
+                uint32_t row;
+                if (!reader->read(&row) || !reader->read(&record)) {
+                    throw runtime_error("corrupt film checkpoint " + name);
+                }
+
+                rows.push_back(row);
+                const Float *v = reinterpret_cast<const Float *>(record.data());
+                values.insert(values.end(), v,
+                              v + record.length() / sizeof(Float));
+            }
+
+            film->RestoreRows(rows, values);
+        }
+    }
+
+    return true;
+}
+
+}  // namespace pbrt
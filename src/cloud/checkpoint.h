@@ -0,0 +1,107 @@
+#ifndef PBRT_CLOUD_CHECKPOINT_H
+#define PBRT_CLOUD_CHECKPOINT_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core/pbrt.h"
+#include "messages/serialization.h"
+#include "pbrt/raystate.h"
+#include "util/temp_file.h"
+
+namespace pbrt {
+
+class Film;
+class RayScheduler;
+
+/* CheckpointWriter periodically saves the in-flight state of a render into a
+ * directory: the queued rays, the finished samples that were not yet
+ * accumulated, the film, and how far camera-ray generation has got.
+ *
+ * Taking a checkpoint only copies that state in memory: the resident rays
+ * into a RayBatch, the samples finished since the previous checkpoint and
+ * the film rows that changed. A background thread serializes them, links
+ * the spill files and writes the rest, so tracing carries on while it does.
+ * Samples and film are incremental: a checkpoint lists the files of the
+ * earlier ones it builds on, and the film gets a full copy every
+ * `fullFilmEvery` checkpoints.
+ *
+ * Layout of the directory, for checkpoint `e`:
+ *   RAYS.e, RAYS.e.i   queued rays, in the ray file format
+ *   SAMPLES.e          samples finished since the previous checkpoint
+ *   FILM.e             (row, pixels) record pairs
+ *   CHECKPOINT.e       protobuf::Checkpoint listing the files above
+ *   LATEST             the number of the last complete checkpoint */
+class CheckpointWriter {
+  public:
+    struct State {
+        uint64_t nextSample{0};
+        const RayScheduler *rays{nullptr};
+        std::vector<Sample> *samples{nullptr};
+        Film *film{nullptr};
+    };
+
+    CheckpointWriter(const std::string &directory,
+                     const uint64_t fullFilmEvery = 8);
+    ~CheckpointWriter();
+
+    CheckpointWriter(const CheckpointWriter &) = delete;
+    CheckpointWriter &operator=(const CheckpointWriter &) = delete;
+
+    /* returns false, and does nothing, while the previous checkpoint is
+     * still being written */
+    bool Checkpoint(const State &state);
+
+    /* blocks until the pending checkpoint is on disk */
+    void Wait();
+
+    uint64_t LastEpoch() const { return epoch; }
+
+  private:
+    struct Job {
+        protobuf::Checkpoint info{};
+        RayBatch rays{};
+        std::vector<std::shared_ptr<TempFile>> spillFiles{};
+        std::vector<Sample> samples{};
+        std::vector<int> filmRows{};
+        std::vector<Float> filmValues{};
+    };
+
+    void WriterThread();
+    void Write(Job &job);
+
+    const std::string directory;
+    const uint64_t fullFilmEvery;
+
+    uint64_t epoch{0};
+    uint64_t sinceFullFilm{0};
+    std::vector<std::string> filmChain{};
+    size_t samplesSaved{0};
+    std::vector<std::string> sampleChain{};
+    protobuf::Checkpoint previous{};
+
+    std::mutex jobMutex{};
+    std::condition_variable jobReady{};
+    std::condition_variable jobDone{};
+    std::unique_ptr<Job> pending{};
+    bool exiting{false};
+    std::exception_ptr error{};
+
+    std::thread writer;
+};
+
+/* Loads the last complete checkpoint in `directory`. Rays are pushed into
+ * `rays`, finished samples appended to `samples` and the film rows restored;
+ * any of them may be null. Returns false if there is no checkpoint. */
+bool RestoreCheckpoint(const std::string &directory,
+                       protobuf::Checkpoint &info, RayScheduler *rays,
+                       std::vector<Sample> *samples, Film *film);
+
+}  // namespace pbrt
+
+#endif /* PBRT_CLOUD_CHECKPOINT_H */
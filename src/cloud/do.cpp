@@ -1,12 +1,16 @@
+#include <unistd.h>
+
 #include <iostream>
-#include <queue>
 #include <string>
 #include <vector>
 
 #include "accelerators/cloud.h"
 #include "cloud/manager.h"
+#include "cloud/scheduler.h"
 #include "pbrt/main.h"
 #include "pbrt/raystate.h"
+#include "pbrt/replication.h"
+#include "pbrt/telemetry.h"
 #include "messages/serialization.h"
 #include "messages/utils.h"
 #include "util/exception.h"
@@ -15,7 +19,7 @@ using namespace std;
 using namespace pbrt;
 
 void usage(const char *argv0) {
-    cerr << argv0 << " SCENE-DATA CAMERA-RAYS" << endl;
+    cerr << argv0 << " SCENE-DATA CAMERA-RAYS [MAX-RESIDENT-RAYS [TREELET-STATS]]" << endl;
 }
 
 vector<shared_ptr<Light>> loadLights() {
@@ -60,7 +64,7 @@ int main(int argc, char const *argv[]) {
             abort();
         }
 
-        if (argc != 3) {
+        if (argc < 3 || argc > 5) {
             usage(argv[0]);
             return EXIT_FAILURE;
         }
@@ -70,29 +74,38 @@ int main(int argc, char const *argv[]) {
 
         const string scenePath{argv[1]};
         const string raysPath{argv[2]};
+        const size_t maxResidentRays =
+            (argc >= 4) ? stoull(argv[3]) : 1'000'000;
+        const string treeletStatsPath{(argc == 5) ? argv[4] : ""};
 
         global::manager.init(scenePath);
 
-        queue<RayStatePtr> rayList;
+        RayScheduler rayList{maxResidentRays};
+        TreeletLoadMonitor loadMonitor{global::manager.treeletCount()};
         vector<Sample> samples;
 
-        /* loading all the rays */
+        auto enqueue = [&rayList, &loadMonitor](RayStatePtr &&ray) {
+            loadMonitor.RecordArrival(ray->CurrentTreelet());
+            rayList.Push(move(ray));
+        };
+
+        /* loading all the rays; the file is a single bag */
         {
-            protobuf::RecordReader reader{raysPath};
-            while (!reader.eof()) {
-                string rayStr;
-
-                if (reader.read(&rayStr)) {
-                    auto rayStatePtr = RayState::Create();
-                    rayStatePtr->Deserialize(rayStr.data(), rayStr.length());
-                    rayList.push(move(rayStatePtr));
-                }
+            RayBatch batch;
+            {
+                MMap_Region rays{raysPath};
+                batch.Unpack(rays.addr(), rays.length());
+            }
+
+            for (size_t i = 0; i < batch.size(); i++) {
+                enqueue(batch.Get(i));
             }
         }
 
-        cerr << rayList.size() << " RayState(s) loaded." << endl;
+        cerr << rayList.Size() << " RayState(s) loaded." << endl;
+        rayList.PrintGauges(cerr);
 
-        if (!rayList.size()) {
+        if (rayList.Empty()) {
             return EXIT_SUCCESS;
         }
 
@@ -119,12 +132,20 @@ int main(int argc, char const *argv[]) {
         const auto sampleExtent = camera->film->GetSampleBounds().Diagonal();
         const int maxDepth = 5;
 
-        while (!rayList.empty()) {
-            RayStatePtr theRayPtr = move(rayList.front());
+        unique_ptr<TreeletStatsExporter> treeletStats;
+        if (!treeletStatsPath.empty()) {
+            treeletStats =
+                make_unique<TreeletStatsExporter>(treeletStatsPath, getpid());
+        }
+
+        while (!rayList.Empty()) {
+            if (treeletStats) treeletStats->MaybeExport();
+
+            RayStatePtr theRayPtr = rayList.Pop();
             RayState &theRay = *theRayPtr;
-            rayList.pop();
 
             const TreeletId rayTreeletId = theRay.CurrentTreelet();
+            const auto serviceStart = TreeletLoadMonitor::Clock::now();
 
             if (!theRay.toVisitEmpty()) {
                 auto newRayPtr = graphics::TraceRay(move(theRayPtr),
@@ -139,10 +160,10 @@ int main(int argc, char const *argv[]) {
                         newRay.Ld = hit ? 0.f : newRay.Ld;
                         samples.emplace_back(*newRayPtr);
                     } else {
-                        rayList.push(move(newRayPtr));
+                        enqueue(move(newRayPtr));
                     }
                 } else if (!emptyVisit || hit) {
-                    rayList.push(move(newRayPtr));
+                    enqueue(move(newRayPtr));
                 } else if (emptyVisit) {
                     newRay.Ld = 0.f;
                     samples.emplace_back(*newRayPtr);
@@ -154,15 +175,21 @@ int main(int argc, char const *argv[]) {
                                        lights, sampleExtent, sampler, maxDepth, arena);
 
                 if (bounceRay != nullptr) {
-                    rayList.push(move(bounceRay));
+                    enqueue(move(bounceRay));
                 }
 
                 if (shadowRay != nullptr) {
-                    rayList.push(move(shadowRay));
+                    enqueue(move(shadowRay));
                 }
             }
+
+            loadMonitor.RecordService(
+                rayTreeletId, TreeletLoadMonitor::Clock::now() - serviceStart);
         }
 
+        loadMonitor.PrintSummary(cerr);
+        treeletStats.reset();
+
         graphics::AccumulateImage(camera, samples);
         camera->film->WriteImage();
     } catch (const exception &e) {
@@ -0,0 +1,373 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "accelerators/proxy.h"
+#include "api.h"
+#include "cloud/extract.h"
+#include "fileutil.h"
+#include "geometry.h"
+#include "parser.h"
+#include "pbrt.h"
+#include "util/exception.h"
+#include "util/path.h"
+#include "util/util.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace pbrt;
+
+/* An instance or a chunk that extract-instances split off the scene. It is
+ * dumped on its own into PROXY-DIR/name, once all the proxies it refers to
+ * have been dumped. */
+struct Shard {
+    string name;
+    string input;
+    set<string> dependencies{};
+
+    bool started{false};
+    bool done{false};
+    steady_clock::time_point start{};
+};
+
+void usage(const char *argv0) {
+    cerr << argv0 << " PBRT-BIN IN-SCENE OUT-DIR [JOBS]" << endl;
+}
+
+/* the proxies a shard refers to, from the "Proxy" statements written by
+ * ExtractScene() */
+set<string> proxyReferences(const string &path) {
+    set<string> result;
+    ifstream fin{path};
+    string line;
+
+    while (getline(fin, line)) {
+        if (line.compare(0, 6, "Proxy ") != 0) continue;
+
+        const size_t begin = line.find('"');
+        const size_t end = line.find('"', begin + 1);
+        if (begin == string::npos || end == string::npos) {
+            throw runtime_error("malformed proxy statement in " + path);
+        }
+
+        result.insert(line.substr(begin + 1, end - begin - 1));
+    }
+
+    return result;
+}
+
+/* the dependencies recorded in a proxy's HEADER, the same way CreateProxy()
+ * reads them */
+vector<string> headerDependencies(const string &path) {
+    ifstream header{path, ios::binary};
+    if (!header.good()) {
+        throw runtime_error("could not open " + path);
+    }
+
+    header.seekg(sizeof(Bounds3f) + 2 * sizeof(uint64_t));
+    uint64_t numDependencies = 0;
+    header.read(reinterpret_cast<char *>(&numDependencies), sizeof(uint64_t));
+
+    vector<string> result;
+    for (uint64_t i = 0; i < numDependencies; i++) {
+        uint64_t numChars = 0;
+        header.read(reinterpret_cast<char *>(&numChars), sizeof(uint64_t));
+        string name(numChars, '\0');
+        header.read(&name[0], numChars);
+        result.push_back(move(name));
+    }
+
+    if (!header.good()) {
+        throw runtime_error("truncated header " + path);
+    }
+
+    return result;
+}
+
+void extractScene(const string &inScene, const string &outDir) {
+    const string masterFilename = outDir + "/master.pbrt";
+    const string partialFilename = masterFilename + ".partial";
+
+    /* the shards are only complete once the master file is */
+    for (const string dir : {"/instances", "/chunks"}) {
+        if (roost::exists(outDir + dir)) {
+            roost::remove_directory(outDir + dir);
+        }
+
+        roost::create_directories(outDir + dir);
+    }
+
+    {
+        ofstream masterFile{partialFilename};
+
+        SetSearchDirectory(DirectoryContaining(inScene));
+        auto tokError = [](const char *msg) {
+            Error("%s", msg);
+            exit(EXIT_FAILURE);
+        };
+
+        auto t = Tokenizer::CreateFromFile(inScene, tokError);
+        if (!t) {
+            throw runtime_error("could not read " + inScene);
+        }
+
+        ExtractScene(move(t), masterFile, outDir + "/instances",
+                     outDir + "/chunks", true, true, false);
+
+        if (!masterFile.good()) {
+            throw runtime_error("could not write " + partialFilename);
+        }
+    }
+
+    roost::rename(partialFilename, masterFilename);
+}
+
+vector<Shard> loadShards(const string &outDir) {
+    vector<Shard> shards;
+
+    for (const string dir : {"/instances", "/chunks"}) {
+        for (const string &file : roost::list_directory(outDir + dir)) {
+            const string ext = ".pbrt";
+            if (file.size() <= ext.size() ||
+                file.compare(file.size() - ext.size(), ext.size(), ext)) {
+                continue;
+            }
+
+            Shard shard;
+            shard.name = file.substr(0, file.size() - ext.size());
+            shard.input = outDir + dir + "/" + file;
+            shard.dependencies = proxyReferences(shard.input);
+            shards.push_back(move(shard));
+        }
+    }
+
+    return shards;
+}
+
+pid_t launch(const string &pbrtBin, const Shard &shard,
+             const string &proxyDir) {
+    const string target = proxyDir + "/" + shard.name + ".partial";
+    const string logPath = proxyDir + "/" + shard.name + ".log";
+
+    /* left over from an interrupted run */
+    if (roost::exists(target)) {
+        roost::remove_directory(target);
+    }
+
+    roost::create_directories(target);
+
+    const vector<string> args = {pbrtBin,      "--nthreads=1",
+                                 "--nomaterial", "--proxydir",
+                                 proxyDir,     "--dumpscene",
+                                 target,       shard.input};
+
+    vector<char *> argv;
+    for (const string &arg : args) {
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    const pid_t pid = CheckSystemCall("fork", fork());
+
+    if (pid == 0) {
+        const int fd = open(logPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                            S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+        if (fd < 0 || dup2(fd, STDOUT_FILENO) < 0 ||
+            dup2(fd, STDERR_FILENO) < 0) {
+            _exit(EXIT_FAILURE);
+        }
+
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+
+    return pid;
+}
+
+/* Takes down the dumps still in flight, so a failed run does not leave them
+ * writing into PROXY-DIR behind our back. */
+void stopAll(const map<pid_t, size_t> &running) {
+    for (const auto &kv : running) {
+        kill(kv.first, SIGTERM);
+    }
+
+    for (const auto &kv : running) {
+        int status = 0;
+        while (waitpid(kv.first, &status, 0) < 0 && errno == EINTR) {
+        }
+    }
+}
+
+int main(int argc, char const *argv[]) {
+    try {
+        if (argc <= 0) {
+            abort();
+        }
+
+        if (argc != 4 && argc != 5) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        const string pbrtBin = roost::canonical(argv[1]).string();
+        const string inScene{argv[2]};
+        const string outDir{argv[3]};
+        const size_t jobs = (argc == 5) ? stoul(argv[4])
+                                        : max(1u, thread::hardware_concurrency());
+        const string proxyDir = outDir + "/proxies";
+
+        roost::create_directories(outDir);
+        roost::create_directories(proxyDir);
+
+        /* it would go stale as the shards get dumped */
+        if (roost::exists(ProxyIndex::Path(proxyDir))) {
+            roost::remove(ProxyIndex::Path(proxyDir));
+        }
+
+        /* a finished extraction is reused, so an interrupted run can be
+         * picked up where it stopped */
+        if (!roost::exists(outDir + "/master.pbrt")) {
+            Options options;
+            options.nThreads = 1;
+            pbrtInit(options);
+
+            const auto start = steady_clock::now();
+            extractScene(inScene, outDir);
+            cerr << "Extracted the scene in "
+                 << duration_cast<milliseconds>(steady_clock::now() - start)
+                        .count()
+                 << " ms" << endl;
+        }
+
+        vector<Shard> shards = loadShards(outDir);
+        map<string, size_t> shardByName;
+        for (size_t i = 0; i < shards.size(); i++) {
+            shardByName.emplace(shards[i].name, i);
+        }
+
+        size_t doneCount = 0;
+        for (Shard &shard : shards) {
+            for (const string &dep : shard.dependencies) {
+                if (!shardByName.count(dep)) {
+                    throw runtime_error(shard.name + " refers to unknown proxy " +
+                                        dep);
+                }
+            }
+
+            if (roost::exists(proxyDir + "/" + shard.name + "/HEADER")) {
+                shard.started = shard.done = true;
+                doneCount++;
+            }
+        }
+
+        cerr << "Dumping " << (shards.size() - doneCount) << " of "
+             << shards.size() << " " << pluralize("shard", shards.size())
+             << " with " << jobs << " " << pluralize("job", jobs) << endl;
+
+        const auto start = steady_clock::now();
+        map<pid_t, size_t> running;
+
+        try {
+            while (doneCount < shards.size()) {
+                for (size_t i = 0; i < shards.size() && running.size() < jobs;
+                     i++) {
+                    Shard &shard = shards[i];
+                    if (shard.started) continue;
+
+                    bool ready = true;
+                    for (const string &dep : shard.dependencies) {
+                        ready = ready && shards[shardByName.at(dep)].done;
+                    }
+
+                    if (!ready) continue;
+
+                    shard.started = true;
+                    shard.start = steady_clock::now();
+                    running.emplace(launch(pbrtBin, shard, proxyDir), i);
+                }
+
+                if (running.empty()) {
+                    throw runtime_error(
+                        "proxies depend on each other in a cycle");
+                }
+
+                int status = 0;
+                const pid_t pid =
+                    CheckSystemCall("waitpid", waitpid(-1, &status, 0));
+
+                auto it = running.find(pid);
+                if (it == running.end()) continue;
+
+                Shard &shard = shards[it->second];
+                running.erase(it);
+
+                const string target = proxyDir + "/" + shard.name;
+                if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                    throw runtime_error("dumping " + shard.name +
+                                        " failed, see " + target + ".log");
+                }
+
+                if (!roost::exists(target + ".partial/HEADER")) {
+                    throw runtime_error(shard.name +
+                                        " has no HEADER; the accelerator "
+                                        "needs \"writeheader\"");
+                }
+
+                /* HEADERs also list the dependencies of dependencies; all of
+                 * them had to be there for the dump to load them */
+                for (const string &dep :
+                     headerDependencies(target + ".partial/HEADER")) {
+                    auto depIt = shardByName.find(dep);
+                    if (depIt == shardByName.end() ||
+                        !shards[depIt->second].done) {
+                        throw runtime_error(shard.name +
+                                            " was dumped before " + dep);
+                    }
+                }
+
+                if (roost::exists(target)) {
+                    roost::remove_directory(target);
+                }
+
+                roost::rename(target + ".partial", target);
+                shard.done = true;
+                doneCount++;
+
+                cerr << "[" << doneCount << "/" << shards.size() << "] "
+                     << shard.name << " ("
+                     << duration_cast<milliseconds>(steady_clock::now() -
+                                                    shard.start)
+                            .count()
+                     << " ms)" << endl;
+            }
+        } catch (...) {
+            stopAll(running);
+            throw;
+        }
+
+        ProxyIndex::Write(proxyDir);
+
+        cerr << "Dumped all shards in "
+             << duration_cast<milliseconds>(steady_clock::now() - start)
+                    .count()
+             << " ms; dump " << outDir << "/master.pbrt with --proxydir "
+             << proxyDir << endl;
+    } catch (const exception &e) {
+        print_exception(argv[0], e);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
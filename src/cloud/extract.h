@@ -0,0 +1,24 @@
+#ifndef PBRT_CLOUD_EXTRACT_H
+#define PBRT_CLOUD_EXTRACT_H
+
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include "parser.h"
+
+namespace pbrt {
+
+/* Streams a scene through the parser and splits it up: every ObjectBegin
+ * block goes to its own file in instancesDir, and with levelChunk every
+ * top-level Include goes to a file in chunksDir. What's left, with "Proxy"
+ * statements in place of the parts that were split off, is written to
+ * masterFile. pbrtInit() has to be called first. */
+void ExtractScene(std::unique_ptr<Tokenizer> t, std::ofstream &masterFile,
+                  const std::string &instancesDir,
+                  const std::string &chunksDir, bool extractInstances,
+                  bool levelChunk, bool binChunk);
+
+}  // namespace pbrt
+
+#endif /* PBRT_CLOUD_EXTRACT_H */
@@ -0,0 +1,597 @@
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "cloud/tools.h"
+#include "geometry.h"
+#include "imageio.h"
+#include "parallel.h"
+#include "pbrt.h"
+#include "rng.h"
+#include "shapes/triangle.h"
+#include "util/exception.h"
+#include "util/path.h"
+#include "util/util.h"
+
+using namespace std;
+using namespace pbrt;
+
+/* Generates synthetic scenes of a given size and shape, so that the
+ * partitioner, the dumper and the workers can be stressed with the same
+ * inputs from run to run. The output for a set of options and a seed is
+ * always the same. */
+
+enum class Distribution { Uniform, Clustered, Walls };
+
+struct GenOptions {
+    uint64_t triangles{1'000'000};
+    uint64_t meshTriangles{100'000};
+    uint64_t instances{0};
+    int depth{1};
+    int materials{1};
+    int textureSize{0};
+    Distribution distribution{Distribution::Uniform};
+    uint64_t seed{0};
+    int resolution{512};
+    string accelerator{"treeletdumpbvh"};
+    int maxTreeletBytes{10'000'000};
+    string dumpDir{};
+};
+
+/* all the geometry lives in [-WORLD_SIZE, WORLD_SIZE]^3 */
+constexpr Float WORLD_SIZE = 100;
+
+void usage(const char *argv0, const char *msg = nullptr) {
+    if (msg) cerr << argv0 << ": " << msg << endl << endl;
+
+    cerr << "Usage: " << argv0 << " [OPTIONS] OUT-DIR" << endl << R"(
+Writes OUT-DIR/scene.pbrt, with its meshes as binary PLY files in
+OUT-DIR/meshes and its textures in OUT-DIR/textures.
+
+  --triangles <n>       Distinct triangles in the scene (default: 1000000)
+  --mesh-triangles <n>  Triangles per mesh (default: 100000)
+  --instances <n>       Place the meshes as <n> object instances; with 0,
+                        every mesh is placed once as a shape (default: 0)
+  --depth <n>           Levels of groups the placements are nested in
+                        (default: 1)
+  --materials <n>       Number of materials, given to the meshes in turn
+                        (default: 1)
+  --texture-size <n>    Give each material an <n>x<n> image texture; with
+                        0, materials have constant colors (default: 0)
+  --distribution <d>    uniform, clustered or walls, which adds occluding
+                        walls to a uniform placement (default: uniform)
+  --seed <n>            Seed for the generator (default: 0)
+  --resolution <n>      Width and height of the image (default: 512)
+  --accelerator <a>     treeletdumpbvh, which the dump needs, or bvh, for
+                        rendering the scene locally (default: treeletdumpbvh)
+  --max-treelet-bytes <n>
+                        maxtreeletbytes of the dump accelerator
+                        (default: 10000000)
+  --dump <dir>          Also dump the scene's treelets into <dir>; needs the
+                        treeletdumpbvh accelerator
+)";
+
+    exit(msg ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/* the latitudes and longitudes of a sphere with about `triangles`
+ * triangles; it has 2 * segments * (rings - 1) of them */
+void sphereTessellation(uint64_t triangles, int *rings, int *segments) {
+    *rings = max<int>(2, sqrt(triangles / 4.0) + 1);
+    *segments = max<int>(3, triangles / (2 * (*rings - 1)));
+}
+
+uint64_t sphereTriangles(uint64_t triangles) {
+    int rings, segments;
+    sphereTessellation(triangles, &rings, &segments);
+    return 2 * static_cast<uint64_t>(segments) * (rings - 1);
+}
+
+/* A unit sphere whose radius is perturbed by a few waves. Every mesh gets
+ * its own waves. */
+void writeMesh(const string &path, uint64_t triangles, RNG &rng) {
+    int rings, segments;
+    sphereTessellation(triangles, &rings, &segments);
+
+    const Float freqTheta = 1 + rng.UniformUInt32(8);
+    const Float freqPhi = 1 + rng.UniformUInt32(8);
+    const Float amplitude = 0.05 + 0.2 * rng.UniformFloat();
+
+    auto radius = [&](Float theta, Float phi) {
+        return 1 + amplitude * sin(freqTheta * theta) * cos(freqPhi * phi);
+    };
+
+    /* the poles, then a ring of vertices for each latitude in between */
+    vector<Point3f> P;
+    vector<Point2f> uv;
+    P.emplace_back(0, 0, radius(0, 0));
+    uv.emplace_back(0, 0);
+    P.emplace_back(0, 0, -radius(Pi, 0));
+    uv.emplace_back(0, 1);
+
+    for (int i = 1; i < rings; i++) {
+        const Float theta = Pi * i / rings;
+        for (int j = 0; j < segments; j++) {
+            const Float phi = 2 * Pi * j / segments;
+            const Float r = radius(theta, phi);
+            P.emplace_back(r * sin(theta) * cos(phi), r * sin(theta) * sin(phi),
+                           r * cos(theta));
+            uv.emplace_back(Float(j) / segments, Float(i) / rings);
+        }
+    }
+
+    auto vertex = [segments](int ring, int segment) {
+        return 2 + (ring - 1) * segments + (segment % segments);
+    };
+
+    vector<int> indices;
+    indices.reserve(6 * segments * (rings - 1));
+
+    for (int j = 0; j < segments; j++) {
+        indices.insert(indices.end(), {0, vertex(1, j), vertex(1, j + 1)});
+        indices.insert(indices.end(),
+                       {1, vertex(rings - 1, j + 1), vertex(rings - 1, j)});
+    }
+
+    for (int i = 1; i < rings - 1; i++) {
+        for (int j = 0; j < segments; j++) {
+            indices.insert(indices.end(), {vertex(i, j), vertex(i + 1, j),
+                                           vertex(i + 1, j + 1)});
+            indices.insert(indices.end(), {vertex(i, j), vertex(i + 1, j + 1),
+                                           vertex(i, j + 1)});
+        }
+    }
+
+    if (!WritePlyFile(path, indices.size() / 3, indices.data(), P.size(),
+                      P.data(), nullptr, nullptr, uv.data(), nullptr)) {
+        throw runtime_error("could not write " + path);
+    }
+}
+
+/* a checkerboard of two random colors, darkened towards one corner */
+void writeTexture(const string &path, int size, RNG &rng) {
+    Float colors[2][3];
+    for (auto &color : colors) {
+        for (Float &c : color) c = 0.1 + 0.8 * rng.UniformFloat();
+    }
+
+    const int checks = 8;
+    vector<Float> rgb(3 * size * size);
+
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            const int check = (x * checks / size + y * checks / size) % 2;
+            const Float shade = 1 - 0.5 * Float(x + y) / (2 * size);
+            for (int c = 0; c < 3; c++) {
+                rgb[3 * (y * size + x) + c] = shade * colors[check][c];
+            }
+        }
+    }
+
+    WriteImage(path, rgb.data(), Bounds2i{{0, 0}, {size, size}},
+               {size, size});
+}
+
+class SceneWriter {
+  public:
+    SceneWriter(const GenOptions &options, ostream &out,
+                const vector<uint64_t> &meshTriangles)
+        : options_(options), out_(out), meshTriangles_(meshTriangles),
+          meshCount_(meshTriangles.size()), rng_(options.seed) {}
+
+    void writeHeader();
+    void writeMaterials();
+    void writeObjects();
+    void writeWalls();
+
+    /* places `count` meshes or instances, spread over `depth` levels of
+     * groups, and returns how many triangles that puts in the scene */
+    uint64_t writePlacements(uint64_t count);
+
+  private:
+    void writeMeshShape(uint64_t mesh, int indent);
+    void writeGroup(uint64_t count, int levelsLeft, int indent);
+    void writeTransform(const Vector3f &position, Float scale, int indent);
+    Vector3f topLevelPosition();
+
+    const GenOptions &options_;
+    ostream &out_;
+    const vector<uint64_t> &meshTriangles_;
+    const uint64_t meshCount_;
+    RNG rng_;
+
+    vector<Vector3f> clusters_{};
+    uint64_t placed_{0};
+    uint64_t triangles_{0};
+};
+
+void SceneWriter::writeHeader() {
+    const Float d = WORLD_SIZE;
+
+    out_ << "LookAt 0 " << -3 * d << " " << d << "  0 0 0  0 0 1" << endl
+         << "Camera \"perspective\" \"float fov\" [45]" << endl
+         << "Film \"image\" \"integer xresolution\" [" << options_.resolution
+         << "] \"integer yresolution\" [" << options_.resolution << "]"
+         << endl
+         << "    \"string filename\" \"scene.png\"" << endl
+         << "Sampler \"halton\" \"integer pixelsamples\" [1]" << endl
+         << "Integrator \"path\" \"integer maxdepth\" [5]" << endl
+         << "Accelerator \"" << options_.accelerator << "\"";
+
+    if (options_.accelerator == "treeletdumpbvh") {
+        out_ << " \"integer maxtreeletbytes\" [" << options_.maxTreeletBytes
+             << "]";
+    }
+
+    out_ << endl
+         << endl
+         << "WorldBegin" << endl
+         << endl
+         << "LightSource \"distant\" \"point from\" [" << d << " " << -2 * d
+         << " " << 3 * d << "] \"blackbody L\" [5500 3]" << endl
+         << "LightSource \"infinite\" \"rgb L\" [.2 .2 .25]" << endl
+         << endl;
+}
+
+void SceneWriter::writeMaterials() {
+    for (int i = 0; i < options_.materials; i++) {
+        const string name = "material_" + to_string(i);
+        string kd;
+
+        if (options_.textureSize > 0) {
+            out_ << "Texture \"texture_" << i
+                 << "\" \"spectrum\" \"imagemap\" \"string filename\" "
+                 << "\"textures/" << name << ".png\"" << endl;
+            kd = "\"texture Kd\" \"texture_" + to_string(i) + "\"";
+        } else {
+            kd = "\"rgb Kd\" [" + to_string(0.1 + 0.8 * rng_.UniformFloat()) +
+                 " " + to_string(0.1 + 0.8 * rng_.UniformFloat()) + " " +
+                 to_string(0.1 + 0.8 * rng_.UniformFloat()) + "]";
+        }
+
+        out_ << "MakeNamedMaterial \"" << name << "\" \"string type\" \""
+             << ((i % 2) ? "plastic" : "matte") << "\" " << kd << endl;
+    }
+
+    out_ << endl;
+}
+
+void SceneWriter::writeMeshShape(uint64_t mesh, int indent) {
+    out_ << setw(indent) << "" << "NamedMaterial \"material_"
+         << (mesh % options_.materials) << "\"" << endl
+         << setw(indent) << "" << "Shape \"plymesh\" \"string filename\" "
+         << "\"meshes/mesh_" << mesh << ".ply\"" << endl;
+}
+
+void SceneWriter::writeObjects() {
+    for (uint64_t i = 0; i < meshCount_; i++) {
+        out_ << "ObjectBegin \"mesh_" << i << "\"" << endl;
+        writeMeshShape(i, 4);
+        out_ << "ObjectEnd" << endl;
+    }
+
+    out_ << endl;
+}
+
+/* Rows of walls across the view, each with a hole in a random place, so
+ * that most rays are stopped early and only some see what's behind. */
+void SceneWriter::writeWalls() {
+    const int wallCount = max<int>(2, cbrt(options_.instances
+                                               ? options_.instances
+                                               : meshCount_) / 2);
+    const Float d = WORLD_SIZE;
+    const Float hole = d / 2;
+
+    out_ << "AttributeBegin" << endl
+         << "Material \"matte\" \"rgb Kd\" [.5 .5 .5]" << endl;
+
+    for (int i = 0; i < wallCount; i++) {
+        const Float y = -d + 2 * d * (i + 0.5) / wallCount;
+        const Float hx = -d + (2 * d - hole) * rng_.UniformFloat();
+        const Float hz = -d + (2 * d - hole) * rng_.UniformFloat();
+
+        /* the wall around the hole, as four rectangles */
+        const Float rects[4][4] = {{-d, -d, d, hz},
+                                   {-d, hz + hole, d, d},
+                                   {-d, hz, hx, hz + hole},
+                                   {hx + hole, hz, d, hz + hole}};
+
+        out_ << "Shape \"trianglemesh\" \"integer indices\" [";
+        for (int r = 0; r < 4; r++) {
+            const int b = 4 * r;
+            out_ << " " << b << " " << b + 1 << " " << b + 2 << " " << b
+                 << " " << b + 2 << " " << b + 3;
+        }
+
+        out_ << " ]" << endl << "    \"point P\" [";
+        for (const auto &rect : rects) {
+            out_ << " " << rect[0] << " " << y << " " << rect[1] << "  "
+                 << rect[2] << " " << y << " " << rect[1] << "  " << rect[2]
+                 << " " << y << " " << rect[3] << "  " << rect[0] << " " << y
+                 << " " << rect[3];
+        }
+
+        out_ << " ]" << endl;
+        triangles_ += 8;
+    }
+
+    out_ << "AttributeEnd" << endl << endl;
+}
+
+/* where a top-level group or placement goes, in [-1, 1]^3 */
+Vector3f SceneWriter::topLevelPosition() {
+    auto uniform = [this]() {
+        return Vector3f(2 * rng_.UniformFloat() - 1,
+                        2 * rng_.UniformFloat() - 1,
+                        2 * rng_.UniformFloat() - 1);
+    };
+
+    if (options_.distribution != Distribution::Clustered) {
+        return uniform();
+    }
+
+    const Vector3f &center = clusters_[rng_.UniformUInt32(clusters_.size())];
+    const Float sigma = 0.08;
+    Vector3f offset;
+
+    for (int i = 0; i < 3; i++) {
+        /* Box-Muller */
+        const Float u1 = max<Float>(rng_.UniformFloat(), 1e-7);
+        const Float u2 = rng_.UniformFloat();
+        offset[i] = sigma * sqrt(-2 * log(u1)) * cos(2 * Pi * u2);
+    }
+
+    const Vector3f p = center + offset;
+    return Vector3f(Clamp(p.x, -1, 1), Clamp(p.y, -1, 1), Clamp(p.z, -1, 1));
+}
+
+void SceneWriter::writeTransform(const Vector3f &position, Float scale,
+                                 int indent) {
+    const Vector3f axis = Normalize(Vector3f(rng_.UniformFloat() - 0.5,
+                                             rng_.UniformFloat() - 0.5,
+                                             rng_.UniformFloat() - 0.5) +
+                                    Vector3f(0, 0, 1e-3));
+
+    out_ << setw(indent) << "" << "Translate " << position.x << " "
+         << position.y << " " << position.z << endl
+         << setw(indent) << "" << "Rotate " << 360 * rng_.UniformFloat()
+         << " " << axis.x << " " << axis.y << " " << axis.z << endl
+         << setw(indent) << "" << "Scale " << scale << " " << scale << " "
+         << scale << endl;
+}
+
+/* Each group puts its children in its own [-1, 1]^3, scaled down so that
+ * they roughly fill it without overlapping much. pbrt doesn't allow object
+ * instances inside other objects, so the levels are made of nested
+ * transforms around the instances rather than of nested objects. */
+void SceneWriter::writeGroup(uint64_t count, int levelsLeft, int indent) {
+    const bool topLevel = (indent == 4);
+    const uint64_t children =
+        (levelsLeft == 1)
+            ? count
+            : min<uint64_t>(count, ceil(pow(count, 1.0 / levelsLeft)));
+    const Float childScale = 1 / max<Float>(1, cbrt(children));
+
+    for (uint64_t i = 0; i < children; i++) {
+        const Vector3f position =
+            topLevel ? topLevelPosition()
+                     : Vector3f(2 * rng_.UniformFloat() - 1,
+                                2 * rng_.UniformFloat() - 1,
+                                2 * rng_.UniformFloat() - 1);
+        const Float scale = childScale * (0.5 + 0.5 * rng_.UniformFloat());
+
+        out_ << setw(indent) << "" << "AttributeBegin" << endl;
+        writeTransform(position, scale, indent + 2);
+
+        if (levelsLeft == 1) {
+            const uint64_t mesh = placed_++ % meshCount_;
+            if (options_.instances) {
+                out_ << setw(indent + 2) << "" << "ObjectInstance \"mesh_"
+                     << mesh << "\"" << endl;
+            } else {
+                writeMeshShape(mesh, indent + 2);
+            }
+
+            triangles_ += meshTriangles_[mesh];
+        } else {
+            const uint64_t share =
+                count / children + (i < count % children ? 1 : 0);
+            writeGroup(share, levelsLeft - 1, indent + 2);
+        }
+
+        out_ << setw(indent) << "" << "AttributeEnd" << endl;
+    }
+}
+
+uint64_t SceneWriter::writePlacements(uint64_t count) {
+    if (options_.distribution == Distribution::Clustered) {
+        const size_t clusterCount = max<size_t>(1, round(cbrt(count)));
+        for (size_t i = 0; i < clusterCount; i++) {
+            clusters_.emplace_back(1.6 * rng_.UniformFloat() - 0.8,
+                                   1.6 * rng_.UniformFloat() - 0.8,
+                                   1.6 * rng_.UniformFloat() - 0.8);
+        }
+    }
+
+    out_ << "AttributeBegin" << endl
+         << "  Scale " << WORLD_SIZE << " " << WORLD_SIZE << " " << WORLD_SIZE
+         << endl;
+    writeGroup(count, options_.depth, 4);
+    out_ << "AttributeEnd" << endl << endl;
+
+    return triangles_;
+}
+
+void writeScene(const GenOptions &options, const string &outDir) {
+    const uint64_t meshCount =
+        (options.triangles + options.meshTriangles - 1) / options.meshTriangles;
+
+    /* the last mesh gets what's left */
+    vector<uint64_t> meshTriangles(meshCount);
+    for (uint64_t i = 0; i < meshCount; i++) {
+        meshTriangles[i] = sphereTriangles(min(
+            options.meshTriangles, options.triangles - i * options.meshTriangles));
+    }
+
+    roost::create_directories(outDir + "/meshes");
+    if (options.textureSize > 0) {
+        roost::create_directories(outDir + "/textures");
+    }
+
+    /* every mesh and texture has its own sequence, so they come out the
+     * same however the work is split between threads */
+    ParallelFor(
+        [&](int64_t i) {
+            RNG rng{options.seed ^ (static_cast<uint64_t>(i + 1) << 32)};
+            writeMesh(outDir + "/meshes/mesh_" + to_string(i) + ".ply",
+                      min(options.meshTriangles,
+                          options.triangles - i * options.meshTriangles),
+                      rng);
+        },
+        meshCount);
+
+    if (options.textureSize > 0) {
+        ParallelFor(
+            [&](int64_t i) {
+                RNG rng{options.seed ^ (static_cast<uint64_t>(i + 1) << 48)};
+                writeTexture(outDir + "/textures/material_" + to_string(i) +
+                                 ".png",
+                             options.textureSize, rng);
+            },
+            options.materials);
+    }
+
+    const string scenePath = outDir + "/scene.pbrt";
+    const string partialPath = scenePath + ".partial";
+    uint64_t triangles = 0;
+
+    {
+        ofstream out{partialPath};
+        SceneWriter writer{options, out, meshTriangles};
+
+        writer.writeHeader();
+        writer.writeMaterials();
+
+        if (options.instances) {
+            writer.writeObjects();
+        }
+
+        if (options.distribution == Distribution::Walls) {
+            writer.writeWalls();
+        }
+
+        triangles = writer.writePlacements(
+            options.instances ? options.instances : meshCount);
+        out << "WorldEnd" << endl;
+
+        if (!out.good()) {
+            throw runtime_error("could not write " + partialPath);
+        }
+    }
+
+    roost::rename(partialPath, scenePath);
+
+    const uint64_t distinct =
+        accumulate(meshTriangles.begin(), meshTriangles.end(), uint64_t{0});
+
+    cerr << "Wrote " << scenePath << ": " << meshCount
+         << (meshCount == 1 ? " mesh" : " meshes") << " with " << distinct
+         << " " << pluralize("triangle", distinct) << ", " << triangles
+         << " " << pluralize("triangle", triangles) << " in the scene"
+         << endl;
+}
+
+int main(int argc, char const *argv[]) {
+    try {
+        if (argc <= 0) {
+            abort();
+        }
+
+        GenOptions options;
+        string outDir;
+
+        auto onArgument = [&](const string &arg) {
+            if (!outDir.empty()) usage(argv[0], "too many arguments");
+            outDir = arg;
+        };
+
+        auto onOption = [&](const string &arg, const string &value) {
+            if (arg == "--triangles") {
+                options.triangles = stoull(value);
+            } else if (arg == "--mesh-triangles") {
+                options.meshTriangles = stoull(value);
+            } else if (arg == "--instances") {
+                options.instances = stoull(value);
+            } else if (arg == "--depth") {
+                options.depth = stoi(value);
+            } else if (arg == "--materials") {
+                options.materials = stoi(value);
+            } else if (arg == "--texture-size") {
+                options.textureSize = stoi(value);
+            } else if (arg == "--distribution") {
+                if (value == "uniform") {
+                    options.distribution = Distribution::Uniform;
+                } else if (value == "clustered") {
+                    options.distribution = Distribution::Clustered;
+                } else if (value == "walls") {
+                    options.distribution = Distribution::Walls;
+                } else {
+                    usage(argv[0], ("unknown distribution " + value).c_str());
+                }
+            } else if (arg == "--seed") {
+                options.seed = stoull(value);
+            } else if (arg == "--resolution") {
+                options.resolution = stoi(value);
+            } else if (arg == "--accelerator") {
+                if (value != "treeletdumpbvh" && value != "bvh") {
+                    usage(argv[0], ("unknown accelerator " + value).c_str());
+                }
+                options.accelerator = value;
+            } else if (arg == "--max-treelet-bytes") {
+                options.maxTreeletBytes = stoi(value);
+            } else if (arg == "--dump") {
+                options.dumpDir = value;
+            } else {
+                return false;
+            }
+
+            return true;
+        };
+
+        ParseToolArguments(argc, argv, usage, onArgument, onOption);
+
+        if (outDir.empty()) usage(argv[0], "missing OUT-DIR");
+        if (options.triangles < 8 || options.meshTriangles < 8) {
+            usage(argv[0], "meshes need at least 8 triangles");
+        }
+        if (options.depth < 1 || options.materials < 1 ||
+            options.textureSize < 0 || options.resolution < 1) {
+            usage(argv[0], "invalid option value");
+        }
+        if (!options.dumpDir.empty() &&
+            options.accelerator != "treeletdumpbvh") {
+            usage(argv[0], "--dump needs the treeletdumpbvh accelerator");
+        }
+
+        PbrtOptions.nThreads = 0;
+        ParallelInit();
+        writeScene(options, outDir);
+        ParallelCleanup();
+
+        if (!options.dumpDir.empty()) {
+            DumpScene(outDir + "/scene.pbrt", options.dumpDir, 0);
+            cerr << "Dumped the scene into " << options.dumpDir << endl;
+        }
+    } catch (const exception &e) {
+        print_exception(argv[0], e);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
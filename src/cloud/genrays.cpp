@@ -1,3 +1,5 @@
+#include <lz4.h>
+
 #include <iostream>
 #include <memory>
 #include <string>
@@ -8,6 +10,7 @@
 #include "core/camera.h"
 #include "core/geometry.h"
 #include "core/transform.h"
+#include "messages/serialization.h"
 #include "messages/utils.h"
 #include "util/exception.h"
 
@@ -57,12 +60,15 @@ int main(int argc, char const *argv[]) {
         const uint8_t maxDepth = 5;
         const float rayScale = 1 / sqrt((Float)sampler->samplesPerPixel);
 
-        protobuf::RecordWriter rayWriter{outputPath};
+        /* camera rays are cheap to make, so writing them out on this
+           thread would make I/O the bottleneck */
+        protobuf::AsyncRecordWriter rayWriter{outputPath};
 
         /* Generate all the samples */
         size_t sampleCount = 0;
 
-        char rayBuffer[sizeof(RayState)];
+        vector<char> rayBuffer(LZ4_COMPRESSBOUND(RayState::MaxPackedSize) +
+                               4);
 
         for (size_t sample = 0; sample < sampler->samplesPerPixel; sample++) {
             for (Point2i pixel : sampleBounds) {
@@ -72,11 +78,13 @@ int main(int argc, char const *argv[]) {
                 RayStatePtr statePtr = graphics::GenerateCameraRay(
                     camera, pixel, sample, maxDepth, sampleExtent, sampler);
 
-                const auto len = statePtr->Serialize(rayBuffer);
-                rayWriter.write(rayBuffer + 4, len - 4);
+                const auto len = statePtr->Serialize(rayBuffer.data());
+                rayWriter.write(rayBuffer.data() + 4, len - 4);
             }
         }
 
+        rayWriter.close();
+
         cerr << sampleCount << " sample(s) were generated and written to "
              << outputPath << endl;
     } catch (const exception &e) {
@@ -88,7 +88,7 @@ void AccumulatedStats::Merge(const AccumulatedStats &other) {
 
 namespace scene {
 
-string GetObjectName(const ObjectType type, const uint32_t id) {
+string GetObjectName(const ObjectType type, const ObjectID id) {
     return SceneManager::getFileName(type, id);
 }
 
@@ -134,9 +134,11 @@ Base::Base(const std::string &path, const int samplesPerPixel) {
 
     const auto treeletCount = manager.treeletCount();
     treeletDependencies.resize(treeletCount);
+    treeletClosureSizes.resize(treeletCount);
 
     for (TreeletId i = 0; i < treeletCount; i++) {
         treeletDependencies[i] = manager.getTreeletDependencies(i);
+        treeletClosureSizes[i] = manager.getTreeletClosureSize(i);
     }
 
     this->samplesPerPixel = sampler->samplesPerPixel;
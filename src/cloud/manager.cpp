@@ -1,8 +1,16 @@
 #include "manager.h"
 
+#include <endian.h>
 #include <fcntl.h>
-#include <fstream>
+#include <zlib.h>
 
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <sstream>
+
+#include "core/error.h"
+#include "core/pbrt.h"
 #include "messages/utils.h"
 #include "util/exception.h"
 
@@ -12,36 +20,167 @@ namespace pbrt {
 
 static const string TYPE_PREFIXES[] = {
     "T",    "TM",   "LIGHTS",   "SAMPLER", "CAMERA", "SCENE", "MAT",
-    "FTEX", "STEX", "MANIFEST", "TEX",     "TINFO",  "STATIC"};
+    "FTEX", "STEX", "MANIFEST", "TEX",     "TINFO",  "STATIC", "BLOB",
+    "PROXIES", "PROXY"};
 
 static_assert(
     sizeof(TYPE_PREFIXES) / sizeof(string) == to_underlying(ObjectType::COUNT),
     "COUNT enum value for SceneManager Type must be the last entry in "
     "the enum declaration.");
 
-void SceneManager::init(const string& scenePath) {
+constexpr char SceneManager::ARCHIVE_MAGIC[];
+
+static const size_t ARCHIVE_FOOTER_SIZE =
+    sizeof(uint64_t) + sizeof(SceneManager::ARCHIVE_MAGIC) - 1;
+
+static uint32_t Checksum(const char* data, uint64_t length) {
+    uLong crc = crc32(0L, Z_NULL, 0);
+
+    /* zlib takes 32-bit lengths */
+    while (length > 0) {
+        const uInt chunk = min<uint64_t>(length, 1 << 30);
+        crc = crc32(crc, reinterpret_cast<const Bytef*>(data), chunk);
+        data += chunk;
+        length -= chunk;
+    }
+
+    return crc;
+}
+
+/* MurmurHash64A; blobs are compared byte for byte before one is reused, so
+   this only has to spread well */
+static uint64_t ContentHash(const char* data, const size_t length) {
+    const uint64_t m = 0xc6a4a7935bd1e995ull;
+    const int r = 47;
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ (length * m);
+
+    const size_t blocks = length / 8;
+    for (size_t i = 0; i < blocks; i++) {
+        uint64_t k;
+        memcpy(&k, data + i * 8, sizeof(k));
+        k = le64toh(k);
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+
+    const unsigned char* tail =
+        reinterpret_cast<const unsigned char*>(data + blocks * 8);
+    const size_t rest = length & 7;
+
+    if (rest > 0) {
+        for (size_t i = rest; i-- > 0;) {
+            h ^= uint64_t(tail[i]) << (8 * i);
+        }
+        h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+void SceneManager::init(const string& scenePath, const bool verify) {
     this->scenePath = scenePath;
-    sceneFD.reset(CheckSystemCall(
-        scenePath, open(scenePath.c_str(), O_DIRECTORY | O_CLOEXEC)));
+    archive.clear();
+    archiveIndex.clear();
+
+    if (roost::is_directory(scenePath)) {
+        sceneFD.reset(CheckSystemCall(
+            scenePath, open(scenePath.c_str(), O_DIRECTORY | O_CLOEXEC)));
+    } else {
+        sceneFD.reset(CheckSystemCall(
+            scenePath, open(scenePath.c_str(), O_RDONLY | O_CLOEXEC)));
+        loadArchive(verify);
+    }
+}
+
+void SceneManager::loadArchive(const bool verify) {
+    archive.reset(*sceneFD);
+
+    const char* data = archive->addr();
+    const size_t length = archive->length();
+
+    if (length < ARCHIVE_FOOTER_SIZE ||
+        memcmp(data + length - sizeof(ARCHIVE_MAGIC) + 1, ARCHIVE_MAGIC,
+               sizeof(ARCHIVE_MAGIC) - 1) != 0) {
+        throw runtime_error(scenePath + ": not a scene archive");
+    }
+
+    uint64_t indexOffset;
+    memcpy(&indexOffset, data + length - ARCHIVE_FOOTER_SIZE,
+           sizeof(indexOffset));
+    indexOffset = le64toh(indexOffset);
+
+    protobuf::ArchiveIndex index;
+    if (indexOffset > length - ARCHIVE_FOOTER_SIZE ||
+        !index.ParseFromArray(data + indexOffset,
+                              length - ARCHIVE_FOOTER_SIZE - indexOffset)) {
+        throw runtime_error(scenePath + ": corrupt archive index");
+    }
+
+    for (const auto& entry : index.entries()) {
+        if (entry.offset() + entry.length() > indexOffset) {
+            throw runtime_error(scenePath + ": archive entry out of bounds");
+        }
+
+        const ObjectKey key = from_protobuf(entry.id());
+
+        if (verify &&
+            Checksum(data + entry.offset(), entry.length()) != entry.crc32()) {
+            throw runtime_error("checksum mismatch for " +
+                                getFileName(key.type, key.id) + " in " +
+                                scenePath);
+        }
+
+        archiveIndex[key] =
+            ArchiveEntry{entry.offset(), entry.length(), entry.crc32()};
+    }
+}
+
+const SceneManager::ArchiveEntry& SceneManager::getArchiveEntry(
+    const ObjectType type, const ObjectID id) const {
+    auto it = archiveIndex.find(ObjectKey{type, id});
+    if (it == archiveIndex.end()) {
+        throw runtime_error(getFileName(type, id) + " is not in " + scenePath);
+    }
+
+    return it->second;
 }
 
 unique_ptr<protobuf::RecordReader> SceneManager::GetReader(
-    const ObjectType type, const uint32_t id) const {
+    const ObjectType type, const ObjectID id) const {
     if (!sceneFD.initialized()) {
         throw runtime_error("SceneManager is not initialized");
     }
 
-    return make_unique<protobuf::RecordReader>(FileDescriptor(CheckSystemCall(
-        "openat", openat(sceneFD->fd_num(), getFileName(type, id).c_str(),
-                         O_RDONLY, 0))));
+    if (archive.initialized()) {
+        const ArchiveEntry& entry = getArchiveEntry(type, id);
+        return make_unique<protobuf::RecordReader>(
+            archive->addr() + entry.offset, entry.length);
+    }
+
+    /* scene objects are read whole, so mapping them saves a copy */
+    return make_unique<protobuf::RecordReader>(
+        MMap_Region{FileDescriptor(CheckSystemCall(
+            "openat", openat(sceneFD->fd_num(), getFileName(type, id).c_str(),
+                             O_RDONLY, 0)))});
 }
 
 unique_ptr<protobuf::RecordWriter> SceneManager::GetWriter(
-    const ObjectType type, const uint32_t id) const {
+    const ObjectType type, const ObjectID id) const {
     if (!sceneFD.initialized()) {
         throw runtime_error("SceneManager is not initialized");
     }
 
+    if (archive.initialized()) {
+        throw runtime_error("scene archives are read-only");
+    }
+
     return make_unique<protobuf::RecordWriter>(FileDescriptor(CheckSystemCall(
         "openat",
         openat(sceneFD->fd_num(), getFileName(type, id).c_str(),
@@ -49,9 +188,34 @@ unique_ptr<protobuf::RecordWriter> SceneManager::GetWriter(
                S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH))));
 }
 
-string SceneManager::getFileName(const ObjectType type, const uint32_t id) {
+uint64_t SceneManager::getObjectSize(const ObjectType type,
+                                     const ObjectID id) const {
+    if (archive.initialized()) {
+        return getArchiveEntry(type, id).length;
+    }
+
+    return roost::file_size_at(*sceneFD, getFileName(type, id));
+}
+
+string SceneManager::readObject(const ObjectType type,
+                                const ObjectID id) const {
+    if (archive.initialized()) {
+        const ArchiveEntry& entry = getArchiveEntry(type, id);
+        return string(archive->addr() + entry.offset, entry.length);
+    }
+
+    const roost::path path = roost::path(scenePath) / getFileName(type, id);
+    if (!roost::exists(path)) {
+        throw runtime_error(getFileName(type, id) + " file not found");
+    }
+
+    return roost::read_file(path);
+}
+
+string SceneManager::getFileName(const ObjectType type, const ObjectID id) {
     switch (type) {
     case ObjectType::Treelet:
+    case ObjectType::Blob:
     case ObjectType::Material:
     case ObjectType::FloatTexture:
     case ObjectType::SpectrumTexture:
@@ -65,18 +229,105 @@ string SceneManager::getFileName(const ObjectType type, const uint32_t id) {
     case ObjectType::Scene:
     case ObjectType::Manifest:
     case ObjectType::TreeletInfo:
+    case ObjectType::ProxyTable:
         return TYPE_PREFIXES[to_underlying(type)];
 
     case ObjectType::TriangleMesh:
         throw runtime_error(
             "TriangleMesh is not supposed to be a separate file");
 
+    case ObjectType::ProxyScene:
+        throw runtime_error("ProxyScene refers to a scene of its own");
+
     default:
         throw runtime_error("invalid object type");
     }
 }
 
+bool SceneManager::parseFileName(const string& name, ObjectKey& key) {
+    for (size_t t = 0; t < to_underlying(ObjectType::COUNT); t++) {
+        const ObjectType type = static_cast<ObjectType>(t);
+        const string& prefix = TYPE_PREFIXES[t];
+
+        if (type == ObjectType::TriangleMesh ||
+            type == ObjectType::ProxyScene ||
+            name.compare(0, prefix.length(), prefix) != 0) {
+            continue;
+        }
+
+        const string rest = name.substr(prefix.length());
+        const bool indexed = (getFileName(type, 0) != prefix);
+
+        if (!indexed && rest.empty()) {
+            key = ObjectKey{type, 0};
+            return true;
+        }
+
+        if (indexed && !rest.empty() &&
+            all_of(rest.begin(), rest.end(),
+                   [](const char c) { return isdigit(c); })) {
+            key = ObjectKey{type, stoull(rest)};
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void SceneManager::packArchive(const string& sceneDir,
+                               const string& archivePath) {
+    vector<pair<ObjectKey, string>> objects;
+
+    for (const string& name : roost::list_directory(sceneDir)) {
+        ObjectKey key;
+        if (parseFileName(name, key)) {
+            objects.emplace_back(key, name);
+        }
+    }
+
+    /* keeps objects of the same type, e.g. all the treelets, together */
+    sort(objects.begin(), objects.end());
+
+    FileDescriptor out{CheckSystemCall(
+        archivePath, open(archivePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                          S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH))};
+
+    protobuf::ArchiveIndex index;
+    uint64_t offset = 0;
+
+    for (const auto& object : objects) {
+        const string data =
+            roost::read_file(roost::path(sceneDir) / object.second);
+        out.write(data);
+
+        auto* entry = index.add_entries();
+        *entry->mutable_id() = to_protobuf(object.first);
+        entry->set_offset(offset);
+        entry->set_length(data.length());
+        entry->set_crc32(Checksum(data.data(), data.length()));
+
+        offset += data.length();
+    }
+
+    const uint64_t indexOffset = htole64(offset);
+    out.write(index.SerializeAsString());
+    out.write(string(reinterpret_cast<const char*>(&indexOffset),
+                     sizeof(indexOffset)));
+    out.write(string(ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC) - 1));
+}
+
+uint32_t SceneManager::getId(const void* ptr) const {
+    lock_guard<mutex> lock{dumpMutex};
+    return ptrIds.at(ptr);
+}
+
+bool SceneManager::hasId(const void* ptr) const {
+    lock_guard<mutex> lock{dumpMutex};
+    return ptrIds.count(ptr) > 0;
+}
+
 uint32_t SceneManager::getNextId(const ObjectType type, const void* ptr) {
+    lock_guard<mutex> lock{dumpMutex};
     const uint32_t id = autoIds[to_underlying(type)]++;
     if (ptr) {
         ptrIds[ptr] = id;
@@ -85,63 +336,237 @@ uint32_t SceneManager::getNextId(const ObjectType type, const void* ptr) {
 }
 
 uint32_t SceneManager::getTextureId(const std::string& path) {
+    lock_guard<mutex> lock{dumpMutex};
+
     if (textureNameToId.count(path)) {
         return textureNameToId[path];
     }
 
+    /* the same image under another name is stored only once */
+    if (roost::exists(path)) {
+        const string data = roost::read_file(path);
+        const ObjectID hash = ContentHash(data.data(), data.length());
+
+        auto it = textureHashToId.find(hash);
+        if (it != textureHashToId.end() &&
+            roost::read_file(roost::path(scenePath) /
+                             getFileName(ObjectType::Texture, it->second)) ==
+                data) {
+            return (textureNameToId[path] = it->second);
+        }
+
+        const uint32_t id = autoIds[to_underlying(ObjectType::Texture)]++;
+        textureHashToId.emplace(hash, id);
+        return (textureNameToId[path] = id);
+    }
+
     return (textureNameToId[path] =
                 autoIds[to_underlying(ObjectType::Texture)]++);
 }
 
+ObjectID SceneManager::blobId(const char* data, const size_t length) {
+    /* proto3 can't tell 0 from unset */
+    return max<ObjectID>(ContentHash(data, length), 1);
+}
+
+ObjectID SceneManager::putBlob(const string& data) {
+    if (archive.initialized()) {
+        throw runtime_error("scene archives are read-only");
+    }
+
+    const ObjectID id = blobId(data.data(), data.length());
+    {
+        lock_guard<mutex> lock{dumpMutex};
+        if (blobIds.count(id)) {
+            return id;
+        }
+    }
+
+    /* The blob may be left over from an earlier dump into this directory.
+     * The lock isn't held for the I/O: threads racing on the same blob
+     * write identical contents, and atomic_create makes either one win. */
+    const roost::path path =
+        roost::path(scenePath) / getFileName(ObjectType::Blob, id);
+
+    if (roost::exists(path)) {
+        if (roost::read_file(path) != data) {
+            throw runtime_error("hash collision on " + path.string());
+        }
+    } else {
+        roost::atomic_create(data, path);
+    }
+
+    lock_guard<mutex> lock{dumpMutex};
+    blobIds.insert(id);
+    return id;
+}
+
 void SceneManager::recordDependency(const ObjectKey& from,
                                     const ObjectKey& to) {
+    lock_guard<mutex> lock{dumpMutex};
     dependencies[from].insert(to);
 }
 
 protobuf::Manifest SceneManager::makeManifest() const {
     protobuf::Manifest manifest;
-    /* add ids for all objects */
-    auto add_to_manifest = [this, &manifest](const ObjectType& type) {
-        size_t total_ids = autoIds[to_underlying(type)];
-        for (size_t id = 0; id < total_ids; ++id) {
-            ObjectKey type_id{type, id};
+    map<ObjectKey, uint64_t> sizes;
 
-            size_t size = 0;
-            if (type != ObjectType::TriangleMesh) {
-                size = roost::file_size_at(*sceneFD, getFileName(type, id));
-            }
+    auto add_object = [this, &manifest, &sizes](const ObjectKey& type_id) {
+        size_t size = 0;
+        if (type_id.type != ObjectType::TriangleMesh) {
+            size = getObjectSize(type_id.type, type_id.id);
+        }
 
-            protobuf::Manifest::Object* obj = manifest.add_objects();
-            obj->set_size(size);
-            (*obj->mutable_id()) = to_protobuf(type_id);
-            if (dependencies.count(type_id) > 0) {
-                for (const ObjectKey& dep : dependencies.at(type_id)) {
-                    protobuf::ObjectKey* dep_id = obj->add_dependencies();
-                    (*dep_id) = to_protobuf(dep);
-                }
+        sizes[type_id] = size;
+
+        protobuf::Manifest::Object* obj = manifest.add_objects();
+        obj->set_size(size);
+        (*obj->mutable_id()) = to_protobuf(type_id);
+        if (dependencies.count(type_id) > 0) {
+            for (const ObjectKey& dep : dependencies.at(type_id)) {
+                protobuf::ObjectKey* dep_id = obj->add_dependencies();
+                (*dep_id) = to_protobuf(dep);
             }
         }
     };
 
+    /* add ids for all objects */
+    auto add_to_manifest = [this, &add_object](const ObjectType& type) {
+        size_t total_ids = autoIds[to_underlying(type)];
+        for (size_t id = 0; id < total_ids; ++id) {
+            add_object(ObjectKey{type, id});
+        }
+    };
+
     add_to_manifest(ObjectType::Treelet);
     add_to_manifest(ObjectType::Material);
     add_to_manifest(ObjectType::FloatTexture);
     add_to_manifest(ObjectType::SpectrumTexture);
     add_to_manifest(ObjectType::Texture);
 
+    for (const ObjectID id : blobIds) {
+        add_object(ObjectKey{ObjectType::Blob, id});
+    }
+
+    /* only there when some treelets refer to proxies that weren't inlined */
+    const ObjectKey proxyTable{ObjectType::ProxyTable, 0};
+    for (const auto& kv : dependencies) {
+        if (kv.second.count(proxyTable)) {
+            add_object(proxyTable);
+            break;
+        }
+    }
+
+    /* the ProxyScenes are other scenes and aren't in the manifest, but a
+       treelet that refers to one needs all of it */
+    for (const auto& kv : dependencies) {
+        for (const ObjectKey& dep : kv.second) {
+            if (dep.type == ObjectType::ProxyScene && !sizes.count(dep)) {
+                sizes[dep] = getProxySceneSize(dep.id);
+            }
+        }
+    }
+
+    /* store the closures, so that workers don't have to compute them */
+    const auto closures = computeClosures();
+
+    for (protobuf::Manifest::Object& obj : *manifest.mutable_objects()) {
+        const ObjectKey id = from_protobuf(obj.id());
+        uint64_t closureSize = obj.size();
+
+        auto it = closures.find(id);
+        if (it != closures.end()) {
+            for (const ObjectKey& dep : it->second) {
+                (*obj.add_closure()) = to_protobuf(dep);
+                auto size = sizes.find(dep);
+                closureSize += (size == sizes.end()) ? 0 : size->second;
+            }
+        }
+
+        obj.set_closure_bytes(closureSize);
+    }
+
+    manifest.set_has_closures(true);
     return manifest;
 }
 
-set<ObjectKey> SceneManager::getRecursiveDependencies(const ObjectKey& object) {
-    set<ObjectKey> allDeps;
+map<ObjectKey, vector<ObjectKey>> SceneManager::computeClosures() const {
+    /* give every object a dense index */
+    vector<ObjectKey> keys;
+    map<ObjectKey, uint32_t> index;
+
+    auto indexOf = [&keys, &index](const ObjectKey& key) {
+        auto it = index.emplace(key, keys.size());
+        if (it.second) keys.push_back(key);
+        return it.first->second;
+    };
+
+    vector<vector<uint32_t>> edges;
 
-    for (const ObjectKey& id : dependencies[object]) {
-        allDeps.insert(id);
-        auto deps = getRecursiveDependencies(id);
-        allDeps.insert(deps.begin(), deps.end());
+    for (const auto& kv : dependencies) {
+        const uint32_t from = indexOf(kv.first);
+        for (const ObjectKey& to : kv.second) {
+            const uint32_t t = indexOf(to);
+            edges.resize(keys.size());
+            edges[from].push_back(t);
+        }
     }
 
-    return allDeps;
+    edges.resize(keys.size());
+
+    /* iterative post-order DFS; an object's closure is built when all of its
+       dependencies are done. Edges back to an object still on the stack
+       (cycles, which a valid scene doesn't have) are ignored. */
+    enum class State : uint8_t { New, Active, Done };
+    vector<State> state(keys.size(), State::New);
+    vector<vector<uint32_t>> closure(keys.size());
+    vector<pair<uint32_t, size_t>> stack;
+
+    for (uint32_t root = 0; root < keys.size(); root++) {
+        if (state[root] != State::New) continue;
+
+        state[root] = State::Active;
+        stack.emplace_back(root, 0);
+
+        while (!stack.empty()) {
+            const uint32_t node = stack.back().first;
+            size_t& next = stack.back().second;
+
+            if (next < edges[node].size()) {
+                const uint32_t child = edges[node][next++];
+                if (state[child] == State::New) {
+                    state[child] = State::Active;
+                    stack.emplace_back(child, 0);
+                }
+                continue;
+            }
+
+            vector<uint32_t>& c = closure[node];
+            for (const uint32_t child : edges[node]) {
+                if (child == node) continue;
+                c.push_back(child);
+                c.insert(c.end(), closure[child].begin(), closure[child].end());
+            }
+
+            sort(c.begin(), c.end());
+            c.erase(unique(c.begin(), c.end()), c.end());
+            c.erase(remove(c.begin(), c.end(), node), c.end());
+
+            state[node] = State::Done;
+            stack.pop_back();
+        }
+    }
+
+    map<ObjectKey, vector<ObjectKey>> result;
+
+    for (uint32_t i = 0; i < keys.size(); i++) {
+        vector<ObjectKey>& deps = result[keys[i]];
+        deps.reserve(closure[i].size());
+        for (const uint32_t d : closure[i]) deps.push_back(keys[d]);
+        sort(deps.begin(), deps.end());
+    }
+
+    return result;
 }
 
 void SceneManager::loadManifest() {
@@ -149,6 +574,8 @@ void SceneManager::loadManifest() {
     protobuf::Manifest manifest;
     reader->read(&manifest);
 
+    hasManifestClosures = manifest.has_closures();
+
     for (const protobuf::Manifest::Object& obj : manifest.objects()) {
         ObjectKey id = from_protobuf(obj.id());
         objectSizes[id] = obj.size();
@@ -156,6 +583,16 @@ void SceneManager::loadManifest() {
         for (const protobuf::ObjectKey& dep : obj.dependencies()) {
             dependencies[id].insert(from_protobuf(dep));
         }
+
+        if (hasManifestClosures) {
+            vector<ObjectKey>& closure = manifestClosures[id];
+            closure.reserve(obj.closure_size());
+            for (const protobuf::ObjectKey& dep : obj.closure()) {
+                closure.push_back(from_protobuf(dep));
+            }
+
+            manifestClosureSizes[id] = obj.closure_bytes();
+        }
     }
 
     dependencies[ObjectKey{ObjectType::Scene, 0}];
@@ -169,12 +606,46 @@ void SceneManager::loadTreeletDependencies() {
         loadManifest();
     }
 
+    /* older manifests don't carry the closures */
+    map<ObjectKey, vector<ObjectKey>> computed;
+    if (!hasManifestClosures) {
+        computed = computeClosures();
+    }
+
+    const auto& closures = hasManifestClosures ? manifestClosures : computed;
+
     for (const auto& kv : dependencies) {
-        if (kv.first.type == ObjectType::Treelet) {
-            treeletDependencies[kv.first.id] =
-                getRecursiveDependencies(kv.first);
+        if (kv.first.type != ObjectType::Treelet) continue;
+
+        set<ObjectKey>& deps = treeletDependencies[kv.first.id];
+        set<ObjectID>& proxies = treeletProxies[kv.first.id];
+        uint64_t& size = treeletClosureSizes[kv.first.id];
+
+        auto it = closures.find(kv.first);
+        if (it != closures.end()) {
+            /* closures are sorted, so this is linear */
+            for (const ObjectKey& dep : it->second) {
+                if (dep.type == ObjectType::ProxyScene) {
+                    proxies.insert(proxies.end(), dep.id);
+                } else {
+                    deps.insert(deps.end(), dep);
+                }
+            }
+        }
+
+        if (hasManifestClosures) {
+            size = manifestClosureSizes[kv.first];
+        } else {
+            size = objectSizes[kv.first];
+            for (const ObjectKey& dep : deps) {
+                auto s = objectSizes.find(dep);
+                size += (s == objectSizes.end()) ? 0 : s->second;
+            }
         }
     }
+
+    manifestClosures.clear();
+    manifestClosureSizes.clear();
 }
 
 const set<ObjectKey>& SceneManager::getTreeletDependencies(
@@ -190,6 +661,75 @@ const set<ObjectKey>& SceneManager::getTreeletDependencies(
     return treeletDependencies.at(treeletId);
 }
 
+const set<SceneManager::ObjectID>& SceneManager::getTreeletProxies(
+    const ObjectID treeletId) {
+    if (!sceneFD.initialized()) {
+        throw runtime_error("SceneManager is not initialized");
+    }
+
+    if (treeletDependencies.empty()) {
+        loadTreeletDependencies();
+    }
+
+    return treeletProxies.at(treeletId);
+}
+
+string SceneManager::getProxyPath(const ObjectID proxyIdx) const {
+    lock_guard<mutex> lock{proxyMutex};
+
+    if (proxyNames.empty()) {
+        auto reader = GetReader(ObjectType::ProxyTable);
+        while (!reader->eof()) {
+            string name;
+            reader->read(&name);
+            proxyNames.push_back(move(name));
+        }
+    }
+
+    if (proxyIdx >= proxyNames.size()) {
+        throw runtime_error("proxy " + to_string(proxyIdx) +
+                            " is not in the proxy table of " + scenePath);
+    }
+
+    /* proxies are next to the scene, unless told otherwise */
+    const string proxyDir = PbrtOptions.proxyDir.empty()
+                                ? roost::dirname(scenePath).string()
+                                : PbrtOptions.proxyDir;
+
+    return proxyDir + "/" + proxyNames[proxyIdx];
+}
+
+uint64_t SceneManager::getProxySceneSize(const ObjectID proxyIdx) const {
+    const string path = getProxyPath(proxyIdx);
+
+    try {
+        SceneManager proxy;
+        proxy.init(path);
+        proxy.loadManifest();
+
+        uint64_t size = 0;
+        for (const auto& kv : proxy.objectSizes) size += kv.second;
+        return size;
+    } catch (const exception& e) {
+        Warning("Can't read proxy scene %s, its size is left out of the "
+                "closures: %s",
+                path.c_str(), e.what());
+        return 0;
+    }
+}
+
+uint64_t SceneManager::getTreeletClosureSize(const ObjectID treeletId) {
+    if (!sceneFD.initialized()) {
+        throw runtime_error("SceneManager is not initialized");
+    }
+
+    if (treeletDependencies.empty()) {
+        loadTreeletDependencies();
+    }
+
+    return treeletClosureSizes.at(treeletId);
+}
+
 size_t SceneManager::treeletCount() {
     if (!sceneFD.initialized()) {
         throw runtime_error("SceneManager is not initialized");
@@ -212,13 +752,7 @@ size_t SceneManager::treeletCount() {
 
 vector<double> SceneManager::getTreeletProbs() const {
     vector<double> result;
-
-    ifstream fin{getScenePath() + "/" +
-                 getFileName(ObjectType::TreeletInfo, 0)};
-
-    if (!fin.good()) {
-        throw runtime_error("TINFO file not found");
-    }
+    istringstream fin{readObject(ObjectType::TreeletInfo, 0)};
 
     size_t count = 0;
     fin >> count;
@@ -1,11 +1,16 @@
 #ifndef PBRT_CLOUD_MANAGER_H
 #define PBRT_CLOUD_MANAGER_H
 
+#include <map>
+#include <mutex>
+#include <set>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "messages/serialization.h"
 #include "pbrt/common.h"
+#include "util/mmap.h"
 #include "util/optional.h"
 #include "util/path.h"
 #include "util/util.h"
@@ -28,43 +33,118 @@ class SceneManager {
     using ReaderPtr = std::unique_ptr<protobuf::RecordReader>;
     using WriterPtr = std::unique_ptr<protobuf::RecordWriter>;
 
-    void init(const std::string& scenePath);
+    /* scenePath is either a scene directory or a packed archive. Archive
+     * entries are only checked against their CRC32 when `verify` is set,
+     * all at once, here; GetReader hands out the mapped bytes as they are. */
+    void init(const std::string& scenePath, const bool verify = false);
     bool initialized() const { return sceneFD.initialized(); }
-    ReaderPtr GetReader(const ObjectType type, const uint32_t id = 0) const;
-    WriterPtr GetWriter(const ObjectType type, const uint32_t id = 0) const;
-
-    /* used during dumping */
-    uint32_t getId(const void* ptr) const { return ptrIds.at(ptr); }
+    bool isArchive() const { return archive.initialized(); }
+    ReaderPtr GetReader(const ObjectType type, const ObjectID id = 0) const;
+    WriterPtr GetWriter(const ObjectType type, const ObjectID id = 0) const;
+    uint64_t getObjectSize(const ObjectType type, const ObjectID id = 0) const;
+
+    /* used during dumping; safe to call from the threads that write out
+     * treelets in parallel */
+    uint32_t getId(const void* ptr) const;
     uint32_t getNextId(const ObjectType type, const void* ptr = nullptr);
     uint32_t getTextureId(const std::string& path);
-    bool hasId(const void* ptr) const { return ptrIds.count(ptr) > 0; }
+    bool hasId(const void* ptr) const;
     void recordDependency(const ObjectKey& from, const ObjectKey& to);
+
+    /* Stores data as a Blob object named by its hash, unless an identical
+     * blob is already there, and returns the id. Blobs are listed in the
+     * manifest like any other object. */
+    ObjectID putBlob(const std::string& data);
+    static ObjectID blobId(const char* data, const size_t length);
     protobuf::Manifest makeManifest() const;
 
-    static std::string getFileName(const ObjectType type, const uint32_t id);
+    static std::string getFileName(const ObjectType type, const ObjectID id);
+    static bool parseFileName(const std::string& name, ObjectKey& key);
+
+    /* Packs all the objects of a scene directory into a single file:
+     *   [object data]...[ArchiveIndex][index offset: u64][ARCHIVE_MAGIC]
+     * Objects are stored as they are in their files, so an archive can be
+     * read with plain slices of its mapping. */
+    static void packArchive(const std::string& sceneDir,
+                            const std::string& archivePath);
+
+    static constexpr char ARCHIVE_MAGIC[] = "PBRTPAK1";
     const std::string& getScenePath() const { return scenePath; }
 
     std::vector<double> getTreeletProbs() const;
 
+    /* every key is an object of this scene, with a file of its own */
     const std::set<ObjectKey>& getTreeletDependencies(const ObjectID treeletId);
 
+    /* ProxyScenes are other scenes that are shipped on their own, so they're
+     * kept out of the dependencies and listed here, by their index in the
+     * ProxyTable */
+    const std::set<ObjectID>& getTreeletProxies(const ObjectID treeletId);
+
+    /* Where the proxy scene with this index in the ProxyTable is: next to
+     * this scene, unless PbrtOptions.proxyDir says otherwise. Safe to call
+     * from several threads. */
+    std::string getProxyPath(const ObjectID proxyIdx) const;
+
+    /* Bytes of the treelet and everything it depends on, including all the
+     * objects of the proxy scenes it refers to. A proxy that couldn't be
+     * read when the scene was dumped counts as 0 bytes, and so do the
+     * proxies nested in a proxy, so for those this is an undercount. */
+    uint64_t getTreeletClosureSize(const ObjectID treeletId);
+
     size_t treeletCount();
 
   private:
+    struct ArchiveEntry {
+        uint64_t offset;
+        uint64_t length;
+        uint32_t crc32;
+    };
+
+    void loadArchive(const bool verify);
+    const ArchiveEntry& getArchiveEntry(const ObjectType type,
+                                        const ObjectID id) const;
+    std::string readObject(const ObjectType type, const ObjectID id) const;
+
     void loadManifest();
     void loadTreeletDependencies();
 
-    std::set<ObjectKey> getRecursiveDependencies(const ObjectKey& object);
+    /* The transitive dependencies of every object, computed in a single
+     * post-order pass so that each closure is merged from the closures of
+     * the object's direct dependencies, which are already complete. */
+    std::map<ObjectKey, std::vector<ObjectKey>> computeClosures() const;
+
+    /* the size of all the objects of a proxy scene, or 0 if it can't be
+     * read */
+    uint64_t getProxySceneSize(const ObjectID proxyIdx) const;
+
+    /* guards the id, dependency and blob bookkeeping of a dump */
+    mutable std::mutex dumpMutex{};
 
     size_t autoIds[to_underlying(ObjectType::COUNT)] = {0};
     std::string scenePath{};
     Optional<FileDescriptor> sceneFD{};
+    Optional<MMap_Region> archive{};
+    std::map<ObjectKey, ArchiveEntry> archiveIndex{};
     std::unordered_map<const void*, uint32_t> ptrIds{};
     std::map<std::string, uint32_t> textureNameToId;
+    std::map<ObjectID, uint32_t> textureHashToId;
+    std::set<ObjectID> blobIds{};
     std::map<ObjectKey, uint64_t> objectSizes{};
     std::map<ObjectKey, std::set<ObjectKey>> dependencies;
 
     std::map<ObjectID, std::set<ObjectKey>> treeletDependencies;
+    std::map<ObjectID, std::set<ObjectID>> treeletProxies;
+    std::map<ObjectID, uint64_t> treeletClosureSizes;
+
+    /* read from the ProxyTable when a proxy is first needed */
+    mutable std::mutex proxyMutex{};
+    mutable std::vector<std::string> proxyNames{};
+
+    /* closures read from the manifest, if it has them */
+    bool hasManifestClosures{false};
+    std::map<ObjectKey, std::vector<ObjectKey>> manifestClosures;
+    std::map<ObjectKey, uint64_t> manifestClosureSizes;
 };
 
 namespace global {
@@ -0,0 +1,53 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "cloud/manager.h"
+#include "util/exception.h"
+#include "util/util.h"
+
+using namespace std;
+using namespace pbrt;
+
+void usage(const char *argv0) {
+    cerr << argv0 << " SCENE-DIR ARCHIVE" << endl;
+}
+
+int main(int argc, char const *argv[]) {
+    try {
+        if (argc <= 0) {
+            abort();
+        }
+
+        if (argc != 3) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        const string sceneDir{argv[1]};
+        const string archivePath{argv[2]};
+
+        SceneManager::packArchive(sceneDir, archivePath);
+
+        /* make sure everything in it can be read back */
+        SceneManager archive;
+        archive.init(archivePath, true);
+
+        const size_t treeletCount = archive.treeletCount();
+        uint64_t treeletBytes = 0;
+
+        for (size_t i = 0; i < treeletCount; i++) {
+            treeletBytes += archive.getObjectSize(ObjectType::Treelet, i);
+        }
+
+        cerr << "Packed " << treeletCount << " "
+             << pluralize("treelet", treeletCount) << " ("
+             << format_bytes(treeletBytes) << ") into " << archivePath
+             << endl;
+    } catch (const exception &e) {
+        print_exception(argv[0], e);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
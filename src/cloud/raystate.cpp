@@ -258,7 +258,7 @@ void UnPackRay(char *buffer, RayState &state) {
         state.ray.rxOrigin = diffs->rxOrigin.ToPoint3f();
         state.ray.ryOrigin = diffs->ryOrigin.ToPoint3f();
         state.ray.rxDirection = diffs->rxDirection.ToVector3f();
-        state.ray.rxDirection = diffs->rxDirection.ToVector3f();
+        state.ray.ryDirection = diffs->ryDirection.ToVector3f();
 
         buffer += sizeof(PackedDifferentials);
     }
@@ -297,11 +297,8 @@ const size_t RayState::MaxPackedSize =
     sizeof(PackedTreeletNode) + sizeof(PackedDifferentials) +
     2 * sizeof(PackedTransform) + 4;
 
-size_t RayState::Serialize(char *data) {
-    static thread_local char packedBuffer[RayState::MaxPackedSize];
-
-    size_t packedBytes = PackRay(packedBuffer, *this);
-
+size_t SerializePacked(const char *packedBuffer, const size_t packedBytes,
+                       char *data) {
     const size_t upperBound = LZ4_COMPRESSBOUND(RayState::MaxPackedSize);
     uint32_t len = packedBytes;
 
@@ -322,9 +319,8 @@ size_t RayState::Serialize(char *data) {
     return len;
 }
 
-void RayState::Deserialize(const char *data, const size_t len) {
-    static thread_local char packedBuffer[RayState::MaxPackedSize];
-
+void DeserializePacked(const char *data, const size_t len,
+                       char *packedBuffer) {
     if (PbrtOptions.compressRays) {
         if (LZ4_decompress_safe(data, packedBuffer, len,
                                 RayState::MaxPackedSize) < 0) {
@@ -333,7 +329,19 @@ void RayState::Deserialize(const char *data, const size_t len) {
     } else {
         memcpy(packedBuffer, data, min(RayState::MaxPackedSize, len));
     }
+}
 
+size_t RayState::Serialize(char *data) {
+    static thread_local char packedBuffer[RayState::MaxPackedSize];
+
+    size_t packedBytes = PackRay(packedBuffer, *this);
+    return SerializePacked(packedBuffer, packedBytes, data);
+}
+
+void RayState::Deserialize(const char *data, const size_t len) {
+    static thread_local char packedBuffer[RayState::MaxPackedSize];
+
+    DeserializePacked(data, len, packedBuffer);
     UnPackRay(packedBuffer, *this);
 }
 
@@ -454,3 +462,428 @@ void Sample::Deserialize(const char *data, const size_t len) {
 
     UnPackSample(packedBuffer, *this);
 }
+
+/*******************************************************************************
+ * RAY BATCH                                                                   *
+ ******************************************************************************/
+
+void RayBatch::clear() {
+    ox.clear(), oy.clear(), oz.clear();
+    dx.clear(), dy.clear(), dz.clear();
+    tMax.clear();
+    time.clear();
+    beta.clear();
+    Ld.clear();
+    sampleId.clear();
+    remainingBounces.clear();
+    flags.clear();
+    toVisitHead.clear();
+
+    pFilm.clear();
+    weight.clear();
+    dim.clear();
+    hop.clear();
+    pathHop.clear();
+
+    differentialsIdx.clear();
+    hitNode.clear();
+    hitTransformIdx.clear();
+    rayTransformIdx.clear();
+    toVisitOffset.clear();
+
+    differentials.clear();
+    transforms.clear();
+    toVisit.clear();
+}
+
+void RayBatch::reserve(const size_t n) {
+    ox.reserve(n), oy.reserve(n), oz.reserve(n);
+    dx.reserve(n), dy.reserve(n), dz.reserve(n);
+    tMax.reserve(n);
+    time.reserve(n);
+    beta.reserve(n);
+    Ld.reserve(n);
+    sampleId.reserve(n);
+    remainingBounces.reserve(n);
+    flags.reserve(n);
+    toVisitHead.reserve(n);
+
+    pFilm.reserve(n);
+    weight.reserve(n);
+    dim.reserve(n);
+    hop.reserve(n);
+    pathHop.reserve(n);
+
+    differentialsIdx.reserve(n);
+    hitNode.reserve(n);
+    hitTransformIdx.reserve(n);
+    rayTransformIdx.reserve(n);
+    toVisitOffset.reserve(n);
+}
+
+void RayBatch::Add(const RayState &state) {
+    const RayDifferential &ray = state.ray;
+
+    ox.push_back(ray.o.x), oy.push_back(ray.o.y), oz.push_back(ray.o.z);
+    dx.push_back(ray.d.x), dy.push_back(ray.d.y), dz.push_back(ray.d.z);
+    tMax.push_back(ray.tMax);
+    time.push_back(ray.time);
+    beta.push_back(state.beta);
+    Ld.push_back(state.Ld);
+    sampleId.push_back(state.sample.id);
+    remainingBounces.push_back(state.remainingBounces);
+    flags.push_back((state.trackRay ? TrackRay : 0) |
+                    (state.isShadowRay ? ShadowRay : 0) |
+                    (state.hit ? Hit : 0));
+    toVisitHead.push_back(state.toVisitHead);
+
+    pFilm.push_back(state.sample.pFilm);
+    weight.push_back(state.sample.weight);
+    dim.push_back(state.sample.dim);
+    hop.push_back(state.hop);
+    pathHop.push_back(state.pathHop);
+
+    if (ray.hasDifferentials) {
+        differentialsIdx.push_back(differentials.size());
+        differentials.push_back({ray.rxOrigin, ray.ryOrigin, ray.rxDirection,
+                                 ray.ryDirection});
+    } else {
+        differentialsIdx.push_back(-1);
+    }
+
+    if (state.hit) {
+        hitNode.push_back(state.hitNode);
+    } else {
+        hitNode.emplace_back();
+    }
+
+    if (state.hit && state.hitNode.transformed) {
+        hitTransformIdx.push_back(transforms.size());
+        transforms.push_back(state.hitTransform);
+    } else {
+        hitTransformIdx.push_back(-1);
+    }
+
+    toVisitOffset.push_back(toVisit.size());
+    toVisit.insert(toVisit.end(), state.toVisit,
+                   state.toVisit + state.toVisitHead);
+
+    if (!state.toVisitEmpty() && state.toVisitTop().transformed) {
+        rayTransformIdx.push_back(transforms.size());
+        transforms.push_back(state.rayTransform);
+    } else {
+        rayTransformIdx.push_back(-1);
+    }
+}
+
+void RayBatch::Get(const size_t i, RayState &state) const {
+    state.trackRay = flags[i] & TrackRay;
+    state.isShadowRay = flags[i] & ShadowRay;
+    state.hit = flags[i] & Hit;
+    state.hop = hop[i];
+    state.pathHop = pathHop[i];
+
+    state.sample.id = sampleId[i];
+    state.sample.pFilm = pFilm[i];
+    state.sample.weight = weight[i];
+    state.sample.dim = dim[i];
+
+    state.ray.o = Point3f(ox[i], oy[i], oz[i]);
+    state.ray.d = Vector3f(dx[i], dy[i], dz[i]);
+    state.ray.tMax = tMax[i];
+    state.ray.time = time[i];
+    state.ray.hasDifferentials = differentialsIdx[i] >= 0;
+
+    if (state.ray.hasDifferentials) {
+        const Differentials &diffs = differentials[differentialsIdx[i]];
+        state.ray.rxOrigin = diffs.rxOrigin;
+        state.ray.ryOrigin = diffs.ryOrigin;
+        state.ray.rxDirection = diffs.rxDirection;
+        state.ray.ryDirection = diffs.ryDirection;
+    }
+
+    state.beta = beta[i];
+    state.Ld = Ld[i];
+    state.remainingBounces = remainingBounces[i];
+
+    /* the transforms are reset, so that a state can be reused for rays
+       with and without them */
+    state.hitNode = hitNode[i];
+    state.hitTransform = (hitTransformIdx[i] >= 0)
+                             ? transforms[hitTransformIdx[i]]
+                             : Transform();
+
+    state.toVisitHead = toVisitHead[i];
+    copy_n(toVisit.begin() + toVisitOffset[i], toVisitHead[i], state.toVisit);
+
+    state.rayTransform = (rayTransformIdx[i] >= 0)
+                             ? transforms[rayTransformIdx[i]]
+                             : Transform();
+}
+
+RayStatePtr RayBatch::Get(const size_t i) const {
+    RayStatePtr state = RayState::Create();
+    Get(i, *state);
+    return state;
+}
+
+size_t PackRay(char *bufferStart, const RayBatch &batch, const size_t i) {
+    char *buffer = bufferStart;
+    PackedRayFixedHdr *hdr = reinterpret_cast<PackedRayFixedHdr *>(buffer);
+    hdr->trackRay = (batch.flags[i] & RayBatch::TrackRay) != 0;
+    hdr->isShadowRay = (batch.flags[i] & RayBatch::ShadowRay) != 0;
+    hdr->hit = (batch.flags[i] & RayBatch::Hit) != 0;
+    hdr->remainingBounces = batch.remainingBounces[i];
+    hdr->hop = batch.hop[i];
+    hdr->pathHop = batch.pathHop[i];
+
+    hdr->sample.id = batch.sampleId[i];
+    hdr->sample.pFilmX = batch.pFilm[i].x;
+    hdr->sample.pFilmY = batch.pFilm[i].y;
+    hdr->sample.weight = batch.weight[i];
+    hdr->sample.dim = batch.dim[i];
+
+    hdr->beta = Packed3f(batch.beta[i]);
+    hdr->Ld = Packed3f(batch.Ld[i]);
+    hdr->toVisitHead = batch.toVisitHead[i];
+    hdr->hasDifferentials = batch.differentialsIdx[i] >= 0;
+
+    hdr->ray.o = Packed3f(Point3f(batch.ox[i], batch.oy[i], batch.oz[i]));
+    hdr->ray.d = Packed3f(Vector3f(batch.dx[i], batch.dy[i], batch.dz[i]));
+    hdr->ray.tMax = batch.tMax[i];
+    hdr->ray.time = batch.time[i];
+    buffer += sizeof(PackedRayFixedHdr);
+
+    if (hdr->hasDifferentials) {
+        const RayBatch::Differentials &diffs =
+            batch.differentials[batch.differentialsIdx[i]];
+        PackedDifferentials *packed =
+            reinterpret_cast<PackedDifferentials *>(buffer);
+        packed->rxOrigin = Packed3f(diffs.rxOrigin);
+        packed->ryOrigin = Packed3f(diffs.ryOrigin);
+        packed->rxDirection = Packed3f(diffs.rxDirection);
+        packed->ryDirection = Packed3f(diffs.ryDirection);
+        buffer += sizeof(PackedDifferentials);
+    }
+
+    if (hdr->hit) {
+        new (buffer) PackedTreeletNode(batch.hitNode[i]);
+        buffer += sizeof(PackedTreeletNode);
+        if (batch.hitTransformIdx[i] >= 0) {
+            new (buffer)
+                PackedTransform(batch.transforms[batch.hitTransformIdx[i]]);
+            buffer += sizeof(PackedTransform);
+        }
+    }
+
+    const RayState::TreeletNode *stack =
+        batch.toVisit.data() + batch.toVisitOffset[i];
+
+    for (int j = 0; j < batch.toVisitHead[i]; j++) {
+        new (buffer) PackedTreeletNode(stack[j]);
+        buffer += sizeof(PackedTreeletNode);
+    }
+
+    if (batch.rayTransformIdx[i] >= 0) {
+        new (buffer)
+            PackedTransform(batch.transforms[batch.rayTransformIdx[i]]);
+        buffer += sizeof(PackedTransform);
+    }
+
+    return buffer - bufferStart;
+}
+
+size_t UnPackRay(const char *bufferStart, RayBatch &batch) {
+    const char *buffer = bufferStart;
+    const PackedRayFixedHdr *hdr =
+        reinterpret_cast<const PackedRayFixedHdr *>(buffer);
+
+    batch.ox.push_back(hdr->ray.o.values[0]);
+    batch.oy.push_back(hdr->ray.o.values[1]);
+    batch.oz.push_back(hdr->ray.o.values[2]);
+    batch.dx.push_back(hdr->ray.d.values[0]);
+    batch.dy.push_back(hdr->ray.d.values[1]);
+    batch.dz.push_back(hdr->ray.d.values[2]);
+    batch.tMax.push_back(hdr->ray.tMax);
+    batch.time.push_back(hdr->ray.time);
+    batch.beta.push_back(hdr->beta.ToSpectrum());
+    batch.Ld.push_back(hdr->Ld.ToSpectrum());
+    batch.sampleId.push_back(hdr->sample.id);
+    batch.remainingBounces.push_back(hdr->remainingBounces);
+    batch.flags.push_back((hdr->trackRay ? RayBatch::TrackRay : 0) |
+                          (hdr->isShadowRay ? RayBatch::ShadowRay : 0) |
+                          (hdr->hit ? RayBatch::Hit : 0));
+    batch.toVisitHead.push_back(hdr->toVisitHead);
+
+    batch.pFilm.emplace_back(hdr->sample.pFilmX, hdr->sample.pFilmY);
+    batch.weight.push_back(hdr->sample.weight);
+    batch.dim.push_back(hdr->sample.dim);
+    batch.hop.push_back(hdr->hop);
+    batch.pathHop.push_back(hdr->pathHop);
+    buffer += sizeof(PackedRayFixedHdr);
+
+    if (hdr->hasDifferentials) {
+        const PackedDifferentials *diffs =
+            reinterpret_cast<const PackedDifferentials *>(buffer);
+        batch.differentialsIdx.push_back(batch.differentials.size());
+        batch.differentials.push_back({diffs->rxOrigin.ToPoint3f(),
+                                       diffs->ryOrigin.ToPoint3f(),
+                                       diffs->rxDirection.ToVector3f(),
+                                       diffs->ryDirection.ToVector3f()});
+        buffer += sizeof(PackedDifferentials);
+    } else {
+        batch.differentialsIdx.push_back(-1);
+    }
+
+    batch.hitTransformIdx.push_back(-1);
+
+    if (hdr->hit) {
+        const PackedTreeletNode *hitNode =
+            reinterpret_cast<const PackedTreeletNode *>(buffer);
+        buffer += sizeof(PackedTreeletNode);
+
+        batch.hitNode.push_back(hitNode->ToTreeletNode());
+        if (hitNode->transformed) {
+            const PackedTransform *txfm =
+                reinterpret_cast<const PackedTransform *>(buffer);
+            buffer += sizeof(PackedTransform);
+
+            batch.hitTransformIdx.back() = batch.transforms.size();
+            batch.transforms.push_back(txfm->ToTransform());
+        }
+    } else {
+        batch.hitNode.emplace_back();
+    }
+
+    batch.toVisitOffset.push_back(batch.toVisit.size());
+    for (int j = 0; j < hdr->toVisitHead; j++) {
+        const PackedTreeletNode *stackNode =
+            reinterpret_cast<const PackedTreeletNode *>(buffer);
+        buffer += sizeof(PackedTreeletNode);
+
+        batch.toVisit.push_back(stackNode->ToTreeletNode());
+    }
+
+    if (hdr->toVisitHead > 0 && batch.toVisit.back().transformed) {
+        const PackedTransform *txfm =
+            reinterpret_cast<const PackedTransform *>(buffer);
+        buffer += sizeof(PackedTransform);
+
+        batch.rayTransformIdx.push_back(batch.transforms.size());
+        batch.transforms.push_back(txfm->ToTransform());
+    } else {
+        batch.rayTransformIdx.push_back(-1);
+    }
+
+    return buffer - bufferStart;
+}
+
+size_t RayBatch::Serialize(const size_t i, char *data) const {
+    static thread_local char packedBuffer[RayState::MaxPackedSize];
+
+    size_t packedBytes = PackRay(packedBuffer, *this, i);
+    return SerializePacked(packedBuffer, packedBytes, data);
+}
+
+void RayBatch::Deserialize(const char *data, const size_t len) {
+    static thread_local char packedBuffer[RayState::MaxPackedSize];
+
+    DeserializePacked(data, len, packedBuffer);
+    UnPackRay(packedBuffer, *this);
+}
+
+size_t RayBatch::MaxSize(const size_t i) const {
+    size_t size = 4 + sizeof(PackedRayFixedHdr) +
+                  toVisitHead[i] * sizeof(PackedTreeletNode);
+
+    if (HasHit(i)) {
+        size += sizeof(PackedTreeletNode) + sizeof(PackedTransform);
+    }
+
+    if (rayTransformIdx[i] >= 0) {
+        size += sizeof(PackedTransform);
+    }
+
+    if (differentialsIdx[i] >= 0) {
+        size += sizeof(PackedDifferentials);
+    }
+
+    return size;
+}
+
+size_t RayBatch::MaxCompressedSize(const size_t i) const {
+    if (PbrtOptions.compressRays) {
+        return LZ4_COMPRESSBOUND(MaxSize(i));
+    } else {
+        return MaxSize(i);
+    }
+}
+
+size_t RayBatch::Unpack(const char *bag, const size_t len) {
+    /* the framing is walked first, so that the arrays grow once per bag */
+    size_t count = 0;
+    for (size_t offset = 0; offset + 4 <= len; count++) {
+        uint32_t rayLen;
+        memcpy(&rayLen, bag + offset, 4);
+        offset += 4;
+
+        if (offset + rayLen > len) {
+            throw runtime_error("truncated ray bag");
+        }
+
+        offset += rayLen;
+    }
+
+    reserve(size() + count);
+
+    /* uncompressed rays are read where they are, unless they're too close to
+       the end of the bag for a corrupt header to be harmless */
+    const bool compressed = PbrtOptions.compressRays;
+    vector<char> packedBuffer(RayState::MaxPackedSize);
+
+    for (size_t offset = 0; offset + 4 <= len;) {
+        uint32_t rayLen;
+        memcpy(&rayLen, bag + offset, 4);
+        offset += 4;
+
+        const char *packed = bag + offset;
+        size_t packedLen = rayLen;
+
+        if (compressed) {
+            const int n = LZ4_decompress_safe(packed, packedBuffer.data(),
+                                              rayLen, RayState::MaxPackedSize);
+            if (n < 0) {
+                throw runtime_error("ray decompression failed");
+            }
+
+            packed = packedBuffer.data();
+            packedLen = n;
+        } else if (offset + RayState::MaxPackedSize > len) {
+            memcpy(packedBuffer.data(), packed,
+                   min(RayState::MaxPackedSize, packedLen));
+            packed = packedBuffer.data();
+        }
+
+        if (UnPackRay(packed, *this) != packedLen) {
+            throw runtime_error("corrupt ray in bag");
+        }
+
+        offset += rayLen;
+    }
+
+    return count;
+}
+
+size_t RayBatch::Pack(char *bag, const size_t capacity) const {
+    size_t offset = 0;
+
+    for (size_t i = 0; i < size(); i++) {
+        if (offset + MaxCompressedSize(i) > capacity) {
+            throw runtime_error("ray bag capacity exceeded");
+        }
+
+        offset += Serialize(i, bag + offset);
+    }
+
+    return offset;
+}
@@ -0,0 +1,285 @@
+#include "pbrt/replication.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <stdexcept>
+
+#include "cloud/manager.h"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace pbrt {
+
+/* TreeletLoadMonitor */
+
+TreeletLoadMonitor::TreeletLoadMonitor(const size_t treeletCount,
+                                       const Clock::duration window,
+                                       const size_t bucketCount)
+    : treeletCount(treeletCount),
+      bucketCount(bucketCount),
+      bucketLength(window / max<size_t>(bucketCount, 1)),
+      start(Clock::now()),
+      buckets(treeletCount * bucketCount) {
+    if (bucketCount == 0 || bucketLength.count() <= 0) {
+        throw runtime_error("TreeletLoadMonitor: invalid window");
+    }
+}
+
+void TreeletLoadMonitor::Advance(const Clock::time_point now) {
+    const int64_t epoch = (now - start) / bucketLength;
+    if (epoch <= currentEpoch) return;
+
+    /* clear every bucket the window moved past */
+    const int64_t stale = min<int64_t>(epoch - currentEpoch, bucketCount);
+    for (int64_t e = 1; e <= stale; e++) {
+        const size_t b = (currentEpoch + e) % bucketCount;
+        for (size_t t = 0; t < treeletCount; t++) {
+            buckets[t * bucketCount + b] = Bucket{};
+        }
+    }
+
+    currentEpoch = epoch;
+}
+
+void TreeletLoadMonitor::Grow(const TreeletId treelet) {
+    if (treelet < treeletCount) return;
+
+    /* buckets are grouped by treelet, so new treelets go at the end */
+    treeletCount = treelet + 1;
+    buckets.resize(treeletCount * bucketCount);
+}
+
+double TreeletLoadMonitor::WindowSeconds(const Clock::time_point now) const {
+    /* until a full window has passed, rates are over the elapsed time */
+    const Clock::duration elapsed =
+        min(now - start, bucketLength * static_cast<int64_t>(bucketCount));
+    return max(duration<double>(elapsed).count(), 1e-3);
+}
+
+void TreeletLoadMonitor::RecordArrival(const TreeletId treelet,
+                                       const uint64_t count,
+                                       const Clock::time_point now) {
+    Advance(now);
+    Grow(treelet);
+    buckets.at(treelet * bucketCount + currentEpoch % bucketCount).arrivals +=
+        count;
+}
+
+void TreeletLoadMonitor::RecordService(const TreeletId treelet,
+                                       const Clock::duration time,
+                                       const uint64_t count,
+                                       const Clock::time_point now) {
+    Advance(now);
+    Grow(treelet);
+    Bucket &bucket =
+        buckets.at(treelet * bucketCount + currentEpoch % bucketCount);
+    bucket.serviced += count;
+    bucket.serviceTime += time;
+}
+
+TreeletLoad TreeletLoadMonitor::GetLoad(const TreeletId treelet,
+                                        const Clock::time_point now) {
+    Advance(now);
+
+    TreeletLoad load;
+    load.treelet = treelet;
+    if (treelet >= treeletCount) return load;
+
+    uint64_t arrivals = 0;
+    uint64_t serviced = 0;
+    Clock::duration serviceTime{0};
+
+    for (size_t b = 0; b < bucketCount; b++) {
+        const Bucket &bucket = buckets.at(treelet * bucketCount + b);
+        arrivals += bucket.arrivals;
+        serviced += bucket.serviced;
+        serviceTime += bucket.serviceTime;
+    }
+
+    const double window = WindowSeconds(now);
+    const double busy = duration<double>(serviceTime).count();
+
+    load.arrivalRate = arrivals / window;
+    load.serviceRate = (busy > 0) ? serviced / busy : 0.0;
+    load.utilization = busy / window;
+    return load;
+}
+
+vector<TreeletLoad> TreeletLoadMonitor::GetLoads(const Clock::time_point now) {
+    vector<TreeletLoad> loads;
+
+    for (TreeletId t = 0; t < treeletCount; t++) {
+        TreeletLoad load = GetLoad(t, now);
+        if (load.arrivalRate > 0 || load.utilization > 0) {
+            loads.push_back(load);
+        }
+    }
+
+    sort(loads.begin(), loads.end(),
+         [](const TreeletLoad &a, const TreeletLoad &b) {
+             return a.arrivalRate > b.arrivalRate;
+         });
+
+    return loads;
+}
+
+void TreeletLoadMonitor::PrintSummary(ostream &out, const size_t topN) {
+    const vector<TreeletLoad> loads = GetLoads();
+
+    out << "hot treelets (" << loads.size() << " active):" << endl;
+    for (size_t i = 0; i < min(topN, loads.size()); i++) {
+        const TreeletLoad &load = loads[i];
+        out << "  T" << setw(6) << left << load.treelet << right << fixed
+            << setprecision(1) << " arrivals=" << load.arrivalRate << "/s"
+            << " service=" << load.serviceRate << "/s"
+            << setprecision(3) << " utilization=" << load.utilization
+            << endl;
+    }
+}
+
+/* ReplicationPlanner */
+
+ReplicationPlanner::ReplicationPlanner(DependencyFn dependencies,
+                                       const double targetUtilization,
+                                       const double idleUtilization)
+    : dependencies(move(dependencies)),
+      targetUtilization(targetUtilization),
+      idleUtilization(idleUtilization) {
+    if (!this->dependencies) {
+        this->dependencies = [](const TreeletId t) -> const set<ObjectKey> & {
+            return global::manager.getTreeletDependencies(t);
+        };
+    }
+
+    if (targetUtilization <= 0 || targetUtilization > 1) {
+        throw runtime_error("ReplicationPlanner: invalid target utilization");
+    }
+}
+
+vector<ReplicaAssignment> ReplicationPlanner::Plan(
+    const vector<WorkerLoadReport> &reports) const {
+    struct Demand {
+        double arrivalRate{0.0};
+        double serviceRate{0.0};
+        size_t serviceSamples{0};
+        size_t replicas{0};
+    };
+
+    map<TreeletId, Demand> demand;
+    vector<pair<double, const WorkerLoadReport *>> idleWorkers;
+
+    for (const WorkerLoadReport &report : reports) {
+        double utilization = 0.0;
+
+        for (const TreeletLoad &load : report.loads) {
+            Demand &d = demand[load.treelet];
+            d.arrivalRate += load.arrivalRate;
+            if (load.serviceRate > 0) {
+                d.serviceRate += load.serviceRate;
+                d.serviceSamples++;
+            }
+
+            utilization += load.utilization;
+        }
+
+        for (const TreeletId t : report.treelets) {
+            demand[t].replicas++;
+        }
+
+        if (utilization < idleUtilization) {
+            idleWorkers.emplace_back(utilization, &report);
+        }
+    }
+
+    /* how far over its capacity a treelet is; > 1 means it needs help */
+    auto pressure = [this](const Demand &d) {
+        if (d.serviceSamples == 0) return 0.0;
+        const double capacity = (d.serviceRate / d.serviceSamples) *
+                                max<size_t>(d.replicas, 1) *
+                                targetUtilization;
+        return d.arrivalRate / capacity;
+    };
+
+    sort(idleWorkers.begin(), idleWorkers.end(),
+         [](const pair<double, const WorkerLoadReport *> &a,
+            const pair<double, const WorkerLoadReport *> &b) {
+             return a.first < b.first;
+         });
+
+    vector<ReplicaAssignment> plan;
+
+    for (const auto &idle : idleWorkers) {
+        const WorkerLoadReport &worker = *idle.second;
+
+        auto hottest = demand.end();
+        double hottestPressure = 1.0;
+
+        for (auto it = demand.begin(); it != demand.end(); it++) {
+            if (worker.treelets.count(it->first)) continue;
+
+            const double p = pressure(it->second);
+            if (p > hottestPressure) {
+                hottest = it;
+                hottestPressure = p;
+            }
+        }
+
+        if (hottest == demand.end()) break;
+
+        hottest->second.replicas = max<size_t>(hottest->second.replicas, 1) + 1;
+
+        ReplicaAssignment assignment;
+        assignment.treelet = hottest->first;
+        assignment.workerId = worker.workerId;
+        assignment.objects = dependencies(hottest->first);
+        assignment.objects.insert(
+            ObjectKey{ObjectType::Treelet, hottest->first});
+        plan.push_back(move(assignment));
+    }
+
+    return plan;
+}
+
+/* ReplicaRouter */
+
+void ReplicaRouter::AddReplica(const TreeletId treelet,
+                               const uint64_t workerId) {
+    auto &workers = replicas[treelet].workers;
+    if (find(workers.begin(), workers.end(), workerId) == workers.end()) {
+        workers.push_back(workerId);
+    }
+}
+
+void ReplicaRouter::RemoveReplica(const TreeletId treelet,
+                                  const uint64_t workerId) {
+    auto it = replicas.find(treelet);
+    if (it == replicas.end()) return;
+
+    auto &workers = it->second.workers;
+    workers.erase(remove(workers.begin(), workers.end(), workerId),
+                  workers.end());
+
+    if (workers.empty()) {
+        replicas.erase(it);
+    }
+}
+
+const vector<uint64_t> &ReplicaRouter::Replicas(const TreeletId treelet) const {
+    static const vector<uint64_t> none;
+    auto it = replicas.find(treelet);
+    return (it == replicas.end()) ? none : it->second.workers;
+}
+
+uint64_t ReplicaRouter::Route(const TreeletId treelet) {
+    auto it = replicas.find(treelet);
+    if (it == replicas.end()) {
+        throw runtime_error("no replica for treelet " + to_string(treelet));
+    }
+
+    ReplicaSet &set = it->second;
+    return set.workers[set.next++ % set.workers.size()];
+}
+
+}  // namespace pbrt
@@ -0,0 +1,208 @@
+#include "scheduler.h"
+
+#include <cstdlib>
+#include <iomanip>
+
+#include "core/stats.h"
+#include "util/mmap.h"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace pbrt {
+
+STAT_COUNTER("Scheduler/Rays spilled to disk", nRaysSpilled);
+STAT_COUNTER("Scheduler/Rays read back from disk", nRaysUnspilled);
+STAT_INT_DISTRIBUTION("Scheduler/Resident rays", nResidentRays);
+STAT_FLOAT_DISTRIBUTION("Scheduler/Ray queueing time (ms)", rayQueueingTime);
+
+static string DefaultSpillDir() {
+    const char *tmpdir = getenv("TMPDIR");
+    return (tmpdir != nullptr && *tmpdir != '\0') ? tmpdir : "/tmp";
+}
+
+RayScheduler::RayScheduler(const size_t maxResidentRays,
+                           const string &spillDir,
+                           const size_t spillBatchSize)
+    : maxResidentRays(maxResidentRays),
+      spillDir(spillDir.empty() ? DefaultSpillDir() : spillDir),
+      spillBatchSize(spillBatchSize) {
+    if (maxResidentRays == 0 || spillBatchSize == 0) {
+        throw runtime_error("RayScheduler: limits must be positive");
+    }
+}
+
+size_t RayScheduler::PriorityClass(const RayState &ray) {
+    if (ray.isShadowRay) return 0;
+    return min<size_t>(ray.remainingBounces + 1, ClassCount - 1);
+}
+
+bool RayScheduler::AcceptsCameraRays() const {
+    return resident < maxResidentRays && spilled == 0;
+}
+
+void RayScheduler::Push(RayStatePtr &&ray) {
+    Queue &queue = queues[PriorityClass(*ray)];
+    queue.rays.push_back({Clock::now(), move(ray)});
+    resident++;
+
+    if (resident > maxResidentRays) {
+        SpillColdest();
+    }
+}
+
+RayStatePtr RayScheduler::Pop() {
+    size_t c = 0;
+    for (; c < ClassCount; c++) {
+        if (!queues[c].rays.empty() || !queues[c].spills.empty()) break;
+    }
+
+    if (c == ClassCount) return nullptr;
+
+    activeClass = c;
+    Queue &queue = queues[c];
+
+    if (queue.rays.empty()) {
+        Unspill(c);
+    }
+
+    Entry entry = move(queue.rays.front());
+    queue.rays.pop_front();
+    resident--;
+
+    const double queueingTime =
+        duration<double, milli>(Clock::now() - entry.enqueued).count();
+
+    ReportValue(nResidentRays, resident);
+    ReportValue(rayQueueingTime, queueingTime);
+
+    return move(entry.ray);
+}
+
+void RayScheduler::SpillColdest() {
+    while (resident > maxResidentRays) {
+        size_t c = ClassCount - 1;
+        for (; c > activeClass; c--) {
+            if (!queues[c].rays.empty()) break;
+        }
+
+        /* everything left in memory is at least as urgent as the rays we are
+           currently working on */
+        if (c == activeClass) return;
+
+        Spill(c);
+    }
+}
+
+void RayScheduler::Spill(const size_t priorityClass) {
+    Queue &queue = queues[priorityClass];
+    const size_t count = min(spillBatchSize, queue.rays.size());
+    const auto first = queue.rays.end() - count;
+
+    SpillFile spill{make_shared<TempFile>(spillDir + "/pbrt-rays"), count,
+                    first->enqueued};
+
+    /* the rays go out as one bag, which reads back as a record file */
+    RayBatch batch;
+    batch.reserve(count);
+    size_t capacity = 0;
+
+    for (auto it = first; it != queue.rays.end(); it++) {
+        batch.Add(*it->ray);
+        capacity += batch.MaxCompressedSize(batch.size() - 1);
+    }
+
+    string bag(capacity, '\0');
+    bag.resize(batch.Pack(&bag[0], bag.size()));
+    spill.file->write(bag);
+
+    queue.rays.erase(first, queue.rays.end());
+    queue.spills.push_back(move(spill));
+    queue.spilled += count;
+
+    resident -= count;
+    spilled += count;
+    nRaysSpilled += count;
+}
+
+void RayScheduler::Unspill(const size_t priorityClass) {
+    Queue &queue = queues[priorityClass];
+    SpillFile &spill = queue.spills.front();
+
+    RayBatch batch;
+    {
+        MMap_Region bag{spill.file->name()};
+        batch.Unpack(bag.addr(), bag.length());
+    }
+
+    if (batch.size() != spill.count) {
+        throw runtime_error("RayScheduler: spill file " + spill.file->name() +
+                            " is incomplete");
+    }
+
+    for (size_t i = 0; i < batch.size(); i++) {
+        queue.rays.push_back({spill.oldest, batch.Get(i)});
+    }
+
+    queue.spilled -= spill.count;
+    resident += spill.count;
+    spilled -= spill.count;
+    nRaysUnspilled += spill.count;
+
+    queue.spills.pop_front();
+}
+
+void RayScheduler::Snapshot(RayBatch &resident,
+                            vector<shared_ptr<TempFile>> &spillFiles) const {
+    resident.reserve(resident.size() + this->resident);
+
+    for (const Queue &queue : queues) {
+        for (const Entry &entry : queue.rays) {
+            resident.Add(*entry.ray);
+        }
+
+        for (const SpillFile &spill : queue.spills) {
+            spillFiles.push_back(spill.file);
+        }
+    }
+}
+
+RayScheduler::Gauge RayScheduler::GetGauge(const size_t priorityClass) const {
+    const Queue &queue = queues[priorityClass];
+    Gauge gauge;
+    gauge.resident = queue.rays.size();
+    gauge.spilled = queue.spilled;
+
+    Clock::time_point oldest = Clock::now();
+    const Clock::time_point now = oldest;
+
+    if (!queue.rays.empty()) {
+        oldest = min(oldest, queue.rays.front().enqueued);
+    }
+
+    if (!queue.spills.empty()) {
+        oldest = min(oldest, queue.spills.front().oldest);
+    }
+
+    gauge.oldestAge = duration<double>(now - oldest).count();
+    return gauge;
+}
+
+void RayScheduler::PrintGauges(ostream &out) const {
+    out << "ray queues: " << resident << " resident, " << spilled
+        << " spilled" << endl;
+
+    for (size_t c = 0; c < ClassCount; c++) {
+        const Gauge gauge = GetGauge(c);
+        if (gauge.resident == 0 && gauge.spilled == 0) continue;
+
+        out << "  " << setw(8) << left
+            << (c == 0 ? "shadow" : "b=" + to_string(c - 1)) << right
+            << " depth=" << gauge.resident + gauge.spilled
+            << " (spilled=" << gauge.spilled << ")"
+            << " oldest=" << fixed << setprecision(3) << gauge.oldestAge
+            << "s" << endl;
+    }
+}
+
+}  // namespace pbrt
@@ -0,0 +1,102 @@
+#ifndef PBRT_CLOUD_SCHEDULER_H
+#define PBRT_CLOUD_SCHEDULER_H
+
+#include <array>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "pbrt/raystate.h"
+#include "util/temp_file.h"
+
+namespace pbrt {
+
+/* RayScheduler holds the rays a worker has yet to process and hands them out
+ * so that paths close to completion are finished first: shadow rays, then
+ * rays in order of increasing remainingBounces. The number of rays kept in
+ * memory is bounded; once it exceeds the limit, the coldest queues are
+ * written to temporary files and read back when they become the most urgent
+ * work left. */
+class RayScheduler {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    /* class 0 is for shadow rays, class i + 1 for remainingBounces == i */
+    static constexpr size_t ClassCount = 33;
+
+    struct Gauge {
+        size_t resident{0};
+        size_t spilled{0};
+        double oldestAge{0.0}; /* in seconds */
+    };
+
+    RayScheduler(const size_t maxResidentRays = 1'000'000,
+                 const std::string &spillDir = "",
+                 const size_t spillBatchSize = 4096);
+
+    RayScheduler(const RayScheduler &) = delete;
+    RayScheduler &operator=(const RayScheduler &) = delete;
+
+    void Push(RayStatePtr &&ray);
+    RayStatePtr Pop();
+
+    bool Empty() const { return resident == 0 && spilled == 0; }
+    size_t Size() const { return resident + spilled; }
+    size_t Resident() const { return resident; }
+    size_t Spilled() const { return spilled; }
+
+    /* false while the worker holds more rays than it should; callers are
+     * expected to hold back new camera rays until this becomes true */
+    bool AcceptsCameraRays() const;
+
+    /* for checkpointing: resident rays are copied into `resident`, while
+     * spilled rays are left where they are and only their (immutable) files
+     * are returned; a file is kept until the last of its holders drops it */
+    void Snapshot(RayBatch &resident,
+                  std::vector<std::shared_ptr<TempFile>> &spillFiles) const;
+
+    Gauge GetGauge(const size_t priorityClass) const;
+    void PrintGauges(std::ostream &out) const;
+
+    static size_t PriorityClass(const RayState &ray);
+
+  private:
+    struct Entry {
+        Clock::time_point enqueued;
+        RayStatePtr ray;
+    };
+
+    struct SpillFile {
+        std::shared_ptr<TempFile> file;
+        size_t count;
+        Clock::time_point oldest;
+    };
+
+    struct Queue {
+        std::deque<Entry> rays{};
+        std::deque<SpillFile> spills{};
+        size_t spilled{0};
+    };
+
+    void SpillColdest();
+    void Spill(const size_t priorityClass);
+    void Unspill(const size_t priorityClass);
+
+    const size_t maxResidentRays;
+    const std::string spillDir;
+    const size_t spillBatchSize;
+
+    std::array<Queue, ClassCount> queues{};
+    size_t resident{0};
+    size_t spilled{0};
+
+    /* the class of the last ray handed out; never spilled */
+    size_t activeClass{0};
+};
+
+}  // namespace pbrt
+
+#endif /* PBRT_CLOUD_SCHEDULER_H */
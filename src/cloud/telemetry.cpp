@@ -0,0 +1,183 @@
+#include "pbrt/telemetry.h"
+
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace pbrt {
+
+static mutex statsMutex;
+static map<TreeletId, TreeletStats> reportedStats;
+static map<TreeletId, uint64_t> residentBytes;
+
+/* indexed by treelet id, which are dense */
+static thread_local vector<TreeletStats> threadStats;
+
+static TreeletStats &ThreadStats(const TreeletId treelet) {
+    if (threadStats.size() <= treelet) {
+        threadStats.resize(treelet + 1);
+    }
+
+    return threadStats[treelet];
+}
+
+void TreeletStats::Merge(const TreeletStats &other) {
+    raysTraced += other.raysTraced;
+    nodesVisited += other.nodesVisited;
+    primitivesTested += other.primitivesTested;
+    hits += other.hits;
+    loads += other.loads;
+    loadTime += other.loadTime;
+    residentBytes = max(residentBytes, other.residentBytes);
+
+    for (const auto &kv : other.forwarded) {
+        forwarded[kv.first] += kv.second;
+    }
+}
+
+bool TreeletStats::Empty() const {
+    return raysTraced == 0 && nodesVisited == 0 && loads == 0 &&
+           forwarded.empty();
+}
+
+void RecordTreeletTrace(const TreeletId treelet, const uint64_t nodesVisited,
+                        const uint64_t primitivesTested, const uint64_t hits) {
+    TreeletStats &stats = ThreadStats(treelet);
+    stats.raysTraced++;
+    stats.nodesVisited += nodesVisited;
+    stats.primitivesTested += primitivesTested;
+    stats.hits += hits;
+}
+
+void RecordTreeletForward(const TreeletId from, const TreeletId to) {
+    ThreadStats(from).forwarded[to]++;
+}
+
+void RecordTreeletLoad(const TreeletId treelet, const nanoseconds time,
+                       const uint64_t bytes) {
+    lock_guard<mutex> lock{statsMutex};
+    TreeletStats &stats = reportedStats[treelet];
+    stats.loads++;
+    stats.loadTime += time;
+    residentBytes[treelet] = bytes;
+}
+
+void ReportThreadTreeletStats() {
+    lock_guard<mutex> lock{statsMutex};
+
+    for (TreeletId t = 0; t < threadStats.size(); t++) {
+        if (threadStats[t].Empty()) continue;
+        reportedStats[t].Merge(threadStats[t]);
+        threadStats[t] = TreeletStats{};
+    }
+}
+
+map<TreeletId, TreeletStats> TakeTreeletStats() {
+    map<TreeletId, TreeletStats> result;
+
+    lock_guard<mutex> lock{statsMutex};
+    swap(result, reportedStats);
+
+    for (auto &kv : result) {
+        auto it = residentBytes.find(kv.first);
+        kv.second.residentBytes = (it == residentBytes.end()) ? 0 : it->second;
+    }
+
+    return result;
+}
+
+TreeletStatsExporter::Format TreeletStatsExporter::FormatFromPath(
+    const string &path) {
+    const string ext = ".csv";
+    if (path.size() >= ext.size() &&
+        path.compare(path.size() - ext.size(), ext.size(), ext) == 0) {
+        return Format::CSV;
+    }
+
+    return Format::JSONLines;
+}
+
+TreeletStatsExporter::TreeletStatsExporter(const string &path,
+                                           const uint64_t workerId,
+                                           const Clock::duration interval)
+    : workerId(workerId),
+      format(FormatFromPath(path)),
+      out(path, ios::out | ios::trunc),
+      exportDue(interval) {
+    if (!out.good()) {
+        throw runtime_error("could not open " + path);
+    }
+
+    if (format == Format::CSV) {
+        out << "timestamp,worker,treelet,rays,nodes,primitives,hits,loads,"
+               "load_ms,resident_bytes,forwarded"
+            << endl;
+    }
+}
+
+TreeletStatsExporter::~TreeletStatsExporter() {
+    try {
+        Export();
+    } catch (...) {
+    }
+}
+
+void TreeletStatsExporter::MaybeExport() {
+    if (exportDue.Due()) Export();
+}
+
+void TreeletStatsExporter::Export() {
+    ReportThreadTreeletStats();
+    exportDue.Reset();
+
+    const auto timestamp =
+        duration_cast<milliseconds>(system_clock::now().time_since_epoch())
+            .count();
+
+    for (const auto &kv : TakeTreeletStats()) {
+        const TreeletStats &s = kv.second;
+        const double loadMs = duration<double, milli>(s.loadTime).count();
+
+        if (format == Format::CSV) {
+            out << timestamp << ',' << workerId << ',' << kv.first << ','
+                << s.raysTraced << ',' << s.nodesVisited << ','
+                << s.primitivesTested << ',' << s.hits << ',' << s.loads << ','
+                << loadMs << ',' << s.residentBytes << ',';
+
+            /* destination:count pairs, separated by spaces */
+            bool first = true;
+            for (const auto &f : s.forwarded) {
+                out << (first ? "" : " ") << f.first << ':' << f.second;
+                first = false;
+            }
+
+            out << '\n';
+        } else {
+            out << "{\"timestamp\":" << timestamp << ",\"worker\":" << workerId
+                << ",\"treelet\":" << kv.first << ",\"rays\":" << s.raysTraced
+                << ",\"nodes\":" << s.nodesVisited
+                << ",\"primitives\":" << s.primitivesTested
+                << ",\"hits\":" << s.hits << ",\"loads\":" << s.loads
+                << ",\"load_ms\":" << loadMs
+                << ",\"resident_bytes\":" << s.residentBytes
+                << ",\"forwarded\":{";
+
+            bool first = true;
+            for (const auto &f : s.forwarded) {
+                out << (first ? "" : ",") << '"' << f.first
+                    << "\":" << f.second;
+                first = false;
+            }
+
+            out << "}}\n";
+        }
+    }
+
+    out.flush();
+}
+
+}  // namespace pbrt
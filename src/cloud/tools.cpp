@@ -0,0 +1,69 @@
+#include "cloud/tools.h"
+
+#include <string>
+
+#include "api.h"
+#include "cloud/manager.h"
+#include "parser.h"
+#include "pbrt.h"
+#include "util/path.h"
+
+using namespace std;
+
+namespace pbrt {
+
+void ParseToolArguments(
+    int argc, char const *argv[],
+    void (*usage)(const char *argv0, const char *msg),
+    const function<void(const string &arg)> &onArgument,
+    const function<bool(const string &name, const string &value)> &onOption) {
+    for (int i = 1; i < argc; i++) {
+        string arg{argv[i]};
+        string value;
+
+        if (arg == "--help" || arg == "-h") {
+            usage(argv[0], nullptr);
+        } else if (arg.compare(0, 2, "--") != 0) {
+            onArgument(arg);
+            continue;
+        }
+
+        const size_t eq = arg.find('=');
+        if (eq != string::npos) {
+            value = arg.substr(eq + 1);
+            arg = arg.substr(0, eq);
+        } else if (i + 1 < argc) {
+            value = argv[++i];
+        } else {
+            usage(argv[0], ("missing value after " + arg).c_str());
+        }
+
+        if (!onOption(arg, value)) {
+            usage(argv[0], ("unknown option " + arg).c_str());
+        }
+    }
+}
+
+void DumpScene(const string &scenePath, const string &dumpDir,
+               const int nThreads) {
+    roost::create_directories(dumpDir);
+
+    Options options;
+    options.nThreads = nThreads;
+    options.dumpScene = true;
+    options.quiet = true;
+
+    /* pbrt renders the scene after dumping it; one pixel is enough */
+    options.cropWindow[0][1] = 1e-6;
+    options.cropWindow[1][1] = 1e-6;
+
+    global::manager.init(dumpDir);
+    pbrtInit(options);
+    pbrtParseFile(scenePath);
+    pbrtCleanup();
+
+    /* pbrtInit() left the dump options behind */
+    PbrtOptions = Options();
+}
+
+}  // namespace pbrt
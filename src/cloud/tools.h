@@ -0,0 +1,28 @@
+#ifndef PBRT_CLOUD_TOOLS_H
+#define PBRT_CLOUD_TOOLS_H
+
+#include <functional>
+#include <string>
+
+namespace pbrt {
+
+/* Splits the command line of a tool into positional arguments and options,
+ * given as "--name value" or "--name=value", and hands each one to its
+ * callback. "--help" or "-h", an option without a value and an option that
+ * onOption returns false for end in usage(argv[0], msg), with a null msg for
+ * the help. */
+void ParseToolArguments(
+    int argc, char const *argv[],
+    void (*usage)(const char *argv0, const char *msg),
+    const std::function<void(const std::string &arg)> &onArgument,
+    const std::function<bool(const std::string &name,
+                             const std::string &value)> &onOption);
+
+/* Dumps the scene into dumpDir the same way `pbrt --dumpscene` would, with
+ * nThreads threads (0 for one per core), and resets PbrtOptions after. */
+void DumpScene(const std::string &scenePath, const std::string &dumpDir,
+               int nThreads);
+
+}  // namespace pbrt
+
+#endif /* PBRT_CLOUD_TOOLS_H */
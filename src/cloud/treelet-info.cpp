@@ -139,14 +139,14 @@ int main(int argc, char const *argv[]) {
         const uint32_t treeletCount = stoul(argv[3]);
         global::manager.init(scenePath.string());
 
-        auto filename = [](const uint32_t tId) { return "T" + to_string(tId); };
         map<uint32_t, CloudBVH::TreeletInfo> treeletInfo;
         map<uint32_t, size_t> treeletSize;
 
         for (uint32_t i = 0; i < treeletCount; i++) {
             CloudBVH bvh{i};
             treeletInfo[i] = bvh.GetInfo(i);
-            treeletSize[i] = roost::file_size(scenePath / filename(i));
+            treeletSize[i] =
+                global::manager.getObjectSize(ObjectType::Treelet, i);
         }
 
         if (operation == "report") {
@@ -1,9 +1,12 @@
 #include "treeletdumpbvh.h"
 #include "accelerators/cloud.h"
+#include "parallel.h"
 #include "paramset.h"
 #include "stats.h"
 #include <algorithm>
+#include <exception>
 #include <fstream>
+#include <mutex>
 
 #include "messages/utils.h"
 #include "pbrt.pb.h"
@@ -1902,12 +1905,40 @@ vector<uint32_t> TreeletDumpBVH::DumpTreelets(bool root) const {
 
     DumpSanityCheck(treeletNodeLocations);
 
+    // Dump the instances that are too large to copy up front, so that the
+    // treelets below only have to look up their IDs
     unordered_map<TreeletDumpBVH *, vector<uint32_t>> nonCopyableInstanceTreelets;
+    for (const TreeletInfo &treelet : allTreelets) {
+        for (uint64_t nodeIdx : treelet.nodes) {
+            const LinearBVHNode &node = nodes[nodeIdx];
+            for (int primIdx = 0; primIdx < node.nPrimitives; primIdx++) {
+                auto &prim = primitives[node.primitivesOffset + primIdx];
+                if (prim->GetType() != PrimitiveType::Transformed) continue;
 
-    for (uint32_t treeletID = 0; treeletID < allTreelets.size(); treeletID++) {
-        const TreeletInfo &treelet = allTreelets[treeletID];
-        // Find which triangles / meshes are in treelet
-        unordered_map<TriangleMesh *, vector<size_t>> trianglesInTreelet;
+                shared_ptr<TransformedPrimitive> tp =
+                    dynamic_pointer_cast<TransformedPrimitive>(prim);
+                shared_ptr<TreeletDumpBVH> instance =
+                    dynamic_pointer_cast<TreeletDumpBVH>(tp->GetPrimitive());
+
+                CHECK_NOTNULL(instance.get());
+                if (instance->copyable ||
+                    nonCopyableInstanceTreelets.count(instance.get())) {
+                    continue;
+                }
+
+                nonCopyableInstanceTreelets.emplace(
+                    instance.get(), instance->DumpTreelets(false));
+            }
+        }
+    }
+
+    // The meshes a treelet's triangles come from and the meshes of its
+    // instances, each in the order they're first found
+    auto findMeshes = [&](const TreeletInfo &treelet,
+                          vector<TriangleMesh *> &meshes,
+                          vector<TriangleMesh *> &instanceMeshes,
+                          unordered_map<TriangleMesh *, vector<size_t>> *triangles) {
+        unordered_set<TriangleMesh *> seen;
         for (uint64_t nodeIdx : treelet.nodes) {
             const LinearBVHNode &node = nodes[nodeIdx];
             for (int primIdx = 0; primIdx < node.nPrimitives; primIdx++) {
@@ -1919,18 +1950,21 @@ vector<uint32_t> TreeletDumpBVH::DumpTreelets(bool root) const {
                     CHECK_NOTNULL(tri);
                     TriangleMesh *mesh = tri->mesh.get();
 
+                    if (seen.insert(mesh).second) meshes.push_back(mesh);
+                    if (!triangles) continue;
+
                     uint64_t triNum =
                         (tri->v - tri->mesh->vertexIndices.data()) / 3;
 
                     CHECK_GE(triNum, 0);
                     CHECK_LT(triNum * 3, tri->mesh->vertexIndices.size());
-                    trianglesInTreelet[mesh].push_back(triNum);
+                    (*triangles)[mesh].push_back(triNum);
                 }
             }
         }
 
         // Get meshes for instances
-        unordered_set<TriangleMesh *> instanceMeshes;
+        seen.clear();
         for (const TreeletDumpBVH *inst : treelet.instances) {
             for (uint64_t nodeIdx = 0; nodeIdx < inst->nodeCount; nodeIdx++) {
                 const LinearBVHNode &node = inst->nodes[nodeIdx];
@@ -1943,14 +1977,41 @@ vector<uint32_t> TreeletDumpBVH::DumpTreelets(bool root) const {
                     const Shape *shape = gp->GetShape();
                     const Triangle *tri = dynamic_cast<const Triangle *>(shape);
                     CHECK_NOTNULL(tri);
-                    instanceMeshes.insert(tri->mesh.get());
+                    TriangleMesh *mesh = tri->mesh.get();
+                    if (seen.insert(mesh).second) instanceMeshes.push_back(mesh);
                 }
             }
         }
+    };
+
+    // Mesh IDs are handed out up front, in treelet order, so that they
+    // don't depend on how the treelets below get scheduled
+    vector<uint32_t> firstMeshIDs(allTreelets.size());
+    for (size_t treeletID = 0; treeletID < allTreelets.size(); treeletID++) {
+        vector<TriangleMesh *> meshes, instanceMeshes;
+        findMeshes(allTreelets[treeletID], meshes, instanceMeshes, nullptr);
+
+        const size_t meshCount = meshes.size() + instanceMeshes.size();
+        for (size_t i = 0; i < meshCount; i++) {
+            uint32_t sMeshID = global::manager.getNextId(ObjectType::TriangleMesh);
+            if (i == 0) firstMeshIDs[treeletID] = sMeshID;
+        }
+    }
+
+    // Treelets are independent of each other once their IDs are known, so
+    // they are written out in parallel. Only one treelet's worth of
+    // rewritten meshes is alive per thread at any time.
+    auto dumpTreelet = [&](int64_t treeletID) {
+        const TreeletInfo &treelet = allTreelets[treeletID];
+        // Find which triangles / meshes are in treelet
+        vector<TriangleMesh *> treeletMeshes, instanceMeshes;
+        unordered_map<TriangleMesh *, vector<size_t>> trianglesInTreelet;
+        findMeshes(treelet, treeletMeshes, instanceMeshes, &trianglesInTreelet);
+        uint32_t sMeshID = firstMeshIDs[treeletID];
 
         unsigned sTreeletID = global::manager.getId(&treelet);
         auto writer = global::manager.GetWriter(ObjectType::Treelet, sTreeletID);
-        uint32_t numTriMeshes = trianglesInTreelet.size() + instanceMeshes.size();
+        uint32_t numTriMeshes = treeletMeshes.size() + instanceMeshes.size();
 
         writer->write(numTriMeshes);
 
@@ -1963,90 +2024,34 @@ vector<uint32_t> TreeletDumpBVH::DumpTreelets(bool root) const {
         unordered_map<TriangleMesh *, uint32_t> triMeshIDs;
 
         // Write out rewritten meshes with only triangles in treelet
-        for (auto &kv : trianglesInTreelet) {
-            TriangleMesh *mesh = kv.first;
-            vector<size_t> &triNums = kv.second;
-
-            size_t numTris = triNums.size();
-            unordered_map<int, size_t> vertexRemap;
-            size_t newIdx = 0;
-            size_t newTriNum = 0;
-
-            for (auto triNum : triNums) {
-                for (int i = 0; i < 3; i++) {
-                    int idx = mesh->vertexIndices[triNum * 3 + i];
-                    if (vertexRemap.count(idx) == 0) {
-                        vertexRemap.emplace(idx, newIdx++);
-                    }
-                }
-                triNumRemap[mesh].emplace(triNum, newTriNum++);
-            }
-            size_t numVerts = newIdx;
-            CHECK_EQ(numVerts, vertexRemap.size());
-
-            vector<int> vertIdxs(numTris * 3);
-            vector<Point3f> P(numVerts);
-            vector<Vector3f> S(numVerts);
-            vector<Normal3f> N(numVerts);
-            vector<Point2f> uv(numVerts);
-            vector<int> faceIdxs(numVerts);
-
-            for (size_t i = 0; i < numTris; i++) {
-                size_t triNum = triNums[i];
-                for (int j = 0; j < 3; j++) {
-                    int origIdx = mesh->vertexIndices[triNum * 3 + j];
-                    int newIdx = vertexRemap.at(origIdx);
-                    vertIdxs[i * 3 + j] = newIdx;
-                }
-                if (mesh->faceIndices.size() > 0) {
-                    faceIdxs[i] = mesh->faceIndices[triNum];
-                }
-            }
+        for (TriangleMesh *mesh : treeletMeshes) {
+            vector<size_t> &triNums = trianglesInTreelet.at(mesh);
 
-            for (auto &kv : vertexRemap) {
-                int origIdx = kv.first;
-                int newIdx = kv.second;
-                P[newIdx] = mesh->p[origIdx];
-                if (mesh->s.get()) {
-                    S[newIdx] = mesh->s[origIdx];
-                }
-                if (mesh->n.get()) {
-                    N[newIdx] = mesh->n[origIdx];
-                }
-                if (mesh->uv.get()) {
-                    uv[newIdx] = mesh->uv[origIdx];
-                }
+            for (size_t i = 0; i < triNums.size(); i++) {
+                triNumRemap[mesh].emplace(triNums[i], i);
             }
 
-            shared_ptr<TriangleMesh> newMesh = make_shared<TriangleMesh>(
-                Transform(), numTris, vertIdxs.data(), numVerts,
-                P.data(), mesh->s.get() ? S.data() : nullptr,
-                mesh->n.get() ? N.data() : nullptr,
-                mesh->uv.get() ? uv.data() : nullptr, mesh->alphaMask,
-                mesh->shadowAlphaMask,
-                mesh->faceIndices.size() > 0 ? faceIdxs.data() : nullptr);
+            shared_ptr<TriangleMesh> newMesh = ExtractSubMesh(*mesh, triNums);
 
 
             // Give triangle mesh an ID
-            uint32_t sMeshID = global::manager.getNextId(ObjectType::TriangleMesh);
-
             triMeshIDs[mesh] = sMeshID;
 
             protobuf::TriangleMesh tmProto = to_protobuf(*newMesh);
-            tmProto.set_id(sMeshID);
+            tmProto.set_id(sMeshID++);
             tmProto.set_material_id(0);
+            StoreMeshBlob(tmProto, sTreeletID);
             writer->write(tmProto);
         }
 
         // Write out the full triangle meshes for all the instances referenced by this treelet
         for (TriangleMesh *instMesh : instanceMeshes) {
-            uint32_t sMeshID = global::manager.getNextId(ObjectType::TriangleMesh);
-
             triMeshIDs[instMesh] = sMeshID;
 
             protobuf::TriangleMesh tmProto = to_protobuf(*instMesh);
-            tmProto.set_id(sMeshID);
+            tmProto.set_id(sMeshID++);
             tmProto.set_material_id(0);
+            StoreMeshBlob(tmProto, sTreeletID);
             writer->write(tmProto);
         }
 
@@ -2073,15 +2078,8 @@ vector<uint32_t> TreeletDumpBVH::DumpTreelets(bool root) const {
                         instanceRef <<= 32;
                         instanceRef |= treeletInstanceStarts[treeletID].at(instance.get());
                     } else {
-                        auto iter = nonCopyableInstanceTreelets.find(instance.get());
-                        if (iter == nonCopyableInstanceTreelets.end()) {
-                            auto instanceIDs = instance->DumpTreelets(false);
-                            auto res = nonCopyableInstanceTreelets.emplace(instance.get(), move(instanceIDs));
-                            CHECK_EQ(res.second, true);
-                            iter = res.first;
-                        }
-
-                        instanceRef = iter->second[treelet.dirIdx];
+                        instanceRef = nonCopyableInstanceTreelets.at(
+                            instance.get())[treelet.dirIdx];
                         instanceRef <<= 32;
                     }
 
@@ -2164,7 +2162,22 @@ vector<uint32_t> TreeletDumpBVH::DumpTreelets(bool root) const {
                 writer->write(nodeProto);
             }
         }
-    }
+    };
+
+    // An exception can't leave a worker thread, so the first one is kept
+    // and thrown once all the treelets are done
+    mutex errorMutex;
+    exception_ptr error;
+    ParallelFor([&](int64_t treeletID) {
+        try {
+            dumpTreelet(treeletID);
+        } catch (...) {
+            lock_guard<mutex> lock(errorMutex);
+            if (!error) error = current_exception();
+        }
+    }, allTreelets.size());
+
+    if (error) rethrow_exception(error);
 
     if (root) {
         ofstream staticAllocOut(global::manager.getScenePath() + "/STATIC0_pre");
@@ -7,6 +7,7 @@
 #include "messages/utils.h"
 #include "pbrt.pb.h"
 #include "cloud/manager.h"
+#include "accelerators/proxy.h"
 
 using namespace pbrt;
 using namespace std;
@@ -14,9 +15,17 @@ using namespace std;
 int main(int argc, char *argv[]) {
     if (argc != 3) {
         cerr << argv[0] << " DIR BYTES" << endl;
+        cerr << argv[0] << " --index PROXY-DIR" << endl;
         exit(1);
     }
 
+    if (string(argv[1]) == "--index") {
+        ProxyIndex::Write(argv[2]);
+        cerr << "Indexed " << ProxyIndex(argv[2]).size() << " proxies in "
+             << ProxyIndex::Path(argv[2]) << endl;
+        return 0;
+    }
+
     const string sceneDir(argv[1]);
     uint64_t numBytes(stoul(argv[2]));
 
@@ -190,6 +190,8 @@ struct RenderOptions {
     std::vector<std::shared_ptr<Primitive>> primitives;
     std::map<std::string, std::vector<std::shared_ptr<Primitive>>> instances;
     std::map<std::string, std::shared_ptr<ProxyBVH>> proxies;
+    // Loaded on the first proxy of the scene; it can change between scenes
+    std::unique_ptr<ProxyIndex> proxyIndex;
     std::vector<std::shared_ptr<Primitive>> *currentInstance = nullptr;
     bool haveScatteringMedia = false;
 
@@ -1018,6 +1020,9 @@ void pbrtInit(const Options &opt) {
     ParallelInit();  // Threads must be launched before the profiler is
                      // initialized.
     InitProfiler();
+    if (!PbrtOptions.traceFile.empty())
+        InitTrace(std::chrono::microseconds(PbrtOptions.traceMinDuration),
+                  1 << 18);  // 6 MB per thread
 }
 
 void pbrtCleanup() {
@@ -1027,8 +1032,13 @@ void pbrtCleanup() {
     else if (currentApiState == APIState::WorldBlock)
         Error("pbrtCleanup() called while inside world block.");
     currentApiState = APIState::Uninitialized;
+    renderOptions.reset();
     ParallelCleanup();
     CleanupProfiler();
+    if (TracingEnabled) {
+        WriteTrace(PbrtOptions.traceFile);
+        CleanupTrace();
+    }
 }
 
 void pbrtIdentity() {
@@ -1770,38 +1780,31 @@ static std::shared_ptr<ProxyBVH> CreateProxy(const std::string &name) {
         return existingProxy->second;
     }
 
-    std::ifstream proxyHdr(PbrtOptions.proxyDir + "/" + name + "/HEADER",
-                           std::ios::binary);
-    if (!proxyHdr.is_open()) {
+    // The index of the proxy dir, if there is one, saves reading the
+    // HEADER of every proxy
+    std::unique_ptr<ProxyIndex> &proxyIndex = renderOptions->proxyIndex;
+    if (!proxyIndex) {
+        proxyIndex = std::make_unique<ProxyIndex>(PbrtOptions.proxyDir);
+    }
+
+    ProxyInfo info;
+    if (!proxyIndex->Lookup(name, &info) &&
+        !ReadProxyHeader(PbrtOptions.proxyDir + "/" + name + "/HEADER",
+                         &info)) {
         Error("Missing proxy");
         exit(1);
     }
 
-    Bounds3f root;
-    proxyHdr.read(reinterpret_cast<char *>(&root), sizeof(Bounds3f));
-    uint64_t treeletSize;
-    proxyHdr.read(reinterpret_cast<char *>(&treeletSize), sizeof(uint64_t));
-
-    uint64_t nodeCount;
-    proxyHdr.read(reinterpret_cast<char *>(&nodeCount), sizeof(uint64_t));
-
-    uint64_t numDependencies;
-    proxyHdr.read(reinterpret_cast<char *>(&numDependencies), sizeof(uint64_t));
     std::vector<const ProxyBVH *> deps;
-    deps.reserve(numDependencies);
-    for (int i = 0; i < numDependencies; i++) {
-        uint64_t numChars;
-        proxyHdr.read(reinterpret_cast<char *>(&numChars), sizeof(uint64_t));
-        std::vector<char> depBuf(numChars + 1, '\0');
-        proxyHdr.read(depBuf.data(), numChars);
-
-        std::string depName(depBuf.data());
+    deps.reserve(info.dependencies.size());
+    for (const std::string &depName : info.dependencies) {
         deps.push_back(CreateProxy(depName).get());
     }
 
     auto iter = renderOptions->proxies.emplace(name, 
-            std::make_shared<ProxyBVH>(root, treeletSize, name,
-                                       nodeCount, move(deps)));
+            std::make_shared<ProxyBVH>(info.bounds, info.size, name,
+                                       info.nodeCount, move(deps),
+                                       info.treeletCount));
     return iter.first->second;
 }
 
@@ -1875,6 +1878,11 @@ void pbrtWorldEnd() {
         CHECK_EQ(CurrentProfilerState(), ProfToBits(Prof::SceneConstruction));
         ProfilerState = ProfToBits(Prof::IntegratorRender);
 
+        if (!PbrtOptions.statsSnapshotPath.empty())
+            StartStatsSnapshots(
+                PbrtOptions.statsSnapshotPath,
+                std::chrono::seconds(PbrtOptions.statsSnapshotInterval));
+
         __timepoints.render_start = TimePoints::clock::now();
         if (scene && integrator) integrator->Render(*scene);
         __timepoints.render_end = TimePoints::clock::now();
@@ -1897,6 +1905,7 @@ void pbrtWorldEnd() {
     if (!PbrtOptions.cat && !PbrtOptions.toPly && !PbrtOptions.noRender) {
         MergeWorkerThreadStats();
         ReportThreadStats();
+        StopStatsSnapshots();
         if (!PbrtOptions.quiet) {
             PrintStats(stdout);
             ReportProfilerResults(stdout);
@@ -65,6 +65,10 @@ Film::Film(const Point2i &resolution, const Bounds2f &cropWindow,
     pixels = std::unique_ptr<Pixel[]>(new Pixel[croppedPixelBounds.Area()]);
     filmPixelMemory += croppedPixelBounds.Area() * sizeof(Pixel);
 
+    const int height = croppedPixelBounds.pMax.y - croppedPixelBounds.pMin.y;
+    dirtyRows.reset(new std::atomic<bool>[std::max(height, 0)]);
+    for (int y = 0; y < height; ++y) dirtyRows[y] = false;
+
     // Precompute filter weight table
     int offset = 0;
     for (int y = 0; y < filterTableWidth; ++y) {
@@ -111,6 +115,7 @@ void Film::Clear() {
         for (int c = 0; c < 3; ++c)
             pixel.splatXYZ[c] = pixel.xyz[c] = 0;
         pixel.filterWeightSum = 0;
+        MarkDirty(p.y);
     }
 }
 
@@ -127,6 +132,56 @@ void Film::MergeFilmTile(std::unique_ptr<FilmTile> tile) {
         for (int i = 0; i < 3; ++i) mergePixel.xyz[i] += xyz[i];
         mergePixel.filterWeightSum += tilePixel.filterWeightSum;
     }
+
+    const Bounds2i &tileBounds = tile->GetPixelBounds();
+    for (int y = tileBounds.pMin.y; y < tileBounds.pMax.y; ++y) MarkDirty(y);
+}
+
+void Film::SnapshotRows(bool onlyDirty, std::vector<int> *rows,
+                        std::vector<Float> *values) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const int width = croppedPixelBounds.pMax.x - croppedPixelBounds.pMin.x;
+    rows->clear();
+    values->clear();
+
+    for (int y = croppedPixelBounds.pMin.y; y < croppedPixelBounds.pMax.y;
+         ++y) {
+        // Clear the row's mark before copying it, so that concurrent splats
+        // are picked up by the next snapshot at the latest
+        bool dirty = dirtyRows[y - croppedPixelBounds.pMin.y].exchange(false);
+        if (onlyDirty && !dirty) continue;
+
+        rows->push_back(y);
+        for (int x = croppedPixelBounds.pMin.x; x < croppedPixelBounds.pMax.x;
+             ++x) {
+            const Pixel &pixel = GetPixel(Point2i(x, y));
+            for (int c = 0; c < 3; ++c) values->push_back(pixel.xyz[c]);
+            values->push_back(pixel.filterWeightSum);
+            for (int c = 0; c < 3; ++c) values->push_back(pixel.splatXYZ[c]);
+        }
+    }
+
+    CHECK_EQ(values->size(), rows->size() * width * CheckpointFloats);
+}
+
+void Film::RestoreRows(const std::vector<int> &rows,
+                       const std::vector<Float> &values) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const int width = croppedPixelBounds.pMax.x - croppedPixelBounds.pMin.x;
+    if (values.size() != rows.size() * width * CheckpointFloats)
+        Error("Film checkpoint doesn't match the film resolution");
+
+    const Float *v = values.data();
+    for (int y : rows) {
+        for (int x = croppedPixelBounds.pMin.x; x < croppedPixelBounds.pMax.x;
+             ++x) {
+            Pixel &pixel = GetPixel(Point2i(x, y));
+            for (int c = 0; c < 3; ++c) pixel.xyz[c] = *v++;
+            pixel.filterWeightSum = *v++;
+            for (int c = 0; c < 3; ++c) pixel.splatXYZ[c] = *v++;
+        }
+        MarkDirty(y);
+    }
 }
 
 void Film::SetImage(const Spectrum *img) const {
@@ -163,6 +218,7 @@ void Film::AddSplat(const Point2f &p, Spectrum v) {
     v.ToXYZ(xyz);
     Pixel &pixel = GetPixel((Point2i)p);
     for (int i = 0; i < 3; ++i) pixel.splatXYZ[i].Add(xyz[i]);
+    MarkDirty(((Point2i)p).y);
 }
 
 void Film::WriteImage(Float splatScale) {
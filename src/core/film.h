@@ -71,6 +71,15 @@ class Film {
     void WriteImage(Float splatScale = 1);
     void Clear();
 
+    // Film checkpointing: every pixel is saved as _CheckpointFloats_ values
+    // (xyz, filter weight sum, splat xyz). Rows are marked when they change,
+    // so that a snapshot can be restricted to what changed since the last one.
+    static PBRT_CONSTEXPR int CheckpointFloats = 7;
+    void SnapshotRows(bool onlyDirty, std::vector<int> *rows,
+                      std::vector<Float> *values);
+    void RestoreRows(const std::vector<int> &rows,
+                     const std::vector<Float> &values);
+
     void setFilename(const std::string &filename) { this->filename = filename; }
 
     // Film Public Data
@@ -90,6 +99,7 @@ class Film {
         Float pad;
     };
     std::unique_ptr<Pixel[]> pixels;
+    std::unique_ptr<std::atomic<bool>[]> dirtyRows;
     static PBRT_CONSTEXPR int filterTableWidth = 16;
     Float filterTable[filterTableWidth * filterTableWidth];
     std::mutex mutex;
@@ -104,6 +114,10 @@ class Film {
                      (p.y - croppedPixelBounds.pMin.y) * width;
         return pixels[offset];
     }
+    void MarkDirty(int y) {
+        dirtyRows[y - croppedPixelBounds.pMin.y].store(
+            true, std::memory_order_relaxed);
+    }
 };
 
 class FilmTile {
@@ -183,6 +183,10 @@ class BlockedArray {
         for (int v = 0; v < vRes; ++v)
             for (int u = 0; u < uRes; ++u) *a++ = (*this)(u, v);
     }
+    const T *Data() const { return data; }
+    size_t AllocatedBytes() const {
+        return sizeof(T) * RoundUp(uRes) * RoundUp(vRes);
+    }
 
   private:
     // BlockedArray Private Data
@@ -44,6 +44,7 @@
 #include "texture.h"
 #include "stats.h"
 #include "parallel.h"
+#include "numa.h"
 
 namespace pbrt {
 
@@ -206,6 +207,12 @@ MIPMap<T>::MIPMap(const Point2i &res, const T *img, bool doTrilinear,
         }, tRes, 16);
     }
 
+    // Spread the pyramid over the NUMA nodes; which thread filters a texel
+    // says nothing about which threads will look it up.
+    if (PbrtOptions.numa)
+        for (const auto &level : pyramid)
+            NumaInterleave(level->Data(), level->AllocatedBytes());
+
     // Initialize EWA filter weights if needed
     if (weightLut[0] == 0.) {
         for (int i = 0; i < WeightLUTSize; ++i) {
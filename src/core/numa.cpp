@@ -0,0 +1,248 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+// core/numa.cpp*
+#include "numa.h"
+#include "memory.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#ifdef __linux__
+#include <dirent.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace pbrt {
+
+// NUMA Local Definitions
+struct NumaNode {
+    int id;  // the kernel's number for the node
+    std::vector<int> cpus;
+};
+
+#ifdef __linux__
+// From <linux/mempolicy.h>, so that libnuma's headers aren't needed
+static PBRT_CONSTEXPR int MpolBind = 2, MpolInterleave = 3;
+static PBRT_CONSTEXPR unsigned MpolMoveFlag = 1 << 1;
+static PBRT_CONSTEXPR int MaxNodeId = 1024;
+static PBRT_CONSTEXPR int BitsPerLong = 8 * sizeof(unsigned long);
+#endif
+
+static std::vector<NumaNode> ReadTopology() {
+    std::vector<NumaNode> nodes;
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return nodes;
+
+    const std::string root = "/sys/devices/system/node/";
+    DIR *dir = opendir(root.c_str());
+    if (!dir) return nodes;
+
+    while (dirent *entry = readdir(dir)) {
+        int id;
+        char extra;
+        if (sscanf(entry->d_name, "node%d%c", &id, &extra) != 1 ||
+            id < 0 || id >= MaxNodeId)
+            continue;
+
+        std::ifstream in(root + entry->d_name + "/cpulist");
+        std::string list;
+        if (!std::getline(in, list)) continue;
+
+        // Memory-only nodes and nodes whose CPUs we can't use get no
+        // threads, so they're left out.
+        NumaNode node{id, {}};
+        for (int cpu : ParseCpuList(list))
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+                node.cpus.push_back(cpu);
+        if (!node.cpus.empty()) nodes.push_back(std::move(node));
+    }
+    closedir(dir);
+
+    std::sort(nodes.begin(), nodes.end(),
+              [](const NumaNode &a, const NumaNode &b) {
+                  return a.id < b.id;
+              });
+#endif
+    return nodes;
+}
+
+static const std::vector<NumaNode> &Topology() {
+    static const std::vector<NumaNode> nodes = ReadTopology();
+    return nodes;
+}
+
+#ifdef __linux__
+static bool SetMemoryPolicy(const void *ptr, size_t bytes, int mode,
+                            const std::vector<int> &nodeIndices,
+                            unsigned flags) {
+    unsigned long mask[MaxNodeId / BitsPerLong] = {};
+    for (int index : nodeIndices) {
+        const int id = Topology()[index].id;
+        mask[id / BitsPerLong] |= 1ul << (id % BitsPerLong);
+    }
+
+    // The kernel ignores the last bit of maxnode.
+    if (syscall(SYS_mbind, ptr, bytes, mode, mask, MaxNodeId + 1, flags) == 0)
+        return true;
+
+    static bool warned = false;
+    if (!warned) {
+        warned = true;
+        Warning("mbind() failed: %s. Memory is left where it was first "
+                "touched.", strerror(errno));
+    }
+    return false;
+}
+#endif
+
+// NUMA Function Definitions
+PBRT_THREAD_LOCAL int ThreadNumaNode;
+
+#ifdef __linux__
+// The affinity of the thread before NumaBindThread() first changed it
+static PBRT_THREAD_LOCAL bool threadBound;
+static PBRT_THREAD_LOCAL cpu_set_t threadOriginalCpus;
+#endif
+
+int NumaNodeCount() { return std::max<int>(1, Topology().size()); }
+
+std::vector<int> ParseCpuList(const std::string &list) {
+    // For example, "0-7,16-23" or "3"
+    std::vector<int> cpus;
+    const char *s = list.c_str();
+    while (*s) {
+        char *end;
+        const long first = strtol(s, &end, 10);
+        if (end == s) break;
+        long last = first;
+        s = end;
+        if (*s == '-') {
+            last = strtol(s + 1, &end, 10);
+            if (end == s + 1) break;
+            s = end;
+        }
+        for (long cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+        if (*s != ',') break;
+        ++s;
+    }
+    return cpus;
+}
+
+int NumaNodeForThread(int threadIndex, int nThreads) {
+    CHECK_GE(threadIndex, 0);
+    CHECK_LT(threadIndex, nThreads);
+    return (int64_t)threadIndex * NumaNodeCount() / nThreads;
+}
+
+void NumaBindThread(int node) {
+    CHECK_GE(node, 0);
+    CHECK_LT(node, NumaNodeCount());
+    ThreadNumaNode = node;
+#ifdef __linux__
+    if (Topology().empty()) return;
+
+    if (!threadBound &&
+        sched_getaffinity(0, sizeof(threadOriginalCpus),
+                          &threadOriginalCpus) == 0)
+        threadBound = true;
+
+    // The thread may run on any CPU of the node, since pinning to single
+    // CPUs would fight with whatever else runs on the machine.
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (int cpu : Topology()[node].cpus) CPU_SET(cpu, &cpus);
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+        Warning("Couldn't bind thread to NUMA node %d: %s",
+                Topology()[node].id, strerror(errno));
+#endif
+}
+
+void NumaUnbindThread() {
+    ThreadNumaNode = 0;
+#ifdef __linux__
+    if (!threadBound) return;
+    threadBound = false;
+
+    if (sched_setaffinity(0, sizeof(threadOriginalCpus),
+                          &threadOriginalCpus) != 0)
+        Warning("Couldn't restore the CPUs of the thread: %s",
+                strerror(errno));
+#endif
+}
+
+void NumaInterleave(const void *ptr, size_t bytes) {
+#ifdef __linux__
+    if (NumaNodeCount() < 2) return;
+
+    const uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+    const uintptr_t begin = ((uintptr_t)ptr + pageSize - 1) & ~(pageSize - 1);
+    const uintptr_t end = ((uintptr_t)ptr + bytes) & ~(pageSize - 1);
+    if (end <= begin) return;
+
+    std::vector<int> all(NumaNodeCount());
+    for (int i = 0; i < NumaNodeCount(); ++i) all[i] = i;
+    SetMemoryPolicy((const void *)begin, end - begin, MpolInterleave, all,
+                    MpolMoveFlag);
+#endif
+}
+
+void *NumaAllocOnNode(size_t bytes, int node) {
+#ifdef __linux__
+    void *ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+        LOG(FATAL) << "mmap() of " << bytes
+                   << " bytes failed: " << strerror(errno);
+    // Nothing is touched yet, so there's nothing to move.
+    if (NumaNodeCount() > 1) SetMemoryPolicy(ptr, bytes, MpolBind, {node}, 0);
+    return ptr;
+#else
+    return AllocAligned(bytes);
+#endif
+}
+
+void NumaFree(void *ptr, size_t bytes) {
+    if (!ptr) return;
+#ifdef __linux__
+    munmap(ptr, bytes);
+#else
+    FreeAligned(ptr);
+#endif
+}
+
+}  // namespace pbrt
@@ -0,0 +1,79 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef PBRT_CORE_NUMA_H
+#define PBRT_CORE_NUMA_H
+
+// core/numa.h*
+#include "pbrt.h"
+#include <string>
+#include <vector>
+
+namespace pbrt {
+
+// NUMA Declarations
+
+// The topology comes from /sys/devices/system/node, restricted to the CPUs
+// the process may run on; nodes are numbered 0..NumaNodeCount()-1 among
+// the ones that are left.  Without NUMA support, there is a single node.
+int NumaNodeCount();
+std::vector<int> ParseCpuList(const std::string &list);
+
+// The node the calling thread was bound to with NumaBindThread(), or 0.
+extern PBRT_THREAD_LOCAL int ThreadNumaNode;
+
+// Spreads nThreads threads evenly over the nodes, in blocks, so that
+// neighboring thread indices share a node.
+int NumaNodeForThread(int threadIndex, int nThreads);
+void NumaBindThread(int node);
+
+// Gives the calling thread back the CPUs it had before its first
+// NumaBindThread(), and resets ThreadNumaNode.
+void NumaUnbindThread();
+
+// Spreads the pages of an existing allocation round-robin over the nodes,
+// moving the ones that were already touched.  Only the whole pages inside
+// [ptr, ptr + bytes) are affected.
+void NumaInterleave(const void *ptr, size_t bytes);
+
+// Page-granular allocations whose memory is placed on the given node.
+void *NumaAllocOnNode(size_t bytes, int node);
+void NumaFree(void *ptr, size_t bytes);
+
+}  // namespace pbrt
+
+#endif  // PBRT_CORE_NUMA_H
@@ -34,30 +34,17 @@
 // core/parallel.cpp*
 #include "parallel.h"
 #include "memory.h"
+#include "numa.h"
 #include "stats.h"
+#include <deque>
 #include <list>
+#include <memory>
 #include <thread>
 #include <condition_variable>
 
 namespace pbrt {
 
 // Parallel Local Definitions
-static std::vector<std::thread> threads;
-static bool shutdownThreads = false;
-class ParallelForLoop;
-static ParallelForLoop *workList = nullptr;
-static std::mutex workListMutex;
-
-// Bookkeeping variables to help with the implementation of
-// MergeWorkerThreadStats().
-static std::atomic<bool> reportWorkerStats{false};
-// Number of workers that still need to report their stats.
-static std::atomic<int> reporterCount;
-// After kicking the workers to report their stats, the main thread waits
-// on this condition variable until they've all done so.
-static std::condition_variable reportDoneCondition;
-static std::mutex reportDoneMutex;
-
 class ParallelForLoop {
   public:
     // ParallelForLoop Public Methods
@@ -66,13 +53,17 @@ class ParallelForLoop {
         : func1D(std::move(func1D)),
           maxIndex(maxIndex),
           chunkSize(chunkSize),
-          profilerState(profilerState) {}
+          profilerState(profilerState),
+          pending(maxIndex),
+          remaining(&pending) {}
     ParallelForLoop(const std::function<void(Point2i)> &f, const Point2i &count,
                     uint64_t profilerState)
         : func2D(f),
           maxIndex(count.x * count.y),
           chunkSize(1),
-          profilerState(profilerState) {
+          profilerState(profilerState),
+          pending(maxIndex),
+          remaining(&pending) {
         nX = count.x;
     }
 
@@ -83,17 +74,85 @@ class ParallelForLoop {
     const int64_t maxIndex;
     const int chunkSize;
     uint64_t profilerState;
-    int64_t nextIndex = 0;
-    int activeWorkers = 0;
-    ParallelForLoop *next = nullptr;
     int nX = -1;
+    // Iterations that haven't finished yet. A TaskGroup's tasks count
+    // towards the group's total instead of their own.
+    std::atomic<int64_t> pending;
+    std::atomic<int64_t> *remaining;
+};
 
-    // ParallelForLoop Private Methods
-    bool Finished() const {
-        return nextIndex >= maxIndex && activeWorkers == 0;
+// A range of loop iterations. Whoever runs it splits off halves for other
+// threads to steal, down to single chunks.
+struct LoopRange {
+    ParallelForLoop *loop;
+    int64_t begin, end;
+};
+
+// Each thread pushes and pops ranges at the back of its own deque, and
+// idle threads steal from the front of the others', where the biggest
+// ranges are. The lock is only contended while a thread is being robbed.
+class WorkDeque {
+  public:
+    void Push(const LoopRange &range) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ranges.push_back(range);
+        size = ranges.size();
+    }
+    bool Pop(LoopRange *range) {
+        if (size == 0) return false;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (ranges.empty()) return false;
+        *range = ranges.back();
+        ranges.pop_back();
+        size = ranges.size();
+        return true;
     }
+    bool Empty() const { return size == 0; }
+    bool Steal(LoopRange *range) {
+        if (size == 0) return false;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (ranges.empty()) return false;
+        *range = ranges.front();
+        ranges.pop_front();
+        size = ranges.size();
+        return true;
+    }
+
+  private:
+    std::mutex mutex;
+    std::deque<LoopRange> ranges;
+    // Read without the lock, so that thieves skip empty deques cheaply
+    std::atomic<size_t> size{0};
 };
 
+static std::vector<std::thread> threads;
+static std::atomic<bool> shutdownThreads{false};
+
+// One deque for each thread of the pool, indexed by ThreadIndex, and a
+// last one shared by threads from outside the pool that call ParallelFor.
+static std::vector<std::unique_ptr<WorkDeque>> workDeques;
+static PBRT_THREAD_LOCAL WorkDeque *threadDeque;
+static PBRT_THREAD_LOCAL uint64_t stealState;
+
+// Idle workers sleep on sleepCondition until workVersion changes, which
+// happens whenever work is pushed. Threads waiting for a loop to finish
+// sleep there too, and are also woken when a loop's counter drops to
+// zero.
+static std::atomic<uint64_t> workVersion{0};
+static std::atomic<int> sleepingWorkers{0};
+static std::mutex sleepMutex;
+static std::condition_variable sleepCondition;
+
+// Bookkeeping variables to help with the implementation of
+// MergeWorkerThreadStats().
+static std::atomic<int> reportGeneration{0};
+// Number of workers that still need to report their stats.
+static std::atomic<int> reporterCount;
+// After kicking the workers to report their stats, the main thread waits
+// on this condition variable until they've all done so.
+static std::condition_variable reportDoneCondition;
+static std::mutex reportDoneMutex;
+
 void Barrier::Wait() {
     std::unique_lock<std::mutex> lock(mutex);
     CHECK_GT(count, 0);
@@ -107,11 +166,134 @@ void Barrier::Wait() {
         cv.wait(lock, [this] { return count == 0; });
 }
 
-static std::condition_variable workListCondition;
+static WorkDeque *localDeque() {
+    return threadDeque ? threadDeque : workDeques.back().get();
+}
+
+static void wakeWorkers(bool all) {
+    ++workVersion;
+    if (sleepingWorkers > 0) {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        if (all)
+            sleepCondition.notify_all();
+        else
+            sleepCondition.notify_one();
+    }
+}
+
+static void wakeWaiters() {
+    if (sleepingWorkers > 0) {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        sleepCondition.notify_all();
+    }
+}
+
+static void pushRange(const LoopRange &range) {
+    localDeque()->Push(range);
+    wakeWorkers(false);
+}
+
+static bool findRange(LoopRange *range) {
+    if (localDeque()->Pop(range)) return true;
+
+    // Start at a random victim, so that thieves don't all line up at the
+    // same deque.
+    if (stealState == 0) stealState = (uintptr_t)&stealState | 1;
+    stealState ^= stealState << 13;
+    stealState ^= stealState >> 7;
+    stealState ^= stealState << 17;
+
+    const size_t nDeques = workDeques.size();
+    const size_t start = stealState % nDeques;
+    for (size_t i = 0; i < nDeques; ++i)
+        if (workDeques[(start + i) % nDeques]->Steal(range)) return true;
+    return false;
+}
+
+static void runRange(LoopRange range) {
+    ParallelForLoop &loop = *range.loop;
+    int64_t nDone = 0;
+
+    while (range.begin < range.end) {
+        // Split off the upper half only while this thread has nothing
+        // left for others to steal; otherwise, splitting further would
+        // just be overhead.
+        if (range.end - range.begin > loop.chunkSize && localDeque()->Empty()) {
+            int64_t nChunks =
+                (range.end - range.begin + loop.chunkSize - 1) / loop.chunkSize;
+            int64_t mid = range.begin + (nChunks / 2) * loop.chunkSize;
+            pushRange({&loop, mid, range.end});
+            range.end = mid;
+            continue;
+        }
+
+        // Run loop indices in _[indexStart, indexEnd)_
+        int64_t indexStart = range.begin;
+        int64_t indexEnd = std::min(indexStart + loop.chunkSize, range.end);
+        range.begin = indexEnd;
+        nDone += indexEnd - indexStart;
+
+        const int64_t traceStart =
+            TracingEnabled.load(std::memory_order_relaxed) ? TraceClock() : -1;
+        for (int64_t index = indexStart; index < indexEnd; ++index) {
+            uint64_t oldState = ProfilerState;
+            ProfilerState = loop.profilerState;
+            if (loop.func1D) {
+                loop.func1D(index);
+            }
+            // Handle other types of loops
+            else {
+                CHECK(loop.func2D);
+                loop.func2D(Point2i(index % loop.nX, index / loop.nX));
+            }
+            ProfilerState = oldState;
+        }
+        if (traceStart >= 0)
+            RecordTraceEvent((int)TraceEvent::ParallelForChunk, traceStart,
+                             TraceClock());
+        ReportThreadStatsIfRequested();
+    }
+
+    // The loop may be gone as soon as this is done
+    if (loop.remaining->fetch_sub(nDone) == nDone) wakeWaiters();
+}
+
+// Runs whatever work there is, this thread's own first, until the counter
+// drops to zero. Once there's nothing left to help with, the thread spins
+// for a little while, since the last ranges are often about to finish,
+// and then sleeps until the counter is zero or more work shows up.
+static void helpUntilDone(const std::atomic<int64_t> &remaining) {
+    LoopRange range;
+    int idleRounds = 0;
+    while (remaining > 0) {
+        const uint64_t version = workVersion;
+        if (findRange(&range)) {
+            runRange(range);
+            idleRounds = 0;
+            continue;
+        }
+
+        if (++idleRounds < 64) {
+            std::this_thread::yield();
+            continue;
+        }
+        idleRounds = 0;
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        ++sleepingWorkers;
+        sleepCondition.wait(lock, [&]() {
+            return remaining == 0 || workVersion != version;
+        });
+        --sleepingWorkers;
+    }
+}
 
 static void workerThreadFunc(int tIndex, std::shared_ptr<Barrier> barrier) {
     LOG(INFO) << "Started execution in worker thread " << tIndex;
     ThreadIndex = tIndex;
+    threadDeque = workDeques[tIndex].get();
+    if (PbrtOptions.numa)
+        NumaBindThread(NumaNodeForThread(tIndex, MaxThreadIndex()));
 
     // Give the profiler a chance to do per-thread initialization for
     // the worker thread before the profiling system actually stops running.
@@ -126,56 +308,43 @@ static void workerThreadFunc(int tIndex, std::shared_ptr<Barrier> barrier) {
     // the threads have cleared it.
     barrier.reset();
 
-    std::unique_lock<std::mutex> lock(workListMutex);
+    int reportedGeneration = reportGeneration;
+    int idleRounds = 0;
+    LoopRange range;
     while (!shutdownThreads) {
-        if (reportWorkerStats) {
+        if (reportGeneration != reportedGeneration) {
+            reportedGeneration = reportGeneration;
             ReportThreadStats();
+            std::lock_guard<std::mutex> lock(reportDoneMutex);
             if (--reporterCount == 0)
                 // Once all worker threads have merged their stats, wake up
                 // the main thread.
                 reportDoneCondition.notify_one();
-            // Now sleep again.
-            workListCondition.wait(lock);
-        } else if (!workList) {
-            // Sleep until there are more tasks to run
-            workListCondition.wait(lock);
-        } else {
-            // Get work from _workList_ and run loop iterations
-            ParallelForLoop &loop = *workList;
-
-            // Run a chunk of loop iterations for _loop_
-
-            // Find the set of loop iterations to run next
-            int64_t indexStart = loop.nextIndex;
-            int64_t indexEnd =
-                std::min(indexStart + loop.chunkSize, loop.maxIndex);
-
-            // Update _loop_ to reflect iterations this thread will run
-            loop.nextIndex = indexEnd;
-            if (loop.nextIndex == loop.maxIndex) workList = loop.next;
-            loop.activeWorkers++;
-
-            // Run loop indices in _[indexStart, indexEnd)_
-            lock.unlock();
-            for (int64_t index = indexStart; index < indexEnd; ++index) {
-                uint64_t oldState = ProfilerState;
-                ProfilerState = loop.profilerState;
-                if (loop.func1D) {
-                    loop.func1D(index);
-                }
-                // Handle other types of loops
-                else {
-                    CHECK(loop.func2D);
-                    loop.func2D(Point2i(index % loop.nX, index / loop.nX));
-                }
-                ProfilerState = oldState;
-            }
-            lock.lock();
+            continue;
+        }
+
+        const uint64_t version = workVersion;
+        if (findRange(&range)) {
+            runRange(range);
+            idleRounds = 0;
+            continue;
+        }
 
-            // Update _loop_ to reflect completion of iterations
-            loop.activeWorkers--;
-            if (loop.Finished()) workListCondition.notify_all();
+        // Fine-grained loops push work again soon, so keep looking for a
+        // little while before going to sleep.
+        if (++idleRounds < 64) {
+            std::this_thread::yield();
+            continue;
         }
+        idleRounds = 0;
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        ++sleepingWorkers;
+        sleepCondition.wait(lock, [&]() {
+            return shutdownThreads || workVersion != version ||
+                   reportGeneration != reportedGeneration;
+        });
+        --sleepingWorkers;
     }
     LOG(INFO) << "Exiting worker thread " << tIndex;
 }
@@ -186,56 +355,19 @@ void ParallelFor(std::function<void(int64_t)> func, int64_t count,
     CHECK(threads.size() > 0 || MaxThreadIndex() == 1);
 
     // Run iterations immediately if not using threads or if _count_ is small
-    if (threads.empty() || count < chunkSize) {
-        for (int64_t i = 0; i < count; ++i) func(i);
+    if (threads.empty() || count <= chunkSize) {
+        for (int64_t i = 0; i < count; ++i) {
+            func(i);
+            ReportThreadStatsIfRequested();
+        }
         return;
     }
 
-    // Create and enqueue _ParallelForLoop_ for this loop
+    // Push the whole loop as one range, and help until it's done
     ParallelForLoop loop(std::move(func), count, chunkSize,
                          CurrentProfilerState());
-    workListMutex.lock();
-    loop.next = workList;
-    workList = &loop;
-    workListMutex.unlock();
-
-    // Notify worker threads of work to be done
-    std::unique_lock<std::mutex> lock(workListMutex);
-    workListCondition.notify_all();
-
-    // Help out with parallel loop iterations in the current thread
-    while (!loop.Finished()) {
-        // Run a chunk of loop iterations for _loop_
-
-        // Find the set of loop iterations to run next
-        int64_t indexStart = loop.nextIndex;
-        int64_t indexEnd = std::min(indexStart + loop.chunkSize, loop.maxIndex);
-
-        // Update _loop_ to reflect iterations this thread will run
-        loop.nextIndex = indexEnd;
-        if (loop.nextIndex == loop.maxIndex) workList = loop.next;
-        loop.activeWorkers++;
-
-        // Run loop indices in _[indexStart, indexEnd)_
-        lock.unlock();
-        for (int64_t index = indexStart; index < indexEnd; ++index) {
-            uint64_t oldState = ProfilerState;
-            ProfilerState = loop.profilerState;
-            if (loop.func1D) {
-                loop.func1D(index);
-            }
-            // Handle other types of loops
-            else {
-                CHECK(loop.func2D);
-                loop.func2D(Point2i(index % loop.nX, index / loop.nX));
-            }
-            ProfilerState = oldState;
-        }
-        lock.lock();
-
-        // Update _loop_ to reflect completion of iterations
-        loop.activeWorkers--;
-    }
+    pushRange({&loop, 0, count});
+    helpUntilDone(loop.pending);
 }
 
 PBRT_THREAD_LOCAL int ThreadIndex;
@@ -249,53 +381,44 @@ void ParallelFor2D(std::function<void(Point2i)> func, const Point2i &count) {
 
     if (threads.empty() || count.x * count.y <= 1) {
         for (int y = 0; y < count.y; ++y)
-            for (int x = 0; x < count.x; ++x) func(Point2i(x, y));
+            for (int x = 0; x < count.x; ++x) {
+                func(Point2i(x, y));
+                ReportThreadStatsIfRequested();
+            }
         return;
     }
 
     ParallelForLoop loop(std::move(func), count, CurrentProfilerState());
-    {
-        std::lock_guard<std::mutex> lock(workListMutex);
-        loop.next = workList;
-        workList = &loop;
-    }
-
-    std::unique_lock<std::mutex> lock(workListMutex);
-    workListCondition.notify_all();
-
-    // Help out with parallel loop iterations in the current thread
-    while (!loop.Finished()) {
-        // Run a chunk of loop iterations for _loop_
+    pushRange({&loop, 0, loop.maxIndex});
+    helpUntilDone(loop.pending);
+}
 
-        // Find the set of loop iterations to run next
-        int64_t indexStart = loop.nextIndex;
-        int64_t indexEnd = std::min(indexStart + loop.chunkSize, loop.maxIndex);
+TaskGroup::TaskGroup() {}
 
-        // Update _loop_ to reflect iterations this thread will run
-        loop.nextIndex = indexEnd;
-        if (loop.nextIndex == loop.maxIndex) workList = loop.next;
-        loop.activeWorkers++;
+TaskGroup::~TaskGroup() { Wait(); }
 
-        // Run loop indices in _[indexStart, indexEnd)_
-        lock.unlock();
-        for (int64_t index = indexStart; index < indexEnd; ++index) {
-            uint64_t oldState = ProfilerState;
-            ProfilerState = loop.profilerState;
-            if (loop.func1D) {
-                loop.func1D(index);
-            }
-            // Handle other types of loops
-            else {
-                CHECK(loop.func2D);
-                loop.func2D(Point2i(index % loop.nX, index / loop.nX));
-            }
-            ProfilerState = oldState;
-        }
-        lock.lock();
+void TaskGroup::Spawn(std::function<void()> task) {
+    if (threads.empty()) {
+        task();
+        return;
+    }
 
-        // Update _loop_ to reflect completion of iterations
-        loop.activeWorkers--;
+    ParallelForLoop *loop;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.emplace_back(new ParallelForLoop(
+            [task](int64_t) { task(); }, 1, 1, CurrentProfilerState()));
+        loop = tasks.back().get();
     }
+    loop->remaining = &pending;
+    ++pending;
+    pushRange({loop, 0, 1});
+}
+
+void TaskGroup::Wait() {
+    helpUntilDone(pending);
+    std::lock_guard<std::mutex> lock(mutex);
+    tasks.clear();
 }
 
 int NumSystemCores() {
@@ -307,6 +430,19 @@ void ParallelInit() {
     int nThreads = MaxThreadIndex();
     ThreadIndex = 0;
 
+    if (PbrtOptions.numa) {
+        if (NumaNodeCount() == 1)
+            Warning("--numa given, but only one NUMA node was found");
+        else
+            LOG(INFO) << "Spreading " << nThreads << " threads over "
+                      << NumaNodeCount() << " NUMA nodes";
+        NumaBindThread(NumaNodeForThread(0, nThreads));
+    }
+
+    for (int i = 0; i < nThreads + 1; ++i)
+        workDeques.push_back(std::unique_ptr<WorkDeque>(new WorkDeque));
+    threadDeque = workDeques[0].get();
+
     // Create a barrier so that we can be sure all worker threads get past
     // their call to ProfilerWorkerThreadInit() before we return from this
     // function.  In turn, we can be sure that the profiling system isn't
@@ -322,34 +458,34 @@ void ParallelInit() {
 }
 
 void ParallelCleanup() {
-    if (threads.empty()) return;
-
-    {
-        std::lock_guard<std::mutex> lock(workListMutex);
+    if (!threads.empty()) {
         shutdownThreads = true;
-        workListCondition.notify_all();
+        wakeWorkers(true);
+
+        for (std::thread &thread : threads) thread.join();
+        threads.erase(threads.begin(), threads.end());
+        shutdownThreads = false;
     }
 
-    for (std::thread &thread : threads) thread.join();
-    threads.erase(threads.begin(), threads.end());
-    shutdownThreads = false;
+    threadDeque = nullptr;
+    workDeques.clear();
+
+    // ParallelInit() bound the main thread to a node with --numa
+    NumaUnbindThread();
 }
 
 void MergeWorkerThreadStats() {
-    std::unique_lock<std::mutex> lock(workListMutex);
-    std::unique_lock<std::mutex> doneLock(reportDoneMutex);
+    std::unique_lock<std::mutex> lock(reportDoneMutex);
     // Set up state so that the worker threads will know that we would like
     // them to report their thread-specific stats when they wake up.
-    reportWorkerStats = true;
     reporterCount = threads.size();
+    ++reportGeneration;
 
     // Wake up the worker threads.
-    workListCondition.notify_all();
+    wakeWorkers(true);
 
     // Wait for all of them to merge their stats.
     reportDoneCondition.wait(lock, []() { return reporterCount == 0; });
-
-    reportWorkerStats = false;
 }
 
 }  // namespace pbrt
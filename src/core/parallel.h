@@ -45,6 +45,8 @@
 #include <condition_variable>
 #include <functional>
 #include <atomic>
+#include <memory>
+#include <vector>
 
 namespace pbrt {
 
@@ -98,10 +100,40 @@ class Barrier {
     int count;
 };
 
+// ParallelFor() and ParallelFor2D() return once all the iterations have
+// run. The calling thread helps with them; it's fine to call them from
+// inside another loop, or from a TaskGroup task.
+//
+// While it waits, the calling thread may also run iterations of other
+// loops, including the one it was called from. So don't hold a
+// non-recursive mutex across a nested ParallelFor() if the outer loop's
+// body takes the same mutex: the thread can deadlock on itself.
 void ParallelFor(std::function<void(int64_t)> func, int64_t count,
                  int chunkSize = 1);
 extern PBRT_THREAD_LOCAL int ThreadIndex;
 void ParallelFor2D(std::function<void(Point2i)> func, const Point2i &count);
+
+// Runs tasks on the worker threads; tasks may spawn more tasks into the
+// same group. Wait() helps with pending work until all of them are done,
+// and the destructor waits too. Like ParallelFor(), Wait() can run
+// unrelated work in the meantime, so the same caveat about locks applies.
+class ParallelForLoop;
+class TaskGroup {
+  public:
+    TaskGroup();
+    ~TaskGroup();
+    TaskGroup(const TaskGroup &) = delete;
+    TaskGroup &operator=(const TaskGroup &) = delete;
+
+    void Spawn(std::function<void()> task);
+    void Wait();
+
+  private:
+    std::atomic<int64_t> pending{0};
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ParallelForLoop>> tasks;
+};
+
 int MaxThreadIndex();
 int NumSystemCores();
 
@@ -190,6 +190,18 @@ struct Options {
     // x0, x1, y0, y1
     Float cropWindow[2][2];
     std::string proxyDir {};
+    std::string checkpointDir {};
+    int checkpointInterval = 60;
+    std::string treeletStatsFile {};
+    int treeletStatsInterval = 10;
+    std::string traceFile {};
+    int traceMinDuration = 10;  // microseconds
+    std::string statsSnapshotPath {};
+    int statsSnapshotInterval = 10;
+    bool numa = false;
+    int meshFormat = 2;
+    bool quantizeMeshes = false;
+    bool dedupBlobs = false;
 };
 
 extern Options PbrtOptions;
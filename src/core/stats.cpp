@@ -32,13 +32,19 @@
 
 // core/stats.cpp*
 #include "stats.h"
+#include <poll.h>
 #include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 #include <algorithm>
 #include <array>
 #include <atomic>
 #include <cinttypes>
 #include <functional>
+#include <memory>
 #include <mutex>
+#include <thread>
 #include <type_traits>
 #include "parallel.h"
 #include "stringprint.h"
@@ -55,6 +61,9 @@ TimePoints __timepoints;
 // Statistics Local Variables
 std::vector<std::function<void(StatsAccumulator &)>> *StatRegisterer::funcs;
 static StatsAccumulator statsAccumulator;
+// Guards statsAccumulator, which the stats snapshot thread reads while
+// the other threads report into it.
+static std::mutex statsMutex;
 
 // For a given profiler state (i.e., a set of "on" bits corresponding to
 // profiling categories that are active), ProfileSample stores a count of
@@ -81,8 +90,7 @@ static void ReportProfileSample(int, siginfo_t *, void *);
 
 // Statistics Definitions
 void ReportThreadStats() {
-    static std::mutex mutex;
-    std::lock_guard<std::mutex> lock(mutex);
+    std::lock_guard<std::mutex> lock(statsMutex);
     StatRegisterer::CallCallbacks(statsAccumulator);
 }
 
@@ -90,9 +98,15 @@ void StatRegisterer::CallCallbacks(StatsAccumulator &accum) {
     for (auto func : *funcs) func(accum);
 }
 
-void PrintStats(FILE *dest) { statsAccumulator.Print(dest); }
+void PrintStats(FILE *dest) {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    statsAccumulator.Print(dest);
+}
 
-void ClearStats() { statsAccumulator.Clear(); }
+void ClearStats() {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    statsAccumulator.Clear();
+}
 
 static void getCategoryAndTitle(const std::string &str, std::string *category,
                                 std::string *title) {
@@ -233,6 +247,7 @@ pbrt::AccumulatedStats pbrt::stats::GetThreadStats()
     if (!statsFetched) {
         ReportThreadStats();
         statsFetched = true;
+        std::lock_guard<std::mutex> lock(statsMutex);
         stats = statsAccumulator.Export();
     }
 
@@ -429,4 +444,440 @@ void ReportProfilerResults(FILE *dest) {
 #endif
 }
 
+// Trace Local Definitions
+struct TraceRecord {
+    int64_t start, end;
+    int event;
+};
+
+struct TraceBuffer {
+    TraceBuffer(size_t size, int threadIndex)
+        : records(size), threadIndex(threadIndex) {}
+
+    std::vector<TraceRecord> records;
+    uint64_t recorded = 0;  // records[recorded % size] is the oldest one
+    int threadIndex;
+};
+
+std::atomic<bool> TracingEnabled{false};
+static int64_t traceMinDuration;
+static size_t traceBufferSize;
+static int64_t traceStartTime;
+static int traceGeneration = 0;
+static std::mutex traceBuffersMutex;
+static std::vector<std::unique_ptr<TraceBuffer>> traceBuffers;
+static PBRT_THREAD_LOCAL TraceBuffer *threadTraceBuffer;
+static PBRT_THREAD_LOCAL int threadTraceGeneration;
+
+void InitTrace(std::chrono::nanoseconds minDuration, size_t eventsPerThread) {
+    CHECK(!TracingEnabled);
+    CHECK_GT(eventsPerThread, 0);
+    traceMinDuration = minDuration.count();
+    traceBufferSize = eventsPerThread;
+    traceStartTime = TraceClock();
+    ++traceGeneration;
+    TracingEnabled.store(true, std::memory_order_release);
+}
+
+void RecordTraceEvent(int event, int64_t start, int64_t end) {
+    if (!TracingEnabled.load(std::memory_order_acquire) ||
+        end - start < traceMinDuration)
+        return;
+
+    // The buffer of a thread belongs to traceBuffers, so that it outlives
+    // the thread; the generation tells stale pointers from an earlier
+    // InitTrace() apart.
+    if (!threadTraceBuffer || threadTraceGeneration != traceGeneration) {
+        std::lock_guard<std::mutex> lock(traceBuffersMutex);
+        traceBuffers.emplace_back(new TraceBuffer(traceBufferSize, ThreadIndex));
+        threadTraceBuffer = traceBuffers.back().get();
+        threadTraceGeneration = traceGeneration;
+    }
+
+    TraceBuffer &buffer = *threadTraceBuffer;
+    buffer.records[buffer.recorded++ % buffer.records.size()] = {start, end,
+                                                                 event};
+}
+
+static const char *traceEventName(int event) {
+    if (event == (int)TraceEvent::ParallelForChunk) return "ParallelFor chunk";
+    return ProfNames[event];
+}
+
+void WriteTrace(const std::string &filename) {
+    CHECK(TracingEnabled);
+    std::lock_guard<std::mutex> lock(traceBuffersMutex);
+
+    FILE *f = fopen(filename.c_str(), "w");
+    if (!f) {
+        Error("%s: unable to open trace file: %s", filename.c_str(),
+              strerror(errno));
+        return;
+    }
+
+    const int pid = getpid();
+    uint64_t dropped = 0;
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    for (size_t tid = 0; tid < traceBuffers.size(); ++tid) {
+        const TraceBuffer &buffer = *traceBuffers[tid];
+        const std::string threadName =
+            buffer.threadIndex == 0
+                ? std::string("main")
+                : StringPrintf("worker %d", buffer.threadIndex);
+        fprintf(f,
+                "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+                "\"tid\":%zu,\"args\":{\"name\":\"%s\"}}",
+                tid == 0 ? "" : ",\n", pid, tid, threadName.c_str());
+
+        // Write the records from the oldest to the newest
+        const uint64_t size = buffer.records.size();
+        const uint64_t first =
+            buffer.recorded > size ? buffer.recorded - size : 0;
+        dropped += first;
+
+        for (uint64_t i = first; i < buffer.recorded; ++i) {
+            const TraceRecord &r = buffer.records[i % size];
+            fprintf(f,
+                    ",\n{\"name\":\"%s\",\"cat\":\"pbrt\",\"ph\":\"X\","
+                    "\"pid\":%d,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f}",
+                    traceEventName(r.event), pid, tid,
+                    (r.start - traceStartTime) / 1000., (r.end - r.start) / 1000.);
+        }
+    }
+
+    fprintf(f, "\n]}\n");
+    fclose(f);
+
+    if (dropped > 0)
+        Warning("%s: the oldest %" PRIu64 " trace events were overwritten",
+                filename.c_str(), dropped);
+}
+
+void CleanupTrace() {
+    std::lock_guard<std::mutex> lock(traceBuffersMutex);
+    TracingEnabled = false;
+    traceBuffers.clear();
+}
+
+// Live Statistics Local Definitions
+static std::atomic<int> statsSnapshotEpoch{0};
+static PBRT_THREAD_LOCAL int threadStatsEpoch;
+
+static std::thread snapshotThread;
+static int snapshotStopPipe[2] = {-1, -1};
+static std::chrono::steady_clock::time_point snapshotStartTime;
+static std::chrono::steady_clock::time_point lastSnapshotTime;
+static std::map<std::string, int64_t> lastSnapshotCounters;
+
+void RequestThreadStats() { ++statsSnapshotEpoch; }
+
+void ReportThreadStatsIfRequested() {
+    const int epoch = statsSnapshotEpoch.load(std::memory_order_relaxed);
+    if (threadStatsEpoch == epoch) return;
+    threadStatsEpoch = epoch;
+    ReportThreadStats();
+}
+
+static std::string prometheusLabels(const std::string &name) {
+    std::string category, title;
+    getCategoryAndTitle(name, &category, &title);
+
+    auto escape = [](const std::string &str) {
+        std::string escaped;
+        for (char c : str) {
+            if (c == '\\' || c == '"')
+                escaped += std::string("\\") + c;
+            else if (c == '\n')
+                escaped += "\\n";
+            else
+                escaped += c;
+        }
+        return escaped;
+    };
+
+    return "{category=\"" + escape(category) + "\",stat=\"" + escape(title) +
+           "\"}";
+}
+
+static int64_t residentMemory() {
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    long long pages = 0, resident = 0;
+    if (fscanf(f, "%lld %lld", &pages, &resident) != 2) resident = 0;
+    fclose(f);
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+std::string TakeStatsSnapshot() {
+    AccumulatedStats stats;
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        stats = statsAccumulator.Export();
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    const double uptime =
+        std::chrono::duration<double>(now - snapshotStartTime).count();
+    const double interval =
+        std::chrono::duration<double>(now - lastSnapshotTime).count();
+
+    std::string out;
+    auto family = [&out](const char *name, const char *type,
+                         const char *help) {
+        out += StringPrintf("# HELP %s %s\n# TYPE %s %s\n", name, help, name,
+                            type);
+    };
+
+    family("pbrt_uptime_seconds", "gauge",
+           "Seconds since the snapshots started.");
+    out += StringPrintf("pbrt_uptime_seconds %.3f\n", uptime);
+    family("pbrt_resident_memory_bytes", "gauge",
+           "Resident set size of the process.");
+    out += StringPrintf("pbrt_resident_memory_bytes %" PRId64 "\n",
+                        residentMemory());
+
+    family("pbrt_counter_total", "counter", "STAT_COUNTER values.");
+    for (const auto &c : stats.counters)
+        out += StringPrintf("pbrt_counter_total%s %" PRId64 "\n",
+                            prometheusLabels(c.first).c_str(), c.second);
+
+    family("pbrt_counter_rate", "gauge",
+           "Per-second increase of each counter since the last snapshot.");
+    for (const auto &c : stats.counters) {
+        // A counter that went down was cleared after a render
+        auto last = lastSnapshotCounters.find(c.first);
+        int64_t delta = c.second;
+        if (last != lastSnapshotCounters.end() && last->second <= c.second)
+            delta -= last->second;
+        out += StringPrintf("pbrt_counter_rate%s %.3f\n",
+                            prometheusLabels(c.first).c_str(),
+                            interval > 0 ? delta / interval : 0.);
+    }
+
+    family("pbrt_memory_bytes", "gauge", "STAT_MEMORY_COUNTER values.");
+    for (const auto &c : stats.memoryCounters)
+        out += StringPrintf("pbrt_memory_bytes%s %" PRId64 "\n",
+                            prometheusLabels(c.first).c_str(), c.second);
+
+    family("pbrt_distribution_count", "counter",
+           "Number of values in each STAT_*_DISTRIBUTION.");
+    for (const auto &c : stats.intDistributionCounts)
+        out += StringPrintf("pbrt_distribution_count%s %" PRId64 "\n",
+                            prometheusLabels(c.first).c_str(), c.second);
+    for (const auto &c : stats.floatDistributionCounts)
+        out += StringPrintf("pbrt_distribution_count%s %" PRId64 "\n",
+                            prometheusLabels(c.first).c_str(), c.second);
+
+    family("pbrt_distribution_sum", "counter",
+           "Sum of the values in each STAT_*_DISTRIBUTION.");
+    for (const auto &c : stats.intDistributionSums)
+        out += StringPrintf("pbrt_distribution_sum%s %" PRId64 "\n",
+                            prometheusLabels(c.first).c_str(), c.second);
+    for (const auto &c : stats.floatDistributionSums)
+        out += StringPrintf("pbrt_distribution_sum%s %g\n",
+                            prometheusLabels(c.first).c_str(), c.second);
+
+    family("pbrt_distribution_min", "gauge",
+           "Smallest value in each STAT_*_DISTRIBUTION.");
+    for (const auto &c : stats.intDistributionMins)
+        out += StringPrintf("pbrt_distribution_min%s %" PRId64 "\n",
+                            prometheusLabels(c.first).c_str(), c.second);
+    for (const auto &c : stats.floatDistributionMins)
+        out += StringPrintf("pbrt_distribution_min%s %g\n",
+                            prometheusLabels(c.first).c_str(), c.second);
+
+    family("pbrt_distribution_max", "gauge",
+           "Largest value in each STAT_*_DISTRIBUTION.");
+    for (const auto &c : stats.intDistributionMaxs)
+        out += StringPrintf("pbrt_distribution_max%s %" PRId64 "\n",
+                            prometheusLabels(c.first).c_str(), c.second);
+    for (const auto &c : stats.floatDistributionMaxs)
+        out += StringPrintf("pbrt_distribution_max%s %g\n",
+                            prometheusLabels(c.first).c_str(), c.second);
+
+    family("pbrt_percent", "gauge", "STAT_PERCENT values, in percent.");
+    for (const auto &c : stats.percentages) {
+        if (c.second.second == 0) continue;
+        out += StringPrintf("pbrt_percent%s %.4f\n",
+                            prometheusLabels(c.first).c_str(),
+                            100. * c.second.first / c.second.second);
+    }
+
+    family("pbrt_ratio", "gauge", "STAT_RATIO values.");
+    for (const auto &c : stats.ratios) {
+        if (c.second.second == 0) continue;
+        out += StringPrintf("pbrt_ratio%s %.4f\n",
+                            prometheusLabels(c.first).c_str(),
+                            (double)c.second.first / c.second.second);
+    }
+
+    lastSnapshotTime = now;
+    lastSnapshotCounters = std::move(stats.counters);
+    return out;
+}
+
+static void writeSnapshotFile(const std::string &path,
+                              const std::string &snapshot) {
+    // Written aside and renamed, so that readers never see half of it
+    const std::string tmpPath = path + ".tmp";
+    FILE *f = fopen(tmpPath.c_str(), "w");
+    if (!f) {
+        Warning("%s: %s", tmpPath.c_str(), strerror(errno));
+        return;
+    }
+    fwrite(snapshot.data(), 1, snapshot.size(), f);
+    fclose(f);
+    if (rename(tmpPath.c_str(), path.c_str()) != 0)
+        Warning("%s: %s", path.c_str(), strerror(errno));
+}
+
+// Answers one connection to the stats socket with the latest snapshot, as
+// an HTTP response, so that "curl --unix-socket" can fetch it.
+static void serveSnapshot(int listenFd, const std::string &snapshot) {
+    int fd = accept(listenFd, nullptr, nullptr);
+    if (fd < 0) return;
+
+    // Read (and ignore) the request, if the client sends one
+    std::string request;
+    pollfd pfd{fd, POLLIN, 0};
+    while (request.find("\r\n\r\n") == std::string::npos &&
+           request.size() < 8192 && poll(&pfd, 1, 100) > 0) {
+        char buffer[1024];
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n <= 0) break;
+        request.append(buffer, n);
+    }
+
+    const std::string response =
+        StringPrintf("HTTP/1.0 200 OK\r\n"
+                     "Content-Type: text/plain; version=0.0.4\r\n"
+                     "Content-Length: %zu\r\n\r\n",
+                     snapshot.size()) +
+        snapshot;
+    for (size_t written = 0; written < response.size();) {
+        ssize_t n = send(fd, response.data() + written,
+                         response.size() - written, MSG_NOSIGNAL);
+        if (n <= 0) break;
+        written += n;
+    }
+    close(fd);
+}
+
+static int listenOnUnixSocket(const std::string &path) {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        Error("%s: Unix socket path is too long", path.c_str());
+        return -1;
+    }
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        Error("socket: %s", strerror(errno));
+        return -1;
+    }
+
+    unlink(path.c_str());
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(fd, 16) != 0) {
+        Error("%s: %s", path.c_str(), strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+void StartStatsSnapshots(const std::string &path,
+                         std::chrono::seconds interval) {
+    CHECK(!snapshotThread.joinable());
+    if (interval.count() <= 0) {
+        Error("Stats snapshot interval must be positive.");
+        return;
+    }
+
+    const std::string socketPrefix = "unix:";
+    const bool useSocket = path.compare(0, socketPrefix.size(), socketPrefix) == 0;
+    const std::string target =
+        useSocket ? path.substr(socketPrefix.size()) : path;
+
+    int listenFd = -1;
+    if (useSocket && (listenFd = listenOnUnixSocket(target)) < 0) return;
+
+    if (pipe(snapshotStopPipe) != 0) {
+        Error("pipe: %s", strerror(errno));
+        if (listenFd >= 0) close(listenFd);
+        return;
+    }
+
+    snapshotStartTime = lastSnapshotTime = std::chrono::steady_clock::now();
+    lastSnapshotCounters.clear();
+
+    snapshotThread = std::thread([=]() {
+        using Clock = std::chrono::steady_clock;
+
+        std::string snapshot = TakeStatsSnapshot();
+
+        // Waits until the deadline, serving connections meanwhile; false
+        // if the snapshots are being stopped.
+        auto waitUntil = [&](Clock::time_point deadline) {
+            while (Clock::now() < deadline) {
+                pollfd fds[2] = {{snapshotStopPipe[0], POLLIN, 0},
+                                 {listenFd, POLLIN, 0}};
+                const auto timeout =
+                    std::chrono::duration_cast<std::chrono::milliseconds>(
+                        deadline - Clock::now());
+                int ready = poll(fds, useSocket ? 2 : 1,
+                                 std::max<int64_t>(timeout.count(), 0) + 1);
+
+                if (ready > 0 && fds[0].revents) return false;
+                if (ready > 0 && useSocket && fds[1].revents)
+                    serveSnapshot(listenFd, snapshot);
+            }
+            return true;
+        };
+
+        // Threads report at their next chunk boundary, so they're asked a
+        // little before the snapshot is due.
+        const auto settle = std::min<Clock::duration>(
+            std::chrono::seconds(1), Clock::duration(interval) / 4);
+        auto next = Clock::now() + interval;
+
+        while (true) {
+            if (!useSocket) writeSnapshotFile(target, snapshot);
+
+            if (!waitUntil(next - settle)) break;
+            RequestThreadStats();
+            if (!waitUntil(next)) break;
+
+            snapshot = TakeStatsSnapshot();
+            next += interval;
+        }
+
+        // The final totals
+        snapshot = TakeStatsSnapshot();
+        if (useSocket) {
+            close(listenFd);
+            unlink(target.c_str());
+        } else {
+            writeSnapshotFile(target, snapshot);
+        }
+    });
+}
+
+void StopStatsSnapshots() {
+    if (!snapshotThread.joinable()) return;
+
+    const char stop = 0;
+    CHECK_EQ(write(snapshotStopPipe[1], &stop, 1), 1);
+    snapshotThread.join();
+
+    close(snapshotStopPipe[0]);
+    close(snapshotStopPipe[1]);
+    snapshotStopPipe[0] = snapshotStopPipe[1] = -1;
+}
+
 }  // namespace pbrt
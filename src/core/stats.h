@@ -40,6 +40,7 @@
 
 // core/stats.h*
 #include "pbrt.h"
+#include <atomic>
 #include <map>
 #include <chrono>
 #include <string>
@@ -88,6 +89,19 @@ void PrintStats(FILE *dest);
 void ClearStats();
 void ReportThreadStats();
 
+// Live statistics (--stats-snapshot): every interval, a background thread
+// writes the merged statistics in the Prometheus text format, either to a
+// file or, for a "unix:<path>" target, to whoever connects to that Unix
+// socket. Threads aren't stopped for it; instead, RequestThreadStats()
+// asks each one to report its statistics at its next ParallelFor chunk
+// boundary, shortly before the snapshot is taken.
+void RequestThreadStats();
+void ReportThreadStatsIfRequested();
+void StartStatsSnapshots(const std::string &path,
+                         std::chrono::seconds interval);
+void StopStatsSnapshots();
+std::string TakeStatsSnapshot();
+
 class StatsAccumulator {
   public:
     // StatsAccumulator Public Methods
@@ -282,6 +296,26 @@ static_assert((int)Prof::NumProfCategories ==
 extern PBRT_THREAD_LOCAL uint64_t ProfilerState;
 inline uint64_t CurrentProfilerState() { return ProfilerState; }
 
+// Timeline tracing (--trace): while it's enabled, every thread keeps its
+// most recent ProfilePhase intervals in a ring buffer, and WriteTrace()
+// dumps them in the Chrome trace event format, for chrome://tracing or
+// Perfetto. The hot paths read the flag relaxed; RecordTraceEvent() reads it
+// again with acquire ordering before it uses the trace settings.
+extern std::atomic<bool> TracingEnabled;
+
+// Trace events that aren't profiling categories
+enum class TraceEvent {
+    ParallelForChunk = (int)Prof::NumProfCategories,
+};
+
+inline int64_t TraceClock() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void RecordTraceEvent(int event, int64_t start, int64_t end);
+
 class ProfilePhase {
   public:
     // ProfilePhase Public Methods
@@ -289,9 +323,16 @@ class ProfilePhase {
         categoryBit = ProfToBits(p);
         reset = (ProfilerState & categoryBit) == 0;
         ProfilerState |= categoryBit;
+        if (reset && TracingEnabled.load(std::memory_order_relaxed))
+            traceStart = TraceClock();
     }
     ~ProfilePhase() {
-        if (reset) ProfilerState &= ~categoryBit;
+        if (reset) {
+            ProfilerState &= ~categoryBit;
+            if (traceStart >= 0)
+                RecordTraceEvent(Log2Int(categoryBit), traceStart,
+                                 TraceClock());
+        }
     }
     ProfilePhase(const ProfilePhase &) = delete;
     ProfilePhase &operator=(const ProfilePhase &) = delete;
@@ -300,6 +341,7 @@ class ProfilePhase {
     // ProfilePhase Private Data
     bool reset;
     uint64_t categoryBit;
+    int64_t traceStart = -1;
 };
 
 void InitProfiler();
@@ -310,6 +352,12 @@ void ReportProfilerResults(FILE *dest);
 void ClearProfiler();
 void CleanupProfiler();
 
+// Events shorter than minDuration are dropped, and each thread keeps the
+// last eventsPerThread of the others.
+void InitTrace(std::chrono::nanoseconds minDuration, size_t eventsPerThread);
+void WriteTrace(const std::string &filename);
+void CleanupTrace();
+
 // Statistics Macros
 #define STAT_COUNTER(title, var)                           \
     static PBRT_THREAD_LOCAL int64_t var;                  \
@@ -20,6 +20,9 @@ enum class ObjectType {
     Texture,
     TreeletInfo,
     StaticAssignment,
+    Blob, /* content-addressed: the id is a hash of the data */
+    ProxyTable, /* names of the proxy scenes that root refs point into */
+    ProxyScene, /* not a file: the scene at this index of the ProxyTable */
     COUNT
 };
 
@@ -27,6 +30,10 @@ struct ObjectKey {
     ObjectType type;
     ObjectID id;
 
+    bool operator==(const ObjectKey& other) const {
+        return type == other.type && id == other.id;
+    }
+
     bool operator<(const ObjectKey& other) const {
         if (type == other.type) {
             return id < other.id;
@@ -42,6 +42,7 @@ namespace scene {
 class Base {
   private:
     std::vector<std::set<ObjectKey>> treeletDependencies{};
+    std::vector<uint64_t> treeletClosureSizes{};
 
   public:
     std::shared_ptr<Camera> camera{};
@@ -67,10 +68,15 @@ class Base {
         return treeletDependencies.at(treeletId);
     }
 
+    /* bytes a worker has to fetch to hold the treelet */
+    uint64_t GetTreeletClosureSize(const TreeletId treeletId) const {
+        return treeletClosureSizes.at(treeletId);
+    }
+
     size_t GetTreeletCount() const { return treeletDependencies.size(); }
 };
 
-std::string GetObjectName(const ObjectType type, const uint32_t id);
+std::string GetObjectName(const ObjectType type, const ObjectID id);
 
 Base LoadBase(const std::string &path, const int samplesPerPixel);
 
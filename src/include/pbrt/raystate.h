@@ -2,6 +2,7 @@
 #define PBRT_CLOUD_RAYSTATE_H
 
 #include <memory>
+#include <vector>
 
 #include "geometry.h"
 #include "transform.h"
@@ -110,6 +111,91 @@ class Sample {
     size_t MaxCompressedSize() const { return Size(); }
 };
 
+/* RayBatch keeps a group of rays in structure-of-arrays form. The fields that
+ * traversal and shading touch for every ray live in parallel arrays; the rest
+ * (differentials, hit info, transforms, the treelet stack) are stored
+ * out-of-line and indexed per ray. The wire format is the same one used by
+ * RayState::Serialize, so batches and single rays can be mixed freely. */
+class RayBatch {
+  public:
+    struct Differentials {
+        Point3f rxOrigin, ryOrigin;
+        Vector3f rxDirection, ryDirection;
+    };
+
+    enum Flags : uint8_t {
+        TrackRay = 1 << 0,
+        ShadowRay = 1 << 1,
+        Hit = 1 << 2,
+    };
+
+    RayBatch() = default;
+    RayBatch(RayBatch &&) = default;
+    RayBatch &operator=(RayBatch &&) = default;
+
+    /* disallow copying */
+    RayBatch(const RayBatch &) = delete;
+    RayBatch &operator=(const RayBatch &) = delete;
+
+    /* per-ray data */
+    std::vector<Float> ox, oy, oz;
+    std::vector<Float> dx, dy, dz;
+    std::vector<Float> tMax;
+    std::vector<Float> time;
+    std::vector<Spectrum> beta;
+    std::vector<Spectrum> Ld;
+    std::vector<uint64_t> sampleId;
+    std::vector<uint8_t> remainingBounces;
+    std::vector<uint8_t> flags;
+    std::vector<uint8_t> toVisitHead;
+
+    std::vector<Point2f> pFilm;
+    std::vector<Float> weight;
+    std::vector<int> dim;
+    std::vector<uint16_t> hop;
+    std::vector<uint16_t> pathHop;
+
+    /* index into `differentials`, or -1 */
+    std::vector<int32_t> differentialsIdx;
+    std::vector<RayState::TreeletNode> hitNode;
+    /* indices into `transforms`, or -1 */
+    std::vector<int32_t> hitTransformIdx;
+    std::vector<int32_t> rayTransformIdx;
+    /* ray i's stack is toVisit[toVisitOffset[i] .. + toVisitHead[i]] */
+    std::vector<uint32_t> toVisitOffset;
+
+    /* out-of-line storage */
+    std::vector<Differentials> differentials;
+    std::vector<Transform> transforms;
+    std::vector<RayState::TreeletNode> toVisit;
+
+    size_t size() const { return sampleId.size(); }
+    bool empty() const { return sampleId.empty(); }
+    void clear();
+    void reserve(const size_t n);
+
+    bool IsShadowRay(const size_t i) const { return flags[i] & ShadowRay; }
+    bool HasHit(const size_t i) const { return flags[i] & Hit; }
+
+    /* conversion from/to RayState */
+    void Add(const RayState &state);
+    void Get(const size_t i, RayState &state) const;
+    RayStatePtr Get(const size_t i) const;
+
+    /* serialization of individual rays, matches RayState::(De)Serialize */
+    size_t Serialize(const size_t i, char *data) const;
+    void Deserialize(const char *data, const size_t len);
+    size_t MaxSize(const size_t i) const;
+    size_t MaxCompressedSize(const size_t i) const;
+
+    /* A bag is a sequence of serialized rays, each prefixed by its length,
+     * which is also how a RecordWriter frames them. Unpack appends all the
+     * rays of a bag, growing the arrays once; it returns how many there
+     * were. */
+    size_t Unpack(const char *bag, const size_t len);
+    size_t Pack(char *bag, const size_t capacity) const;
+};
+
 }  // namespace pbrt
 
 #endif /* PBRT_CLOUD_RAYSTATE_H */
@@ -0,0 +1,127 @@
+#ifndef PBRT_INCLUDE_REPLICATION_H
+#define PBRT_INCLUDE_REPLICATION_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <ostream>
+#include <set>
+#include <vector>
+
+#include "common.h"
+
+namespace pbrt {
+
+struct TreeletLoad {
+    TreeletId treelet{0};
+    double arrivalRate{0.0}; /* rays per second entering the queue */
+    double serviceRate{0.0}; /* rays per second while busy on this treelet */
+    double utilization{0.0}; /* fraction of the window spent tracing it */
+};
+
+/* Keeps per-treelet ray arrivals and service times over a sliding window.
+ * The window is split into buckets; a bucket is cleared when the window
+ * moves past it. treeletCount is only a hint, the monitor grows when it
+ * sees a larger id. Not thread-safe, every worker thread should keep its
+ * own. */
+class TreeletLoadMonitor {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    TreeletLoadMonitor(const size_t treeletCount,
+                       const Clock::duration window = std::chrono::seconds{10},
+                       const size_t bucketCount = 10);
+
+    void RecordArrival(const TreeletId treelet, const uint64_t count = 1,
+                       const Clock::time_point now = Clock::now());
+
+    void RecordService(const TreeletId treelet, const Clock::duration time,
+                       const uint64_t count = 1,
+                       const Clock::time_point now = Clock::now());
+
+    TreeletLoad GetLoad(const TreeletId treelet,
+                        const Clock::time_point now = Clock::now());
+
+    /* all treelets that saw any traffic in the window, hottest first */
+    std::vector<TreeletLoad> GetLoads(const Clock::time_point now = Clock::now());
+
+    void PrintSummary(std::ostream &out, const size_t topN = 10);
+
+  private:
+    struct Bucket {
+        uint64_t arrivals{0};
+        uint64_t serviced{0};
+        Clock::duration serviceTime{0};
+    };
+
+    void Advance(const Clock::time_point now);
+    void Grow(const TreeletId treelet);
+    double WindowSeconds(const Clock::time_point now) const;
+
+    size_t treeletCount;
+    const size_t bucketCount;
+    const Clock::duration bucketLength;
+    const Clock::time_point start;
+
+    /* buckets[treelet * bucketCount + bucket] */
+    std::vector<Bucket> buckets;
+    int64_t currentEpoch{0};
+};
+
+/* What a worker tells the coordinator about itself */
+struct WorkerLoadReport {
+    uint64_t workerId{0};
+    std::set<TreeletId> treelets{};
+    std::vector<TreeletLoad> loads{};
+};
+
+struct ReplicaAssignment {
+    TreeletId treelet{0};
+    uint64_t workerId{0};
+    std::set<ObjectKey> objects{}; /* everything the worker has to load */
+};
+
+/* Decides which treelets are overloaded and assigns idle workers to host
+ * extra replicas of them. A treelet is hot when its arrival rate exceeds
+ * what its current replicas can serve at the target utilization. */
+class ReplicationPlanner {
+  public:
+    using DependencyFn =
+        std::function<const std::set<ObjectKey> &(const TreeletId)>;
+
+    /* if no dependency function is given, global::manager is used */
+    ReplicationPlanner(DependencyFn dependencies = {},
+                       const double targetUtilization = 0.8,
+                       const double idleUtilization = 0.1);
+
+    std::vector<ReplicaAssignment> Plan(
+        const std::vector<WorkerLoadReport> &reports) const;
+
+  private:
+    DependencyFn dependencies;
+    const double targetUtilization;
+    const double idleUtilization;
+};
+
+/* Splits the queue of a replicated treelet across its replicas */
+class ReplicaRouter {
+  public:
+    void AddReplica(const TreeletId treelet, const uint64_t workerId);
+    void RemoveReplica(const TreeletId treelet, const uint64_t workerId);
+
+    const std::vector<uint64_t> &Replicas(const TreeletId treelet) const;
+    uint64_t Route(const TreeletId treelet);
+
+  private:
+    struct ReplicaSet {
+        std::vector<uint64_t> workers{};
+        size_t next{0};
+    };
+
+    std::map<TreeletId, ReplicaSet> replicas{};
+};
+
+}  // namespace pbrt
+
+#endif /* PBRT_INCLUDE_REPLICATION_H */
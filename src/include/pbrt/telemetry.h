@@ -0,0 +1,83 @@
+#ifndef PBRT_INCLUDE_TELEMETRY_H
+#define PBRT_INCLUDE_TELEMETRY_H
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <string>
+
+#include "common.h"
+#include "util/util.h"
+
+namespace pbrt {
+
+struct TreeletStats {
+    uint64_t raysTraced{0};
+    uint64_t nodesVisited{0};
+    uint64_t primitivesTested{0};
+    uint64_t hits{0};
+    uint64_t loads{0};
+    std::chrono::nanoseconds loadTime{0};
+    uint64_t residentBytes{0}; /* a gauge, not reset between exports */
+
+    /* rays that left this treelet, by the treelet they went to */
+    std::map<TreeletId, uint64_t> forwarded{};
+
+    void Merge(const TreeletStats &other);
+    bool Empty() const;
+};
+
+/* Called by CloudBVH. Tracing counters are kept per thread and only become
+ * visible to TakeTreeletStats() once the thread calls
+ * ReportThreadTreeletStats(); loads are rare and recorded directly. */
+void RecordTreeletTrace(const TreeletId treelet, const uint64_t nodesVisited,
+                        const uint64_t primitivesTested, const uint64_t hits);
+
+void RecordTreeletForward(const TreeletId from, const TreeletId to);
+
+void RecordTreeletLoad(const TreeletId treelet,
+                       const std::chrono::nanoseconds time,
+                       const uint64_t residentBytes);
+
+void ReportThreadTreeletStats();
+
+/* returns what was reported since the last call and resets the counters */
+std::map<TreeletId, TreeletStats> TakeTreeletStats();
+
+/* Periodically appends the per-treelet counters of this process to a file,
+ * one row per active treelet and interval. The format is picked by the
+ * extension: CSV for ".csv", JSON lines otherwise. Counters are deltas over
+ * the interval, except for resident bytes. */
+class TreeletStatsExporter {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Format { JSONLines, CSV };
+
+    TreeletStatsExporter(const std::string &path, const uint64_t workerId,
+                         const Clock::duration interval = std::chrono::seconds{
+                             10});
+    ~TreeletStatsExporter();
+
+    TreeletStatsExporter(const TreeletStatsExporter &) = delete;
+    TreeletStatsExporter &operator=(const TreeletStatsExporter &) = delete;
+
+    /* cheap enough to call for every ray; reports the calling thread's
+     * counters and writes them out once the interval has passed */
+    void MaybeExport();
+    void Export();
+
+    static Format FormatFromPath(const std::string &path);
+
+  private:
+    const uint64_t workerId;
+    const Format format;
+
+    std::ofstream out;
+    PeriodicCheck exportDue;
+};
+
+}  // namespace pbrt
+
+#endif /* PBRT_INCLUDE_TELEMETRY_H */
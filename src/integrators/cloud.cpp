@@ -1,13 +1,20 @@
 #include "cloud.h"
 
+#include <unistd.h>
+
+#include <chrono>
 #include <cmath>
 #include <cstdlib>
 #include <deque>
 #include <iterator>
 
 #include "accelerators/cloud.h"
+#include "cloud/checkpoint.h"
 #include "cloud/manager.h"
+#include "cloud/scheduler.h"
 #include "core/paramset.h"
+#include "pbrt/telemetry.h"
+#include "util/util.h"
 
 using namespace std;
 
@@ -22,6 +29,7 @@ STAT_INT_DISTRIBUTION("Integrator/Unused bounces per path", nRemainingBounces);
 
 STAT_COUNTER("Integrator/Calls to Shade", nShadeCalls);
 STAT_COUNTER("Integrator/Calls to Trace", nTraceCalls);
+STAT_COUNTER("Scheduler/Camera rays throttled", nCameraRaysThrottled);
 
 RayStatePtr CloudIntegrator::Trace(RayStatePtr &&rayState,
                                    const CloudBVH &treelet) {
@@ -166,52 +174,124 @@ void CloudIntegrator::Preprocess(const Scene &scene, Sampler &sampler) {
     }
 }
 
-void CloudIntegrator::Render(const Scene &scene) {
-    Preprocess(scene, *sampler);
-    const Bounds2i sampleBounds = camera->film->GetSampleBounds();
+void CloudIntegrator::GenerateCameraRays(const Camera &camera,
+                                         GlobalSampler &cameraSampler,
+                                         const Bounds2i &pixelBounds,
+                                         const int maxDepth,
+                                         const uint64_t resumeSample,
+                                         uint64_t *cameraSamples,
+                                         RayScheduler &scheduler,
+                                         const function<void()> &processRay) {
+    const Bounds2i sampleBounds = camera.film->GetSampleBounds();
     const Vector2i sampleExtent = sampleBounds.Diagonal();
-    unique_ptr<FilmTile> filmTile = camera->film->GetFilmTile(sampleBounds);
 
-    deque<RayStatePtr> rayQueue;
-    deque<RayStatePtr> samples;
-
-    /* Generate all the samples */
-    size_t i = 0;
     for (Point2i pixel : sampleBounds) {
-        sampler->StartPixel(pixel);
+        cameraSampler.StartPixel(pixel);
 
         if (!InsideExclusive(pixel, pixelBounds)) continue;
 
         size_t sample_num = 0;
         do {
-            CameraSample cameraSample = sampler->GetCameraSample(pixel);
+            /* these were generated before the checkpoint was taken */
+            if (*cameraSamples < resumeSample) {
+                ++*cameraSamples;
+                continue;
+            }
+
+            if (!scheduler.AcceptsCameraRays()) {
+                ++nCameraRaysThrottled;
+                do {
+                    processRay();
+                } while (!scheduler.AcceptsCameraRays());
+            }
+
+            CameraSample cameraSample = cameraSampler.GetCameraSample(pixel);
 
             RayStatePtr statePtr = RayState::Create();
             auto &state = *statePtr;
 
             state.sample.id = (pixel.x + pixel.y * sampleExtent.x) *
-                                  sampler->samplesPerPixel +
+                                  cameraSampler.samplesPerPixel +
                               sample_num;
-            state.sample.dim = sampler->GetCurrentDimension();
+            state.sample.dim = cameraSampler.GetCurrentDimension();
             state.sample.pFilm = cameraSample.pFilm;
             state.sample.weight =
-                camera->GenerateRayDifferential(cameraSample, &state.ray);
-            state.ray.ScaleDifferentials(1 /
-                                         sqrt((Float)sampler->samplesPerPixel));
+                camera.GenerateRayDifferential(cameraSample, &state.ray);
+            state.ray.ScaleDifferentials(
+                1 / sqrt((Float)cameraSampler.samplesPerPixel));
             state.remainingBounces = maxDepth - 1;
             state.StartTrace();
 
-            rayQueue.push_back(move(statePtr));
+            scheduler.Push(move(statePtr));
 
+            /* only now, so that a checkpoint taken by processRay() above
+               doesn't count a sample that wasn't pushed yet */
+            ++*cameraSamples;
             ++nIntersectionTests;
             ++nCameraRays;
-        } while (sampler->StartNextSample());
+        } while (cameraSampler.StartNextSample());
     }
+}
+
+void CloudIntegrator::Render(const Scene &scene) {
+    Preprocess(scene, *sampler);
+    const Bounds2i sampleBounds = camera->film->GetSampleBounds();
+    const Vector2i sampleExtent = sampleBounds.Diagonal();
+    unique_ptr<FilmTile> filmTile = camera->film->GetFilmTile(sampleBounds);
 
-    while (not rayQueue.empty()) {
-        RayStatePtr statePtr = move(rayQueue.back());
+    RayScheduler scheduler{maxResidentRays};
+    vector<Sample> samples;
+
+    /* camera samples generated so far, including those of a checkpoint we
+       resumed from */
+    uint64_t cameraSamples = 0;
+    uint64_t resumeSample = 0;
+
+    unique_ptr<CheckpointWriter> checkpointWriter;
+    PeriodicCheck checkpointDue{
+        chrono::seconds{PbrtOptions.checkpointInterval}};
+
+    if (!PbrtOptions.checkpointDir.empty()) {
+        protobuf::Checkpoint info;
+        if (RestoreCheckpoint(PbrtOptions.checkpointDir, info, &scheduler,
+                              &samples, camera->film)) {
+            resumeSample = info.next_sample();
+            LOG(INFO) << "Resuming from checkpoint " << info.epoch() << ": "
+                      << scheduler.Size() << " rays, " << samples.size()
+                      << " samples";
+        }
+
+        checkpointWriter =
+            make_unique<CheckpointWriter>(PbrtOptions.checkpointDir);
+    }
+
+    auto maybeCheckpoint = [&]() {
+        if (!checkpointWriter || !checkpointDue.Due()) return;
+
+        CheckpointWriter::State state;
+        state.nextSample = cameraSamples;
+        state.rays = &scheduler;
+        state.samples = &samples;
+        state.film = camera->film;
+
+        if (checkpointWriter->Checkpoint(state)) {
+            checkpointDue.Reset();
+        }
+    };
+
+    unique_ptr<TreeletStatsExporter> treeletStats;
+    if (!PbrtOptions.treeletStatsFile.empty()) {
+        treeletStats = make_unique<TreeletStatsExporter>(
+            PbrtOptions.treeletStatsFile, getpid(),
+            chrono::seconds{PbrtOptions.treeletStatsInterval});
+    }
+
+    auto processRay = [&]() {
+        maybeCheckpoint();
+        if (treeletStats) treeletStats->MaybeExport();
+
+        RayStatePtr statePtr = scheduler.Pop();
         RayState &state = *statePtr;
-        rayQueue.pop_back();
 
         if (!state.toVisitEmpty()) {
             auto newRayPtr = Trace(move(statePtr), *bvh);
@@ -222,35 +302,55 @@ void CloudIntegrator::Render(const Scene &scene) {
             if (newRay.isShadowRay) {
                 if (hit) {
                     newRay.Ld = 0.f;
-                    samples.push_back(move(newRayPtr));
-                    continue; /* discard */
+                    samples.emplace_back(newRay);
+                    return; /* discard */
                 } else if (emptyVisit) {
-                    samples.push_back(move(newRayPtr));
+                    samples.emplace_back(newRay);
                 } else {
-                    rayQueue.push_back(move(newRayPtr));
+                    scheduler.Push(move(newRayPtr));
                 }
             } else if (!emptyVisit || hit) {
-                rayQueue.push_back(move(newRayPtr));
+                scheduler.Push(move(newRayPtr));
             } else {
                 newRay.Ld = 0.f;
-                samples.push_back(move(newRayPtr));
+                samples.emplace_back(newRay);
             }
         } else if (state.hit) {
             auto newRays = Shade(move(statePtr), *bvh, scene.lights,
                                  sampleExtent, sampler, maxDepth, arena);
 
             if (newRays.first != nullptr) {
-                rayQueue.push_back(move(newRays.first));
+                scheduler.Push(move(newRays.first));
             }
 
             if (newRays.second != nullptr) {
-                rayQueue.push_back(move(newRays.second));
+                scheduler.Push(move(newRays.second));
             }
         } else {
             throw runtime_error("unexpected ray state");
         }
+    };
+
+    /* Shade() repositions the sampler, so the camera rays are generated
+       from a copy of it */
+    unique_ptr<Sampler> cameraSamplerPtr = sampler->Clone(0);
+    auto &cameraSampler = dynamic_cast<GlobalSampler &>(*cameraSamplerPtr);
+
+    /* Generate the samples, finishing in-flight paths whenever the
+       scheduler is holding too many rays */
+    GenerateCameraRays(*camera, cameraSampler, pixelBounds, maxDepth,
+                       resumeSample, &cameraSamples, scheduler, processRay);
+
+    while (!scheduler.Empty()) {
+        processRay();
+    }
+
+    if (checkpointWriter) {
+        checkpointWriter->Wait();
     }
 
+    treeletStats.reset(); /* writes out the last interval */
+
     struct CSample {
         Point2f pFilm;
         Spectrum L{0.f};
@@ -259,18 +359,15 @@ void CloudIntegrator::Render(const Scene &scene) {
 
     unordered_map<size_t, CSample> allSamples;
 
-    for (const auto &statePtr : samples) {
-        const auto &state = *statePtr;
-
-        if (allSamples.count(state.sample.id) == 0) {
-            allSamples[state.sample.id].pFilm = state.sample.pFilm;
-            allSamples[state.sample.id].weight = state.sample.weight;
-            allSamples[state.sample.id].L = 0.f;
+    for (const Sample &sample : samples) {
+        if (allSamples.count(sample.sampleId) == 0) {
+            allSamples[sample.sampleId].pFilm = sample.pFilm;
+            allSamples[sample.sampleId].weight = sample.weight;
+            allSamples[sample.sampleId].L = 0.f;
         }
 
-        Spectrum L = state.beta * state.Ld;
-        if (L.HasNaNs() || L.y() < -1e-5 || isinf(L.y())) L = Spectrum(0.f);
-        allSamples[state.sample.id].L += L;
+        /* Sample() already discarded invalid radiance values */
+        allSamples[sample.sampleId].L += sample.L;
     }
 
     cout << allSamples.size() << endl;
@@ -288,13 +385,19 @@ CloudIntegrator *CreateCloudIntegrator(const ParamSet &params,
                                        shared_ptr<Sampler> sampler,
                                        shared_ptr<const Camera> camera) {
     const int maxDepth = params.FindOneInt("maxdepth", 5);
+    const int maxResidentRays = params.FindOneInt("maxresidentrays", 1'000'000);
     Bounds2i pixelBounds = camera->film->GetSampleBounds();
     auto globalSampler = dynamic_pointer_cast<GlobalSampler>(sampler);
     if (!globalSampler) {
         throw(runtime_error("CloudIntegrator only supports GlobalSamplers"));
     }
 
-    return new CloudIntegrator(maxDepth, camera, globalSampler, pixelBounds);
+    if (maxResidentRays <= 0) {
+        throw(runtime_error("CloudIntegrator: maxresidentrays must be positive"));
+    }
+
+    return new CloudIntegrator(maxDepth, camera, globalSampler, pixelBounds,
+                               maxResidentRays);
 }
 
 }  // namespace pbrt
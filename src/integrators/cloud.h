@@ -1,6 +1,7 @@
 #ifndef PBRT_INTEGRATOR_CLOUD_H
 #define PBRT_INTEGRATOR_CLOUD_H
 
+#include <functional>
 #include <memory>
 
 #include "pbrt/raystate.h"
@@ -12,6 +13,7 @@
 namespace pbrt {
 
 class CloudBVH;
+class RayScheduler;
 
 class CloudIntegrator : public Integrator {
   public:
@@ -23,11 +25,13 @@ class CloudIntegrator : public Integrator {
 
     CloudIntegrator(const int maxDepth, std::shared_ptr<const Camera> camera,
                     std::shared_ptr<GlobalSampler> sampler,
-                    const Bounds2i &pixelBounds)
+                    const Bounds2i &pixelBounds,
+                    const size_t maxResidentRays = 1'000'000)
         : maxDepth(maxDepth),
           camera(camera),
           sampler(sampler),
-          pixelBounds(pixelBounds) {}
+          pixelBounds(pixelBounds),
+          maxResidentRays(maxResidentRays) {}
 
     void Preprocess(const Scene &scene, Sampler &sampler);
     void Render(const Scene &scene);
@@ -41,12 +45,27 @@ class CloudIntegrator : public Integrator {
         int maxPathDepth,
         MemoryArena &arena);
 
+    /* Pushes the camera rays of the pixels in `pixelBounds` into the
+     * scheduler, calling `processRay` while it holds too many rays.
+     * `*cameraSamples` counts the samples pushed so far, and the first
+     * `resumeSample` are skipped: they were pushed before the checkpoint
+     * that the render resumed from. */
+    static void GenerateCameraRays(const Camera &camera,
+                                   GlobalSampler &sampler,
+                                   const Bounds2i &pixelBounds,
+                                   const int maxDepth,
+                                   const uint64_t resumeSample,
+                                   uint64_t *cameraSamples,
+                                   RayScheduler &scheduler,
+                                   const std::function<void()> &processRay);
+
   private:
     const int maxDepth;
     std::shared_ptr<const Camera> camera;
     std::shared_ptr<GlobalSampler> sampler;
     std::shared_ptr<CloudBVH> bvh;
     const Bounds2i pixelBounds;
+    const size_t maxResidentRays;
 
     MemoryArena arena;
 };
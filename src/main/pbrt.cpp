@@ -50,10 +50,18 @@ Rendering options:
   --cropwindow <x0,x1,y0,y1> Specify an image crop window.
   --help               Print this help text.
   --nthreads <num>     Use specified number of threads for rendering.
+  --numa               Spread the threads evenly over the NUMA nodes, and
+                       place BVH nodes, meshes and textures so that every
+                       node reads them from nearby memory
   --outfile <filename> Write the final image to the given filename.
   --quick              Automatically reduce a number of quality settings to
                        render more quickly.
   --quiet              Suppress all text output other than error messages.
+  --trace <file>       Write a timeline of the profiling phases of every
+                       thread to <file>, in the Chrome trace event format
+  --trace-min-duration <us>
+                       Leave phases shorter than this out of the timeline
+                       (default: 10)
 
 Logging options:
   --logdir <dir>       Specify directory that log files should be written to.
@@ -74,7 +82,27 @@ Cloud:
   --dumpscene <dir>    Dump scene data to <dir>
   --loadscene <dir>    Load scene data from <dir>
   --nomaterial         Don't dump the texture information
+  --mesh-format <n>    Encoding of dumped triangle meshes: 1 for repeated
+                       messages, 2 for packed arrays (default: 2)
+  --quantize-meshes    Store normals and uvs of dumped meshes in 16 bits
+  --dedup-blobs        Store each distinct mesh once, as a blob shared by
+                       the treelets that use it
   --proxydir           Where to find proxies 
+  --checkpoint <dir>   Periodically save in-flight rays to <dir>, and resume
+                       from the last checkpoint there if there is one
+  --checkpoint-interval <s>
+                       Seconds between checkpoints (default: 60)
+  --treelet-stats <file>
+                       Periodically append per-treelet counters to <file>,
+                       as CSV if it ends in .csv and JSON lines otherwise
+  --treelet-stats-interval <s>
+                       Seconds between treelet stats exports (default: 10)
+  --stats-snapshot <target>
+                       While rendering, periodically write the statistics
+                       in the Prometheus text format to the file <target>,
+                       or serve them on a Unix socket if it's unix:<path>
+  --stats-snapshot-interval <s>
+                       Seconds between stats snapshots (default: 10)
 
 )");
     exit(msg ? 1 : 0);
@@ -127,6 +155,8 @@ int main(int argc, char *argv[]) {
             options.quickRender = true;
         } else if (!strcmp(argv[i], "--quiet") || !strcmp(argv[i], "-quiet")) {
             options.quiet = true;
+        } else if (!strcmp(argv[i], "--numa") || !strcmp(argv[i], "-numa")) {
+            options.numa = true;
         } else if (!strcmp(argv[i], "--cat") || !strcmp(argv[i], "-cat")) {
             options.cat = true;
         } else if (!strcmp(argv[i], "--toply") || !strcmp(argv[i], "-toply")) {
@@ -169,6 +199,83 @@ int main(int argc, char *argv[]) {
             options.proxyDir = std::string(argv[++i]);
         } else if (!strncmp(argv[i], "--proxydir=", 11)) {
             options.proxyDir = std::string(argv[i] + 11);
+        } else if (!strcmp(argv[i], "--checkpoint") ||
+                   !strcmp(argv[i], "-checkpoint")) {
+            if (i + 1 == argc) {
+                usage("missing value after --checkpoint argument");
+            }
+            options.checkpointDir = std::string(argv[++i]);
+        } else if (!strncmp(argv[i], "--checkpoint=", 13)) {
+            options.checkpointDir = std::string(argv[i] + 13);
+        } else if (!strcmp(argv[i], "--checkpoint-interval") ||
+                   !strcmp(argv[i], "-checkpoint-interval")) {
+            if (i + 1 == argc) {
+                usage("missing value after --checkpoint-interval argument");
+            }
+            options.checkpointInterval = atoi(argv[++i]);
+        } else if (!strncmp(argv[i], "--checkpoint-interval=", 22)) {
+            options.checkpointInterval = atoi(argv[i] + 22);
+        } else if (!strcmp(argv[i], "--mesh-format") ||
+                   !strcmp(argv[i], "-mesh-format")) {
+            if (i + 1 == argc) {
+                usage("missing value after --mesh-format argument");
+            }
+            options.meshFormat = atoi(argv[++i]);
+        } else if (!strncmp(argv[i], "--mesh-format=", 14)) {
+            options.meshFormat = atoi(argv[i] + 14);
+        } else if (!strcmp(argv[i], "--quantize-meshes") ||
+                   !strcmp(argv[i], "-quantize-meshes")) {
+            options.quantizeMeshes = true;
+        } else if (!strcmp(argv[i], "--dedup-blobs") ||
+                   !strcmp(argv[i], "-dedup-blobs")) {
+            options.dedupBlobs = true;
+        } else if (!strcmp(argv[i], "--treelet-stats") ||
+                   !strcmp(argv[i], "-treelet-stats")) {
+            if (i + 1 == argc) {
+                usage("missing value after --treelet-stats argument");
+            }
+            options.treeletStatsFile = std::string(argv[++i]);
+        } else if (!strncmp(argv[i], "--treelet-stats=", 16)) {
+            options.treeletStatsFile = std::string(argv[i] + 16);
+        } else if (!strcmp(argv[i], "--treelet-stats-interval") ||
+                   !strcmp(argv[i], "-treelet-stats-interval")) {
+            if (i + 1 == argc) {
+                usage("missing value after --treelet-stats-interval argument");
+            }
+            options.treeletStatsInterval = atoi(argv[++i]);
+        } else if (!strncmp(argv[i], "--treelet-stats-interval=", 25)) {
+            options.treeletStatsInterval = atoi(argv[i] + 25);
+        } else if (!strcmp(argv[i], "--stats-snapshot") ||
+                   !strcmp(argv[i], "-stats-snapshot")) {
+            if (i + 1 == argc) {
+                usage("missing value after --stats-snapshot argument");
+            }
+            options.statsSnapshotPath = std::string(argv[++i]);
+        } else if (!strncmp(argv[i], "--stats-snapshot=", 17)) {
+            options.statsSnapshotPath = std::string(argv[i] + 17);
+        } else if (!strcmp(argv[i], "--stats-snapshot-interval") ||
+                   !strcmp(argv[i], "-stats-snapshot-interval")) {
+            if (i + 1 == argc) {
+                usage("missing value after --stats-snapshot-interval argument");
+            }
+            options.statsSnapshotInterval = atoi(argv[++i]);
+        } else if (!strncmp(argv[i], "--stats-snapshot-interval=", 26)) {
+            options.statsSnapshotInterval = atoi(argv[i] + 26);
+        } else if (!strcmp(argv[i], "--trace") || !strcmp(argv[i], "-trace")) {
+            if (i + 1 == argc) {
+                usage("missing value after --trace argument");
+            }
+            options.traceFile = std::string(argv[++i]);
+        } else if (!strncmp(argv[i], "--trace=", 8)) {
+            options.traceFile = std::string(argv[i] + 8);
+        } else if (!strcmp(argv[i], "--trace-min-duration") ||
+                   !strcmp(argv[i], "-trace-min-duration")) {
+            if (i + 1 == argc) {
+                usage("missing value after --trace-min-duration argument");
+            }
+            options.traceMinDuration = atoi(argv[++i]);
+        } else if (!strncmp(argv[i], "--trace-min-duration=", 21)) {
+            options.traceMinDuration = atoi(argv[i] + 21);
         } else if (!strcmp(argv[i], "--help") || !strcmp(argv[i], "-help") ||
                    !strcmp(argv[i], "-h")) {
             usage();
@@ -1,9 +1,12 @@
 #include "serialization.h"
 
+#include <endian.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <limits>
+
 #include "util/exception.h"
 
 using namespace std;
@@ -49,6 +52,172 @@ void RecordWriter::write(const uint64_t& integer) {
     coded_output_.WriteLittleEndian64(integer);
 }
 
+AsyncRecordWriter::AsyncRecordWriter(const string& filename,
+                                     const size_t buffer_size,
+                                     const size_t max_buffers)
+    : AsyncRecordWriter(
+          FileDescriptor(CheckSystemCall(
+              filename, open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                             S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH |
+                                 S_IWOTH))),
+          buffer_size, max_buffers) {}
+
+AsyncRecordWriter::AsyncRecordWriter(FileDescriptor&& fd,
+                                     const size_t buffer_size,
+                                     const size_t max_buffers)
+    : fd_(move(fd)),
+      buffer_size_(max<size_t>(buffer_size, 1)),
+      max_buffers_(max<size_t>(max_buffers, 1)) {
+    current_.reserve(buffer_size_);
+    thread_ = thread(&AsyncRecordWriter::writer_thread, this);
+}
+
+AsyncRecordWriter::~AsyncRecordWriter() {
+    try {
+        close();
+    } catch (const exception& e) {
+        print_exception("AsyncRecordWriter", e);
+    }
+}
+
+void AsyncRecordWriter::append_header(const uint32_t len) {
+    if (not thread_.joinable()) {
+        throw runtime_error("AsyncRecordWriter: writer is closed");
+    }
+
+    /* the same framing as CodedOutputStream::WriteLittleEndian32 */
+    const uint32_t header = htole32(len);
+    current_.append(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+void AsyncRecordWriter::record_added() {
+    if (current_.size() >= buffer_size_) {
+        unique_lock<mutex> lock{mutex_};
+        submit_buffer(lock);
+    }
+}
+
+void AsyncRecordWriter::write_empty() {
+    append_header(0);
+    record_added();
+}
+
+void AsyncRecordWriter::write(const string& string) {
+    write(string.data(), string.length());
+}
+
+void AsyncRecordWriter::write(const char* data, const uint32_t len) {
+    append_header(len);
+    current_.append(data, len);
+    record_added();
+}
+
+void AsyncRecordWriter::write(const uint32_t& integer) {
+    const uint32_t value = htole32(integer);
+    write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void AsyncRecordWriter::write(const uint64_t& integer) {
+    const uint64_t value = htole64(integer);
+    write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void AsyncRecordWriter::submit_buffer(unique_lock<mutex>& lock) {
+    /* backpressure: don't let the caller run ahead of the disk */
+    buffer_done_.wait(lock, [this] {
+        return pending_.size() < max_buffers_ || error_;
+    });
+
+    if (error_) {
+        rethrow_exception(error_);
+    }
+
+    pending_.push_back(move(current_));
+    current_ = string();
+    current_.reserve(buffer_size_);
+    buffer_ready_.notify_one();
+}
+
+void AsyncRecordWriter::flush() {
+    unique_lock<mutex> lock{mutex_};
+
+    if (not current_.empty()) {
+        submit_buffer(lock);
+    }
+
+    buffer_done_.wait(lock, [this] {
+        return (pending_.empty() && not writing_) || error_;
+    });
+
+    if (error_) {
+        rethrow_exception(error_);
+    }
+}
+
+void AsyncRecordWriter::close() {
+    if (not thread_.joinable()) {
+        return;
+    }
+
+    exception_ptr flushError;
+
+    try {
+        flush();
+    } catch (...) {
+        flushError = current_exception();
+    }
+
+    {
+        unique_lock<mutex> lock{mutex_};
+        closing_ = true;
+    }
+
+    buffer_ready_.notify_all();
+    thread_.join();
+
+    if (flushError) {
+        rethrow_exception(flushError);
+    }
+
+    fd_.close();
+}
+
+void AsyncRecordWriter::writer_thread() {
+    unique_lock<mutex> lock{mutex_};
+
+    while (true) {
+        buffer_ready_.wait(lock,
+                           [this] { return not pending_.empty() || closing_; });
+
+        if (pending_.empty()) {
+            return;
+        }
+
+        const string buffer = move(pending_.front());
+        pending_.pop_front();
+        writing_ = true;
+        lock.unlock();
+
+        exception_ptr writeError;
+
+        try {
+            fd_.write(buffer);
+        } catch (...) {
+            writeError = current_exception();
+        }
+
+        lock.lock();
+        writing_ = false;
+
+        if (writeError) {
+            error_ = writeError;
+            pending_.clear();
+        }
+
+        buffer_done_.notify_all();
+    }
+}
+
 RecordReader::RecordReader(const string& filename)
     : RecordReader(FileDescriptor(
           CheckSystemCall(filename, open(filename.c_str(), O_RDONLY, 0)))) {}
@@ -66,6 +235,30 @@ RecordReader::RecordReader(istream * is)
     initialize();
 }
 
+RecordReader::RecordReader(const char * data, const size_t len)
+    : buffer_(data),
+      input_stream_(make_unique<ArrayInputStream>(data, len)),
+      coded_input_(input_stream_.get()) {
+    if (len > numeric_limits<int>::max()) {
+        throw runtime_error("RecordReader: buffer is too large");
+    }
+
+    initialize();
+}
+
+RecordReader::RecordReader(MMap_Region && region)
+    : region_(true, move(region)),
+      buffer_(region_->addr()),
+      input_stream_(make_unique<ArrayInputStream>(buffer_,
+                                                  region_->length())),
+      coded_input_(input_stream_.get()) {
+    if (region_->length() > numeric_limits<int>::max()) {
+        throw runtime_error("RecordReader: mapped file is too large");
+    }
+
+    initialize();
+}
+
 size_t RecordReader::skip(const size_t n_records)
 {
     if (eof_) {
@@ -127,6 +320,33 @@ bool RecordReader::read(char* data, const uint32_t max_len)  {
     return false;
 }
 
+bool RecordReader::read(Chunk* chunk) {
+    ProfilePhase _(Prof::ReadRecord);
+
+    if (eof_) { throw std::runtime_error("RecordReader: end of file reached"); }
+
+    if (buffer_ == nullptr && !region_.initialized()) {
+        throw runtime_error("RecordReader: in-place reads need a buffer");
+    }
+
+    if (next_size_ == 0) {
+        eof_ = not coded_input_.ReadLittleEndian32(&next_size_);
+        return false;
+    }
+
+    /* CurrentPosition() counts from the start of the array */
+    const char* record = buffer_ + coded_input_.CurrentPosition();
+
+    if (coded_input_.Skip(next_size_)) {
+      *chunk = Chunk(reinterpret_cast<const uint8_t*>(record), next_size_);
+      eof_ = not coded_input_.ReadLittleEndian32(&next_size_);
+      return true;
+    }
+
+    eof_ = true;
+    return false;
+}
+
 bool RecordReader::read(uint32_t* integer) {
     ProfilePhase _(Prof::ReadRecord);
 
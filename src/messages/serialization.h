@@ -1,7 +1,12 @@
 #ifndef PBRT_MESSAGES_SERIALIZATION_H
 #define PBRT_MESSAGES_SERIALIZATION_H
 
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <iostream>
 #include <istream>
 #include <sstream>
@@ -9,7 +14,9 @@
 #include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 
+#include "util/chunk.h"
 #include "util/file_descriptor.h"
+#include "util/mmap.h"
 #include "util/optional.h"
 #include "pbrt.pb.h"
 #include "core/stats.h"
@@ -44,6 +51,67 @@ private:
     google::protobuf::io::CodedOutputStream coded_output_;
 };
 
+/* Writes records in the same framing as RecordWriter, but leaves the I/O to
+ * a background thread. Records are appended to an in-memory buffer, which is
+ * handed to the thread once it reaches `buffer_size`; if `max_buffers` are
+ * already waiting, write() blocks until one is on disk. Errors from the
+ * thread are rethrown by the next call on the writer. */
+class AsyncRecordWriter {
+public:
+    AsyncRecordWriter(const std::string & filename,
+                      const size_t buffer_size = 4 * 1024 * 1024,
+                      const size_t max_buffers = 4);
+    AsyncRecordWriter(FileDescriptor && fd,
+                      const size_t buffer_size = 4 * 1024 * 1024,
+                      const size_t max_buffers = 4);
+
+    /* closes the writer, but swallows any error; call close() to see it */
+    ~AsyncRecordWriter();
+
+    AsyncRecordWriter(const AsyncRecordWriter &) = delete;
+    AsyncRecordWriter& operator=(const AsyncRecordWriter &) = delete;
+
+    template<class ProtobufType>
+    void write(const ProtobufType & proto);
+
+    void write(const std::string & string);
+    void write(const char* data, const uint32_t len);
+
+    void write(const uint32_t& integer);
+    void write(const uint64_t& integer);
+
+    void write_empty();
+
+    /* returns once everything written so far is in the file */
+    void flush();
+
+    /* flushes, stops the thread and closes the file */
+    void close();
+
+private:
+    void append_header(const uint32_t len);
+    void record_added();
+    void submit_buffer(std::unique_lock<std::mutex> & lock);
+    void writer_thread();
+
+    FileDescriptor fd_;
+    const size_t buffer_size_;
+    const size_t max_buffers_;
+
+    /* only touched by the calling thread */
+    std::string current_ {};
+
+    std::mutex mutex_ {};
+    std::condition_variable buffer_ready_ {};
+    std::condition_variable buffer_done_ {};
+    std::deque<std::string> pending_ {};
+    bool writing_ {false};
+    bool closing_ {false};
+    std::exception_ptr error_ {};
+
+    std::thread thread_ {};
+};
+
 class RecordReader {
 public:
     RecordReader(RecordReader &&) = default;
@@ -53,6 +121,12 @@ public:
     RecordReader(FileDescriptor && fd);
     RecordReader(std::istream * is);
 
+    /* reads from memory; the data has to outlive the reader */
+    RecordReader(const char * data, const size_t len);
+
+    /* reads from a mapped file, e.g. RecordReader{MMap_Region{filename}} */
+    RecordReader(MMap_Region && region);
+
     size_t skip(const size_t n_records = 1);
 
     template<class ProtobufType>
@@ -61,6 +135,11 @@ public:
     bool read(std::string* string);
     bool read(char* data, const uint32_t max_len);
 
+    /* points the chunk at the record without copying it; only for readers
+     * over memory, and valid for as long as the reader (or the caller's
+     * buffer) is */
+    bool read(Chunk* chunk);
+
     bool read(uint32_t* integer);
     bool read(uint64_t* integer);
 
@@ -70,6 +149,10 @@ private:
     void initialize();
 
     Optional<FileDescriptor> fd_;
+    Optional<MMap_Region> region_;
+
+    /* start of the buffer, for readers over memory */
+    const char * buffer_ {nullptr};
 
     std::unique_ptr<google::protobuf::io::ZeroCopyInputStream> input_stream_;
     google::protobuf::io::CodedInputStream coded_input_;
@@ -86,6 +169,19 @@ void RecordWriter::write(const ProtobufType & proto) {
     }
 }
 
+template<class ProtobufType>
+void AsyncRecordWriter::write(const ProtobufType & proto) {
+    const size_t len = proto.ByteSize();
+    append_header(len);
+
+    const size_t offset = current_.size();
+    current_.resize(offset + len);
+    proto.SerializeWithCachedSizesToArray(
+        reinterpret_cast<google::protobuf::uint8 *>(&current_[offset]));
+
+    record_added();
+}
+
 template<class ProtobufType>
 bool RecordReader::read(ProtobufType * record) {
     ProfilePhase _(Prof::ReadRecord);
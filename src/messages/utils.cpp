@@ -1,8 +1,13 @@
 #include "utils.h"
 
+#include <endian.h>
+
 #include <chrono>
+#include <cstring>
 #include <memory>
+#include <sstream>
 #include <stdexcept>
+#include <type_traits>
 
 #include "cameras/environment.h"
 #include "cameras/orthographic.h"
@@ -131,11 +136,190 @@ protobuf::AnimatedTransform to_protobuf(const AnimatedTransform& transform) {
     return proto_transform;
 }
 
+/* Packed mesh arrays are little-endian; on little-endian hosts with
+   single-precision Float they are plain copies of the mesh's arrays. */
+static constexpr bool NativeMeshArrays =
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ && is_same<Float, float>::value;
+
+static string PackFloats(const Float* values, const size_t count) {
+    string out(count * sizeof(float), '\0');
+
+    if (NativeMeshArrays) {
+        memcpy(&out[0], values, out.size());
+        return out;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const float f = values[i];
+        uint32_t u;
+        memcpy(&u, &f, sizeof(u));
+        u = htole32(u);
+        memcpy(&out[i * sizeof(u)], &u, sizeof(u));
+    }
+
+    return out;
+}
+
+static void UnpackFloats(const string& in, Float* values, const size_t count) {
+    if (in.size() != count * sizeof(float)) {
+        throw runtime_error("TriangleMesh: packed array has the wrong size");
+    }
+
+    if (NativeMeshArrays) {
+        memcpy(values, in.data(), in.size());
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t u;
+        memcpy(&u, &in[i * sizeof(u)], sizeof(u));
+        u = le32toh(u);
+        float f;
+        memcpy(&f, &u, sizeof(f));
+        values[i] = f;
+    }
+}
+
+template <class T>
+static void PutLE(string& out, const size_t i, T value) {
+    for (size_t b = 0; b < sizeof(T); b++) {
+        out[i * sizeof(T) + b] = static_cast<char>(value & 0xff);
+        value >>= 8;
+    }
+}
+
+template <class T>
+static T GetLE(const string& in, const size_t i) {
+    T value = 0;
+    for (size_t b = sizeof(T); b-- > 0;) {
+        value = (value << 8) | static_cast<uint8_t>(in[i * sizeof(T) + b]);
+    }
+    return value;
+}
+
+/* normals are mapped to the octahedron, which is then unfolded onto a
+   square, and the square is stored with 16 bits per coordinate */
+static void EncodeOctahedral(const Normal3f& n, int16_t out[2]) {
+    const Float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    Float u = (l1 > 0) ? n.x / l1 : 0;
+    Float v = (l1 > 0) ? n.y / l1 : 0;
+
+    if (n.z < 0) {
+        const Float fu = (1 - std::abs(v)) * (u >= 0 ? 1 : -1);
+        const Float fv = (1 - std::abs(u)) * (v >= 0 ? 1 : -1);
+        u = fu;
+        v = fv;
+    }
+
+    out[0] = static_cast<int16_t>(std::round(Clamp(u, -1, 1) * 32767));
+    out[1] = static_cast<int16_t>(std::round(Clamp(v, -1, 1) * 32767));
+}
+
+static Normal3f DecodeOctahedral(const int16_t in[2]) {
+    Float u = in[0] / 32767.f;
+    Float v = in[1] / 32767.f;
+    const Float z = 1 - std::abs(u) - std::abs(v);
+
+    if (z < 0) {
+        const Float fu = (1 - std::abs(v)) * (u >= 0 ? 1 : -1);
+        const Float fv = (1 - std::abs(u)) * (v >= 0 ? 1 : -1);
+        u = fu;
+        v = fv;
+    }
+
+    return Normalize(Normal3f(u, v, z));
+}
+
+static void PackTriangleMesh(const TriangleMesh& tm,
+                             protobuf::TriangleMesh& proto_tm,
+                             const bool quantize) {
+    const size_t nIndices = 3 * tm.nTriangles;
+    const size_t nVertices = tm.nVertices;
+
+    proto_tm.set_format(2);
+    proto_tm.set_quantized(quantize);
+
+    /* indices */
+    const uint32_t indexBytes = (nVertices <= 65536) ? 2 : 4;
+    string indices(nIndices * indexBytes, '\0');
+
+    for (size_t i = 0; i < nIndices; i++) {
+        if (indexBytes == 2) {
+            PutLE<uint16_t>(indices, i, tm.vertexIndices[i]);
+        } else {
+            PutLE<uint32_t>(indices, i, tm.vertexIndices[i]);
+        }
+    }
+
+    proto_tm.set_index_bytes(indexBytes);
+    proto_tm.set_indices(move(indices));
+
+    /* vertex data */
+    proto_tm.set_p_data(
+        PackFloats(reinterpret_cast<const Float*>(tm.p.get()), 3 * nVertices));
+
+    if (tm.s) {
+        proto_tm.set_s_data(PackFloats(
+            reinterpret_cast<const Float*>(tm.s.get()), 3 * nVertices));
+    }
+
+    if (tm.n && quantize) {
+        string normals(nVertices * 2 * sizeof(int16_t), '\0');
+        for (size_t i = 0; i < nVertices; i++) {
+            int16_t oct[2];
+            EncodeOctahedral(tm.n[i], oct);
+            PutLE<uint16_t>(normals, 2 * i, oct[0]);
+            PutLE<uint16_t>(normals, 2 * i + 1, oct[1]);
+        }
+        proto_tm.set_n_data(move(normals));
+    } else if (tm.n) {
+        proto_tm.set_n_data(PackFloats(
+            reinterpret_cast<const Float*>(tm.n.get()), 3 * nVertices));
+    }
+
+    if (tm.uv && quantize) {
+        Bounds2f range;
+        for (size_t i = 0; i < nVertices; i++) {
+            range = Union(range, tm.uv[i]);
+        }
+
+        for (const Float f : {range.pMin.x, range.pMin.y, range.pMax.x,
+                              range.pMax.y}) {
+            proto_tm.add_uv_range(f);
+        }
+
+        const Vector2f extent = range.Diagonal();
+        string uvs(nVertices * 2 * sizeof(uint16_t), '\0');
+
+        for (size_t i = 0; i < nVertices; i++) {
+            const Vector2f o = range.Offset(tm.uv[i]);
+            for (int c = 0; c < 2; c++) {
+                const Float t = (extent[c] > 0) ? o[c] : 0;
+                PutLE<uint16_t>(uvs, 2 * i + c,
+                                std::round(Clamp(t, 0, 1) * 65535));
+            }
+        }
+
+        proto_tm.set_uv_data(move(uvs));
+    } else if (tm.uv) {
+        proto_tm.set_uv_data(PackFloats(
+            reinterpret_cast<const Float*>(tm.uv.get()), 2 * nVertices));
+    }
+}
+
 protobuf::TriangleMesh to_protobuf(const TriangleMesh& tm) {
     protobuf::TriangleMesh proto_tm;
     proto_tm.set_n_triangles(tm.nTriangles);
     proto_tm.set_n_vertices(tm.nVertices);
 
+    if (PbrtOptions.meshFormat == 2) {
+        PackTriangleMesh(tm, proto_tm, PbrtOptions.quantizeMeshes);
+        return proto_tm;
+    } else if (PbrtOptions.meshFormat != 1) {
+        throw runtime_error("unknown mesh format " +
+                            to_string(PbrtOptions.meshFormat));
+    }
+
     for (size_t i = 0; i < tm.nTriangles; i++) {
         proto_tm.add_vertex_indices(tm.vertexIndices[3 * i]);
         proto_tm.add_vertex_indices(tm.vertexIndices[3 * i + 1]);
@@ -311,9 +495,103 @@ RGBSpectrum from_protobuf(const protobuf::RGBSpectrum& proto_spectrum) {
     return RGBSpectrum::FromRGB(proto_spectrum.c().data());
 }
 
+static TriangleMesh UnpackTriangleMesh(
+    const protobuf::TriangleMesh& proto_tm) {
+    const size_t nIndices = 3 * proto_tm.n_triangles();
+    const size_t nVertices = proto_tm.n_vertices();
+    const bool quantized = proto_tm.quantized();
+
+    /* indices */
+    const string& indices = proto_tm.indices();
+    const uint32_t indexBytes = proto_tm.index_bytes();
+
+    if ((indexBytes != 2 && indexBytes != 4) ||
+        indices.size() != nIndices * indexBytes) {
+        throw runtime_error("TriangleMesh: invalid packed indices");
+    }
+
+    vector<int> vertexIndices(nIndices);
+
+    if (indexBytes == 4 && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) {
+        memcpy(vertexIndices.data(), indices.data(), indices.size());
+    } else {
+        for (size_t i = 0; i < nIndices; i++) {
+            vertexIndices[i] = (indexBytes == 2)
+                                   ? GetLE<uint16_t>(indices, i)
+                                   : GetLE<uint32_t>(indices, i);
+        }
+    }
+
+    /* vertex data */
+    unique_ptr<Point3f[]> p{new Point3f[nVertices]};
+    unique_ptr<Vector3f[]> s;
+    unique_ptr<Normal3f[]> n;
+    unique_ptr<Point2f[]> uv;
+
+    UnpackFloats(proto_tm.p_data(), reinterpret_cast<Float*>(p.get()),
+                 3 * nVertices);
+
+    if (!proto_tm.s_data().empty()) {
+        s.reset(new Vector3f[nVertices]);
+        UnpackFloats(proto_tm.s_data(), reinterpret_cast<Float*>(s.get()),
+                     3 * nVertices);
+    }
+
+    const string& normals = proto_tm.n_data();
+    if (!normals.empty() && quantized) {
+        if (normals.size() != nVertices * 2 * sizeof(int16_t)) {
+            throw runtime_error("TriangleMesh: invalid quantized normals");
+        }
+
+        n.reset(new Normal3f[nVertices]);
+        for (size_t i = 0; i < nVertices; i++) {
+            const int16_t oct[2] = {
+                static_cast<int16_t>(GetLE<uint16_t>(normals, 2 * i)),
+                static_cast<int16_t>(GetLE<uint16_t>(normals, 2 * i + 1))};
+            n[i] = DecodeOctahedral(oct);
+        }
+    } else if (!normals.empty()) {
+        n.reset(new Normal3f[nVertices]);
+        UnpackFloats(normals, reinterpret_cast<Float*>(n.get()),
+                     3 * nVertices);
+    }
+
+    const string& uvs = proto_tm.uv_data();
+    if (!uvs.empty() && quantized) {
+        if (uvs.size() != nVertices * 2 * sizeof(uint16_t) ||
+            proto_tm.uv_range_size() != 4) {
+            throw runtime_error("TriangleMesh: invalid quantized uvs");
+        }
+
+        const Point2f pMin{proto_tm.uv_range(0), proto_tm.uv_range(1)};
+        const Vector2f extent{proto_tm.uv_range(2) - proto_tm.uv_range(0),
+                              proto_tm.uv_range(3) - proto_tm.uv_range(1)};
+
+        uv.reset(new Point2f[nVertices]);
+        for (size_t i = 0; i < nVertices; i++) {
+            uv[i] = pMin + Vector2f(GetLE<uint16_t>(uvs, 2 * i) / 65535.f *
+                                        extent.x,
+                                    GetLE<uint16_t>(uvs, 2 * i + 1) /
+                                        65535.f * extent.y);
+        }
+    } else if (!uvs.empty()) {
+        uv.reset(new Point2f[nVertices]);
+        UnpackFloats(uvs, reinterpret_cast<Float*>(uv.get()), 2 * nVertices);
+    }
+
+    return {proto_tm.n_triangles(), move(vertexIndices),
+            proto_tm.n_vertices(),  move(p),
+            move(s),                move(n),
+            move(uv)};
+}
+
 TriangleMesh from_protobuf(const protobuf::TriangleMesh& proto_tm) {
     ProfilePhase _(Prof::ConvertFromProtobuf);
 
+    if (proto_tm.format() == 2) {
+        return UnpackTriangleMesh(proto_tm);
+    }
+
     Transform identity;
     vector<int> vertexIndices;
     vector<Point3f> p;
@@ -463,6 +741,38 @@ ObjectKey from_protobuf(const protobuf::ObjectKey& objectKey) {
     return ObjectKey{static_cast<ObjectType>(objectKey.type()), objectKey.id()};
 }
 
+void StoreMeshBlob(protobuf::TriangleMesh& mesh, const uint32_t treeletId,
+                   SceneManager& manager) {
+    if (PbrtOptions.dedupBlobs && !mesh.blob()) {
+        const int64_t id = mesh.id();
+        const int64_t materialId = mesh.material_id();
+
+        /* the blob can't hold anything specific to this treelet */
+        mesh.clear_id();
+        mesh.clear_material_id();
+
+        ostringstream data;
+
+        {
+            protobuf::RecordWriter writer{&data};
+            writer.write(mesh);
+        }
+
+        const ObjectID blob = manager.putBlob(data.str());
+
+        mesh.Clear();
+        mesh.set_id(id);
+        mesh.set_material_id(materialId);
+        mesh.set_blob(blob);
+    }
+
+    if (mesh.blob()) {
+        manager.recordDependency(
+            ObjectKey{ObjectType::Treelet, treeletId},
+            ObjectKey{ObjectType::Blob, mesh.blob()});
+    }
+}
+
 protobuf::Light light::to_protobuf(const string& name, const ParamSet& params,
                                    const Transform& light2world) {
     protobuf::Light proto_light;
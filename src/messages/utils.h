@@ -96,6 +96,13 @@ TextureParams from_protobuf(
     std::map<std::string, std::shared_ptr<Texture<Spectrum>>>& sTex);
 ObjectKey from_protobuf(const protobuf::ObjectKey& objectKey);
 
+/* Called on a mesh record before it's written into a treelet. With
+ * --dedup-blobs, the mesh data moves into a blob that all the treelets with
+ * the same mesh share, and the record keeps only its id, material and the
+ * blob's id. Also records the treelet's dependency on the blob. */
+void StoreMeshBlob(protobuf::TriangleMesh& mesh, const uint32_t treeletId,
+                   SceneManager& manager = global::manager);
+
 namespace light {
 
 std::shared_ptr<Light> from_protobuf(const protobuf::Light& light);
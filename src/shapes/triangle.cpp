@@ -37,6 +37,7 @@
 #include "paramset.h"
 #include "sampling.h"
 #include "efloat.h"
+#include "numa.h"
 #include "ext/rply.h"
 #include <array>
 
@@ -49,6 +50,20 @@ static void PlyErrorCallback(p_ply, const char *message) {
     Error("PLY writing error: %s", message);
 }
 
+// The mesh is built by one thread but read by all of them, so with --numa
+// its vertex data is spread over the nodes rather than left on the node of
+// the thread that built it.
+static void InterleaveVertexData(const TriangleMesh &mesh) {
+    if (!PbrtOptions.numa) return;
+    const size_t nVertices = mesh.nVertices;
+    NumaInterleave(mesh.vertexIndices.data(),
+                   mesh.vertexIndices.size() * sizeof(int));
+    NumaInterleave(mesh.p.get(), nVertices * sizeof(Point3f));
+    if (mesh.n) NumaInterleave(mesh.n.get(), nVertices * sizeof(Normal3f));
+    if (mesh.s) NumaInterleave(mesh.s.get(), nVertices * sizeof(Vector3f));
+    if (mesh.uv) NumaInterleave(mesh.uv.get(), nVertices * sizeof(Point2f));
+}
+
 // Triangle Method Definitions
 STAT_RATIO("Scene/Triangles per triangle mesh", nTris, nMeshes);
 TriangleMesh::TriangleMesh(
@@ -89,6 +104,86 @@ TriangleMesh::TriangleMesh(
 
     if (fIndices)
         faceIndices = std::vector<int>(fIndices, fIndices + nTriangles);
+
+    InterleaveVertexData(*this);
+}
+
+TriangleMesh::TriangleMesh(int nTriangles, std::vector<int> &&vertexIndices,
+                           int nVertices, std::unique_ptr<Point3f[]> P,
+                           std::unique_ptr<Vector3f[]> S,
+                           std::unique_ptr<Normal3f[]> N,
+                           std::unique_ptr<Point2f[]> UV)
+    : nTriangles(nTriangles),
+      nVertices(nVertices),
+      vertexIndices(std::move(vertexIndices)),
+      p(std::move(P)),
+      n(std::move(N)),
+      s(std::move(S)),
+      uv(std::move(UV)) {
+    CHECK_EQ(this->vertexIndices.size(), 3 * nTriangles);
+    ++nMeshes;
+    nTris += nTriangles;
+    triMeshBytes += sizeof(*this) + this->vertexIndices.size() * sizeof(int) +
+                    nVertices * (sizeof(Point3f) + (n ? sizeof(Normal3f) : 0) +
+                                 (s ? sizeof(Vector3f) : 0) +
+                                 (uv ? sizeof(Point2f) : 0));
+
+    InterleaveVertexData(*this);
+}
+
+std::shared_ptr<TriangleMesh> ExtractSubMesh(
+    const TriangleMesh &mesh, const std::vector<size_t> &triangles) {
+    // A mesh is usually split into many parts, so the vertex map is kept
+    // between calls and only the entries that were used are reset.
+    static thread_local std::vector<int> vertexMap;
+    if (vertexMap.size() < (size_t)mesh.nVertices)
+        vertexMap.resize(mesh.nVertices, -1);
+
+    std::vector<int> indices(3 * triangles.size());
+    std::vector<int> usedVertices;
+
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        CHECK_LT(triangles[i], (size_t)mesh.nTriangles);
+        for (int j = 0; j < 3; ++j) {
+            const int v = mesh.vertexIndices[3 * triangles[i] + j];
+            if (vertexMap[v] < 0) {
+                vertexMap[v] = usedVertices.size();
+                usedVertices.push_back(v);
+            }
+            indices[3 * i + j] = vertexMap[v];
+        }
+    }
+
+    const int nVertices = usedVertices.size();
+    std::unique_ptr<Point3f[]> P(new Point3f[nVertices]);
+    std::unique_ptr<Vector3f[]> S(mesh.s ? new Vector3f[nVertices] : nullptr);
+    std::unique_ptr<Normal3f[]> N(mesh.n ? new Normal3f[nVertices] : nullptr);
+    std::unique_ptr<Point2f[]> UV(mesh.uv ? new Point2f[nVertices] : nullptr);
+
+    for (int i = 0; i < nVertices; ++i) {
+        const int v = usedVertices[i];
+        P[i] = mesh.p[v];
+        if (S) S[i] = mesh.s[v];
+        if (N) N[i] = mesh.n[v];
+        if (UV) UV[i] = mesh.uv[v];
+        vertexMap[v] = -1;
+    }
+
+    auto subMesh = std::make_shared<TriangleMesh>(
+        triangles.size(), std::move(indices), nVertices, std::move(P),
+        std::move(S), std::move(N), std::move(UV));
+
+    subMesh->alphaMask = mesh.alphaMask;
+    subMesh->shadowAlphaMask = mesh.shadowAlphaMask;
+
+    // Face indices are per triangle, not per vertex
+    if (!mesh.faceIndices.empty()) {
+        subMesh->faceIndices.reserve(triangles.size());
+        for (size_t t : triangles)
+            subMesh->faceIndices.push_back(mesh.faceIndices[t]);
+    }
+
+    return subMesh;
 }
 
 std::vector<std::shared_ptr<Shape>> CreateTriangleMesh(
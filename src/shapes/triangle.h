@@ -60,6 +60,12 @@ struct TriangleMesh {
                  const std::shared_ptr<Texture<Float>> &shadowAlphaMask,
                  const int *faceIndices);
 
+    // Takes over vertex data that is already in world space
+    TriangleMesh(int nTriangles, std::vector<int> &&vertexIndices,
+                 int nVertices, std::unique_ptr<Point3f[]> P,
+                 std::unique_ptr<Vector3f[]> S, std::unique_ptr<Normal3f[]> N,
+                 std::unique_ptr<Point2f[]> UV);
+
     // TriangleMesh Data
     const int nTriangles, nVertices;
     std::vector<int> vertexIndices;
@@ -71,6 +77,12 @@ struct TriangleMesh {
     std::vector<int> faceIndices;
 };
 
+// Returns a mesh with only the given triangles of _mesh_, in that order, and
+// the vertices they use, numbered by first use. The dumpers use it to give
+// each treelet just the part of a mesh that it references.
+std::shared_ptr<TriangleMesh> ExtractSubMesh(
+    const TriangleMesh &mesh, const std::vector<size_t> &triangles);
+
 class TreeletDumpBVH;
 class ProxyDumpBVH;
 
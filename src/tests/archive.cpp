@@ -0,0 +1,106 @@
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "cloud/manager.h"
+#include "messages/serialization.h"
+#include "util/path.h"
+#include "util/temp_file.h"
+
+using namespace pbrt;
+
+static void WriteObject(const std::string &dir, const std::string &name,
+                        const std::vector<std::string> &records) {
+    protobuf::RecordWriter writer{(roost::path(dir) / name).string()};
+    for (const auto &record : records) writer.write(record);
+}
+
+static std::vector<std::string> ReadObject(const SceneManager &manager,
+                                           const ObjectType type,
+                                           const uint32_t id = 0) {
+    std::vector<std::string> records;
+    auto reader = manager.GetReader(type, id);
+
+    while (!reader->eof()) {
+        std::string record;
+        if (reader->read(&record)) records.push_back(record);
+    }
+
+    return records;
+}
+
+TEST(SceneArchive, ParseFileName) {
+    ObjectKey key;
+
+    EXPECT_TRUE(SceneManager::parseFileName("T12", key));
+    EXPECT_EQ(ObjectType::Treelet, key.type);
+    EXPECT_EQ(12, key.id);
+
+    EXPECT_TRUE(SceneManager::parseFileName("TEX3", key));
+    EXPECT_EQ(ObjectType::Texture, key.type);
+    EXPECT_EQ(3, key.id);
+
+    EXPECT_TRUE(SceneManager::parseFileName("TINFO", key));
+    EXPECT_EQ(ObjectType::TreeletInfo, key.type);
+
+    EXPECT_TRUE(SceneManager::parseFileName("MANIFEST", key));
+    EXPECT_EQ(ObjectType::Manifest, key.type);
+
+    EXPECT_TRUE(SceneManager::parseFileName("PROXIES", key));
+    EXPECT_EQ(ObjectType::ProxyTable, key.type);
+    EXPECT_FALSE(SceneManager::parseFileName("PROXIES0", key));
+
+    EXPECT_FALSE(SceneManager::parseFileName("T", key));
+    EXPECT_FALSE(SceneManager::parseFileName("TM0", key));
+    EXPECT_FALSE(SceneManager::parseFileName("CAMERA0", key));
+    EXPECT_FALSE(SceneManager::parseFileName("STATIC0_pre", key));
+}
+
+TEST(SceneArchive, PackAndRead) {
+    TempDirectory tempDir{"/tmp/pbrt-archive-test"};
+    const std::string dir = tempDir.name() + "/scene";
+    const std::string archivePath = tempDir.name() + "/scene.pack";
+    roost::create_directories(dir);
+
+    WriteObject(dir, "T0", {"root", "nodes"});
+    WriteObject(dir, "T1", {std::string(100000, 'x')});
+    WriteObject(dir, "MAT7", {"material"});
+    WriteObject(dir, "CAMERA", {"camera"});
+    WriteObject(dir, "STATIC0_pre", {"ignored"});
+    roost::atomic_create("2 0.25 0.75", roost::path(dir) / "TINFO");
+
+    SceneManager::packArchive(dir, archivePath);
+
+    SceneManager directory;
+    directory.init(dir);
+    EXPECT_FALSE(directory.isArchive());
+
+    SceneManager archive;
+    archive.init(archivePath);
+    EXPECT_TRUE(archive.isArchive());
+
+    for (const ObjectKey key :
+         {ObjectKey{ObjectType::Treelet, 0}, ObjectKey{ObjectType::Treelet, 1},
+          ObjectKey{ObjectType::Material, 7}, ObjectKey{ObjectType::Camera, 0}}) {
+        EXPECT_EQ(ReadObject(directory, key.type, key.id),
+                  ReadObject(archive, key.type, key.id));
+        EXPECT_EQ(directory.getObjectSize(key.type, key.id),
+                  archive.getObjectSize(key.type, key.id));
+    }
+
+    EXPECT_EQ(std::vector<double>({0.25, 0.75}), archive.getTreeletProbs());
+    EXPECT_THROW(archive.GetReader(ObjectType::Treelet, 2), std::runtime_error);
+    EXPECT_THROW(archive.GetWriter(ObjectType::Treelet, 2), std::runtime_error);
+
+    /* flip a byte of T1 and see the checksum catch it */
+    const uint64_t t0 = archive.getObjectSize(ObjectType::Treelet, 0);
+    std::string data = roost::read_file(archivePath);
+    data[t0 + 100] ^= 1;
+    roost::atomic_create(data, archivePath);
+
+    SceneManager corrupt;
+    EXPECT_THROW(corrupt.init(archivePath, true), std::runtime_error);
+
+    /* without verification, the entries are read as they are */
+    SceneManager unchecked;
+    unchecked.init(archivePath);
+    EXPECT_NO_THROW(unchecked.GetReader(ObjectType::Treelet, 1));
+}
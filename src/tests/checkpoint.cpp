@@ -0,0 +1,153 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "cameras/perspective.h"
+#include "cloud/checkpoint.h"
+#include "cloud/scheduler.h"
+#include "core/film.h"
+#include "filters/box.h"
+#include "integrators/cloud.h"
+#include "messages/serialization.h"
+#include "samplers/halton.h"
+#include "util/path.h"
+#include "util/temp_file.h"
+
+using namespace pbrt;
+
+static std::unique_ptr<Film> MakeFilm() {
+    return std::unique_ptr<Film>(new Film(
+        Point2i(8, 8), Bounds2f(Point2f(0, 0), Point2f(1, 1)),
+        std::unique_ptr<Filter>(new BoxFilter(Vector2f(0.5f, 0.5f))), 1.f,
+        "test.exr", 1.f));
+}
+
+TEST(Checkpoint, RoundTrip) {
+    TempDirectory tempDir{"/tmp/pbrt-checkpoint-test"};
+    const std::string dir = tempDir.name();
+
+    RayScheduler scheduler{4, "", 2};
+    std::vector<Sample> samples;
+    std::unique_ptr<Film> film = MakeFilm();
+
+    for (int i = 0; i < 10; i++) {
+        RayStatePtr ray = RayState::Create();
+        ray->sample.id = i;
+        ray->remainingBounces = i % 3;
+        scheduler.Push(std::move(ray));
+
+        samples.emplace_back();
+        samples.back().sampleId = 100 + i;
+        samples.back().L = Spectrum(i);
+    }
+
+    std::unique_ptr<FilmTile> tile = film->GetFilmTile(film->GetSampleBounds());
+    tile->AddSample(Point2f(2.5f, 3.5f), Spectrum(1.f));
+    film->MergeFilmTile(std::move(tile));
+
+    {
+        CheckpointWriter writer{dir, 2};
+        CheckpointWriter::State state;
+        state.nextSample = 42;
+        state.rays = &scheduler;
+        state.samples = &samples;
+        state.film = film.get();
+
+        ASSERT_TRUE(writer.Checkpoint(state));
+
+        /* reading the spilled rays back deletes their files; the checkpoint
+           being written keeps them until it's done */
+        std::vector<RayStatePtr> popped;
+        while (!scheduler.Empty()) popped.push_back(scheduler.Pop());
+        writer.Wait();
+        for (RayStatePtr &ray : popped) scheduler.Push(std::move(ray));
+
+        /* the second one is incremental: it only has the touched row and
+           the new samples */
+        tile = film->GetFilmTile(film->GetSampleBounds());
+        tile->AddSample(Point2f(5.5f, 6.5f), Spectrum(2.f));
+        film->MergeFilmTile(std::move(tile));
+
+        for (int i = 10; i < 12; i++) {
+            samples.emplace_back();
+            samples.back().sampleId = 100 + i;
+            samples.back().L = Spectrum(i);
+        }
+
+        ASSERT_TRUE(writer.Checkpoint(state));
+        writer.Wait();
+        EXPECT_EQ(2, writer.LastEpoch());
+    }
+
+    protobuf::Checkpoint info;
+    RayScheduler restoredRays;
+    std::vector<Sample> restoredSamples;
+    std::unique_ptr<Film> restoredFilm = MakeFilm();
+
+    ASSERT_TRUE(RestoreCheckpoint(dir, info, &restoredRays, &restoredSamples,
+                                  restoredFilm.get()));
+    EXPECT_EQ(2, info.epoch());
+    EXPECT_EQ(42, info.next_sample());
+    EXPECT_EQ(2, info.film_files_size());
+    EXPECT_EQ(2, info.sample_files_size());
+    EXPECT_EQ(10, restoredRays.Size());
+    ASSERT_EQ(12, restoredSamples.size());
+
+    for (int i = 0; i < 12; i++) {
+        EXPECT_EQ(100 + i, restoredSamples[i].sampleId);
+        EXPECT_EQ(Spectrum(i), restoredSamples[i].L);
+    }
+
+    std::vector<int> rows, restoredRows;
+    std::vector<Float> values, restoredValues;
+    film->SnapshotRows(false, &rows, &values);
+    restoredFilm->SnapshotRows(false, &restoredRows, &restoredValues);
+    EXPECT_EQ(rows, restoredRows);
+    EXPECT_EQ(values, restoredValues);
+}
+
+TEST(Checkpoint, ResumedCameraSamples) {
+    /* 8x8 pixels with 4 samples each, and a scheduler that only holds a few
+       rays, so that in-flight rays are processed (and a checkpoint may be
+       taken) between camera samples */
+    const int spp = 4;
+    const uint64_t total = 8 * 8 * spp;
+
+    /* the camera owns the film */
+    Film *film = MakeFilm().release();
+    AnimatedTransform identity(new Transform, 0, new Transform, 1);
+    PerspectiveCamera camera(identity, Bounds2f(Point2f(-1, -1), Point2f(1, 1)),
+                             0., 1., 0., 10., 45, film, nullptr);
+
+    /* returns the number of rays pushed; the checkpoint is taken at the
+       first processRay() */
+    auto render = [&](const uint64_t resumeSample, uint64_t *checkpointSample,
+                      uint64_t *pushedAtCheckpoint) {
+        HaltonSampler sampler(spp, film->GetSampleBounds());
+        RayScheduler scheduler{3};
+        uint64_t cameraSamples = 0;
+        uint64_t popped = 0;
+
+        CloudIntegrator::GenerateCameraRays(
+            camera, sampler, film->croppedPixelBounds, 5, resumeSample,
+            &cameraSamples, scheduler, [&]() {
+                if (checkpointSample && popped == 0) {
+                    *checkpointSample = cameraSamples;
+                    *pushedAtCheckpoint = scheduler.Size();
+                }
+                scheduler.Pop();
+                popped++;
+            });
+
+        EXPECT_EQ(total, cameraSamples);
+        return popped + scheduler.Size();
+    };
+
+    uint64_t checkpointSample = 0, pushedAtCheckpoint = 0;
+    EXPECT_EQ(total, render(0, &checkpointSample, &pushedAtCheckpoint));
+    ASSERT_LT(0, checkpointSample);
+    EXPECT_EQ(pushedAtCheckpoint, checkpointSample);
+
+    /* the rays of the checkpoint and the resumed render are all of them */
+    EXPECT_EQ(total, pushedAtCheckpoint + render(checkpointSample, nullptr,
+                                                 nullptr));
+}
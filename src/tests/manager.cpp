@@ -0,0 +1,214 @@
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "cloud/manager.h"
+#include "messages/serialization.h"
+#include "pbrt/main.h"
+#include "util/path.h"
+#include "util/temp_file.h"
+
+using namespace pbrt;
+
+TEST(SceneManager, DependencyClosures) {
+    TempDirectory tempDir{"/tmp/pbrt-manager-test"};
+    const std::string dir = tempDir.name();
+
+    const ObjectKey T0{ObjectType::Treelet, 0}, T1{ObjectType::Treelet, 1},
+        T2{ObjectType::Treelet, 2}, T3{ObjectType::Treelet, 3},
+        MAT0{ObjectType::Material, 0}, MAT1{ObjectType::Material, 1},
+        TEX0{ObjectType::Texture, 0};
+
+    {
+        SceneManager dumper;
+        dumper.init(dir);
+
+        for (int i = 0; i < 4; i++) {
+            dumper.getNextId(ObjectType::Treelet);
+            dumper.GetWriter(ObjectType::Treelet, i)
+                ->write(std::string(100 * (i + 1), 't'));
+        }
+
+        for (int i = 0; i < 2; i++) {
+            dumper.getNextId(ObjectType::Material);
+            dumper.GetWriter(ObjectType::Material, i)->write(std::string(6, 'm'));
+        }
+
+        dumper.getTextureId("checker.png");
+        dumper.GetWriter(ObjectType::Texture, 0)->write(std::string(1000, 'x'));
+
+        /* T0 and T3 both instance T1, which holds T2 */
+        dumper.recordDependency(T0, T1);
+        dumper.recordDependency(T0, MAT1);
+        dumper.recordDependency(T1, T2);
+        dumper.recordDependency(T2, MAT0);
+        dumper.recordDependency(T3, T1);
+        dumper.recordDependency(MAT1, TEX0);
+
+        protobuf::Manifest manifest = dumper.makeManifest();
+        EXPECT_TRUE(manifest.has_closures());
+        dumper.GetWriter(ObjectType::Manifest)->write(manifest);
+
+        /* the same manifest, as written by older versions */
+        manifest.set_has_closures(false);
+        for (auto &obj : *manifest.mutable_objects()) {
+            obj.clear_closure();
+            obj.clear_closure_bytes();
+        }
+
+        roost::create_directories(dir + "/old");
+        for (const std::string name : {"T0", "T1", "T2", "T3", "MAT0", "MAT1",
+                                       "TEX0"}) {
+            roost::atomic_create(roost::read_file(roost::path(dir) / name),
+                                 roost::path(dir) / "old" / name);
+        }
+
+        protobuf::RecordWriter{dir + "/old/MANIFEST"}.write(manifest);
+    }
+
+    for (const std::string path : {dir, dir + "/old"}) {
+        SceneManager manager;
+        manager.init(path);
+
+        ASSERT_EQ(4, manager.treeletCount());
+        EXPECT_EQ(std::set<ObjectKey>({T1, T2, MAT0, MAT1, TEX0}),
+                  manager.getTreeletDependencies(0));
+        EXPECT_EQ(std::set<ObjectKey>({T2, MAT0}),
+                  manager.getTreeletDependencies(1));
+        EXPECT_EQ(std::set<ObjectKey>({MAT0}),
+                  manager.getTreeletDependencies(2));
+        EXPECT_EQ(std::set<ObjectKey>({T1, T2, MAT0}),
+                  manager.getTreeletDependencies(3));
+
+        auto size = [&](const ObjectKey &key) {
+            return manager.getObjectSize(key.type, key.id);
+        };
+
+        EXPECT_EQ(size(T0) + size(T1) + size(T2) + size(MAT0) + size(MAT1) +
+                      size(TEX0),
+                  manager.getTreeletClosureSize(0));
+        EXPECT_EQ(size(T3) + size(T1) + size(T2) + size(MAT0),
+                  manager.getTreeletClosureSize(3));
+    }
+
+}
+
+TEST(SceneManager, Blobs) {
+    TempDirectory tempDir{"/tmp/pbrt-manager-test"};
+    const std::string dir = tempDir.name();
+
+    const std::string data(1000, 'b');
+    ObjectID id;
+
+    {
+        SceneManager dumper;
+        dumper.init(dir);
+
+        id = dumper.putBlob(data);
+        EXPECT_EQ(id, dumper.putBlob(data));
+        EXPECT_NE(id, dumper.putBlob(data + "!"));
+
+        dumper.getNextId(ObjectType::Treelet);
+        dumper.GetWriter(ObjectType::Treelet, 0)->write(std::string("t"));
+        dumper.recordDependency({ObjectType::Treelet, 0},
+                                {ObjectType::Blob, id});
+        dumper.GetWriter(ObjectType::Manifest)->write(dumper.makeManifest());
+    }
+
+    /* blobs survive a second dump into the same directory */
+    {
+        SceneManager dumper;
+        dumper.init(dir);
+        EXPECT_EQ(id, dumper.putBlob(data));
+    }
+
+    SceneManager manager;
+    manager.init(dir);
+
+    const ObjectKey blob{ObjectType::Blob, id};
+    EXPECT_EQ(std::set<ObjectKey>({blob}), manager.getTreeletDependencies(0));
+    EXPECT_EQ(manager.getObjectSize(ObjectType::Treelet, 0) + data.size(),
+              manager.getTreeletClosureSize(0));
+
+    ObjectKey parsed;
+    ASSERT_TRUE(SceneManager::parseFileName(
+        SceneManager::getFileName(ObjectType::Blob, id), parsed));
+    EXPECT_EQ(blob, parsed);
+
+}
+
+TEST(SceneManager, BlobNames) {
+    /* blob ids are 64-bit hashes; the high bits must survive the name */
+    const ObjectKey blob{ObjectType::Blob, 0xfedcba9876543210};
+    const std::string name =
+        scene::GetObjectName(ObjectType::Blob, blob.id);
+    EXPECT_EQ(SceneManager::getFileName(ObjectType::Blob, blob.id), name);
+
+    ObjectKey parsed;
+    ASSERT_TRUE(SceneManager::parseFileName(name, parsed));
+    EXPECT_EQ(blob, parsed);
+}
+
+TEST(SceneManager, ProxyDependencies) {
+    TempDirectory tempDir{"/tmp/pbrt-manager-test"};
+    const std::string dir = tempDir.name() + "/scene";
+    const std::string proxyDir = tempDir.name() + "/leaf";
+    roost::create_directories(dir);
+    roost::create_directories(proxyDir);
+
+    const ObjectKey table{ObjectType::ProxyTable, 0},
+        leaf{ObjectType::ProxyScene, 1};
+
+    {
+        SceneManager dumper;
+        dumper.init(proxyDir);
+
+        dumper.getNextId(ObjectType::Treelet);
+        dumper.GetWriter(ObjectType::Treelet, 0)->write(std::string(100, 'p'));
+        dumper.GetWriter(ObjectType::Manifest)->write(dumper.makeManifest());
+    }
+
+    {
+        SceneManager dumper;
+        dumper.init(dir);
+
+        dumper.getNextId(ObjectType::Treelet);
+        dumper.GetWriter(ObjectType::Treelet, 0)->write(std::string("t"));
+        auto writer = dumper.GetWriter(ObjectType::ProxyTable);
+        writer->write(std::string("tree"));
+        writer->write(std::string("leaf"));
+        writer.reset();
+
+        dumper.recordDependency({ObjectType::Treelet, 0}, table);
+        dumper.recordDependency({ObjectType::Treelet, 0}, leaf);
+        dumper.GetWriter(ObjectType::Manifest)->write(dumper.makeManifest());
+    }
+
+    SceneManager manager;
+    manager.init(dir);
+
+    /* the proxy's scene is shipped on its own, so it's not a dependency, but
+       its size is in the closure */
+    EXPECT_EQ(std::set<ObjectKey>({table}), manager.getTreeletDependencies(0));
+    EXPECT_EQ(std::set<SceneManager::ObjectID>({1}),
+              manager.getTreeletProxies(0));
+    EXPECT_EQ(proxyDir, manager.getProxyPath(1));
+    EXPECT_THROW(manager.getProxyPath(2), std::runtime_error);
+
+    SceneManager proxy;
+    proxy.init(proxyDir);
+    EXPECT_EQ(manager.getObjectSize(ObjectType::Treelet, 0) +
+                  manager.getObjectSize(ObjectType::ProxyTable, 0) +
+                  proxy.getObjectSize(ObjectType::Treelet, 0),
+              manager.getTreeletClosureSize(0));
+
+    /* every dependency is a file that can be fetched */
+    for (const ObjectKey& dep : manager.getTreeletDependencies(0)) {
+        std::string name;
+        EXPECT_NO_THROW(name = SceneManager::getFileName(dep.type, dep.id));
+        EXPECT_TRUE(roost::exists(roost::path(dir) / name)) << name;
+    }
+
+    ObjectKey parsed;
+    EXPECT_THROW(SceneManager::getFileName(ObjectType::ProxyScene, 1),
+                 std::runtime_error);
+    EXPECT_FALSE(SceneManager::parseFileName("PROXY1", parsed));
+}
@@ -0,0 +1,179 @@
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "messages/utils.h"
+#include "rng.h"
+#include "shapes/triangle.h"
+#include "util/path.h"
+#include "util/temp_file.h"
+
+using namespace pbrt;
+
+static std::unique_ptr<TriangleMesh> MakeMesh(const int nVertices,
+                                              const int nTriangles) {
+    RNG rng;
+    std::vector<int> indices;
+    std::vector<Point3f> p;
+    std::vector<Vector3f> s;
+    std::vector<Normal3f> n;
+    std::vector<Point2f> uv;
+
+    for (int i = 0; i < 3 * nTriangles; i++) {
+        indices.push_back(rng.UniformUInt32(nVertices));
+    }
+
+    for (int i = 0; i < nVertices; i++) {
+        p.emplace_back(rng.UniformFloat() * 10, rng.UniformFloat() - 5,
+                       rng.UniformFloat());
+        s.emplace_back(rng.UniformFloat(), 0, 1);
+        n.push_back(Normalize(Normal3f(rng.UniformFloat() - .5f,
+                                       rng.UniformFloat() - .5f,
+                                       rng.UniformFloat() - .5f)));
+        uv.emplace_back(rng.UniformFloat() * 4 - 2, rng.UniformFloat());
+    }
+
+    return std::unique_ptr<TriangleMesh>(new TriangleMesh(
+        Transform(), nTriangles, indices.data(), nVertices, p.data(), s.data(),
+        n.data(), uv.data(), nullptr, nullptr, nullptr));
+}
+
+static TriangleMesh RoundTrip(const TriangleMesh &mesh, const int format,
+                              const bool quantize) {
+    const Options saved = PbrtOptions;
+    PbrtOptions.meshFormat = format;
+    PbrtOptions.quantizeMeshes = quantize;
+
+    std::string data;
+    to_protobuf(mesh).SerializeToString(&data);
+    PbrtOptions = saved;
+
+    protobuf::TriangleMesh proto;
+    EXPECT_TRUE(proto.ParseFromString(data));
+    return from_protobuf(proto);
+}
+
+TEST(TriangleMeshProto, Formats) {
+    /* the second mesh needs 32-bit indices */
+    for (const int nVertices : {100, 70000}) {
+        auto mesh = MakeMesh(nVertices, 500);
+
+        for (const int format : {1, 2}) {
+            for (const bool quantize : {false, true}) {
+                if (format == 1 && quantize) continue;
+
+                TriangleMesh copy = RoundTrip(*mesh, format, quantize);
+                ASSERT_EQ(mesh->nTriangles, copy.nTriangles);
+                ASSERT_EQ(mesh->nVertices, copy.nVertices);
+                EXPECT_EQ(mesh->vertexIndices, copy.vertexIndices);
+                ASSERT_TRUE(copy.s && copy.n && copy.uv);
+
+                for (int i = 0; i < mesh->nVertices; i++) {
+                    EXPECT_EQ(mesh->p[i], copy.p[i]);
+                    EXPECT_EQ(mesh->s[i], copy.s[i]);
+
+                    if (quantize) {
+                        EXPECT_GT(Dot(mesh->n[i], copy.n[i]), 0.9999f);
+                        EXPECT_NEAR(mesh->uv[i].x, copy.uv[i].x, 1e-4f);
+                        EXPECT_NEAR(mesh->uv[i].y, copy.uv[i].y, 1e-4f);
+                    } else {
+                        EXPECT_EQ(mesh->n[i], copy.n[i]);
+                        EXPECT_EQ(mesh->uv[i], copy.uv[i]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST(TriangleMeshProto, OptionalData) {
+    const int indices[] = {0, 1, 2};
+    const Point3f p[] = {Point3f(0, 0, 0), Point3f(1, 0, 0), Point3f(0, 1, 0)};
+    TriangleMesh mesh{Transform(), 1,       indices, 3,      p,
+                      nullptr,     nullptr, nullptr, nullptr, nullptr,
+                      nullptr};
+
+    for (const bool quantize : {false, true}) {
+        TriangleMesh copy = RoundTrip(mesh, 2, quantize);
+        EXPECT_FALSE(copy.s || copy.n || copy.uv);
+        EXPECT_EQ(p[2], copy.p[2]);
+    }
+}
+
+TEST(TriangleMeshProto, Blobs) {
+    TempDirectory tempDir{"/tmp/pbrt-meshproto-test"};
+    SceneManager manager;
+    manager.init(tempDir.name());
+
+    const Options saved = PbrtOptions;
+    PbrtOptions.dedupBlobs = true;
+
+    auto mesh = MakeMesh(100, 50);
+    protobuf::TriangleMesh first = to_protobuf(*mesh);
+    protobuf::TriangleMesh second = to_protobuf(*mesh);
+    protobuf::TriangleMesh other = to_protobuf(*MakeMesh(10, 5));
+    first.set_id(0);
+    second.set_id(1);
+    second.set_material_id(3);
+    other.set_id(2);
+
+    StoreMeshBlob(first, 0, manager);
+    StoreMeshBlob(second, 1, manager);
+    StoreMeshBlob(other, 1, manager);
+    PbrtOptions = saved;
+
+    /* identical meshes share a blob, regardless of their id and material */
+    EXPECT_NE(0, first.blob());
+    EXPECT_EQ(first.blob(), second.blob());
+    EXPECT_NE(first.blob(), other.blob());
+    EXPECT_EQ(1, second.id());
+    EXPECT_EQ(3, second.material_id());
+    EXPECT_EQ(0, second.n_triangles());
+
+    protobuf::TriangleMesh data;
+    ASSERT_TRUE(
+        manager.GetReader(ObjectType::Blob, first.blob())->read(&data));
+    TriangleMesh loaded = from_protobuf(data);
+    EXPECT_EQ(mesh->vertexIndices, loaded.vertexIndices);
+    EXPECT_EQ(mesh->p[42], loaded.p[42]);
+
+    const protobuf::Manifest manifest = manager.makeManifest();
+    int blobs = 0;
+    for (const auto &obj : manifest.objects()) {
+        if (obj.id().type() == to_underlying(ObjectType::Blob)) blobs++;
+    }
+    EXPECT_EQ(2, blobs);
+}
+
+TEST(TriangleMeshProto, ExtractSubMesh) {
+    auto mesh = MakeMesh(200, 300);
+    for (int t = 0; t < mesh->nTriangles; t++) {
+        mesh->faceIndices.push_back(1000 + t);
+    }
+
+    /* more triangles than vertices, so face indices can't be per vertex */
+    std::vector<size_t> triangles;
+    for (size_t t = 0; t < 300; t += 2) triangles.push_back(t);
+
+    for (int pass = 0; pass < 2; pass++) {
+        auto part = ExtractSubMesh(*mesh, triangles);
+        ASSERT_EQ(triangles.size(), part->nTriangles);
+        EXPECT_LE(part->nVertices, mesh->nVertices);
+        ASSERT_EQ(triangles.size(), part->faceIndices.size());
+
+        for (size_t i = 0; i < triangles.size(); i++) {
+            EXPECT_EQ(1000 + triangles[i], part->faceIndices[i]);
+
+            for (int j = 0; j < 3; j++) {
+                const int v = mesh->vertexIndices[3 * triangles[i] + j];
+                const int w = part->vertexIndices[3 * i + j];
+                ASSERT_LT(w, part->nVertices);
+                EXPECT_EQ(mesh->p[v], part->p[w]);
+                EXPECT_EQ(mesh->n[v], part->n[w]);
+                EXPECT_EQ(mesh->s[v], part->s[w]);
+                EXPECT_EQ(mesh->uv[v], part->uv[w]);
+            }
+        }
+
+        /* the second pass checks that the vertex map was reset */
+        triangles = {299, 0};
+    }
+}
@@ -0,0 +1,148 @@
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "accelerators/bvh.h"
+#include "numa.h"
+#include "parallel.h"
+#include "rng.h"
+#include "shapes/sphere.h"
+
+using namespace pbrt;
+using namespace std;
+
+TEST(Numa, ParseCpuList) {
+    EXPECT_EQ(vector<int>({3}), ParseCpuList("3"));
+    EXPECT_EQ(vector<int>({0, 1, 2, 3, 8, 10, 11}),
+              ParseCpuList("0-3,8,10-11\n"));
+    EXPECT_EQ(vector<int>(), ParseCpuList(""));
+}
+
+TEST(Numa, ThreadPlacement) {
+    /* threads are spread evenly and in order over the nodes */
+    const int nNodes = NumaNodeCount();
+    const int nThreads = 4 * nNodes;
+    vector<int> perNode(nNodes);
+    for (int i = 0; i < nThreads; i++) {
+        const int node = NumaNodeForThread(i, nThreads);
+        ASSERT_LE(0, node);
+        ASSERT_LT(node, nNodes);
+        if (i > 0) EXPECT_LE(NumaNodeForThread(i - 1, nThreads), node);
+        perNode[node]++;
+    }
+    for (const int n : perNode) EXPECT_EQ(4, n);
+
+    EXPECT_EQ(0, NumaNodeForThread(0, 1));
+}
+
+TEST(Numa, Memory) {
+    /* placing memory never changes what's in it */
+    const size_t bytes = 1 << 20;
+    for (int node = 0; node < NumaNodeCount(); node++) {
+        char *ptr = (char *)NumaAllocOnNode(bytes, node);
+        ASSERT_NE(nullptr, ptr);
+        memset(ptr, node + 1, bytes);
+
+        NumaInterleave(ptr + 1, bytes - 2);
+        EXPECT_EQ(node + 1, ptr[0]);
+        EXPECT_EQ(node + 1, ptr[bytes / 2]);
+        EXPECT_EQ(node + 1, ptr[bytes - 1]);
+
+        NumaFree(ptr, bytes);
+    }
+}
+
+TEST(Numa, BVHReplicas) {
+    /* small spheres scattered around the origin, one per leaf */
+    const int nSpheres = 200;
+    RNG rng;
+    vector<shared_ptr<Primitive>> prims;
+    vector<Transform> placements;
+    placements.reserve(2 * nSpheres);
+    for (int i = 0; i < nSpheres; i++) {
+        placements.push_back(Translate(Vector3f(-10 + 20 * rng.UniformFloat(),
+                                                -10 + 20 * rng.UniformFloat(),
+                                                -10 + 20 * rng.UniformFloat())));
+        placements.push_back(Inverse(placements.back()));
+        const Transform *o2w = &placements[placements.size() - 2];
+        const Transform *w2o = &placements.back();
+        prims.push_back(make_shared<GeometricPrimitive>(
+            make_shared<Sphere>(o2w, w2o, false, 0.5, -0.5, 0.5, 360), nullptr,
+            nullptr, MediumInterface()));
+    }
+
+    vector<Ray> rays;
+    for (int i = 0; i < 1000; i++) {
+        const Point3f o(-15 + 30 * rng.UniformFloat(),
+                        -15 + 30 * rng.UniformFloat(), -15);
+        const Vector3f d(rng.UniformFloat() - 0.5f, rng.UniformFloat() - 0.5f,
+                         1);
+        rays.emplace_back(o, d);
+    }
+
+    BVHAccel bvh(move(prims), 1);
+
+    struct Hit {
+        bool hit;
+        bool occluded;
+        Float tMax;
+        Point3f p;
+    };
+
+    auto trace = [&]() {
+        vector<Hit> hits;
+        for (const Ray &r : rays) {
+            Ray ray = r;
+            SurfaceInteraction isect;
+            const bool hit = bvh.Intersect(ray, &isect);
+            hits.push_back({hit, bvh.IntersectP(r), ray.tMax,
+                            hit ? isect.p : Point3f()});
+        }
+        return hits;
+    };
+
+    const vector<Hit> expected = trace();
+    EXPECT_LT(0, count_if(expected.begin(), expected.end(),
+                          [](const Hit &h) { return h.hit; }));
+
+    /* forced even on one node; every node's copy gives the same hits */
+    bvh.ReplicateNodes();
+    for (int node = 0; node < NumaNodeCount(); node++) {
+        ThreadNumaNode = node;
+        const vector<Hit> hits = trace();
+        ASSERT_EQ(expected.size(), hits.size());
+        for (size_t i = 0; i < hits.size(); i++) {
+            EXPECT_EQ(expected[i].hit, hits[i].hit);
+            EXPECT_EQ(expected[i].occluded, hits[i].occluded);
+            EXPECT_EQ(expected[i].tMax, hits[i].tMax);
+            EXPECT_EQ(expected[i].p, hits[i].p);
+        }
+    }
+    ThreadNumaNode = 0;
+}
+
+#ifdef __linux__
+TEST(Numa, ParallelCleanupRestoresAffinity) {
+    cpu_set_t before;
+    ASSERT_EQ(0, sched_getaffinity(0, sizeof(before), &before));
+
+    PbrtOptions.nThreads = 1;
+    PbrtOptions.numa = true;
+    ParallelInit();
+    ParallelCleanup();
+    PbrtOptions = Options();
+
+    cpu_set_t after;
+    ASSERT_EQ(0, sched_getaffinity(0, sizeof(after), &after));
+    EXPECT_TRUE(CPU_EQUAL(&before, &after));
+    EXPECT_EQ(0, ThreadNumaNode);
+}
+#endif
@@ -3,6 +3,8 @@
 #include "pbrt.h"
 #include "parallel.h"
 #include <atomic>
+#include <chrono>
+#include <thread>
 
 using namespace pbrt;
 
@@ -37,3 +39,106 @@ TEST(Parallel, DoNothing) {
 
     ParallelCleanup();
 }
+
+TEST(Parallel, EachIndexOnce) {
+    PbrtOptions.nThreads = 8;
+    ParallelInit();
+
+    for (int chunkSize : {1, 3, 64, 1000}) {
+        std::vector<std::atomic<int>> seen(10007);
+        for (auto &s : seen) s = 0;
+        ParallelFor([&](int64_t i) { ++seen[i]; }, seen.size(), chunkSize);
+        for (size_t i = 0; i < seen.size(); ++i) EXPECT_EQ(1, seen[i]) << i;
+    }
+
+    std::vector<std::atomic<int>> seen(37 * 23);
+    for (auto &s : seen) s = 0;
+    ParallelFor2D([&](Point2i p) { ++seen[p.y * 37 + p.x]; }, Point2i(37, 23));
+    for (size_t i = 0; i < seen.size(); ++i) EXPECT_EQ(1, seen[i]) << i;
+
+    ParallelCleanup();
+    PbrtOptions.nThreads = 0;
+}
+
+TEST(Parallel, Nested) {
+    PbrtOptions.nThreads = 8;
+    ParallelInit();
+
+    std::atomic<int> counter{0};
+    ParallelFor([&](int64_t) {
+        ParallelFor([&](int64_t) { ++counter; }, 100, 7);
+    }, 50);
+    EXPECT_EQ(50 * 100, counter);
+
+    ParallelCleanup();
+    PbrtOptions.nThreads = 0;
+}
+
+TEST(Parallel, SlowIterations) {
+    PbrtOptions.nThreads = 4;
+    ParallelInit();
+
+    /* the callers run out of work long before the loops are done, so they
+       end up sleeping until the last iterations wake them */
+    std::atomic<int> counter{0};
+    for (int i = 0; i < 3; i++) {
+        ParallelFor([&](int64_t j) {
+            if (j == 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            ++counter;
+        }, 4);
+    }
+    EXPECT_EQ(3 * 4, counter);
+
+    counter = 0;
+    ParallelFor([&](int64_t) {
+        ParallelFor([&](int64_t j) {
+            if (j == 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            ++counter;
+        }, 3);
+    }, 8);
+    EXPECT_EQ(8 * 3, counter);
+
+    ParallelCleanup();
+    PbrtOptions.nThreads = 0;
+}
+
+static int64_t fib(int n) {
+    if (n < 2) return n;
+
+    int64_t a, b;
+    TaskGroup group;
+    group.Spawn([&]() { a = fib(n - 1); });
+    b = fib(n - 2);
+    group.Wait();
+    return a + b;
+}
+
+TEST(Parallel, TaskGroup) {
+    PbrtOptions.nThreads = 8;
+    ParallelInit();
+
+    EXPECT_EQ(6765, fib(20));
+
+    /* tasks that spawn more tasks into their own group */
+    std::atomic<int> counter{0};
+    {
+        std::function<void(int)> spawn;
+        TaskGroup group;
+        spawn = [&](int depth) {
+            ++counter;
+            if (depth == 0) return;
+            group.Spawn([&spawn, depth]() { spawn(depth - 1); });
+            group.Spawn([&spawn, depth]() { spawn(depth - 1); });
+        };
+        spawn(10);
+    }
+    EXPECT_EQ((1 << 11) - 1, counter);
+
+    /* workers still answer when stats are merged */
+    MergeWorkerThreadStats();
+
+    ParallelCleanup();
+    PbrtOptions.nThreads = 0;
+}
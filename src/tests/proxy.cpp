@@ -0,0 +1,187 @@
+#include <fstream>
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "accelerators/cloud.h"
+#include "accelerators/proxy.h"
+#include "cloud/manager.h"
+#include "interaction.h"
+#include "messages/utils.h"
+#include "shapes/triangle.h"
+#include "util/path.h"
+#include "util/temp_file.h"
+
+using namespace pbrt;
+
+/* a proxy with a HEADER as write-proxy-header writes it, and a manifest
+   listing treeletCount treelets */
+static void WriteProxy(const std::string &dir, const Bounds3f &bounds,
+                       uint64_t size, uint64_t nodeCount,
+                       const std::vector<std::string> &deps,
+                       size_t treeletCount) {
+    roost::create_directories(dir);
+
+    std::ofstream header(dir + "/HEADER", std::ios::binary);
+    header.write(reinterpret_cast<const char *>(&bounds), sizeof(Bounds3f));
+    header.write(reinterpret_cast<const char *>(&size), sizeof(uint64_t));
+    header.write(reinterpret_cast<const char *>(&nodeCount), sizeof(uint64_t));
+
+    uint64_t numDependencies = deps.size();
+    header.write(reinterpret_cast<const char *>(&numDependencies),
+                 sizeof(uint64_t));
+    for (const std::string &dep : deps) {
+        uint64_t numChars = dep.size();
+        header.write(reinterpret_cast<const char *>(&numChars),
+                     sizeof(uint64_t));
+        header.write(dep.data(), numChars);
+    }
+    header.close();
+
+    SceneManager manager;
+    manager.init(dir);
+
+    protobuf::Manifest manifest;
+    for (size_t i = 0; i < treeletCount; i++) {
+        *manifest.add_objects()->mutable_id() =
+            to_protobuf(ObjectKey{ObjectType::Treelet, i});
+    }
+    manager.GetWriter(ObjectType::Manifest)->write(manifest);
+}
+
+/* a scene as CloudBVH reads it, with a single triangle around the origin
+   in the z = 0 plane */
+static void WriteTriangleScene(const std::string &dir) {
+    roost::create_directories(dir);
+
+    SceneManager manager;
+    manager.init(dir);
+
+    const int indices[] = {0, 1, 2};
+    const Point3f p[] = {Point3f{-1, -1, 0}, Point3f{1, -1, 0},
+                         Point3f{0, 1, 0}};
+    TriangleMesh mesh{Transform(), 1,       indices, 3,       p,      nullptr,
+                      nullptr,     nullptr, nullptr, nullptr, nullptr};
+
+    protobuf::TriangleMesh meshProto = to_protobuf(mesh);
+    meshProto.set_id(0);
+    meshProto.set_material_id(0);
+
+    protobuf::BVHNode node;
+    *node.mutable_bounds() =
+        to_protobuf(Bounds3f{Point3f{-1, -1, -1}, Point3f{1, 1, 1}});
+    node.add_triangles()->set_tri_number(0);
+
+    auto writer = manager.GetWriter(ObjectType::Treelet, 0);
+    writer->write(uint32_t{1});
+    writer->write(meshProto);
+    writer->write(node);
+
+    ParamSet params;
+    std::map<std::string, std::shared_ptr<Texture<Float>>> fTex;
+    std::map<std::string, std::shared_ptr<Texture<Spectrum>>> sTex;
+    TextureParams textureParams(params, params, fTex, sTex);
+    manager.GetWriter(ObjectType::Material, 0)
+        ->write(material::to_protobuf("matte", textureParams));
+}
+
+/* a scene whose only leaf instances the proxy once per transform, the way
+   ProxyDumpBVH writes proxies it doesn't inline */
+static void WriteInstancingScene(const std::string &dir,
+                                 const std::string &proxyName,
+                                 const std::vector<Transform> &transforms) {
+    roost::create_directories(dir);
+
+    SceneManager manager;
+    manager.init(dir);
+    manager.GetWriter(ObjectType::ProxyTable)->write(proxyName);
+
+    protobuf::BVHNode node;
+    Bounds3f bounds;
+    for (const Transform &transform : transforms) {
+        bounds = Union(
+            bounds, transform(Bounds3f{Point3f{-1, -1, -1}, Point3f{1, 1, 1}}));
+
+        protobuf::TransformedPrimitive *tp = node.add_transformed_primitives();
+        *tp->mutable_transform() =
+            to_protobuf(AnimatedTransform{&transform, 0, &transform, 1});
+        tp->set_root_ref(CloudBVH::PROXY_REF_FLAG | (0ull << 32));
+    }
+    *node.mutable_bounds() = to_protobuf(bounds);
+
+    auto writer = manager.GetWriter(ObjectType::Treelet, 0);
+    writer->write(uint32_t{0});
+    writer->write(node);
+}
+
+TEST(ProxyIndex, MatchesHeaders) {
+    TempDirectory tempDir{"/tmp/pbrt-proxy-test"};
+    const std::string dir = tempDir.name();
+
+    const Bounds3f bounds{Point3f{-1, -2, -3}, Point3f{4, 5, 6}};
+    WriteProxy(dir + "/leaf", bounds, 1000, 10, {}, 1);
+    WriteProxy(dir + "/chunk_0", bounds, 5000, 70, {"leaf"}, 3);
+
+    /* without an index there's nothing to find */
+    ProxyInfo info;
+    EXPECT_FALSE(ProxyIndex(dir).Lookup("leaf", &info));
+
+    ProxyIndex::Write(dir);
+    ProxyIndex index(dir);
+    EXPECT_EQ(2, index.size());
+
+    for (const std::string name : {"leaf", "chunk_0"}) {
+        ProxyInfo fromHeader;
+        ASSERT_TRUE(ReadProxyHeader(dir + "/" + name + "/HEADER", &fromHeader));
+        ASSERT_TRUE(index.Lookup(name, &info));
+
+        EXPECT_EQ(fromHeader.bounds, info.bounds);
+        EXPECT_EQ(fromHeader.size, info.size);
+        EXPECT_EQ(fromHeader.nodeCount, info.nodeCount);
+        EXPECT_EQ(fromHeader.dependencies, info.dependencies);
+    }
+
+    ASSERT_TRUE(index.Lookup("chunk_0", &info));
+    EXPECT_EQ(3, info.treeletCount);
+    EXPECT_EQ(std::vector<std::string>{"leaf"}, info.dependencies);
+    EXPECT_FALSE(index.Lookup("missing", &info));
+    EXPECT_FALSE(ReadProxyHeader(dir + "/missing/HEADER", &info));
+}
+
+TEST(ProxyInstance, Intersect) {
+    TempDirectory tempDir{"/tmp/pbrt-proxy-test"};
+    const std::string dir = tempDir.name();
+
+    /* lazy loading only works with a single thread */
+    const Options saved = PbrtOptions;
+    PbrtOptions.nThreads = 1;
+
+    /* with no --proxydir, proxies are next to the scene */
+    WriteTriangleScene(dir + "/leaf");
+    WriteInstancingScene(dir + "/scene", "leaf",
+                         {Translate(Vector3f{0, 0, 5}),
+                          Translate(Vector3f{10, 0, 5})});
+
+    SceneManager manager;
+    manager.init(dir + "/scene");
+    CloudBVH bvh{manager, 0, false};
+
+    for (const Float x : {0.f, 10.f}) {
+        Ray ray{Point3f{x, 0, 0}, Vector3f{0, 0, 1}};
+        SurfaceInteraction isect;
+        ASSERT_TRUE(bvh.Intersect(ray, &isect));
+        EXPECT_NEAR(5, ray.tMax, 1e-4);
+        EXPECT_NEAR(x, isect.p.x, 1e-4);
+        EXPECT_NEAR(5, isect.p.z, 1e-4);
+        EXPECT_NE(nullptr, isect.primitive);
+
+        EXPECT_TRUE(bvh.IntersectP(Ray{Point3f{x, 0, 10}, Vector3f{0, 0, -1}}));
+    }
+
+    /* between the two instances, and past the triangle's tip */
+    SurfaceInteraction isect;
+    Ray between{Point3f{5, 0, 0}, Vector3f{0, 0, 1}};
+    EXPECT_FALSE(bvh.Intersect(between, &isect));
+    EXPECT_FALSE(bvh.IntersectP(Ray{Point3f{0, 2, 0}, Vector3f{0, 0, 1}}));
+
+    PbrtOptions = saved;
+}
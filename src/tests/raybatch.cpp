@@ -0,0 +1,188 @@
+
+#include <lz4.h>
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "pbrt/raystate.h"
+
+using namespace pbrt;
+
+static RayStatePtr MakeRayState(const int seed, const bool hit,
+                                const bool differentials) {
+    RayStatePtr state = RayState::Create();
+    state->trackRay = seed % 2;
+    state->hop = seed;
+    state->pathHop = 2 * seed;
+    state->sample.id = 1000 + seed;
+    state->sample.pFilm = Point2f(seed + 0.5f, seed + 0.25f);
+    state->sample.weight = 0.75f;
+    state->sample.dim = 5;
+    state->ray = RayDifferential(Point3f(seed, 2, 3), Vector3f(0, 1, 0), 10.f,
+                                 0.5f);
+    state->ray.hasDifferentials = differentials;
+    state->ray.rxOrigin = Point3f(1, 0, 0);
+    state->ray.ryOrigin = Point3f(0, 1, 0);
+    state->ray.rxDirection = Vector3f(0, 0, 1);
+    state->ray.ryDirection = Vector3f(1, 1, 0);
+    state->beta = Spectrum(0.5f);
+    state->Ld = Spectrum(0.25f);
+    state->remainingBounces = seed % 5;
+    state->isShadowRay = !hit;
+
+    if (hit) {
+        RayState::TreeletNode node;
+        node.treelet = 7;
+        node.node = 42;
+        node.primitive = 3;
+        node.transformed = true;
+        state->rayTransform = Translate(Vector3f(seed, 0, 0));
+        state->SetHit(node);
+    }
+
+    for (int i = 0; i < seed % 4; i++) {
+        RayState::TreeletNode node;
+        node.treelet = i;
+        node.node = 10 * i;
+        node.transformed = (i == seed % 4 - 1);
+        state->toVisitPush(std::move(node));
+    }
+
+    state->rayTransform = Translate(Vector3f(0, seed, 0));
+    return state;
+}
+
+static void ExpectEqual(const RayState &a, const RayState &b) {
+    EXPECT_EQ(a.trackRay, b.trackRay);
+    EXPECT_EQ(a.hop, b.hop);
+    EXPECT_EQ(a.pathHop, b.pathHop);
+    EXPECT_EQ(a.sample.id, b.sample.id);
+    EXPECT_EQ(a.sample.pFilm, b.sample.pFilm);
+    EXPECT_EQ(a.sample.weight, b.sample.weight);
+    EXPECT_EQ(a.sample.dim, b.sample.dim);
+    EXPECT_EQ(a.ray.o, b.ray.o);
+    EXPECT_EQ(a.ray.d, b.ray.d);
+    EXPECT_EQ(a.ray.tMax, b.ray.tMax);
+    EXPECT_EQ(a.ray.time, b.ray.time);
+    EXPECT_EQ(a.ray.hasDifferentials, b.ray.hasDifferentials);
+    if (a.ray.hasDifferentials) {
+        EXPECT_EQ(a.ray.rxOrigin, b.ray.rxOrigin);
+        EXPECT_EQ(a.ray.ryOrigin, b.ray.ryOrigin);
+        EXPECT_EQ(a.ray.rxDirection, b.ray.rxDirection);
+        EXPECT_EQ(a.ray.ryDirection, b.ray.ryDirection);
+    }
+    EXPECT_EQ(a.beta, b.beta);
+    EXPECT_EQ(a.Ld, b.Ld);
+    EXPECT_EQ(a.remainingBounces, b.remainingBounces);
+    EXPECT_EQ(a.isShadowRay, b.isShadowRay);
+    EXPECT_EQ(a.hit, b.hit);
+    if (a.hit) {
+        EXPECT_EQ(a.hitNode.treelet, b.hitNode.treelet);
+        EXPECT_EQ(a.hitNode.node, b.hitNode.node);
+        EXPECT_EQ(a.hitNode.primitive, b.hitNode.primitive);
+        EXPECT_EQ(a.hitNode.transformed, b.hitNode.transformed);
+        EXPECT_EQ(a.hitTransform.GetMatrix(), b.hitTransform.GetMatrix());
+    }
+    EXPECT_EQ(a.toVisitHead, b.toVisitHead);
+    for (int i = 0; i < a.toVisitHead; i++) {
+        EXPECT_EQ(a.toVisit[i].treelet, b.toVisit[i].treelet);
+        EXPECT_EQ(a.toVisit[i].node, b.toVisit[i].node);
+        EXPECT_EQ(a.toVisit[i].transformed, b.toVisit[i].transformed);
+    }
+    if (!a.toVisitEmpty() && a.toVisitTop().transformed) {
+        EXPECT_EQ(a.rayTransform.GetMatrix(), b.rayTransform.GetMatrix());
+    }
+}
+
+TEST(RayBatch, AddGet) {
+    RayBatch batch;
+    std::vector<RayStatePtr> states;
+
+    for (int i = 0; i < 16; i++) {
+        states.push_back(MakeRayState(i, i % 3 == 0, i % 2 == 0));
+        batch.Add(*states.back());
+    }
+
+    ASSERT_EQ(states.size(), batch.size());
+    for (size_t i = 0; i < batch.size(); i++) {
+        ExpectEqual(*states[i], *batch.Get(i));
+    }
+}
+
+TEST(RayBatch, WireFormat) {
+    std::vector<RayStatePtr> states;
+    std::vector<char> bag(16 * RayState::MaxPackedSize);
+    size_t bagLen = 0;
+
+    for (int i = 0; i < 16; i++) {
+        states.push_back(MakeRayState(i, i % 3 == 0, i % 2 == 0));
+        bagLen += states.back()->Serialize(bag.data() + bagLen);
+    }
+
+    RayBatch batch;
+    EXPECT_EQ(states.size(), batch.Unpack(bag.data(), bagLen));
+    ASSERT_EQ(states.size(), batch.size());
+
+    for (size_t i = 0; i < batch.size(); i++) {
+        ExpectEqual(*states[i], *batch.Get(i));
+    }
+
+    /* packing the batch must reproduce the original bytes */
+    std::vector<char> packed(bag.size());
+    EXPECT_EQ(bagLen, batch.Pack(packed.data(), packed.size()));
+    EXPECT_EQ(0, memcmp(bag.data(), packed.data(), bagLen));
+
+    /* and single rays read back through RayState */
+    const size_t len = batch.Serialize(3, packed.data());
+    EXPECT_LE(len, batch.MaxSize(3));
+
+    RayState state;
+    state.Deserialize(packed.data() + 4, len - 4);
+    ExpectEqual(*states[3], state);
+}
+
+TEST(RayBatch, ReuseState) {
+    RayBatch batch;
+    std::vector<RayStatePtr> states;
+
+    /* rays with a transform alternate with rays without */
+    for (int i = 0; i < 8; i++) {
+        states.push_back(i % 2 ? MakeRayState(4, false, false)
+                               : MakeRayState(3, true, true));
+        batch.Add(*states.back());
+    }
+
+    RayState state;
+    for (size_t i = 0; i < batch.size(); i++) {
+        batch.Get(i, state);
+        ExpectEqual(*states[i], state);
+
+        if (i % 2) {
+            EXPECT_EQ(Transform().GetMatrix(), state.hitTransform.GetMatrix());
+            EXPECT_EQ(Transform().GetMatrix(), state.rayTransform.GetMatrix());
+        }
+    }
+}
+
+TEST(RayBatch, CompressedBag) {
+    PbrtOptions.compressRays = true;
+
+    std::vector<RayStatePtr> states;
+    std::vector<char> bag(16 * LZ4_COMPRESSBOUND(RayState::MaxPackedSize));
+    size_t bagLen = 0;
+
+    for (int i = 0; i < 16; i++) {
+        states.push_back(MakeRayState(i, i % 3 == 0, i % 2 == 0));
+        bagLen += states.back()->Serialize(bag.data() + bagLen);
+    }
+
+    RayBatch batch;
+    EXPECT_EQ(states.size(), batch.Unpack(bag.data(), bagLen));
+    ASSERT_EQ(states.size(), batch.size());
+
+    for (size_t i = 0; i < batch.size(); i++) {
+        ExpectEqual(*states[i], *batch.Get(i));
+    }
+
+    EXPECT_THROW(batch.Unpack(bag.data(), bagLen - 1), std::runtime_error);
+    PbrtOptions.compressRays = false;
+}
@@ -0,0 +1,118 @@
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "messages/serialization.h"
+#include "util/temp_file.h"
+
+using namespace pbrt;
+
+TEST(RecordReader, MappedInPlace) {
+    TempFile file{"/tmp/pbrt-records-test"};
+    const std::string large(100000, 'x');
+
+    {
+        protobuf::RecordWriter writer{file.name()};
+        writer.write(std::string("first"));
+        writer.write_empty();
+        writer.write(large);
+        writer.write(static_cast<uint32_t>(42));
+    }
+
+    protobuf::RecordReader reader{MMap_Region{file.name()}};
+    Chunk chunk{nullptr, 0};
+
+    ASSERT_TRUE(reader.read(&chunk));
+    EXPECT_EQ("first", chunk.to_string());
+
+    EXPECT_FALSE(reader.read(&chunk));
+
+    ASSERT_TRUE(reader.read(&chunk));
+    EXPECT_EQ(large, chunk.to_string());
+
+    /* the other record types still work on mapped files */
+    uint32_t value = 0;
+    ASSERT_TRUE(reader.read(&value));
+    EXPECT_EQ(42, value);
+    EXPECT_TRUE(reader.eof());
+}
+
+TEST(RecordReader, InPlaceNeedsMemory) {
+    TempFile file{"/tmp/pbrt-records-test"};
+
+    {
+        protobuf::RecordWriter writer{file.name()};
+        writer.write(std::string("record"));
+    }
+
+    protobuf::RecordReader reader{file.name()};
+    Chunk chunk{nullptr, 0};
+    EXPECT_THROW(reader.read(&chunk), std::runtime_error);
+}
+
+TEST(RecordReader, EmptyMappedFile) {
+    TempFile file{"/tmp/pbrt-records-test"};
+    protobuf::RecordReader reader{MMap_Region{file.name()}};
+    EXPECT_TRUE(reader.eof());
+}
+
+TEST(AsyncRecordWriter, SameFraming) {
+    TempFile file{"/tmp/pbrt-records-test"};
+
+    /* small buffers, so the thread and the backpressure get exercised */
+    {
+        protobuf::AsyncRecordWriter writer{file.name(), 64, 2};
+
+        for (uint32_t i = 0; i < 1000; i++) {
+            writer.write(std::to_string(i));
+        }
+
+        writer.write_empty();
+        writer.write(static_cast<uint32_t>(7));
+        writer.write(static_cast<uint64_t>(1) << 40);
+
+        protobuf::ObjectKey key;
+        key.set_id(12);
+        writer.write(key);
+    }
+
+    protobuf::RecordReader reader{file.name()};
+    std::string record;
+
+    for (uint32_t i = 0; i < 1000; i++) {
+        ASSERT_TRUE(reader.read(&record));
+        EXPECT_EQ(std::to_string(i), record);
+    }
+
+    EXPECT_FALSE(reader.read(&record));
+
+    uint32_t value32 = 0;
+    ASSERT_TRUE(reader.read(&value32));
+    EXPECT_EQ(7, value32);
+
+    uint64_t value64 = 0;
+    ASSERT_TRUE(reader.read(&value64));
+    EXPECT_EQ(static_cast<uint64_t>(1) << 40, value64);
+
+    protobuf::ObjectKey key;
+    ASSERT_TRUE(reader.read(&key));
+    EXPECT_EQ(12, key.id());
+    EXPECT_TRUE(reader.eof());
+}
+
+TEST(AsyncRecordWriter, Flush) {
+    TempFile file{"/tmp/pbrt-records-test"};
+    protobuf::AsyncRecordWriter writer{file.name()};
+
+    writer.write(std::string("record"));
+    writer.flush();
+
+    {
+        protobuf::RecordReader reader{file.name()};
+        std::string record;
+        ASSERT_TRUE(reader.read(&record));
+        EXPECT_EQ("record", record);
+        EXPECT_TRUE(reader.eof());
+    }
+
+    writer.close();
+    EXPECT_THROW(writer.write(std::string("late")), std::runtime_error);
+}
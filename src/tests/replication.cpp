@@ -0,0 +1,98 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "pbrt/replication.h"
+
+using namespace pbrt;
+using namespace std::chrono;
+
+TEST(TreeletLoadMonitor, SlidingWindow) {
+    TreeletLoadMonitor monitor{4, seconds{4}, 4};
+    const auto t0 = TreeletLoadMonitor::Clock::now();
+
+    for (int s = 0; s < 4; s++) {
+        monitor.RecordArrival(1, 100, t0 + seconds{s});
+        monitor.RecordService(1, milliseconds{500}, 100, t0 + seconds{s});
+    }
+
+    TreeletLoad load = monitor.GetLoad(1, t0 + milliseconds{3999});
+    EXPECT_NEAR(100.0, load.arrivalRate, 1.0);
+    EXPECT_NEAR(200.0, load.serviceRate, 1.0);
+    EXPECT_NEAR(0.5, load.utilization, 0.01);
+
+    /* once the window has moved past the traffic, it is forgotten */
+    load = monitor.GetLoad(1, t0 + seconds{10});
+    EXPECT_EQ(0.0, load.arrivalRate);
+    EXPECT_EQ(0.0, load.utilization);
+
+    EXPECT_EQ(0, monitor.GetLoad(2, t0 + seconds{10}).arrivalRate);
+}
+
+TEST(TreeletLoadMonitor, UnknownTreelet) {
+    TreeletLoadMonitor monitor{2, seconds{4}, 4};
+    const auto t0 = TreeletLoadMonitor::Clock::now();
+
+    EXPECT_EQ(0, monitor.GetLoad(7, t0).arrivalRate);
+
+    /* ids past the count it was made with are added as they show up */
+    monitor.RecordArrival(7, 100, t0);
+    monitor.RecordService(7, milliseconds{500}, 100, t0);
+
+    const auto loads = monitor.GetLoads(t0 + seconds{1});
+    ASSERT_EQ(1, loads.size());
+    EXPECT_EQ(7, loads[0].treelet);
+    EXPECT_NEAR(100.0, loads[0].arrivalRate, 1.0);
+}
+
+TEST(ReplicationPlanner, HotTreelet) {
+    std::set<ObjectKey> deps{{ObjectType::Material, 3}};
+    ReplicationPlanner planner{
+        [&deps](const TreeletId) -> const std::set<ObjectKey> & {
+            return deps;
+        }};
+
+    WorkerLoadReport busy;
+    busy.workerId = 1;
+    busy.treelets = {0, 1};
+    busy.loads.push_back({0, 5000.0, 1000.0, 0.9});
+    busy.loads.push_back({1, 10.0, 1000.0, 0.01});
+
+    WorkerLoadReport idle1;
+    idle1.workerId = 2;
+    idle1.treelets = {2};
+
+    WorkerLoadReport idle2;
+    idle2.workerId = 3;
+    idle2.treelets = {3};
+
+    auto plan = planner.Plan({busy, idle1, idle2});
+    ASSERT_EQ(2, plan.size());
+
+    for (const auto &assignment : plan) {
+        EXPECT_EQ(0, assignment.treelet);
+        EXPECT_EQ(1, assignment.objects.count({ObjectType::Treelet, 0}));
+        EXPECT_EQ(1, assignment.objects.count({ObjectType::Material, 3}));
+    }
+
+    EXPECT_NE(plan[0].workerId, plan[1].workerId);
+
+    /* nothing to do when the load is within capacity */
+    busy.loads[0].arrivalRate = 500.0;
+    EXPECT_TRUE(planner.Plan({busy, idle1, idle2}).empty());
+}
+
+TEST(ReplicaRouter, RoundRobin) {
+    ReplicaRouter router;
+    router.AddReplica(5, 10);
+    router.AddReplica(5, 11);
+    router.AddReplica(5, 11);
+
+    EXPECT_EQ(2, router.Replicas(5).size());
+    EXPECT_EQ(10, router.Route(5));
+    EXPECT_EQ(11, router.Route(5));
+    EXPECT_EQ(10, router.Route(5));
+
+    router.RemoveReplica(5, 10);
+    EXPECT_EQ(11, router.Route(5));
+    EXPECT_TRUE(router.Replicas(6).empty());
+}
@@ -0,0 +1,66 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "cloud/scheduler.h"
+
+using namespace pbrt;
+
+static RayStatePtr MakeRay(const uint64_t id, const uint8_t bounces,
+                           const bool shadow) {
+    RayStatePtr ray = RayState::Create();
+    ray->sample.id = id;
+    ray->remainingBounces = bounces;
+    ray->isShadowRay = shadow;
+    return ray;
+}
+
+TEST(RayScheduler, Priority) {
+    RayScheduler scheduler;
+
+    scheduler.Push(MakeRay(0, 4, false));
+    scheduler.Push(MakeRay(1, 1, false));
+    scheduler.Push(MakeRay(2, 3, true));
+    scheduler.Push(MakeRay(3, 1, false));
+    scheduler.Push(MakeRay(4, 0, false));
+
+    const uint64_t expected[] = {2, 4, 1, 3, 0};
+    for (uint64_t id : expected) {
+        ASSERT_FALSE(scheduler.Empty());
+        EXPECT_EQ(id, scheduler.Pop()->sample.id);
+    }
+
+    EXPECT_TRUE(scheduler.Empty());
+    EXPECT_EQ(nullptr, scheduler.Pop());
+}
+
+TEST(RayScheduler, Spill) {
+    const size_t maxResident = 16;
+    RayScheduler scheduler{maxResident, "", 8};
+
+    for (uint64_t i = 0; i < 100; i++) {
+        scheduler.Push(MakeRay(i, i % 4, false));
+        EXPECT_LE(scheduler.Resident(), maxResident);
+    }
+
+    EXPECT_EQ(100, scheduler.Size());
+    EXPECT_GT(scheduler.Spilled(), 0);
+    EXPECT_FALSE(scheduler.AcceptsCameraRays());
+
+    RayScheduler::Gauge gauge = scheduler.GetGauge(4);
+    EXPECT_EQ(25, gauge.resident + gauge.spilled);
+
+    /* every ray comes back, in priority order */
+    std::vector<bool> seen(100, false);
+    int lastBounces = 0;
+    while (!scheduler.Empty()) {
+        RayStatePtr ray = scheduler.Pop();
+        EXPECT_GE(ray->remainingBounces, lastBounces);
+        lastBounces = ray->remainingBounces;
+        EXPECT_EQ(ray->sample.id % 4, ray->remainingBounces);
+        EXPECT_FALSE(seen[ray->sample.id]);
+        seen[ray->sample.id] = true;
+    }
+
+    for (bool s : seen) EXPECT_TRUE(s);
+    EXPECT_TRUE(scheduler.AcceptsCameraRays());
+}
@@ -0,0 +1,118 @@
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "stats.h"
+#include "util/temp_file.h"
+
+using namespace pbrt;
+using namespace std;
+
+STAT_COUNTER("Test/Snapshot \"counter\"", snapshotCounter);
+STAT_MEMORY_COUNTER("Test/Snapshot memory", snapshotMemory);
+
+static const string counterLabels =
+    "{category=\"Test\",stat=\"Snapshot \\\"counter\\\"\"}";
+
+/* the value of a sample in the snapshot, or -1 */
+static double sample(const string &snapshot, const string &metric) {
+    const size_t i = snapshot.find("\n" + metric + " ");
+    if (i == string::npos) return -1;
+    return stod(snapshot.substr(i + metric.size() + 2));
+}
+
+TEST(StatsSnapshot, Prometheus) {
+    TakeStatsSnapshot();
+
+    thread worker([] {
+        snapshotCounter += 7;
+        snapshotMemory = 4096;
+
+        /* nothing is reported until a snapshot asks for it */
+        ReportThreadStatsIfRequested();
+        RequestThreadStats();
+        ReportThreadStatsIfRequested();
+
+        snapshotCounter += 100;
+        ReportThreadStatsIfRequested();
+    });
+    worker.join();
+
+    const string snapshot = TakeStatsSnapshot();
+    EXPECT_NE(string::npos,
+              snapshot.find("# TYPE pbrt_counter_total counter\n"));
+    EXPECT_EQ(7, sample(snapshot, "pbrt_counter_total" + counterLabels));
+    EXPECT_LT(0, sample(snapshot, "pbrt_counter_rate" + counterLabels));
+    EXPECT_EQ(4096, sample(snapshot,
+                           "pbrt_memory_bytes{category=\"Test\",stat="
+                           "\"Snapshot memory\"}"));
+    EXPECT_LT(0, sample(snapshot, "pbrt_resident_memory_bytes"));
+
+    /* counters are totals, rates are per interval */
+    const string next = TakeStatsSnapshot();
+    EXPECT_EQ(7, sample(next, "pbrt_counter_total" + counterLabels));
+    EXPECT_EQ(0, sample(next, "pbrt_counter_rate" + counterLabels));
+
+    ReportThreadStats();
+    ClearStats();
+}
+
+TEST(StatsSnapshot, File) {
+    TempFile file{"/tmp/pbrt-stats-snapshot-test"};
+
+    StartStatsSnapshots(file.name(), chrono::seconds{60});
+    snapshotCounter += 3;
+    ReportThreadStats();
+    StopStatsSnapshots();
+
+    /* stopping writes the final totals */
+    ifstream fin{file.name()};
+    stringstream ss;
+    ss << fin.rdbuf();
+    EXPECT_EQ(3, sample(ss.str(), "pbrt_counter_total" + counterLabels));
+
+    ClearStats();
+}
+
+TEST(StatsSnapshot, UnixSocket) {
+    TempFile file{"/tmp/pbrt-stats-snapshot-test"};
+    const string path = file.name() + ".sock";
+
+    snapshotCounter += 5;
+    ReportThreadStats();
+    StartStatsSnapshots("unix:" + path, chrono::seconds{60});
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT_LE(0, fd);
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    ASSERT_EQ(0, connect(fd, (sockaddr *)&addr, sizeof(addr)));
+
+    const string request = "GET /metrics HTTP/1.0\r\n\r\n";
+    ASSERT_EQ(request.size(), write(fd, request.data(), request.size()));
+
+    string response;
+    char buffer[4096];
+    for (ssize_t n; (n = read(fd, buffer, sizeof(buffer))) > 0;) {
+        response.append(buffer, n);
+    }
+    close(fd);
+
+    StopStatsSnapshots();
+
+    EXPECT_EQ(0, response.find("HTTP/1.0 200 OK\r\n"));
+    EXPECT_EQ(5, sample(response, "pbrt_counter_total" + counterLabels));
+
+    ClearStats();
+}
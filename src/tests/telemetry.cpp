@@ -0,0 +1,88 @@
+
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "pbrt/telemetry.h"
+#include "util/temp_file.h"
+
+using namespace pbrt;
+using namespace std;
+
+TEST(TreeletStats, ThreadLocalAccumulation) {
+    TakeTreeletStats();
+
+    thread worker([] {
+        for (int i = 0; i < 10; i++) {
+            RecordTreeletTrace(3, 20, 5, i % 2);
+            RecordTreeletForward(3, 7);
+        }
+
+        /* nothing is visible before the thread reports */
+        EXPECT_TRUE(TakeTreeletStats().empty());
+        ReportThreadTreeletStats();
+    });
+
+    worker.join();
+
+    RecordTreeletLoad(3, chrono::milliseconds{2}, 4096);
+    RecordTreeletTrace(3, 10, 1, 1);
+    RecordTreeletForward(3, 8);
+    ReportThreadTreeletStats();
+
+    auto stats = TakeTreeletStats();
+    ASSERT_EQ(1, stats.size());
+
+    const TreeletStats &s = stats.at(3);
+    EXPECT_EQ(11, s.raysTraced);
+    EXPECT_EQ(210, s.nodesVisited);
+    EXPECT_EQ(51, s.primitivesTested);
+    EXPECT_EQ(6, s.hits);
+    EXPECT_EQ(1, s.loads);
+    EXPECT_EQ(chrono::milliseconds{2}, s.loadTime);
+    EXPECT_EQ(4096, s.residentBytes);
+    EXPECT_EQ(10, s.forwarded.at(7));
+    EXPECT_EQ(1, s.forwarded.at(8));
+
+    /* counters are reset, but the resident size is kept */
+    EXPECT_TRUE(TakeTreeletStats().empty());
+    RecordTreeletTrace(3, 1, 1, 0);
+    ReportThreadTreeletStats();
+    EXPECT_EQ(4096, TakeTreeletStats().at(3).residentBytes);
+}
+
+TEST(TreeletStats, Export) {
+    TakeTreeletStats();
+
+    for (const string ext : {".csv", ".json"}) {
+        TempFile file{"/tmp/pbrt-treelet-stats"};
+        const string path = file.name() + ext;
+
+        {
+            TreeletStatsExporter exporter{path, 42};
+            RecordTreeletTrace(5, 8, 2, 1);
+            RecordTreeletForward(5, 6);
+            RecordTreeletForward(5, 9);
+        }
+
+        ifstream fin{path};
+        string line;
+
+        if (ext == ".csv") {
+            getline(fin, line);
+            EXPECT_EQ(0, line.find("timestamp,worker,treelet,rays"));
+            getline(fin, line);
+            EXPECT_NE(string::npos, line.find(",42,5,1,8,2,1,0,0,0,6:1 9:1"));
+        } else {
+            getline(fin, line);
+            EXPECT_NE(string::npos, line.find("\"worker\":42,\"treelet\":5"));
+            EXPECT_NE(string::npos,
+                      line.find("\"forwarded\":{\"6\":1,\"9\":1}}"));
+        }
+
+        EXPECT_FALSE(getline(fin, line));
+        remove(path.c_str());
+    }
+}
@@ -0,0 +1,96 @@
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "stats.h"
+#include "util/temp_file.h"
+
+using namespace pbrt;
+using namespace std;
+
+static string readTrace(const string &path) {
+    ifstream fin{path};
+    stringstream ss;
+    ss << fin.rdbuf();
+    return ss.str();
+}
+
+static size_t count(const string &text, const string &what) {
+    size_t n = 0;
+    for (size_t i = text.find(what); i != string::npos;
+         i = text.find(what, i + 1)) {
+        n++;
+    }
+    return n;
+}
+
+TEST(Trace, ProfilePhases) {
+    TempFile file{"/tmp/pbrt-trace-test"};
+    InitTrace(chrono::nanoseconds{0}, 16);
+
+    {
+        ProfilePhase _(Prof::MergeFilmTile);
+        /* nested phases of the same category aren't separate events */
+        ProfilePhase __(Prof::MergeFilmTile);
+    }
+
+    thread worker([] {
+        ProfilePhase _(Prof::LoadTreelet);
+    });
+    worker.join();
+
+    WriteTrace(file.name());
+    CleanupTrace();
+
+    const string trace = readTrace(file.name());
+    EXPECT_EQ(0, trace.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["));
+    EXPECT_EQ(2, count(trace, "\"name\":\"thread_name\""));
+    EXPECT_EQ(1, count(trace, "\"name\":\"Film::MergeTile()\""));
+    EXPECT_EQ(1, count(trace, "\"name\":\"CloudBVH::LoadTreelet()\""));
+    EXPECT_EQ(2, count(trace, "\"ph\":\"X\""));
+}
+
+TEST(Trace, RingBuffer) {
+    TempFile file{"/tmp/pbrt-trace-test"};
+    InitTrace(chrono::nanoseconds{0}, 4);
+
+    for (int i = 0; i < 10; i++) {
+        RecordTraceEvent((int)TraceEvent::ParallelForChunk, 1000 * i,
+                         1000 * i + 500);
+    }
+
+    WriteTrace(file.name());
+    CleanupTrace();
+
+    /* only the last four are kept */
+    const string trace = readTrace(file.name());
+    EXPECT_EQ(4, count(trace, "\"name\":\"ParallelFor chunk\""));
+    EXPECT_EQ(4, count(trace, "\"dur\":0.500"));
+}
+
+TEST(Trace, Disabled) {
+    TempFile file{"/tmp/pbrt-trace-test"};
+
+    /* phases before tracing starts are never recorded */
+    {
+        ProfilePhase _(Prof::MergeFilmTile);
+    }
+
+    InitTrace(chrono::microseconds{1000}, 16);
+
+    /* and neither are the ones below the minimum duration */
+    {
+        ProfilePhase _(Prof::MergeFilmTile);
+    }
+
+    WriteTrace(file.name());
+    CleanupTrace();
+    EXPECT_FALSE(TracingEnabled);
+
+    const string trace = readTrace(file.name());
+    EXPECT_EQ(0, count(trace, "\"ph\":\"X\""));
+}
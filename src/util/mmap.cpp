@@ -0,0 +1,79 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "mmap.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "exception.h"
+
+using namespace std;
+using namespace pbrt;
+
+MMap_Region::MMap_Region( char * const addr, const size_t length,
+                          const int prot, const int flags, const int fd,
+                          const off_t offset )
+  : addr_( nullptr ),
+    length_( length )
+{
+  if ( length_ == 0 ) {
+    /* mmap refuses empty mappings */
+    return;
+  }
+
+  void * ptr = mmap( addr, length, prot, flags, fd, offset );
+
+  if ( ptr == MAP_FAILED ) {
+    throw unix_error( "mmap" );
+  }
+
+  addr_ = static_cast<char *>( ptr );
+}
+
+static size_t file_length( const FileDescriptor & fd )
+{
+  struct stat st;
+  CheckSystemCall( "fstat", fstat( fd.fd_num(), &st ) );
+  return st.st_size;
+}
+
+MMap_Region::MMap_Region( const FileDescriptor & fd )
+  : MMap_Region( nullptr, file_length( fd ), PROT_READ, MAP_SHARED,
+                 fd.fd_num() )
+{}
+
+MMap_Region::MMap_Region( const string & filename )
+  : MMap_Region( FileDescriptor( CheckSystemCall( filename,
+                                                  open( filename.c_str(),
+                                                        O_RDONLY ) ) ) )
+{}
+
+MMap_Region::~MMap_Region()
+{
+  if ( addr_ != nullptr ) {
+    munmap( addr_, length_ );
+  }
+}
+
+MMap_Region::MMap_Region( MMap_Region && other )
+  : addr_( other.addr_ ),
+    length_( other.length_ )
+{
+  other.addr_ = nullptr;
+  other.length_ = 0;
+}
+
+MMap_Region & MMap_Region::operator=( MMap_Region && other )
+{
+  if ( addr_ != nullptr ) {
+    munmap( addr_, length_ );
+  }
+
+  addr_ = other.addr_;
+  length_ = other.length_;
+
+  other.addr_ = nullptr;
+  other.length_ = 0;
+
+  return *this;
+}
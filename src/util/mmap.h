@@ -0,0 +1,44 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef PBRT_UTIL_MMAP_H
+#define PBRT_UTIL_MMAP_H
+
+#include <sys/mman.h>
+#include <cstddef>
+#include <string>
+
+#include "util/file_descriptor.h"
+
+namespace pbrt {
+
+/* a memory-mapped region, unmapped when destroyed */
+class MMap_Region
+{
+private:
+  char * addr_;
+  size_t length_;
+
+public:
+  MMap_Region( char * const addr, const size_t length, const int prot,
+               const int flags, const int fd, const off_t offset = 0 );
+
+  /* maps the whole file for reading */
+  MMap_Region( const FileDescriptor & fd );
+  MMap_Region( const std::string & filename );
+
+  ~MMap_Region();
+
+  char * addr( void ) const { return addr_; }
+  size_t length( void ) const { return length_; }
+
+  /* forbid copying, allow moving */
+  MMap_Region( const MMap_Region & other ) = delete;
+  MMap_Region & operator=( const MMap_Region & other ) = delete;
+
+  MMap_Region( MMap_Region && other );
+  MMap_Region & operator=( MMap_Region && other );
+};
+
+}
+
+#endif /* PBRT_UTIL_MMAP_H */
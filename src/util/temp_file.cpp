@@ -10,6 +10,7 @@
 
 #include "temp_file.h"
 #include "exception.h"
+#include "path.h"
 
 using namespace std;
 using namespace pbrt;
@@ -75,3 +76,25 @@ string UniqueFile::name( void ) const
   assert( mutable_temp_filename_.size() > 1 );
   return string( mutable_temp_filename_.begin(), mutable_temp_filename_.end() - 1 );
 }
+
+TempDirectory::TempDirectory( const string & dirname_template )
+  : mutable_temp_dirname_( to_mutable( dirname_template + ".XXXXXX" ) )
+{
+  if ( mkdtemp( &mutable_temp_dirname_[ 0 ] ) == nullptr ) {
+    throw unix_error( "mkdtemp" );
+  }
+}
+
+TempDirectory::~TempDirectory()
+{
+  try {
+    roost::remove_directory( name() );
+  } catch ( const exception & e ) {
+    print_exception( "TempDirectory", e );
+  }
+}
+
+string TempDirectory::name( void ) const
+{
+  return string( mutable_temp_dirname_.begin(), mutable_temp_dirname_.end() - 1 );
+}
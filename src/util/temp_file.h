@@ -59,6 +59,24 @@ public:
   ~TempFile();
 };
 
+/* use mkdtemp to make a unique directory, which is removed with everything
+   in it when the object is destroyed */
+class TempDirectory
+{
+private:
+  std::vector<char> mutable_temp_dirname_;
+
+public:
+  TempDirectory( const std::string & dirname_template );
+  ~TempDirectory();
+
+  std::string name( void ) const;
+
+  /* ban copying */
+  TempDirectory( const TempDirectory & other ) = delete;
+  TempDirectory & operator=( const TempDirectory & other ) = delete;
+};
+
 }
 
 #endif
@@ -24,6 +24,35 @@ inline std::string pluralize(const std::string &word, const size_t count) {
     return word + (count != 1 ? "s" : "");
 }
 
+/* Tells when `period` has passed since the last Reset(). It is cheap enough
+ * to ask for every ray: the clock is only read once every `callsPerCheck`
+ * calls to Due(). */
+class PeriodicCheck {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    PeriodicCheck(const Clock::duration period,
+                  const size_t callsPerCheck = 1024)
+        : period(period), callsPerCheck(callsPerCheck), last(Clock::now()) {}
+
+    bool Due() {
+        if (++calls < callsPerCheck) return false;
+        calls = 0;
+        return Clock::now() - last >= period;
+    }
+
+    void Reset() {
+        last = Clock::now();
+        calls = 0;
+    }
+
+  private:
+    const Clock::duration period;
+    const size_t callsPerCheck;
+    Clock::time_point last;
+    size_t calls{0};
+};
+
 template <typename Duration>
 inline void to_timespec(const Duration &d, timespec &tv) {
     const auto sec = std::chrono::duration_cast<std::chrono::seconds>(d);